@@ -0,0 +1,142 @@
+//pgo.c
+//Example of a game built with profile-guided optimization for Neki32
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//See the Makefile for how it's built. The game itself is just balls bouncing around the screen.
+//Hold A to add balls and B to take them away.
+
+#include <stdint.h>
+
+//System-call definitions from the SDK
+#include <sc.h>
+
+//Writing out the profile, when built to collect one
+#include <pvmkgcov.h>
+
+//Balls on screen
+#define BALL_MAX 256
+#define BALL_SIZE 6
+typedef struct ball_s
+{
+	int x;
+	int y;
+	int dx;
+	int dy;
+	uint16_t color;
+} ball_t;
+ball_t balls[BALL_MAX];
+int nballs;
+
+//Framebuffers
+uint16_t fbs[2][240][320];
+
+//Cheap random numbers for placing new balls
+static uint32_t rng_state = 12345;
+static int rng(int range)
+{
+	rng_state = (rng_state * 1103515245u) + 12345u;
+	return (rng_state >> 16) % range;
+}
+
+//Adds a ball somewhere random
+static void ball_add(void)
+{
+	if(nballs >= BALL_MAX)
+		return;
+	
+	ball_t *bptr = &(balls[nballs]);
+	bptr->x = rng(320 - BALL_SIZE);
+	bptr->y = rng(240 - BALL_SIZE);
+	bptr->dx = rng(2) ? 1 + rng(3) : -1 - rng(3);
+	bptr->dy = rng(2) ? 1 + rng(3) : -1 - rng(3);
+	bptr->color = rng(0x10000) | 0x8410;
+	nballs++;
+}
+
+//Moves a ball, bouncing it off the edges of the screen
+static void ball_move(ball_t *bptr)
+{
+	bptr->x += bptr->dx;
+	if(bptr->x < 0 || bptr->x > 320 - BALL_SIZE)
+	{
+		bptr->dx = -bptr->dx;
+		bptr->x += 2 * bptr->dx;
+	}
+	
+	bptr->y += bptr->dy;
+	if(bptr->y < 0 || bptr->y > 240 - BALL_SIZE)
+	{
+		bptr->dy = -bptr->dy;
+		bptr->y += 2 * bptr->dy;
+	}
+}
+
+//Draws a ball into a framebuffer
+static void ball_draw(const ball_t *bptr, uint16_t (*fb)[320])
+{
+	for(int yy = 0; yy < BALL_SIZE; yy++)
+	{
+		for(int xx = 0; xx < BALL_SIZE; xx++)
+		{
+			fb[bptr->y + yy][bptr->x + xx] = bptr->color;
+		}
+	}
+}
+
+int main(int argc, const char **argv)
+{
+	(void)argc;
+	(void)argv;
+	
+	for(int bb = 0; bb < 16; bb++)
+	{
+		ball_add();
+	}
+	
+	int back = 0;
+	int buttons = 0;
+	unsigned frames = 0;
+	while(1)
+	{
+		//Take input from the first gamepad
+		_sc_input_t events[10] = {0};
+		int nevents = _sc_input(events, sizeof(events[0]), sizeof(events));
+		for(int ee = 0; ee < nevents; ee++)
+		{
+			if(events[ee].format == 'A')
+				buttons = events[ee].buttons;
+		}
+		
+		if((buttons & _SC_BTNBIT_A) && (frames % 4) == 0)
+			ball_add();
+		if((buttons & _SC_BTNBIT_B) && (frames % 4) == 0 && nballs > 0)
+			nballs--;
+		
+		//Move everything and draw the frame
+		for(int yy = 0; yy < 240; yy++)
+		{
+			for(int xx = 0; xx < 320; xx++)
+			{
+				fbs[back][yy][xx] = 0;
+			}
+		}
+		
+		for(int bb = 0; bb < nballs; bb++)
+		{
+			ball_move(&(balls[bb]));
+			ball_draw(&(balls[bb]), fbs[back]);
+		}
+		
+		while((void*)_sc_gfx_flip(_SC_GFX_MODE_320X240_16BPP, fbs[back]) != fbs[back])
+		{
+			_sc_pause();
+		}
+		back = back ? 0 : 1;
+		
+		//Games don't usually exit, so write out the profile every so often.
+		//This does nothing unless the game was built with -fprofile-generate.
+		frames++;
+		if((frames % 600) == 0)
+			_pvmk_gcov_dump();
+	}
+}
@@ -91,6 +91,15 @@ SYSCALL_DECL int _sc_print(const char *buf_ptr)
 	#define _SC_PRINT_N 0xB0
 	{ return _SC(_SC_PRINT_N, buf_ptr, 0, 0, 0, 0); }
 
+// _sc_print_len //
+//Prints output to the text-mode screen, like _sc_print, but takes "len" bytes at buf_ptr in one call.
+//No terminating NUL is needed, so whole buffers of output can be printed without copying.
+//Returns the number of bytes printed, or a negative error number.
+//Returns -_SC_ENOSYS on systems that don't have it yet; use _sc_print there.
+SYSCALL_DECL int _sc_print_len(const char *buf_ptr, int len)
+	#define _SC_PRINT_LEN_N 0xB1
+	{ return _SC(_SC_PRINT_LEN_N, buf_ptr, len, 0, 0, 0); }
+
 //Graphics modes that are used with _sc_gfx_flip.
 #define _SC_GFX_MODE_TEXT          0 //No framebuffer supplied; kernel text mode only
 #define _SC_GFX_MODE_VGA_16BPP     1 //640x480@60Hz RGB565, 1280 bytes per line
@@ -222,6 +231,46 @@ SYSCALL_DECL _NORETURN void _sc_mexec_apply(void)
 	#define  _SC_MEXEC_APPLY_N 0xA2
 	{ _SC(_SC_MEXEC_APPLY_N, 0, 0, 0, 0, 0); _DONTRETURN; }
 
+//===
+//3. Debugging calls, only implemented by the Nemul simulator.
+//===
+
+//Performance counters returned by _sc_dbg_stats.
+//These count what the simulated CPU does, so they don't depend on the speed of the host.
+typedef struct _sc_dbg_stats_s
+{
+	unsigned long long instrs; //Instructions retired
+	unsigned long long loads; //Memory reads (each register of a multiple load counts)
+	unsigned long long stores; //Memory writes (likewise)
+	unsigned long long branches; //Taken branches and other writes to the PC
+	unsigned long long syscalls; //System calls made
+	unsigned long long paused_ms; //Milliseconds spent blocked in system calls
+	unsigned long long disk_bytes; //Bytes read from disk
+	unsigned long long flips; //Framebuffers enqueued with _sc_gfx_flip
+	unsigned int syscalls_by_num[256]; //System calls made, by call number
+} _sc_dbg_stats_t;
+
+// _sc_dbg_stats //
+//Reads the performance counters of the calling process into the given buffer.
+//Counters start from zero when the process is created. Take differences to measure part of a program.
+//Fills up to "len" bytes of the structure, so older programs keep working if it grows.
+//Returns the number of bytes filled, or a negative error number.
+//Returns -_SC_ENOSYS on real hardware.
+SYSCALL_DECL int _sc_dbg_stats(_sc_dbg_stats_t *buf, int len)
+	#define _SC_DBG_STATS_N 0xD0
+	{ return _SC(_SC_DBG_STATS_N, buf, len, 0, 0, 0); }
+
+// _sc_dbg_fwrite //
+//Writes to a file on the computer running the simulator, for getting profiles and logs out of a test run.
+//Only the last component of the name is used - the file goes in the folder chosen in the simulator.
+//With _SC_DBG_FWRITE_TRUNC the file is started over, otherwise the data is added to the end.
+//Returns the number of bytes written, or a negative error number.
+//Returns -_SC_EPERM if the simulator hasn't been given a folder, and -_SC_ENOSYS on real hardware.
+#define _SC_DBG_FWRITE_TRUNC 0x1
+SYSCALL_DECL int _sc_dbg_fwrite(const char *name, const void *buf, int len, int flags)
+	#define _SC_DBG_FWRITE_N 0xD1
+	{ return _SC(_SC_DBG_FWRITE_N, name, buf, len, flags, 0); }
+
 //Error numbers that may be returned by the kernel.
 //They are defined positively here, but are returned as negative values by the kernel.
 //These attempt to be the same as Linux error numbers, but please don't rely on that.
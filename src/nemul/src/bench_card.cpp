@@ -0,0 +1,621 @@
+//bench_card.cpp
+//Measures speed of the whole simulator running a game card
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#if BENCH_CARD
+//Boots a card image with no window, and runs it for some emulated time as fast as the host allows.
+//Audio is drained in emulated time rather than by the audio thread, so runs are repeatable.
+//Controller input comes from a script, with lines of "<ms> <pad0> [<pad1>...]" giving pad bits in hex from that time on.
+//With -j, that many independent consoles run the image at once, each on its own host thread.
+//With -c, the cache model runs too, and predicts the clock rate the hardware would need.
+//With -g, the cache misses of the busiest process on the first console are saved for gprof.
+//With -e, library routines found in the given ELF of the game run natively.
+//With -p, how often each kind of instruction follows each other kind on the first console is saved as CSV.
+//With -d, the game can write files into the given folder with _sc_dbg_fwrite, like .gcda profiles from gcov.
+//With -m, the first console tracks the game's heap using the symbols from -e, and saves a report of it.
+//With -s or --strace, each system call the first console makes is written to the given file, and their latencies are summarized.
+//Usage: bench_card.elf [-i input.txt] [-o results.json] [-j consoles] [-c] [-g gmon.out] [-e game.elf] [-p pairs.csv]
+//	[-d outdir] [-m heap.txt] [-s|--strace strace.txt] <image|-> <seconds>
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+	#include <sys/resource.h>
+#endif
+
+#include "emul.h"
+#include "process.h"
+#include "sysc.h"
+#include "snd.h"
+#include "prefs.h"
+#include "cache.h"
+#include "hle.h"
+#include "interp.h"
+#include "dbgout.h"
+#include "heap.h"
+#include "strace.h"
+#include "telem.h"
+
+#ifndef BUILDVERSION
+	#define BUILDVERSION "unknown"
+#endif
+
+//Change of controller state from the input script
+typedef struct bench_input_s
+{
+	uint32_t ms;
+	uint16_t pads[PREFS_PAD_MAX];
+} bench_input_t;
+
+//Maximum script length
+#define BENCH_INPUT_MAX 4096
+
+static bench_input_t bench_inputs[BENCH_INPUT_MAX];
+static int bench_ninputs;
+
+//Reads the input script. Returns false on failure.
+static bool bench_loadinput(const char *path)
+{
+	FILE *fp = fopen(path, "r");
+	if(fp == NULL)
+	{
+		fprintf(stderr, "Failed to open input script %s\n", path);
+		return false;
+	}
+	
+	char linebuf[256] = {0};
+	int lineno = 0;
+	while(fgets(linebuf, sizeof(linebuf), fp) != NULL)
+	{
+		lineno++;
+		char *comment = strchr(linebuf, '#');
+		if(comment != NULL)
+			*comment = '\0';
+		
+		char *next = linebuf;
+		char *end = NULL;
+		unsigned long ms = strtoul(next, &end, 10);
+		if(end == next)
+			continue; //Blank line
+		
+		if(bench_ninputs >= BENCH_INPUT_MAX)
+		{
+			fprintf(stderr, "Too many lines in input script %s\n", path);
+			fclose(fp);
+			return false;
+		}
+		
+		if(bench_ninputs > 0 && ms < bench_inputs[bench_ninputs - 1].ms)
+		{
+			fprintf(stderr, "%s:%d: times must not go backwards\n", path, lineno);
+			fclose(fp);
+			return false;
+		}
+		
+		bench_input_t *iptr = &(bench_inputs[bench_ninputs]);
+		memset(iptr, 0, sizeof(*iptr));
+		iptr->ms = ms;
+		for(int pp = 0; pp < PREFS_PAD_MAX; pp++)
+		{
+			next = end;
+			unsigned long bits = strtoul(next, &end, 16);
+			if(end == next)
+				break;
+			
+			iptr->pads[pp] = bits;
+		}
+		bench_ninputs++;
+	}
+	
+	fclose(fp);
+	return true;
+}
+
+//Result of running one console
+typedef struct bench_result_s
+{
+	bool ok;
+	uint64_t instrs;
+	uint64_t syscalls;
+	uint64_t fused;
+	cache_stats_t cache;
+	hle_stats_t hle;
+	heap_stats_t heap;
+	sysc_inputstats_t input;
+	uint32_t input_frames; //Frames flipped after reading input
+	double input_ms_total; //Input-to-flip latency of those frames
+	float input_ms_max;
+} bench_result_t;
+
+//Whether to run the cache model, and where to put the first console's profile
+static bool bench_cache;
+static const char *bench_gmonname;
+
+//ELF to find library routines in, to run natively
+static const char *bench_elfname;
+
+//Where to put counts of instruction pairs
+static const char *bench_pairsname;
+
+//Where to put the first console's heap report
+static const char *bench_heapname;
+
+//Where to write the first console's system calls, and the summary of them after the run
+static const char *bench_stracename;
+static char bench_stracesum[65536];
+
+//Runs a console of its own through the given emulated time
+static void bench_console(const char *imgname, int seconds, bool first, bench_result_t *out)
+{
+	memset(out, 0, sizeof(*out));
+	
+	//"-" runs with no card inserted. Each console reads the image through its own file, as disk reads seek.
+	int diskfd = -1;
+	if(strcmp(imgname, "-") != 0)
+	{
+		diskfd = open(imgname, O_RDONLY);
+		if(diskfd < 0)
+		{
+			fprintf(stderr, "Failed to open image %s\n", imgname);
+			return;
+		}
+	}
+	
+	emul_t *eptr = emul_new();
+	if(eptr == NULL)
+	{
+		fprintf(stderr, "%s", "Failed to allocate emulated console\n");
+		if(diskfd >= 0)
+			close(diskfd);
+		
+		return;
+	}
+	
+	emul_select(eptr);
+	if(bench_cache)
+	{
+		cache_config_t config;
+		cache_defaults(&config);
+		cache_configure(&config);
+	}
+	bool heapok = true;
+	if(first && bench_heapname != NULL)
+	{
+		heap_setenabled(true);
+		heapok = heap_loadelf(bench_elfname);
+	}
+	if(bench_elfname != NULL && (!hle_loadelf(bench_elfname) || !heapok))
+	{
+		fprintf(stderr, "Failed to load symbols from %s\n", bench_elfname);
+		emul_select(NULL);
+		emul_delete(eptr);
+		if(diskfd >= 0)
+			close(diskfd);
+		
+		return;
+	}
+	emul_reset(diskfd);
+	if(first && bench_pairsname != NULL)
+		interp_pairs_enable(true);
+	
+	FILE *stracefp = NULL;
+	if(first && bench_stracename != NULL)
+	{
+		stracefp = fopen(bench_stracename, "w");
+		if(stracefp == NULL)
+			fprintf(stderr, "Failed to open %s for system calls\n", bench_stracename);
+		
+		strace_setoutput(stracefp);
+	}
+	
+	uint16_t pads[PREFS_PAD_MAX] = {0};
+	int nextinput = 0;
+	uint32_t ticks = (uint32_t)seconds * 1000;
+	while(emul_cur->ticks < ticks)
+	{
+		//Scripted input arrives at the millisecond given, so presses shorter than a frame can be tested
+		if(nextinput < bench_ninputs && bench_inputs[nextinput].ms <= emul_cur->ticks)
+		{
+			while(nextinput < bench_ninputs && bench_inputs[nextinput].ms <= emul_cur->ticks)
+			{
+				memcpy(pads, bench_inputs[nextinput].pads, sizeof(pads));
+				nextinput++;
+			}
+			sysc_pushpads(pads);
+		}
+		
+		snd_advance(1);
+		if(!emul_tick())
+			continue;
+		
+		//Vsync - time from input to the frames answering it, in the interval just finished
+		telem_frame_t frame;
+		if(telem_history(&frame, 1) == 1 && frame.input)
+		{
+			out->input_frames++;
+			out->input_ms_total += frame.input_ms;
+			if(frame.input_ms > out->input_ms_max)
+				out->input_ms_max = frame.input_ms;
+		}
+		
+		//Do what the display would
+		uint16_t *fb_ptr = NULL;
+		int fb_mode = 0;
+		sysc_popfbptr(&fb_ptr, &fb_mode);
+	}
+	
+	process_totals(&(out->instrs), &(out->syscalls));
+	interp_counts_t ic;
+	interp_counts(&ic);
+	out->fused = ic.fused;
+	cache_getstats(&(out->cache));
+	hle_getstats(&(out->hle));
+	heap_getstats(&(out->heap));
+	sysc_inputstats(&(out->input));
+	out->ok = true;
+	
+	if(first && bench_gmonname != NULL)
+	{
+		int pid = cache_busiest();
+		if(!cache_savegmon(bench_gmonname, pid))
+		{
+			fprintf(stderr, "Failed to save cache profile to %s\n", bench_gmonname);
+			out->ok = false;
+		}
+	}
+	
+	if(first && bench_pairsname != NULL && !interp_pairs_save(bench_pairsname))
+	{
+		fprintf(stderr, "Failed to save instruction pairs to %s\n", bench_pairsname);
+		out->ok = false;
+	}
+	
+	if(first && bench_heapname != NULL && !heap_savereport(bench_heapname))
+	{
+		fprintf(stderr, "Failed to save heap report to %s\n", bench_heapname);
+		out->ok = false;
+	}
+	
+	if(first && bench_stracename != NULL)
+	{
+		strace_summary(bench_stracesum, sizeof(bench_stracesum));
+		strace_setoutput(NULL);
+		if(stracefp == NULL || fclose(stracefp) != 0)
+			out->ok = false;
+	}
+	
+	emul_select(NULL);
+	emul_delete(eptr);
+	if(diskfd >= 0)
+		close(diskfd);
+}
+
+//Returns the peak memory use of this process in kilobytes, or a negative number if we can't tell
+static long bench_peakrss(void)
+{
+	#ifndef _WIN32
+		struct rusage ru;
+		if(getrusage(RUSAGE_SELF, &ru) == 0)
+		{
+			#if __APPLE__
+				return ru.ru_maxrss / 1024; //Bytes on Mac
+			#else
+				return ru.ru_maxrss;
+			#endif
+		}
+	#endif
+	return -1;
+}
+
+//Writes a string field of the JSON results, escaping what JSON doesn't allow in a string as-is
+static void bench_jsonstr(FILE *fp, const char *key, const char *val)
+{
+	fprintf(fp, "\t\"%s\": \"", key);
+	for(const unsigned char *cc = (const unsigned char*)val; *cc != '\0'; cc++)
+	{
+		if(*cc == '"' || *cc == '\\')
+			fprintf(fp, "\\%c", *cc);
+		else if(*cc < 0x20)
+			fprintf(fp, "\\u%4.4X", *cc);
+		else
+			fputc(*cc, fp);
+	}
+	fprintf(fp, "\",\n");
+}
+
+int main(int argc, const char **argv)
+{
+	const char *inname = NULL;
+	const char *outname = NULL;
+	const char *imgname = NULL;
+	const char *secstr = NULL;
+	const char *dbgoutname = NULL;
+	int nconsoles = 1;
+	for(int aa = 1; aa < argc; aa++)
+	{
+		if(!strcmp(argv[aa], "-i") && aa + 1 < argc)
+			inname = argv[++aa];
+		else if(!strcmp(argv[aa], "-o") && aa + 1 < argc)
+			outname = argv[++aa];
+		else if(!strcmp(argv[aa], "-j") && aa + 1 < argc)
+			nconsoles = atoi(argv[++aa]);
+		else if(!strcmp(argv[aa], "-c"))
+			bench_cache = true;
+		else if(!strcmp(argv[aa], "-g") && aa + 1 < argc)
+			bench_gmonname = argv[++aa];
+		else if(!strcmp(argv[aa], "-e") && aa + 1 < argc)
+			bench_elfname = argv[++aa];
+		else if(!strcmp(argv[aa], "-p") && aa + 1 < argc)
+			bench_pairsname = argv[++aa];
+		else if(!strcmp(argv[aa], "-d") && aa + 1 < argc)
+			dbgoutname = argv[++aa];
+		else if(!strcmp(argv[aa], "-m") && aa + 1 < argc)
+			bench_heapname = argv[++aa];
+		else if((!strcmp(argv[aa], "-s") || !strcmp(argv[aa], "--strace")) && aa + 1 < argc)
+			bench_stracename = argv[++aa];
+		else if(imgname == NULL)
+			imgname = argv[aa];
+		else if(secstr == NULL)
+			secstr = argv[aa];
+		else
+			imgname = NULL; //Too many arguments
+	}
+	
+	int seconds = (secstr != NULL) ? atoi(secstr) : 0;
+	if(imgname == NULL || seconds <= 0 || nconsoles <= 0)
+	{
+		fprintf(stderr, "Usage: %s [-i input.txt] [-o results.json] [-j consoles] [-c] [-g gmon.out] [-e game.elf] [-p pairs.csv] [-d outdir] [-m heap.txt] [-s|--strace strace.txt] <image|-> <seconds>\n", argv[0]);
+		return -1;
+	}
+	
+	//Heap functions are found by symbol
+	if(bench_heapname != NULL && bench_elfname == NULL)
+	{
+		fprintf(stderr, "Heap tracking with -m needs the game's ELF from -e\n");
+		return -1;
+	}
+	
+	//Consoles running the same game would write the same files over each other
+	if(dbgoutname != NULL && nconsoles > 1)
+	{
+		fprintf(stderr, "Only one console can write files with -d\n");
+		return -1;
+	}
+	dbgout_setdir(dbgoutname);
+	
+	//Can't profile cache misses without modelling the cache
+	if(bench_gmonname != NULL)
+		bench_cache = true;
+	
+	if(inname != NULL && !bench_loadinput(inname))
+		return -1;
+	
+	std::vector<bench_result_t> results(nconsoles);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if(nconsoles == 1)
+	{
+		bench_console(imgname, seconds, true, &(results[0]));
+	}
+	else
+	{
+		std::vector<std::thread> threads;
+		for(int cc = 0; cc < nconsoles; cc++)
+		{
+			threads.emplace_back(bench_console, imgname, seconds, cc == 0, &(results[cc]));
+		}
+		for(std::thread &tt : threads)
+		{
+			tt.join();
+		}
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	
+	uint64_t instrs = 0;
+	uint64_t syscalls = 0;
+	uint64_t fused = 0;
+	cache_stats_t cache;
+	memset(&cache, 0, sizeof(cache));
+	hle_stats_t hle;
+	memset(&hle, 0, sizeof(hle));
+	sysc_inputstats_t input;
+	memset(&input, 0, sizeof(input));
+	uint32_t input_frames = 0;
+	double input_ms_total = 0.0;
+	float input_ms_max = 0.0f;
+	for(const bench_result_t &rr : results)
+	{
+		if(!rr.ok)
+			return -1;
+		
+		instrs += rr.instrs;
+		syscalls += rr.syscalls;
+		fused += rr.fused;
+		cache.fetches += rr.cache.fetches;
+		cache.fetch_misses += rr.cache.fetch_misses;
+		cache.reads += rr.cache.reads;
+		cache.read_misses += rr.cache.read_misses;
+		cache.writes += rr.cache.writes;
+		cache.write_misses += rr.cache.write_misses;
+		cache.writebacks += rr.cache.writebacks;
+		cache.flushes += rr.cache.flushes;
+		cache.wbuf_stall_cycles += rr.cache.wbuf_stall_cycles;
+		cache.cycles += rr.cache.cycles;
+		for(int kk = 0; kk < HLE_KIND_MAX; kk++)
+		{
+			hle.calls[kk] += rr.hle.calls[kk];
+			hle.bytes[kk] += rr.hle.bytes[kk];
+		}
+		hle.declined += rr.hle.declined;
+		input.pushed += rr.input.pushed;
+		input.read += rr.input.read;
+		input.dropped += rr.input.dropped;
+		input_frames += rr.input_frames;
+		input_ms_total += rr.input_ms_total;
+		if(rr.input_ms_max > input_ms_max)
+			input_ms_max = rr.input_ms_max;
+	}
+	double input_ms_avg = input_frames ? (input_ms_total / input_frames) : 0.0;
+	
+	double host_s = std::chrono::duration<double>(end - start).count();
+	double mips = (host_s > 0.0) ? (instrs / host_s / 1e6) : 0.0;
+	double sc_per_s = (host_s > 0.0) ? (syscalls / host_s) : 0.0;
+	double speed = (host_s > 0.0) ? (seconds / host_s) : 0.0;
+	long peakrss = bench_peakrss();
+	
+	//Hit rates across all consoles, and the clock one console would need to keep up
+	double ihit = cache.fetches ? (100.0 * (cache.fetches - cache.fetch_misses) / cache.fetches) : 0.0;
+	uint64_t daccess = cache.reads + cache.writes;
+	double dhit = daccess ? (100.0 * (daccess - cache.read_misses - cache.write_misses) / daccess) : 0.0;
+	double mhz = cache.cycles / (double)nconsoles / seconds / 1e6;
+	
+	printf("Image:          %s\n", imgname);
+	printf("Consoles:       %d\n", nconsoles);
+	printf("Emulated time:  %d s\n", seconds);
+	printf("Host time:      %.3f s (%.2fx real time)\n", host_s, speed);
+	printf("Instructions:   %llu (%.2f MIPS)\n", (unsigned long long)instrs, mips);
+	printf("System calls:   %llu (%.0f per second)\n", (unsigned long long)syscalls, sc_per_s);
+	printf("Fused pairs:    %llu (%.1f%% of instructions)\n", (unsigned long long)fused, instrs ? (200.0 * fused / instrs) : 0.0);
+	if(peakrss >= 0)
+		printf("Peak RSS:       %ld KB\n", peakrss);
+	else
+		printf("Peak RSS:       unknown\n");
+	
+	if(bench_cache)
+	{
+		printf("I-cache hits:   %.2f%% of %llu fetches\n", ihit, (unsigned long long)cache.fetches);
+		printf("D-cache hits:   %.2f%% of %llu accesses (%llu writebacks)\n", dhit,
+			(unsigned long long)daccess, (unsigned long long)cache.writebacks);
+		printf("Write stalls:   %llu cycles\n", (unsigned long long)cache.wbuf_stall_cycles);
+		printf("Cache flushes:  %llu\n", (unsigned long long)cache.flushes);
+		printf("Cycles:         %llu (%.1f MHz needed)\n", (unsigned long long)cache.cycles, mhz);
+	}
+	
+	if(bench_elfname != NULL)
+	{
+		for(int kk = 0; kk < HLE_KIND_MAX; kk++)
+		{
+			printf("Native %-8s %llu calls (%llu bytes)\n", hle_kindname((hle_kind_t)kk),
+				(unsigned long long)hle.calls[kk], (unsigned long long)hle.bytes[kk]);
+		}
+		printf("Interpreted:    %llu calls\n", (unsigned long long)hle.declined);
+	}
+	
+	if(inname != NULL)
+	{
+		printf("Input events:   %llu (%llu read, %llu dropped)\n", (unsigned long long)input.pushed,
+			(unsigned long long)input.read, (unsigned long long)input.dropped);
+		printf("Input latency:  %.2f ms average, %.2f ms worst, to flip (%u frames)\n", input_ms_avg, input_ms_max, input_frames);
+	}
+	
+	//Heap is only tracked on the first console
+	const heap_stats_t *heap = &(results[0].heap);
+	uint64_t heapcalls = 0;
+	for(int ff = 0; ff < HEAP_FN_MAX; ff++)
+	{
+		heapcalls += heap->calls[ff];
+	}
+	if(bench_heapname != NULL)
+	{
+		printf("Heap calls:     %llu (%llu failed)\n", (unsigned long long)heapcalls, (unsigned long long)heap->failed);
+		printf("Heap peak:      %llu bytes (%llu bytes in %llu blocks at end)\n", (unsigned long long)heap->peak_bytes,
+			(unsigned long long)heap->live_bytes, (unsigned long long)heap->live_blocks);
+		printf("Heap leaked:    %llu bytes in %llu blocks at exit\n", (unsigned long long)heap->leaked_bytes,
+			(unsigned long long)heap->leaked_blocks);
+		printf("Alloc frames:   %u of %u (most %u in one frame)\n", heap->alloc_frames, heap->frames, heap->max_frame_allocs);
+	}
+	
+	//System calls are only traced on the first console
+	if(bench_stracename != NULL)
+		printf("%s", bench_stracesum);
+	
+	dbgout_stats_t dbgout;
+	dbgout_getstats(&dbgout);
+	if(dbgoutname != NULL)
+		printf("Files written:  %u (%llu bytes)\n", dbgout.files, (unsigned long long)dbgout.bytes);
+	
+	if(outname != NULL)
+	{
+		FILE *outfile = fopen(outname, "w");
+		if(outfile == NULL)
+		{
+			fprintf(stderr, "Failed to open %s for results\n", outname);
+			return -1;
+		}
+		
+		fprintf(outfile, "{\n");
+		bench_jsonstr(outfile, "version", BUILDVERSION);
+		bench_jsonstr(outfile, "image", imgname);
+		bench_jsonstr(outfile, "input", (inname != NULL) ? inname : "");
+		fprintf(outfile, "\t\"consoles\": %d,\n", nconsoles);
+		fprintf(outfile, "\t\"emul_seconds\": %d,\n", seconds);
+		fprintf(outfile, "\t\"host_seconds\": %.6f,\n", host_s);
+		fprintf(outfile, "\t\"instrs\": %llu,\n", (unsigned long long)instrs);
+		fprintf(outfile, "\t\"mips\": %.3f,\n", mips);
+		fprintf(outfile, "\t\"syscalls\": %llu,\n", (unsigned long long)syscalls);
+		if(inname != NULL)
+		{
+			fprintf(outfile, "\t\"input_events\": %llu,\n", (unsigned long long)input.pushed);
+			fprintf(outfile, "\t\"input_dropped\": %llu,\n", (unsigned long long)input.dropped);
+			fprintf(outfile, "\t\"input_ms_avg\": %.3f,\n", input_ms_avg);
+			fprintf(outfile, "\t\"input_ms_max\": %.3f,\n", input_ms_max);
+		}
+		fprintf(outfile, "\t\"syscalls_per_second\": %.1f,\n", sc_per_s);
+		fprintf(outfile, "\t\"fused_pairs\": %llu,\n", (unsigned long long)fused);
+		if(bench_cache)
+		{
+			fprintf(outfile, "\t\"icache_hit_pct\": %.3f,\n", ihit);
+			fprintf(outfile, "\t\"dcache_hit_pct\": %.3f,\n", dhit);
+			fprintf(outfile, "\t\"writebacks\": %llu,\n", (unsigned long long)cache.writebacks);
+			fprintf(outfile, "\t\"wbuf_stall_cycles\": %llu,\n", (unsigned long long)cache.wbuf_stall_cycles);
+			fprintf(outfile, "\t\"cache_flushes\": %llu,\n", (unsigned long long)cache.flushes);
+			fprintf(outfile, "\t\"cycles\": %llu,\n", (unsigned long long)cache.cycles);
+			fprintf(outfile, "\t\"mhz_needed\": %.3f,\n", mhz);
+		}
+		if(bench_elfname != NULL)
+		{
+			bench_jsonstr(outfile, "elf", bench_elfname);
+			for(int kk = 0; kk < HLE_KIND_MAX; kk++)
+			{
+				fprintf(outfile, "\t\"native_%s_calls\": %llu,\n", hle_kindname((hle_kind_t)kk), (unsigned long long)hle.calls[kk]);
+				fprintf(outfile, "\t\"native_%s_bytes\": %llu,\n", hle_kindname((hle_kind_t)kk), (unsigned long long)hle.bytes[kk]);
+			}
+			fprintf(outfile, "\t\"native_declined\": %llu,\n", (unsigned long long)hle.declined);
+		}
+		if(dbgoutname != NULL)
+		{
+			fprintf(outfile, "\t\"files_written\": %u,\n", dbgout.files);
+			fprintf(outfile, "\t\"file_bytes_written\": %llu,\n", (unsigned long long)dbgout.bytes);
+		}
+		if(bench_heapname != NULL)
+		{
+			fprintf(outfile, "\t\"heap_calls\": %llu,\n", (unsigned long long)heapcalls);
+			fprintf(outfile, "\t\"heap_failed\": %llu,\n", (unsigned long long)heap->failed);
+			fprintf(outfile, "\t\"heap_peak_bytes\": %llu,\n", (unsigned long long)heap->peak_bytes);
+			fprintf(outfile, "\t\"heap_live_bytes\": %llu,\n", (unsigned long long)heap->live_bytes);
+			fprintf(outfile, "\t\"heap_leaked_bytes\": %llu,\n", (unsigned long long)heap->leaked_bytes);
+			fprintf(outfile, "\t\"heap_alloc_frames\": %u,\n", heap->alloc_frames);
+			fprintf(outfile, "\t\"heap_frames\": %u,\n", heap->frames);
+		}
+		fprintf(outfile, "\t\"peak_rss_kb\": %ld\n", peakrss);
+		fprintf(outfile, "}\n");
+		fclose(outfile);
+	}
+	
+	return 0;
+}
+
+#endif //BENCH_CARD
@@ -0,0 +1,302 @@
+//bench_interp.cpp
+//Measures speed of ARM interpreter on synthetic kernels
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#if BENCH_INTERP
+//Each kernel is a loop of one class of instruction, run through interp_step until it makes a system call.
+//Results are printed, and written as JSON if a filename is given.
+//If a previous JSON file is also given, kernels that got more than 10% slower fail the run.
+//Usage: bench_interp.elf [results.json [baseline.json]]
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include "interp.h"
+
+#ifndef BUILDVERSION
+	#define BUILDVERSION "unknown"
+#endif
+
+//Memory layout of the benchmark process
+#define BENCH_MEMSZ (1024 * 1024)
+#define BENCH_CODE  0x1000
+#define BENCH_SRC   0x10000
+#define BENCH_DST   0x20000
+
+//Kernel to run. Loops count down r2; r8 and r9 point at source and destination buffers.
+typedef struct bench_kernel_s
+{
+	const char *name;
+	const uint32_t *code;
+	int ncode;
+	uint32_t iters;
+} bench_kernel_t;
+
+static const uint32_t bench_alu[] =
+{
+	0xE0800001, //1: add   r0, r0, r1
+	0xE0203181, //   eor   r3, r0, r1, lsl #3
+	0xE1834120, //   orr   r4, r3, r0, lsr #2
+	0xE0445003, //   sub   r5, r4, r3
+	0xE20560FF, //   and   r6, r5, #255
+	0xE3C6700F, //   bic   r7, r6, #15
+	0xE2522001, //   subs  r2, r2, #1
+	0x1AFFFFF7, //   bne   1b
+	0xE7F009F2, //   udf   #0x92
+};
+
+static const uint32_t bench_ldmstm[] =
+{
+	0xE1A0A008, //1: mov   r10, r8
+	0xE1A0B009, //   mov   r11, r9
+	0xE8BA10FB, //   ldmia r10!, {r0,r1,r3-r7,r12}
+	0xE8AB10FB, //   stmia r11!, {r0,r1,r3-r7,r12}
+	0xE8BA10FB, //   ldmia r10!, {r0,r1,r3-r7,r12}
+	0xE8AB10FB, //   stmia r11!, {r0,r1,r3-r7,r12}
+	0xE8BA10FB, //   ldmia r10!, {r0,r1,r3-r7,r12}
+	0xE8AB10FB, //   stmia r11!, {r0,r1,r3-r7,r12}
+	0xE8BA10FB, //   ldmia r10!, {r0,r1,r3-r7,r12}
+	0xE8AB10FB, //   stmia r11!, {r0,r1,r3-r7,r12}
+	0xE2522001, //   subs  r2, r2, #1
+	0x1AFFFFF3, //   bne   1b
+	0xE7F009F2, //   udf   #0x92
+};
+
+static const uint32_t bench_bytes[] =
+{
+	0xE20240FF, //1: and   r4, r2, #255
+	0xE7D80004, //   ldrb  r0, [r8, r4]
+	0xE7D91004, //   ldrb  r1, [r9, r4]
+	0xE0833000, //   add   r3, r3, r0
+	0xE0833001, //   add   r3, r3, r1
+	0xE7C93004, //   strb  r3, [r9, r4]
+	0xE2522001, //   subs  r2, r2, #1
+	0x1AFFFFF7, //   bne   1b
+	0xE7F009F2, //   udf   #0x92
+};
+
+static const uint32_t bench_branch[] =
+{
+	0xEB000000, //1: bl    2f
+	0xEA000000, //   b     3f
+	0xE12FFF1E, //2: bx    lr
+	0xE3120001, //3: tst   r2, #1
+	0x0A000000, //   beq   4f
+	0xE2833001, //   add   r3, r3, #1
+	0xE2522001, //4: subs  r2, r2, #1
+	0x1AFFFFF7, //   bne   1b
+	0xE7F009F2, //   udf   #0x92
+};
+
+static const uint32_t bench_mul[] =
+{
+	0xE0000291, //1: mul   r0, r1, r2
+	0xE0233190, //   mla   r3, r0, r1, r3
+	0xE0854390, //   umull r4, r5, r0, r3
+	0xE0E76194, //   smlal r6, r7, r4, r1
+	0xE16A0180, //   smulbb r10, r0, r1
+	0xE2522001, //   subs  r2, r2, #1
+	0x1AFFFFF8, //   bne   1b
+	0xE7F009F2, //   udf   #0x92
+};
+
+static const uint32_t bench_cond[] =
+{
+	0xE2124003, //1: ands  r4, r2, #3
+	0x03A00001, //   moveq r0, #1
+	0x12800001, //   addne r0, r0, #1
+	0xE3540002, //   cmp   r4, #2
+	0xC0833000, //   addgt r3, r3, r0
+	0xD0433000, //   suble r3, r3, r0
+	0xE1B050A2, //   movs  r5, r2, lsr #1
+	0x21866002, //   orrcs r6, r6, r2
+	0xE2522001, //   subs  r2, r2, #1
+	0x1AFFFFF5, //   bne   1b
+	0xE7F009F2, //   udf   #0x92
+};
+
+#define BENCH_KERNEL(n, it) { .name = #n, .code = bench_##n, .ncode = sizeof(bench_##n) / sizeof(bench_##n[0]), .iters = it }
+static const bench_kernel_t bench_kernels[] =
+{
+	BENCH_KERNEL(alu,    2000000),
+	BENCH_KERNEL(ldmstm,  500000),
+	BENCH_KERNEL(bytes,  2000000),
+	BENCH_KERNEL(branch, 2000000),
+	BENCH_KERNEL(mul,    2000000),
+	BENCH_KERNEL(cond,   2000000),
+	{}
+};
+
+//Result of running a kernel
+typedef struct bench_result_s
+{
+	uint64_t instrs;
+	double seconds;
+	double mips;
+} bench_result_t;
+
+//Times one run of a kernel. Returns false if the interpreter didn't finish it cleanly.
+static bool bench_run(const bench_kernel_t *kptr, uint32_t *mem, bench_result_t *out)
+{
+	memset(mem, 0, BENCH_MEMSZ);
+	memcpy(&(mem[BENCH_CODE / 4]), kptr->code, kptr->ncode * sizeof(uint32_t));
+	for(int ww = 0; ww < 0x1000 / 4; ww++)
+	{
+		mem[(BENCH_SRC / 4) + ww] = ww * 0x01010101u;
+	}
+	
+	uint32_t regs[16] = {0};
+	uint32_t cpsr = 0x10; //User mode
+	regs[1] = 3;
+	regs[2] = kptr->iters;
+	regs[8] = BENCH_SRC;
+	regs[9] = BENCH_DST;
+	regs[15] = BENCH_CODE;
+	
+	uint64_t instrs = 0;
+	interp_result_t result = INTERP_RESULT_OK;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	while(result == INTERP_RESULT_OK)
+	{
+		result = interp_step(regs, &cpsr, mem, BENCH_MEMSZ);
+		instrs++;
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	
+	if(result != INTERP_RESULT_SYSCALL)
+	{
+		fprintf(stderr, "Kernel %s stopped with result %d at %8.8X\n", kptr->name, result, regs[15]);
+		return false;
+	}
+	
+	out->instrs = instrs;
+	out->seconds = std::chrono::duration<double>(end - start).count();
+	out->mips = (out->seconds > 0.0) ? (instrs / out->seconds / 1e6) : 0.0;
+	return true;
+}
+
+//Finds the MIPS recorded for a kernel in an earlier results file, or returns a negative number
+static double bench_baseline(FILE *fp, const char *name)
+{
+	if(fp == NULL)
+		return -1.0;
+	
+	rewind(fp);
+	char linebuf[256] = {0};
+	char key[64] = {0};
+	snprintf(key, sizeof(key), "{ \"name\": \"%s\",", name);
+	while(fgets(linebuf, sizeof(linebuf), fp) != NULL)
+	{
+		const char *kptr = strstr(linebuf, key);
+		const char *mptr = strstr(linebuf, "\"mips\": ");
+		if(kptr == NULL || mptr == NULL)
+			continue;
+		
+		return atof(mptr + strlen("\"mips\": "));
+	}
+	return -1.0;
+}
+
+int main(int argc, const char **argv)
+{
+	const char *outname = (argc > 1) ? argv[1] : NULL;
+	const char *basename = (argc > 2) ? argv[2] : NULL;
+	
+	FILE *basefile = NULL;
+	if(basename != NULL)
+	{
+		basefile = fopen(basename, "r");
+		if(basefile == NULL)
+			fprintf(stderr, "No baseline results in %s, not comparing\n", basename);
+	}
+	
+	uint32_t *mem = (uint32_t*)malloc(BENCH_MEMSZ);
+	if(mem == NULL)
+	{
+		fprintf(stderr, "%s", "Failed to allocate benchmark memory\n");
+		return -1;
+	}
+	
+	int nkernels = 0;
+	bench_result_t results[sizeof(bench_kernels) / sizeof(bench_kernels[0])];
+	int nslower = 0;
+	
+	printf("%-8s %12s %10s %10s %10s\n", "KERNEL", "INSTRS", "SECONDS", "MIPS", "BASELINE");
+	for(const bench_kernel_t *kptr = bench_kernels; kptr->name != NULL; kptr++)
+	{
+		//Best of a few runs, so one hiccup on the host doesn't count
+		bench_result_t best = {};
+		for(int rr = 0; rr < 3; rr++)
+		{
+			bench_result_t run = {};
+			if(!bench_run(kptr, mem, &run))
+				return -1;
+			
+			if(run.mips > best.mips)
+				best = run;
+		}
+		
+		double base = bench_baseline(basefile, kptr->name);
+		bool slower = (base > 0.0) && (best.mips < base * 0.9);
+		if(slower)
+			nslower++;
+		
+		char basestr[32] = "-";
+		if(base > 0.0)
+			snprintf(basestr, sizeof(basestr), "%.2f", base);
+		
+		printf("%-8s %12llu %10.3f %10.2f %10s%s\n", kptr->name, (unsigned long long)best.instrs, best.seconds, best.mips,
+			basestr, slower ? " SLOWER" : "");
+		
+		results[nkernels] = best;
+		nkernels++;
+	}
+	
+	if(basefile != NULL)
+		fclose(basefile);
+	
+	free(mem);
+	
+	//Write one kernel per line, so the results are easy to diff and to read back as a baseline
+	if(outname != NULL)
+	{
+		FILE *outfile = fopen(outname, "w");
+		if(outfile == NULL)
+		{
+			fprintf(stderr, "Failed to open %s for results\n", outname);
+			return -1;
+		}
+		
+		fprintf(outfile, "{\n");
+		fprintf(outfile, "\t\"version\": \"%s\",\n", BUILDVERSION);
+		fprintf(outfile, "\t\"kernels\": [\n");
+		for(int kk = 0; kk < nkernels; kk++)
+		{
+			fprintf(outfile, "\t\t{ \"name\": \"%s\", \"instrs\": %llu, \"seconds\": %.6f, \"mips\": %.3f }%s\n",
+				bench_kernels[kk].name, (unsigned long long)results[kk].instrs, results[kk].seconds, results[kk].mips,
+				(kk + 1 < nkernels) ? "," : "");
+		}
+		fprintf(outfile, "\t]\n");
+		fprintf(outfile, "}\n");
+		fclose(outfile);
+	}
+	
+	if(nslower > 0)
+	{
+		fprintf(stderr, "%d kernels more than 10%% slower than baseline\n", nslower);
+		return 1;
+	}
+	
+	return 0;
+}
+
+#endif //BENCH_INTERP
@@ -9,6 +9,7 @@
 //(at your option) any later version.
 
 #include "bindprompt.h"
+#include "joy.h"
 #include <stdio.h>
 
 BindPrompt::BindPrompt(wxWindow *parent, prefs_t &prefs_ref, int which_pad, int which_btn)
@@ -23,8 +24,8 @@ BindPrompt::BindPrompt(wxWindow *parent, prefs_t &prefs_ref, int which_pad, int
 	{
 		"Up", "Left", "Down", "Right", "A", "B", "C", "X", "Y", "Z", "Start", "Mode", NULL
 	};
-	char label_string[64] = {0};
-	snprintf(label_string, sizeof(label_string)-1, "Press a key to use for Pad %c: %s Button...", 'A' + which_pad, button_names[which_btn]);
+	char label_string[96] = {0};
+	snprintf(label_string, sizeof(label_string)-1, "Press a key or joystick control to use for Pad %c: %s Button...", 'A' + which_pad, button_names[which_btn]);
 	wxStaticText *label_text = new wxStaticText(this, wxID_ANY, label_string);
 	main_sizer->Add(label_text, 0, wxALL, 8);
 	
@@ -43,6 +44,12 @@ BindPrompt::BindPrompt(wxWindow *parent, prefs_t &prefs_ref, int which_pad, int
 	
 	//Listen for keyboard input
 	Bind(wxEVT_CHAR_HOOK, &BindPrompt::OnKeyUp, this);
+	
+	//Listen for joystick input, ignoring whatever was pushed before we opened
+	JoySeq = joy_lastpress(NULL, NULL);
+	JoyTimer.SetOwner(this);
+	Bind(wxEVT_TIMER, &BindPrompt::OnJoyTimer, this);
+	JoyTimer.Start(10);
 
 	
 	SetSizerAndFit(main_sizer);
@@ -53,5 +60,24 @@ void BindPrompt::OnKeyUp(wxKeyEvent &event)
 	//Set the binding
 	Prefs.pads[WhichPad].btn_src[WhichBtn] = PREFS_PAD_SRC_KEY;
 	Prefs.pads[WhichPad].btn_val[WhichBtn] = event.GetKeyCode();
+	JoyTimer.Stop();
+	EndModal(wxOK);
+}
+
+void BindPrompt::OnJoyTimer(wxTimerEvent &event)
+{
+	(void)event;
+	
+	int js_id = 0;
+	int val = 0;
+	uint32_t seq = joy_lastpress(&js_id, &val);
+	if(seq == JoySeq)
+		return;
+	
+	//Bind the control, and have the pad read the joystick it came from
+	Prefs.pads[WhichPad].btn_src[WhichBtn] = PREFS_PAD_SRC_JOY;
+	Prefs.pads[WhichPad].btn_val[WhichBtn] = val;
+	Prefs.pads[WhichPad].js_id = js_id;
+	JoyTimer.Stop();
 	EndModal(wxOK);
 }
\ No newline at end of file
@@ -24,8 +24,15 @@ private:
 	int WhichPad;
 	int WhichBtn;
 	
+	//Checks for joystick controls pushed since the prompt opened
+	wxTimer JoyTimer;
+	uint32_t JoySeq;
+	
 	//Called when key is released
 	void OnKeyUp(wxKeyEvent &event);
+	
+	//Called periodically to look at joysticks
+	void OnJoyTimer(wxTimerEvent &event);
 };
 
 #endif //_BINDPROMPT_H
@@ -0,0 +1,638 @@
+//cache.cpp
+//Model of the CPU caches and write buffer of the Neki32
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#define FILE_TRACE_CAT TRACE_CAT_INTERP
+#include "trace.h"
+
+#include "cache.h"
+#include "interp.h"
+#include "emul.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <new>
+
+//The model follows the ARM926EJ-S: virtually-addressed caches, with a write-back data cache that only allocates
+//lines on reads. Stores that miss go out through the write buffer, as do dirty lines when they're evicted.
+//Timing is approximate - a cycle per instruction and per data access, plus the penalties modelled here.
+
+//Bits kept alongside the line address in each tag
+#define CACHE_TAG_VALID 1u
+#define CACHE_TAG_DIRTY 2u
+
+//One of the caches
+typedef struct cache_array_s
+{
+	uint32_t *tags; //Line address and CACHE_TAG_* bits of each way of each set
+	uint8_t *next; //Way replaced next in each set, round-robin
+	uint32_t sets;
+} cache_array_t;
+
+//Misses counted at one instruction
+typedef struct cache_pc_s
+{
+	int pid; //Process, or 0 if this slot is empty
+	uint32_t pc;
+	uint32_t fetch_misses;
+	uint32_t data_misses;
+} cache_pc_t;
+
+//Size the table of instructions starts at
+#define CACHE_PCS_MIN 4096
+
+//Caches of one emulated console
+struct cache_ctx_s
+{
+	//Whether the model is on, and how it's set up
+	bool enabled;
+	cache_config_t config;
+	int line_shift;
+	
+	//Contents of the caches
+	cache_array_t icache;
+	cache_array_t dcache;
+	
+	//Times at which each write in the write buffer finishes, as a ring
+	uint64_t *wbuf_done;
+	int wbuf_head;
+	int wbuf_count;
+	
+	//Process running, instruction being run, and the last address fetched (to spot branches)
+	int pid;
+	uint32_t pc;
+	uint32_t last_fetch;
+	
+	//Misses at each instruction, hashed by process and address with linear probing
+	cache_pc_t *pcs;
+	uint32_t pcs_cap;
+	uint32_t pcs_count;
+	
+	//Counts since reset, and as of the last status line
+	cache_stats_t stats;
+	cache_stats_t report_stats;
+	uint32_t report_ticks;
+};
+
+//State used when no console is selected, and the one selected on this thread
+static cache_ctx_t cache_default;
+static thread_local cache_ctx_t *cache_st = &cache_default;
+
+//Called by the interpreter on every memory access while the model is on
+static void cache_access(int kind, uint32_t addr, uint32_t len);
+
+//Frees the arrays behind the caches and instruction table
+static void cache_free(cache_ctx_t *st)
+{
+	free(st->icache.tags);
+	free(st->icache.next);
+	free(st->dcache.tags);
+	free(st->dcache.next);
+	free(st->wbuf_done);
+	free(st->pcs);
+	memset(&(st->icache), 0, sizeof(st->icache));
+	memset(&(st->dcache), 0, sizeof(st->dcache));
+	st->wbuf_done = NULL;
+	st->pcs = NULL;
+	st->pcs_cap = 0;
+	st->pcs_count = 0;
+}
+
+cache_ctx_t *cache_ctx_new(void)
+{
+	return new(std::nothrow) cache_ctx_t();
+}
+
+void cache_ctx_delete(cache_ctx_t *st)
+{
+	if(st == NULL)
+		return;
+	
+	cache_free(st);
+	delete st;
+}
+
+void cache_select(cache_ctx_t *st)
+{
+	cache_st = (st != NULL) ? st : &cache_default;
+}
+
+void cache_defaults(cache_config_t *out)
+{
+	out->icache_kb = 16;
+	out->dcache_kb = 16;
+	out->ways = 4;
+	out->line_bytes = 32;
+	out->wbuf_entries = 16;
+	out->miss_cycles = 24;
+	out->wbuf_cycles = 6;
+	out->branch_cycles = 2;
+}
+
+//Returns whether the given number is a power of two
+static bool cache_pow2(int x)
+{
+	return (x > 0) && ((x & (x - 1)) == 0);
+}
+
+//Sets up one of the caches with the given size. Returns false if out of memory.
+static bool cache_array_init(cache_array_t *arr, int kb, const cache_config_t *config)
+{
+	arr->sets = (kb * 1024) / (config->ways * config->line_bytes);
+	arr->tags = (uint32_t*)calloc(arr->sets * config->ways, sizeof(uint32_t));
+	arr->next = (uint8_t*)calloc(arr->sets, sizeof(uint8_t));
+	return (arr->tags != NULL) && (arr->next != NULL);
+}
+
+bool cache_configure(const cache_config_t *config)
+{
+	cache_free(cache_st);
+	cache_st->enabled = false;
+	interp_setaccesshook(NULL);
+	
+	if(config == NULL)
+		return true;
+	
+	//Sets are picked with the low bits of the line address, so everything must be a power of two
+	bool ok = cache_pow2(config->icache_kb) && cache_pow2(config->dcache_kb);
+	ok = ok && cache_pow2(config->ways) && config->ways <= 64;
+	ok = ok && cache_pow2(config->line_bytes) && config->line_bytes >= 8;
+	ok = ok && (config->icache_kb * 1024 >= config->ways * config->line_bytes);
+	ok = ok && (config->dcache_kb * 1024 >= config->ways * config->line_bytes);
+	ok = ok && (config->wbuf_entries > 0) && (config->miss_cycles >= 0) && (config->wbuf_cycles >= 0);
+	ok = ok && (config->branch_cycles >= 0);
+	if(!ok)
+	{
+		TERROR("Bad cache configuration: %dKB I, %dKB D, %d ways, %d byte lines, %d write buffer entries\n",
+			config->icache_kb, config->dcache_kb, config->ways, config->line_bytes, config->wbuf_entries);
+		return false;
+	}
+	
+	cache_st->config = *config;
+	cache_st->line_shift = 0;
+	while((1 << cache_st->line_shift) < config->line_bytes)
+		cache_st->line_shift++;
+	
+	ok = cache_array_init(&(cache_st->icache), config->icache_kb, config);
+	ok = ok && cache_array_init(&(cache_st->dcache), config->dcache_kb, config);
+	cache_st->wbuf_done = (uint64_t*)calloc(config->wbuf_entries, sizeof(uint64_t));
+	cache_st->pcs_cap = CACHE_PCS_MIN;
+	cache_st->pcs = (cache_pc_t*)calloc(cache_st->pcs_cap, sizeof(cache_pc_t));
+	if(!ok || cache_st->wbuf_done == NULL || cache_st->pcs == NULL)
+	{
+		TERROR("%s", "Failed to allocate cache model\n");
+		cache_free(cache_st);
+		return false;
+	}
+	
+	TINFO("Modelling caches: %dKB I, %dKB D, %d ways, %d byte lines\n",
+		config->icache_kb, config->dcache_kb, config->ways, config->line_bytes);
+	
+	cache_st->enabled = true;
+	cache_reset();
+	interp_setaccesshook(cache_access);
+	return true;
+}
+
+void cache_init(const prefs_t *prefs)
+{
+	if(!prefs->cache_enabled)
+	{
+		cache_configure(NULL);
+		return;
+	}
+	
+	//Anything left unset in the preferences takes the default
+	cache_config_t config;
+	cache_defaults(&config);
+	if(prefs->cache_icache_kb > 0)
+		config.icache_kb = prefs->cache_icache_kb;
+	if(prefs->cache_dcache_kb > 0)
+		config.dcache_kb = prefs->cache_dcache_kb;
+	if(prefs->cache_ways > 0)
+		config.ways = prefs->cache_ways;
+	if(prefs->cache_miss_cycles > 0)
+		config.miss_cycles = prefs->cache_miss_cycles;
+	
+	cache_configure(&config);
+}
+
+bool cache_enabled(void)
+{
+	return cache_st->enabled;
+}
+
+void cache_reset(void)
+{
+	if(!cache_st->enabled)
+		return;
+	
+	int ways = cache_st->config.ways;
+	memset(cache_st->icache.tags, 0, cache_st->icache.sets * ways * sizeof(uint32_t));
+	memset(cache_st->icache.next, 0, cache_st->icache.sets);
+	memset(cache_st->dcache.tags, 0, cache_st->dcache.sets * ways * sizeof(uint32_t));
+	memset(cache_st->dcache.next, 0, cache_st->dcache.sets);
+	memset(cache_st->pcs, 0, cache_st->pcs_cap * sizeof(cache_pc_t));
+	cache_st->pcs_count = 0;
+	cache_st->wbuf_head = 0;
+	cache_st->wbuf_count = 0;
+	cache_st->pid = 0;
+	cache_st->pc = 0;
+	cache_st->last_fetch = 0;
+	memset(&(cache_st->stats), 0, sizeof(cache_st->stats));
+	memset(&(cache_st->report_stats), 0, sizeof(cache_st->report_stats));
+	cache_st->report_ticks = emul_cur->ticks;
+}
+
+//Finds the slot for an instruction in the table, or the empty slot where it would go
+static uint32_t cache_pc_slot(const cache_pc_t *pcs, uint32_t cap, int pid, uint32_t pc)
+{
+	uint32_t ss = (((pc >> 2) * 2654435761u) ^ ((uint32_t)pid * 40503u)) & (cap - 1);
+	while(pcs[ss].pid != 0 && (pcs[ss].pid != pid || pcs[ss].pc != pc))
+		ss = (ss + 1) & (cap - 1);
+	
+	return ss;
+}
+
+//Returns the counts for the instruction being run, or NULL if there's no room to count it
+static cache_pc_t *cache_pc_get(void)
+{
+	if(cache_st->pid == 0)
+		return NULL; //Not running any process yet
+	
+	uint32_t ss = cache_pc_slot(cache_st->pcs, cache_st->pcs_cap, cache_st->pid, cache_st->pc);
+	if(cache_st->pcs[ss].pid != 0)
+		return &(cache_st->pcs[ss]);
+	
+	//Keep the table at most half full, so probing stays short
+	if((cache_st->pcs_count + 1) * 2 > cache_st->pcs_cap)
+	{
+		uint32_t newcap = cache_st->pcs_cap * 2;
+		cache_pc_t *newpcs = (cache_pc_t*)calloc(newcap, sizeof(cache_pc_t));
+		if(newpcs == NULL)
+			return NULL;
+		
+		for(uint32_t oo = 0; oo < cache_st->pcs_cap; oo++)
+		{
+			const cache_pc_t *optr = &(cache_st->pcs[oo]);
+			if(optr->pid != 0)
+				newpcs[cache_pc_slot(newpcs, newcap, optr->pid, optr->pc)] = *optr;
+		}
+		
+		free(cache_st->pcs);
+		cache_st->pcs = newpcs;
+		cache_st->pcs_cap = newcap;
+		ss = cache_pc_slot(cache_st->pcs, cache_st->pcs_cap, cache_st->pid, cache_st->pc);
+	}
+	
+	cache_st->pcs[ss].pid = cache_st->pid;
+	cache_st->pcs[ss].pc = cache_st->pc;
+	cache_st->pcs_count++;
+	return &(cache_st->pcs[ss]);
+}
+
+//Puts a write into the write buffer, waiting for room if it's full. The write occupies memory for the given time.
+static void cache_wbuf_push(uint32_t duration)
+{
+	cache_ctx_t *st = cache_st;
+	int nentries = st->config.wbuf_entries;
+	
+	//Retire writes that have finished by now
+	while(st->wbuf_count > 0 && st->wbuf_done[st->wbuf_head] <= st->stats.cycles)
+	{
+		st->wbuf_head = (st->wbuf_head + 1) % nentries;
+		st->wbuf_count--;
+	}
+	
+	//If it's still full, the CPU stalls until the oldest is out
+	if(st->wbuf_count >= nentries)
+	{
+		uint64_t done = st->wbuf_done[st->wbuf_head];
+		st->stats.wbuf_stall_cycles += done - st->stats.cycles;
+		st->stats.cycles = done;
+		st->wbuf_head = (st->wbuf_head + 1) % nentries;
+		st->wbuf_count--;
+	}
+	
+	//Writes go out one after another
+	uint64_t start = st->stats.cycles;
+	if(st->wbuf_count > 0)
+	{
+		uint64_t last = st->wbuf_done[(st->wbuf_head + st->wbuf_count - 1) % nentries];
+		if(last > start)
+			start = last;
+	}
+	
+	st->wbuf_done[(st->wbuf_head + st->wbuf_count) % nentries] = start + duration;
+	st->wbuf_count++;
+}
+
+//Looks up an address in one of the caches. Returns the index of its tag, or -1 on a miss.
+static inline int cache_lookup(const cache_array_t *arr, uint32_t addr)
+{
+	cache_ctx_t *st = cache_st;
+	uint32_t line = addr >> st->line_shift;
+	uint32_t set = line & (arr->sets - 1);
+	uint32_t want = (line << st->line_shift) | CACHE_TAG_VALID;
+	uint32_t *tags = &(arr->tags[set * st->config.ways]);
+	for(int ww = 0; ww < st->config.ways; ww++)
+	{
+		if((tags[ww] & ~CACHE_TAG_DIRTY) == want)
+			return (set * st->config.ways) + ww;
+	}
+	return -1;
+}
+
+//Fills a line in one of the caches, writing back whatever it replaces if that was dirty
+static void cache_fill(cache_array_t *arr, uint32_t addr)
+{
+	cache_ctx_t *st = cache_st;
+	uint32_t line = addr >> st->line_shift;
+	uint32_t set = line & (arr->sets - 1);
+	int way = arr->next[set];
+	arr->next[set] = (way + 1) % st->config.ways;
+	
+	uint32_t *tag = &(arr->tags[set * st->config.ways + way]);
+	if(*tag & CACHE_TAG_DIRTY)
+	{
+		st->stats.writebacks++;
+		cache_wbuf_push(st->config.miss_cycles);
+	}
+	
+	*tag = (line << st->line_shift) | CACHE_TAG_VALID;
+}
+
+static void cache_access(int kind, uint32_t addr, uint32_t len)
+{
+	(void)len; //Accesses are aligned and no bigger than a line
+	
+	cache_ctx_t *st = cache_st;
+	st->stats.cycles++;
+	if(kind == INTERP_ACCESS_FETCH)
+	{
+		st->stats.fetches++;
+		if(addr != st->last_fetch + 4)
+			st->stats.cycles += st->config.branch_cycles;
+		
+		st->last_fetch = addr;
+		st->pc = addr;
+		
+		if(cache_lookup(&(st->icache), addr) < 0)
+		{
+			st->stats.fetch_misses++;
+			st->stats.cycles += st->config.miss_cycles;
+			cache_fill(&(st->icache), addr);
+			
+			cache_pc_t *pcptr = cache_pc_get();
+			if(pcptr != NULL)
+				pcptr->fetch_misses++;
+		}
+	}
+	else if(kind == INTERP_ACCESS_LOAD)
+	{
+		st->stats.reads++;
+		if(cache_lookup(&(st->dcache), addr) < 0)
+		{
+			st->stats.read_misses++;
+			st->stats.cycles += st->config.miss_cycles;
+			cache_fill(&(st->dcache), addr);
+			
+			cache_pc_t *pcptr = cache_pc_get();
+			if(pcptr != NULL)
+				pcptr->data_misses++;
+		}
+	}
+	else
+	{
+		st->stats.writes++;
+		int tt = cache_lookup(&(st->dcache), addr);
+		if(tt >= 0)
+		{
+			st->dcache.tags[tt] |= CACHE_TAG_DIRTY;
+		}
+		else
+		{
+			st->stats.write_misses++;
+			cache_wbuf_push(st->config.wbuf_cycles);
+			
+			cache_pc_t *pcptr = cache_pc_get();
+			if(pcptr != NULL)
+				pcptr->data_misses++;
+		}
+	}
+}
+
+void cache_switch(int pid)
+{
+	if(!cache_st->enabled || pid == cache_st->pid)
+		return;
+	
+	//The kernel cleans and invalidates the caches when it changes address spaces
+	if(cache_st->pid != 0)
+	{
+		cache_st->stats.flushes++;
+		int ways = cache_st->config.ways;
+		for(uint32_t tt = 0; tt < cache_st->dcache.sets * ways; tt++)
+		{
+			if(cache_st->dcache.tags[tt] & CACHE_TAG_DIRTY)
+			{
+				cache_st->stats.writebacks++;
+				cache_wbuf_push(cache_st->config.miss_cycles);
+			}
+		}
+		memset(cache_st->icache.tags, 0, cache_st->icache.sets * ways * sizeof(uint32_t));
+		memset(cache_st->dcache.tags, 0, cache_st->dcache.sets * ways * sizeof(uint32_t));
+	}
+	
+	cache_st->pid = pid;
+}
+
+void cache_getstats(cache_stats_t *out)
+{
+	*out = cache_st->stats;
+}
+
+//Returns a hit rate as a percentage
+static float cache_hitpct(uint64_t accesses, uint64_t misses)
+{
+	return accesses ? (100.0f * (float)(accesses - misses) / (float)accesses) : 100.0f;
+}
+
+void cache_statusline(char *buf, int len)
+{
+	if(len > 0)
+		buf[0] = '\0';
+	
+	if(!cache_st->enabled)
+		return;
+	
+	const cache_stats_t *now = &(cache_st->stats);
+	const cache_stats_t *then = &(cache_st->report_stats);
+	uint32_t ms = emul_cur->ticks - cache_st->report_ticks;
+	float mhz = ms ? ((float)(now->cycles - then->cycles) / ((float)ms * 1000.0f)) : 0.0f;
+	
+	snprintf(buf, len, "I$ %.1f%% D$ %.1f%% ~%.0fMHz",
+		cache_hitpct(now->fetches - then->fetches, now->fetch_misses - then->fetch_misses),
+		cache_hitpct((now->reads + now->writes) - (then->reads + then->writes),
+			(now->read_misses + now->write_misses) - (then->read_misses + then->write_misses)),
+		mhz);
+	
+	cache_st->report_stats = *now;
+	cache_st->report_ticks = emul_cur->ticks;
+}
+
+int cache_busiest(void)
+{
+	//Few processes exist at once, so just total them up in a little table
+	int pids[64] = {0};
+	uint64_t misses[64] = {0};
+	int npids = 0;
+	for(uint32_t ss = 0; ss < cache_st->pcs_cap; ss++)
+	{
+		const cache_pc_t *pcptr = &(cache_st->pcs[ss]);
+		if(pcptr->pid == 0)
+			continue;
+		
+		int pp = 0;
+		while(pp < npids && pids[pp] != pcptr->pid)
+			pp++;
+		
+		if(pp == npids)
+		{
+			if(npids >= 64)
+				continue;
+			
+			pids[pp] = pcptr->pid;
+			npids++;
+		}
+		misses[pp] += pcptr->fetch_misses + pcptr->data_misses;
+	}
+	
+	int best = 0;
+	uint64_t best_misses = 0;
+	for(int pp = 0; pp < npids; pp++)
+	{
+		if(misses[pp] >= best_misses)
+		{
+			best = pids[pp];
+			best_misses = misses[pp];
+		}
+	}
+	return best;
+}
+
+//Writes little-endian values, as gprof reads them for an ARM target
+static void cache_put16(FILE *fp, uint32_t val)
+{
+	fputc(val & 0xFF, fp);
+	fputc((val >> 8) & 0xFF, fp);
+}
+
+static void cache_put32(FILE *fp, uint32_t val)
+{
+	cache_put16(fp, val & 0xFFFF);
+	cache_put16(fp, val >> 16);
+}
+
+bool cache_savegmon(const char *path, int pid)
+{
+	//Find the range of instructions that missed
+	uint32_t lo = 0xFFFFFFFFu;
+	uint32_t hi = 0;
+	for(uint32_t ss = 0; ss < cache_st->pcs_cap; ss++)
+	{
+		const cache_pc_t *pcptr = &(cache_st->pcs[ss]);
+		if(pcptr->pid != pid || pid == 0)
+			continue;
+		
+		if(pcptr->pc < lo)
+			lo = pcptr->pc;
+		if(pcptr->pc > hi)
+			hi = pcptr->pc;
+	}
+	
+	if(lo > hi)
+	{
+		TERROR("No cache misses recorded for PID %d\n", pid);
+		errno = ENOENT;
+		return false;
+	}
+	
+	//One bin for each instruction
+	uint32_t nbins = ((hi - lo) / 4) + 1;
+	uint32_t *bins = (uint32_t*)calloc(nbins, sizeof(uint32_t));
+	if(bins == NULL)
+	{
+		TERROR("Failed to allocate %u bins for cache profile\n", nbins);
+		return false;
+	}
+	
+	for(uint32_t ss = 0; ss < cache_st->pcs_cap; ss++)
+	{
+		const cache_pc_t *pcptr = &(cache_st->pcs[ss]);
+		if(pcptr->pid == pid)
+			bins[(pcptr->pc - lo) / 4] += pcptr->fetch_misses + pcptr->data_misses;
+	}
+	
+	FILE *fp = fopen(path, "wb");
+	if(fp == NULL)
+	{
+		TERROR("Failed to open %s for cache profile: %s\n", path, strerror(errno));
+		free(bins);
+		return false;
+	}
+	
+	//File header - magic, version 1, padding
+	fwrite("gmon", 1, 4, fp);
+	cache_put32(fp, 1);
+	for(int ii = 0; ii < 3; ii++)
+	{
+		cache_put32(fp, 0);
+	}
+	
+	//Histogram bins only hold 16 bits, but gprof adds up records covering the same range, so write as many as needed
+	bool more = true;
+	while(more)
+	{
+		more = false;
+		
+		fputc(0, fp); //GMON_TAG_TIME_HIST
+		cache_put32(fp, lo);
+		cache_put32(fp, lo + (nbins * 4));
+		cache_put32(fp, nbins);
+		cache_put32(fp, 1); //Each count is one miss
+		
+		char dimen[15] = "misses";
+		fwrite(dimen, 1, sizeof(dimen), fp);
+		fputc('m', fp);
+		
+		for(uint32_t bb = 0; bb < nbins; bb++)
+		{
+			uint32_t count = (bins[bb] > 0xFFFF) ? 0xFFFF : bins[bb];
+			cache_put16(fp, count);
+			bins[bb] -= count;
+			if(bins[bb] > 0)
+				more = true;
+		}
+	}
+	
+	free(bins);
+	
+	bool ok = !ferror(fp);
+	if(fclose(fp) != 0)
+		ok = false;
+	
+	if(!ok)
+		TERROR("Failed to write cache profile to %s\n", path);
+	
+	return ok;
+}
@@ -0,0 +1,87 @@
+//cache.h
+//Model of the CPU caches and write buffer of the Neki32
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#ifndef _CACHE_H
+#define _CACHE_H
+
+#include <stdint.h>
+#include "prefs.h"
+
+//Shape of the modelled caches and the costs of going out to memory, in CPU cycles.
+//The defaults are those of the ARM926EJ-S in the Neki32.
+typedef struct cache_config_s
+{
+	int icache_kb; //Size of instruction cache
+	int dcache_kb; //Size of data cache
+	int ways; //Associativity of both caches
+	int line_bytes; //Size of a cache line
+	int wbuf_entries; //Writes the write buffer holds before the CPU stalls
+	int miss_cycles; //Time to fill a cache line from memory
+	int wbuf_cycles; //Time for the write buffer to put one write out to memory
+	int branch_cycles; //Time lost refilling the pipeline after a branch
+} cache_config_t;
+
+//Fills in the default configuration
+void cache_defaults(cache_config_t *out);
+
+//Counts of what the modelled caches saw
+typedef struct cache_stats_s
+{
+	uint64_t fetches; //Instructions fetched
+	uint64_t fetch_misses; //Fetches that missed in the instruction cache
+	uint64_t reads; //Data reads
+	uint64_t read_misses; //Data reads that missed in the data cache and filled a line
+	uint64_t writes; //Data writes
+	uint64_t write_misses; //Data writes that missed and went to the write buffer
+	uint64_t writebacks; //Dirty lines written back to memory
+	uint64_t flushes; //Times the caches were cleaned and invalidated for a process switch
+	uint64_t wbuf_stall_cycles; //Time spent waiting for room in the write buffer
+	uint64_t cycles; //Predicted hardware cycles, counting instruction timing and all of the above
+} cache_stats_t;
+
+//Caches of one emulated console
+typedef struct cache_ctx_s cache_ctx_t;
+
+//Makes or frees the cache model for a console
+cache_ctx_t *cache_ctx_new(void);
+void cache_ctx_delete(cache_ctx_t *st);
+
+//Selects the model used by later calls on this thread, or NULL for the one used when there's no console
+void cache_select(cache_ctx_t *st);
+
+//Turns the model on with the given configuration, or off if NULL. Returns false if the configuration is unusable.
+bool cache_configure(const cache_config_t *config);
+
+//Turns the model on or off according to the preferences
+void cache_init(const prefs_t *prefs);
+
+//Returns whether the model is on
+bool cache_enabled(void);
+
+//Empties the caches and forgets all counts, for a new run of the simulation
+void cache_reset(void);
+
+//Notes which process is about to run. The caches are virtually addressed, so switching processes flushes them.
+void cache_switch(int pid);
+
+//Returns the counts since the last reset
+void cache_getstats(cache_stats_t *out);
+
+//Describes hit rates and the predicted clock rate needed since the last call, for the status bar
+void cache_statusline(char *buf, int len);
+
+//Returns the process that has had the most misses, or 0 if none
+int cache_busiest(void);
+
+//Writes the misses at each instruction of the given process as a gprof histogram (gmon.out).
+//Returns false on failure.
+bool cache_savegmon(const char *path, int pid);
+
+#endif //_CACHE_H
@@ -10,6 +10,7 @@
 
 #include "cfgwin.h"
 #include "bindprompt.h"
+#include "joy.h"
 #include <stdio.h>
 #include <wx/notebook.h>
 
@@ -51,7 +52,7 @@ CfgWin::CfgWin(wxWindow *parent, const prefs_t &prefs_in)
 			line_sizer->Add(control_val, 0, wxCENTER | wxLEFT | wxRIGHT, 16);
 			ControlLabels[pp][cc] = control_val;
 			
-			wxButton *bind_button = new wxButton(controls_panel, wxID_ANY, "Key...");
+			wxButton *bind_button = new wxButton(controls_panel, wxID_ANY, "Bind...");
 			bind_button->Bind(wxEVT_BUTTON, &CfgWin::OnBind, this, bind_button->GetId());
 			BindButtons[pp][cc] = bind_button;
 			
@@ -60,10 +61,46 @@ CfgWin::CfgWin(wxWindow *parent, const prefs_t &prefs_in)
 			controls_sizer->Add(line_sizer, 0, wxEXPAND | wxLEFT | wxRIGHT, 8);
 		}
 		
+		//Which joystick the pad's joystick bindings read
+		wxBoxSizer *js_sizer = new wxBoxSizer(wxHORIZONTAL);
+		js_sizer->Add(new wxStaticText(controls_panel, wxID_ANY, "Joystick number"), 0, wxCENTER);
+		js_sizer->AddStretchSpacer(1);
+		JsIdCtrls[pp] = new wxSpinCtrl(controls_panel, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize,
+			wxSP_ARROW_KEYS, 0, JOY_DEV_MAX - 1, MutablePrefs.pads[pp].js_id);
+		JsIdCtrls[pp]->Bind(wxEVT_SPINCTRL, &CfgWin::OnJoySpin, this);
+		js_sizer->Add(JsIdCtrls[pp], 0, wxEXPAND);
+		controls_sizer->Add(js_sizer, 0, wxEXPAND | wxALL, 8);
+		
 		controls_panel->SetSizerAndFit(controls_sizer);
 		controls_notebook->AddPage(controls_panel, boxheader, false);
 	}
 	
+	//Page for how joystick axes turn into buttons
+	wxPanel *joy_panel = new wxPanel(controls_notebook);
+	wxBoxSizer *joy_sizer = new wxBoxSizer(wxVERTICAL);
+	joy_sizer->Add(new wxStaticText(joy_panel, wxID_ANY, "Joystick Axes"), 0, wxCENTER | wxALL, 12);
+	
+	char joycount[64] = {0};
+	snprintf(joycount, sizeof(joycount)-1, "%d joysticks found", joy_count());
+	joy_sizer->Add(new wxStaticText(joy_panel, wxID_ANY, joycount), 0, wxLEFT | wxRIGHT | wxBOTTOM, 8);
+	
+	wxFlexGridSizer *thresh_sizer = new wxFlexGridSizer(2, 8, 16);
+	thresh_sizer->AddGrowableCol(0);
+	thresh_sizer->Add(new wxStaticText(joy_panel, wxID_ANY, "Press past % of travel"), 0, wxALIGN_CENTER_VERTICAL);
+	JoyPressCtrl = new wxSpinCtrl(joy_panel, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize,
+		wxSP_ARROW_KEYS, 1, 100, MutablePrefs.joy_press_pct);
+	JoyPressCtrl->Bind(wxEVT_SPINCTRL, &CfgWin::OnJoySpin, this);
+	thresh_sizer->Add(JoyPressCtrl, 0, wxEXPAND);
+	thresh_sizer->Add(new wxStaticText(joy_panel, wxID_ANY, "Release inside % of travel"), 0, wxALIGN_CENTER_VERTICAL);
+	JoyReleaseCtrl = new wxSpinCtrl(joy_panel, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize,
+		wxSP_ARROW_KEYS, 0, 100, MutablePrefs.joy_release_pct);
+	JoyReleaseCtrl->Bind(wxEVT_SPINCTRL, &CfgWin::OnJoySpin, this);
+	thresh_sizer->Add(JoyReleaseCtrl, 0, wxEXPAND);
+	joy_sizer->Add(thresh_sizer, 0, wxEXPAND | wxLEFT | wxRIGHT, 8);
+	
+	joy_panel->SetSizerAndFit(joy_sizer);
+	controls_notebook->AddPage(joy_panel, "Joystick", false);
+	
 	main_sizer->Add(controls_notebook, 1, wxEXPAND | wxALL, 8);
 	
 	//Buttons at the bottom
@@ -115,14 +152,40 @@ void CfgWin::OnBind(wxCommandEvent &evt)
 		//Discard changed prefs
 	}
 	
-	//Update the control
+	//Update the control, and the joystick number in case a control on another joystick was pushed
 	ControlLabels[pad][button]->SetLabel(GetControlValue(pad, button));
+	JsIdCtrls[pad]->SetValue(MutablePrefs.pads[pad].js_id);
 	
 	b->Destroy();	
 }
 
+void CfgWin::OnJoySpin(wxSpinEvent &event)
+{
+	(void)event;
+	for(int pp = 0; pp < 4; pp++)
+	{
+		MutablePrefs.pads[pp].js_id = JsIdCtrls[pp]->GetValue();
+	}
+	
+	//Release has to be inside press, or buttons would stick
+	MutablePrefs.joy_press_pct = JoyPressCtrl->GetValue();
+	MutablePrefs.joy_release_pct = JoyReleaseCtrl->GetValue();
+	if(MutablePrefs.joy_release_pct > MutablePrefs.joy_press_pct)
+	{
+		MutablePrefs.joy_release_pct = MutablePrefs.joy_press_pct;
+		JoyReleaseCtrl->SetValue(MutablePrefs.joy_release_pct);
+	}
+}
+
 wxString CfgWin::GetControlValue(int pad, int button) const
 {
+	if(MutablePrefs.pads[pad].btn_src[button] == PREFS_PAD_SRC_JOY)
+	{
+		char ss[32] = {0};
+		joy_valname(MutablePrefs.pads[pad].btn_val[button], ss, sizeof(ss));
+		return ss;
+	}
+	
 	if(MutablePrefs.pads[pad].btn_src[button] == PREFS_PAD_SRC_KEY)
 	{
 		int bound_key = MutablePrefs.pads[pad].btn_val[button];
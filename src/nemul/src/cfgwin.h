@@ -12,6 +12,7 @@
 #define _CFGWIN_H
 
 #include <wx/wx.h>
+#include <wx/spinctrl.h>
 #include "prefs.h"
 
 class CfgWin : public wxDialog
@@ -24,12 +25,20 @@ private:
 	
 	//Bind button clicked
 	void OnBind(wxCommandEvent &event);
+	
+	//Joystick number or thresholds changed
+	void OnJoySpin(wxSpinEvent &event);
 
 	//Mapping between pad/button numbers and the wxWidgets Bind Button controls
 	const wxButton *BindButtons[4][16];
 	
 	//Mapping between pad/button numbers and wxWidgets labels
 	wxStaticText *ControlLabels[4][16];
+	
+	//Joystick used by each pad, and the thresholds for joystick axes
+	wxSpinCtrl *JsIdCtrls[4];
+	wxSpinCtrl *JoyPressCtrl;
+	wxSpinCtrl *JoyReleaseCtrl;
 
 	//Returns the value to show for a bound control
 	wxString GetControlValue(int pad, int button) const;
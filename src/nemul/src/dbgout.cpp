@@ -0,0 +1,124 @@
+//dbgout.cpp
+//Files written to the host by emulated programs, for getting profiles out of test runs
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#define FILE_TRACE_CAT TRACE_CAT_SYSC
+#include "trace.h"
+
+#include "dbgout.h"
+#include "sysc.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include <mutex>
+
+//Compatibility shim for making directories
+#if !defined(__MINGW32__)
+	static int dbgout_c_mkdir(const char *path)
+		{ return mkdir(path, 0777); }
+#else
+	static int dbgout_c_mkdir(const char *path)
+		{ return mkdir(path); }
+#endif
+
+//Folder that files go in, empty if programs can't write files.
+//Consoles on other threads may write at once, so this and the counts are protected by the mutex.
+static std::mutex dbgout_mutex;
+static char dbgout_dir[1024];
+static dbgout_stats_t dbgout_stats;
+
+void dbgout_init(const prefs_t *prefs)
+{
+	dbgout_setdir(prefs->dbgout_dir);
+}
+
+void dbgout_setdir(const char *dir)
+{
+	std::lock_guard<std::mutex> lock(dbgout_mutex);
+	snprintf(dbgout_dir, sizeof(dbgout_dir), "%s", (dir != NULL) ? dir : "");
+	
+	//Strip trailing separators so paths come out clean
+	size_t len = strlen(dbgout_dir);
+	while(len > 1 && dbgout_dir[len-1] == '/')
+		dbgout_dir[--len] = '\0';
+	
+	if(dbgout_dir[0] != '\0')
+		TINFO("Writing files from programs in %s\n", dbgout_dir);
+}
+
+//Makes sure the configured folder exists
+static void dbgout_mkdirs(void)
+{
+	char path[1024];
+	snprintf(path, sizeof(path), "%s", dbgout_dir);
+	for(char *sep = strchr(path + 1, '/'); sep != NULL; sep = strchr(sep + 1, '/'))
+	{
+		*sep = '\0';
+		dbgout_c_mkdir(path);
+		*sep = '/';
+	}
+	dbgout_c_mkdir(path);
+}
+
+int dbgout_write(const char *name, const void *data, uint32_t len, bool truncate)
+{
+	//Programs usually give a whole path from the machine they were built on - like the .gcda files of gcov.
+	//Keep only the filename, so nothing outside the folder can be touched.
+	const char *base = name;
+	for(const char *cc = name; *cc != '\0'; cc++)
+	{
+		if(*cc == '/' || *cc == '\\')
+			base = cc + 1;
+	}
+	
+	if(base[0] == '\0' || !strcmp(base, ".") || !strcmp(base, "..") || strchr(base, ':') != NULL)
+		return -PVMK_EINVAL;
+	if(strlen(base) > DBGOUT_NAME_MAX)
+		return -PVMK_EINVAL;
+	
+	std::lock_guard<std::mutex> lock(dbgout_mutex);
+	if(dbgout_dir[0] == '\0')
+		return -PVMK_EPERM;
+	
+	char path[1400];
+	snprintf(path, sizeof(path), "%s/%s", dbgout_dir, base);
+	if(truncate)
+		dbgout_mkdirs();
+	
+	FILE *fp = fopen(path, truncate ? "wb" : "ab");
+	if(fp == NULL)
+	{
+		TWARNING("Failed to open %s for a program: %s\n", path, strerror(errno));
+		return -PVMK_EIO;
+	}
+	
+	size_t written = fwrite(data, 1, len, fp);
+	if(fclose(fp) != 0 || written != len)
+	{
+		TWARNING("Failed to write %s for a program: %s\n", path, strerror(errno));
+		return -PVMK_EIO;
+	}
+	
+	if(truncate)
+	{
+		TDEBUG("Program started file %s\n", path);
+		dbgout_stats.files++;
+	}
+	dbgout_stats.bytes += len;
+	return len;
+}
+
+void dbgout_getstats(dbgout_stats_t *out)
+{
+	std::lock_guard<std::mutex> lock(dbgout_mutex);
+	*out = dbgout_stats;
+}
@@ -0,0 +1,39 @@
+//dbgout.h
+//Files written to the host by emulated programs, for getting profiles out of test runs
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#ifndef _DBGOUT_H
+#define _DBGOUT_H
+
+#include <stdint.h>
+#include "prefs.h"
+
+//Longest name a file can have on the host, not including NUL
+#define DBGOUT_NAME_MAX 255
+
+//Counts of what's been written, for checking that a test run produced its output
+typedef struct dbgout_stats_s
+{
+	uint32_t files; //Files started over
+	uint64_t bytes; //Bytes written to them
+} dbgout_stats_t;
+
+//Sets the folder that files are written in, or turns writing off if it's empty
+void dbgout_init(const prefs_t *prefs);
+void dbgout_setdir(const char *dir);
+
+//Writes to a file in the configured folder, starting it over if "truncate" is set.
+//Only the last component of the name is used, so programs can't write outside the folder.
+//Returns the number of bytes written or a negative error number.
+int dbgout_write(const char *name, const void *data, uint32_t len, bool truncate);
+
+//Returns the counts since startup
+void dbgout_getstats(dbgout_stats_t *out);
+
+#endif //_DBGOUT_H
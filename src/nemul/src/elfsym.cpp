@@ -0,0 +1,289 @@
+//elfsym.cpp
+//Reading functions out of the symbol table of a game's ELF, for the Neki32 simulator
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#define FILE_TRACE_CAT TRACE_CAT_PROCESS
+#include "trace.h"
+
+#include "elfsym.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+//Reads little-endian values out of the ELF
+static uint32_t elfsym_le32(const uint8_t *ptr)
+{
+	return ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | ((uint32_t)ptr[3] << 24);
+}
+
+static uint16_t elfsym_le16(const uint8_t *ptr)
+{
+	return ptr[0] | (ptr[1] << 8);
+}
+
+//Reads part of a file into a new buffer, which the caller frees. Returns NULL on failure.
+static uint8_t *elfsym_readat(FILE *fp, uint32_t offset, uint32_t len)
+{
+	uint8_t *buf = (uint8_t*)malloc(len ? len : 1);
+	if(buf == NULL)
+		return NULL;
+	
+	if(fseek(fp, offset, SEEK_SET) != 0 || fread(buf, 1, len, fp) != len)
+	{
+		free(buf);
+		return NULL;
+	}
+	
+	return buf;
+}
+
+//Sizes of ELF32 structures we look at
+#define ELFSYM_EHDR_SIZE 52
+#define ELFSYM_SHDR_SIZE 40
+#define ELFSYM_SYM_SIZE 16
+
+//Section and symbol types we look for
+#define ELFSYM_SHT_PROGBITS 1
+#define ELFSYM_SHT_SYMTAB 2
+#define ELFSYM_STT_FUNC 2
+
+//Called for each ARM function in the symbol table, with where its code is in the file.
+//Returns true if the function was wanted.
+typedef bool (*elfsym_visit_t)(void *arg, FILE *fp, const char *name, uint32_t addr, uint32_t size, uint32_t fileoff);
+
+//Goes through one symbol table, returning the number of functions wanted
+static int elfsym_table(FILE *fp, const uint8_t *shdrs, int shnum, int symsec, elfsym_visit_t visit, void *arg)
+{
+	const uint8_t *symhdr = shdrs + (symsec * ELFSYM_SHDR_SIZE);
+	uint32_t symoff = elfsym_le32(symhdr + 16);
+	uint32_t symsize = elfsym_le32(symhdr + 20);
+	uint32_t strsec = elfsym_le32(symhdr + 24);
+	if(strsec >= (uint32_t)shnum)
+		return 0;
+	
+	const uint8_t *strhdr = shdrs + (strsec * ELFSYM_SHDR_SIZE);
+	uint32_t stroff = elfsym_le32(strhdr + 16);
+	uint32_t strsize = elfsym_le32(strhdr + 20);
+	
+	uint8_t *syms = elfsym_readat(fp, symoff, symsize);
+	uint8_t *strs = elfsym_readat(fp, stroff, strsize);
+	if(strs != NULL && (strsize == 0 || strs[strsize - 1] != '\0'))
+	{
+		//Names have to end within the table
+		free(strs);
+		strs = NULL;
+	}
+	
+	int nfound = 0;
+	for(uint32_t ss = 0; syms != NULL && strs != NULL && ss + ELFSYM_SYM_SIZE <= symsize; ss += ELFSYM_SYM_SIZE)
+	{
+		const uint8_t *sym = syms + ss;
+		uint32_t name = elfsym_le32(sym + 0);
+		uint32_t value = elfsym_le32(sym + 4);
+		uint32_t size = elfsym_le32(sym + 8);
+		int type = sym[12] & 0xF;
+		uint16_t shndx = elfsym_le16(sym + 14);
+		if(type != ELFSYM_STT_FUNC || size < 4 || (value & 3) || name >= strsize || shndx >= shnum)
+			continue; //Not a function, or a Thumb one, which we can't run anyway
+		
+		//Find the code in the section holding it
+		const uint8_t *sechdr = shdrs + (shndx * ELFSYM_SHDR_SIZE);
+		uint32_t sectype = elfsym_le32(sechdr + 4);
+		uint32_t secaddr = elfsym_le32(sechdr + 12);
+		uint32_t secoff = elfsym_le32(sechdr + 16);
+		uint32_t secsize = elfsym_le32(sechdr + 20);
+		if(sectype != ELFSYM_SHT_PROGBITS || value < secaddr || value + size > secaddr + secsize)
+			continue;
+		
+		if(visit(arg, fp, (const char*)strs + name, value, size, secoff + (value - secaddr)))
+			nfound++;
+	}
+	
+	free(syms);
+	free(strs);
+	return nfound;
+}
+
+//Goes through every symbol table of an ELF, returning the number of functions wanted or -1 on failure
+static int elfsym_scan(const char *path, elfsym_visit_t visit, void *arg)
+{
+	FILE *fp = fopen(path, "rb");
+	if(fp == NULL)
+	{
+		TERROR("Failed to open %s for symbols: %s\n", path, strerror(errno));
+		return -1;
+	}
+	
+	//Only 32-bit little-endian ARM executables make sense
+	uint8_t ehdr[ELFSYM_EHDR_SIZE] = {0};
+	bool ok = fread(ehdr, 1, sizeof(ehdr), fp) == sizeof(ehdr);
+	ok = ok && !memcmp(ehdr, "\x7F" "ELF", 4) && ehdr[4] == 1 && ehdr[5] == 1 && elfsym_le16(ehdr + 18) == 40;
+	if(!ok)
+	{
+		TERROR("%s is not a 32-bit little-endian ARM ELF\n", path);
+		fclose(fp);
+		return -1;
+	}
+	
+	uint32_t shoff = elfsym_le32(ehdr + 32);
+	int shnum = elfsym_le16(ehdr + 48);
+	if(elfsym_le16(ehdr + 46) != ELFSYM_SHDR_SIZE || shnum == 0)
+	{
+		TERROR("%s has no section headers\n", path);
+		fclose(fp);
+		return -1;
+	}
+	
+	uint8_t *shdrs = elfsym_readat(fp, shoff, shnum * ELFSYM_SHDR_SIZE);
+	if(shdrs == NULL)
+	{
+		TERROR("Failed to read section headers of %s\n", path);
+		fclose(fp);
+		return -1;
+	}
+	
+	int nfound = 0;
+	for(int ss = 0; ss < shnum; ss++)
+	{
+		if(elfsym_le32(shdrs + (ss * ELFSYM_SHDR_SIZE) + 4) == ELFSYM_SHT_SYMTAB)
+			nfound += elfsym_table(fp, shdrs, shnum, ss, visit, arg);
+	}
+	
+	free(shdrs);
+	fclose(fp);
+	return nfound;
+}
+
+//Functions being looked for by elfsym_funcs
+typedef struct elfsym_want_s
+{
+	const char *const *names;
+	int nnames;
+	elfsym_func_t *out;
+} elfsym_want_t;
+
+static bool elfsym_visit_funcs(void *arg, FILE *fp, const char *name, uint32_t addr, uint32_t size, uint32_t fileoff)
+{
+	elfsym_want_t *want = (elfsym_want_t*)arg;
+	int idx = 0;
+	while(idx < want->nnames && strcmp(name, want->names[idx]) != 0)
+		idx++;
+	
+	if(idx >= want->nnames || want->out[idx].size != 0)
+		return false;
+	
+	elfsym_func_t *fptr = &(want->out[idx]);
+	fptr->ncode = ((size / 4) < ELFSYM_CODE_MAX) ? (size / 4) : ELFSYM_CODE_MAX;
+	uint8_t *code = elfsym_readat(fp, fileoff, fptr->ncode * 4);
+	if(code == NULL)
+		return false;
+	
+	for(int cc = 0; cc < fptr->ncode; cc++)
+	{
+		fptr->code[cc] = elfsym_le32(code + (cc * 4));
+	}
+	free(code);
+	
+	fptr->addr = addr;
+	fptr->size = size;
+	return true;
+}
+
+int elfsym_funcs(const char *path, const char *const *names, int nnames, elfsym_func_t *out)
+{
+	memset(out, 0, nnames * sizeof(out[0]));
+	elfsym_want_t want = { names, nnames, out };
+	return elfsym_scan(path, elfsym_visit_funcs, &want);
+}
+
+//Names collected by elfsym_names, in a growing array
+typedef struct elfsym_list_s
+{
+	elfsym_name_t *names;
+	int count;
+	int alloc;
+} elfsym_list_t;
+
+static bool elfsym_visit_names(void *arg, FILE *fp, const char *name, uint32_t addr, uint32_t size, uint32_t fileoff)
+{
+	(void)fp;
+	(void)fileoff;
+	elfsym_list_t *list = (elfsym_list_t*)arg;
+	if(list->count >= list->alloc)
+	{
+		int newalloc = (list->alloc > 0) ? (list->alloc * 2) : 256;
+		elfsym_name_t *newnames = (elfsym_name_t*)realloc(list->names, newalloc * sizeof(elfsym_name_t));
+		if(newnames == NULL)
+			return false;
+		
+		list->names = newnames;
+		list->alloc = newalloc;
+	}
+	
+	elfsym_name_t *nptr = &(list->names[list->count]);
+	nptr->addr = addr;
+	nptr->size = size;
+	snprintf(nptr->name, sizeof(nptr->name), "%s", name);
+	list->count++;
+	return true;
+}
+
+static int elfsym_compare(const void *a, const void *b)
+{
+	uint32_t aa = ((const elfsym_name_t*)a)->addr;
+	uint32_t bb = ((const elfsym_name_t*)b)->addr;
+	return (aa > bb) - (aa < bb);
+}
+
+int elfsym_names(const char *path, elfsym_name_t **out)
+{
+	elfsym_list_t list = { NULL, 0, 0 };
+	if(elfsym_scan(path, elfsym_visit_names, &list) < 0)
+	{
+		free(list.names);
+		*out = NULL;
+		return -1;
+	}
+	
+	if(list.count > 0)
+		qsort(list.names, list.count, sizeof(list.names[0]), elfsym_compare);
+	
+	*out = list.names;
+	return list.count;
+}
+
+const elfsym_name_t *elfsym_lookup(const elfsym_name_t *names, int nnames, uint32_t addr)
+{
+	//Find the last function starting at or before the address
+	int lo = 0;
+	int hi = nnames;
+	while(lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+		if(names[mid].addr <= addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	
+	if(lo == 0 || addr >= names[lo - 1].addr + names[lo - 1].size)
+		return NULL;
+	
+	return &(names[lo - 1]);
+}
+
+bool elfsym_matches(const uint32_t *mem, uint32_t memsz, const elfsym_func_t *fptr, uint32_t addr)
+{
+	if(fptr->size == 0 || addr < 0x1000 || (uint64_t)addr + (fptr->ncode * 4) > memsz)
+		return false;
+	
+	return !memcmp(mem + (addr / 4), fptr->code, fptr->ncode * 4);
+}
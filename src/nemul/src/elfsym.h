@@ -0,0 +1,50 @@
+//elfsym.h
+//Reading functions out of the symbol table of a game's ELF, for the Neki32 simulator
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#ifndef _ELFSYM_H
+#define _ELFSYM_H
+
+#include <stdint.h>
+
+//Most words of a function's code kept to recognize it
+#define ELFSYM_CODE_MAX 64
+
+//A function found in an ELF
+typedef struct elfsym_func_s
+{
+	uint32_t addr; //Where the ELF puts it
+	uint32_t size; //Bytes of code, from the symbol table, or 0 if it wasn't found
+	int ncode;
+	uint32_t code[ELFSYM_CODE_MAX]; //Its first words of code
+} elfsym_func_t;
+
+//Looks up the given ARM functions in the symbol table of a 32-bit ARM ELF, filling in one entry for each name.
+//Returns the number found, or -1 if the file can't be read.
+int elfsym_funcs(const char *path, const char *const *names, int nnames, elfsym_func_t *out);
+
+//Name of a function found in an ELF
+typedef struct elfsym_name_s
+{
+	uint32_t addr;
+	uint32_t size;
+	char name[64]; //Cut short if it's longer
+} elfsym_name_t;
+
+//Reads the names of all ARM functions in a 32-bit ARM ELF into a new array sorted by address, which the caller frees.
+//Returns the number of functions, or -1 if the file can't be read.
+int elfsym_names(const char *path, elfsym_name_t **out);
+
+//Finds the function holding the given address in an array from elfsym_names, or returns NULL
+const elfsym_name_t *elfsym_lookup(const elfsym_name_t *names, int nnames, uint32_t addr);
+
+//Checks whether a function's code is at the given address of a process image
+bool elfsym_matches(const uint32_t *mem, uint32_t memsz, const elfsym_func_t *fptr, uint32_t addr);
+
+#endif //_ELFSYM_H
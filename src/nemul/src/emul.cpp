@@ -0,0 +1,137 @@
+//emul.cpp
+//Simulation main loop shared by the GUI and headless runs of the Neki32 simulator
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#define FILE_TRACE_CAT TRACE_CAT_PROCESS
+#include "trace.h"
+
+#include "emul.h"
+#include "interp.h"
+#include "process.h"
+#include "sysc.h"
+#include "snd.h"
+#include "nvm.h"
+#include "undo.h"
+#include "telem.h"
+#include "cache.h"
+#include "hle.h"
+#include "heap.h"
+#include "strace.h"
+#include "textscr.h"
+
+#include <stdlib.h>
+
+//Console used when nothing else is selected - its parts all use their own defaults
+static emul_t emul_default;
+thread_local emul_t *emul_cur = &emul_default;
+
+emul_t *emul_new(void)
+{
+	emul_t *eptr = (emul_t*)calloc(1, sizeof(emul_t));
+	if(eptr == NULL)
+		return NULL;
+	
+	eptr->trace = trace_ctx_new();
+	eptr->interp = interp_ctx_new();
+	eptr->process = process_ctx_new();
+	eptr->sysc = sysc_ctx_new();
+	eptr->snd = snd_ctx_new();
+	eptr->nvm = nvm_ctx_new();
+	eptr->undo = undo_ctx_new();
+	eptr->telem = telem_ctx_new();
+	eptr->cache = cache_ctx_new();
+	eptr->hle = hle_ctx_new();
+	eptr->heap = heap_ctx_new();
+	eptr->strace = strace_ctx_new();
+	eptr->textscr = textscr_ctx_new();
+	
+	if(eptr->trace == NULL || eptr->interp == NULL || eptr->process == NULL || eptr->sysc == NULL ||
+		eptr->snd == NULL || eptr->nvm == NULL || eptr->undo == NULL || eptr->telem == NULL || eptr->cache == NULL ||
+		eptr->hle == NULL || eptr->heap == NULL || eptr->strace == NULL || eptr->textscr == NULL)
+	{
+		TERROR("%s", "Failed to allocate state for emulated console\n");
+		emul_delete(eptr);
+		return NULL;
+	}
+	
+	return eptr;
+}
+
+void emul_delete(emul_t *eptr)
+{
+	if(eptr == NULL)
+		return;
+	
+	trace_ctx_delete(eptr->trace);
+	interp_ctx_delete(eptr->interp);
+	process_ctx_delete(eptr->process);
+	sysc_ctx_delete(eptr->sysc);
+	snd_ctx_delete(eptr->snd);
+	nvm_ctx_delete(eptr->nvm);
+	undo_ctx_delete(eptr->undo);
+	telem_ctx_delete(eptr->telem);
+	cache_ctx_delete(eptr->cache);
+	hle_ctx_delete(eptr->hle);
+	heap_ctx_delete(eptr->heap);
+	strace_ctx_delete(eptr->strace);
+	textscr_ctx_delete(eptr->textscr);
+	free(eptr);
+}
+
+void emul_select(emul_t *eptr)
+{
+	emul_cur = (eptr != NULL) ? eptr : &emul_default;
+	trace_select(emul_cur->trace);
+	interp_select(emul_cur->interp);
+	process_select(emul_cur->process);
+	sysc_select(emul_cur->sysc);
+	snd_select(emul_cur->snd);
+	nvm_select(emul_cur->nvm);
+	undo_select(emul_cur->undo);
+	telem_select(emul_cur->telem);
+	cache_select(emul_cur->cache);
+	hle_select(emul_cur->hle);
+	heap_select(emul_cur->heap);
+	strace_select(emul_cur->strace);
+	textscr_select(emul_cur->textscr);
+}
+
+void emul_reset(int diskfd)
+{
+	emul_cur->ticks = 0;
+	emul_cur->vsyncs = 0;
+	
+	sysc_reset();
+	sysc_setdiskfd(diskfd);
+	process_reset();
+	telem_reset();
+	snd_reset();
+	cache_reset();
+	hle_reset();
+	heap_reset();
+	strace_reset();
+	textscr_reset();
+}
+
+bool emul_tick(void)
+{
+	snd_poll();
+	process_step();
+	emul_cur->ticks++;
+	
+	//Vsync at 60Hz
+	if(emul_cur->ticks * 60ull > emul_cur->vsyncs * 1000ull)
+	{
+		emul_cur->vsyncs++;
+		telem_vsync();
+		return true;
+	}
+	
+	return false;
+}
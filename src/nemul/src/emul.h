@@ -0,0 +1,58 @@
+//emul.h
+//Simulation main loop shared by the GUI and headless runs of the Neki32 simulator
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#ifndef _EMUL_H
+#define _EMUL_H
+
+#include <stdint.h>
+
+//One emulated console - everything that a run of the simulation changes.
+//Each thread works on one console at a time, selected by emul_select, so many can run in one host process.
+typedef struct emul_s
+{
+	//Emulated time - milliseconds and vsyncs since the simulation started
+	uint32_t ticks;
+	uint32_t vsyncs;
+	
+	//State kept by each part of the simulator, or NULL for the part's own default
+	struct trace_ctx_s *trace;
+	struct interp_ctx_s *interp;
+	struct process_ctx_s *process;
+	struct sysc_ctx_s *sysc;
+	struct snd_ctx_s *snd;
+	struct nvm_ctx_s *nvm;
+	struct undo_ctx_s *undo;
+	struct telem_ctx_s *telem;
+	struct cache_ctx_s *cache;
+	struct hle_ctx_s *hle;
+	struct heap_ctx_s *heap;
+	struct strace_ctx_s *strace;
+	struct textscr_ctx_s *textscr;
+} emul_t;
+
+//Console selected on this thread
+extern thread_local emul_t *emul_cur;
+
+//Makes a new console with nothing running, or returns NULL on failure
+emul_t *emul_new(void);
+
+//Frees a console made by emul_new. It must not be selected on any thread.
+void emul_delete(emul_t *eptr);
+
+//Selects the console that later calls on this thread work on, or NULL for the one used by the GUI
+void emul_select(emul_t *eptr);
+
+//Starts the selected console over, with the given disk image inserted (or -1 for none)
+void emul_reset(int diskfd);
+
+//Runs one millisecond of simulation on the selected console. Returns true if it ended at a vsync.
+bool emul_tick(void);
+
+#endif //_EMUL_H
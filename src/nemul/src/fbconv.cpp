@@ -0,0 +1,200 @@
+//fbconv.cpp
+//Framebuffer pixel conversion for Neki32 simulator display
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#include "fbconv.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+	#include <immintrin.h>
+	#define FBCONV_X86 1
+#else
+	#define FBCONV_X86 0
+#endif
+
+//Converts one pixel, the simple way
+static inline void fbconv_px(uint16_t px, unsigned char *dst)
+{
+	dst[0] = ((px >> 11) & 0x1F) << 3;
+	dst[1] = ((px >>  5) & 0x3F) << 2;
+	dst[2] = ((px >>  0) & 0x1F) << 3;
+}
+
+//Portable version, used for leftovers and on hosts without vector support
+static void fbconv_row_scalar(const uint16_t *src, unsigned char *dst, int npx, bool doubled)
+{
+	if(doubled)
+	{
+		for(int xx = 0; xx < npx; xx++)
+		{
+			fbconv_px(src[xx], dst);
+			dst[3] = dst[0];
+			dst[4] = dst[1];
+			dst[5] = dst[2];
+			dst += 6;
+		}
+	}
+	else
+	{
+		for(int xx = 0; xx < npx; xx++)
+		{
+			fbconv_px(src[xx], dst);
+			dst += 3;
+		}
+	}
+}
+
+#if FBCONV_X86
+
+//Converts 8 RGB565 pixels to 24 bytes of RGB
+__attribute__((target("ssse3")))
+static inline void fbconv_8px_ssse3(__m128i px, unsigned char *dst)
+{
+	//Expand each channel to 8 bits, in 16-bit lanes
+	__m128i r = _mm_slli_epi16(_mm_srli_epi16(px, 11), 3);
+	__m128i g = _mm_slli_epi16(_mm_and_si128(_mm_srli_epi16(px, 5), _mm_set1_epi16(0x3F)), 2);
+	__m128i b = _mm_slli_epi16(_mm_and_si128(px, _mm_set1_epi16(0x1F)), 3);
+
+	//Make RGBX for each pixel, then squeeze out the X bytes
+	__m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+	__m128i lo = _mm_unpacklo_epi16(rg, b);
+	__m128i hi = _mm_unpackhi_epi16(rg, b);
+	const __m128i squeeze = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	lo = _mm_shuffle_epi8(lo, squeeze);
+	hi = _mm_shuffle_epi8(hi, squeeze);
+
+	//Pack the two runs of 12 bytes together
+	_mm_storeu_si128((__m128i*)(dst + 0), _mm_or_si128(lo, _mm_slli_si128(hi, 12)));
+	_mm_storel_epi64((__m128i*)(dst + 16), _mm_srli_si128(hi, 4));
+}
+
+__attribute__((target("ssse3")))
+static void fbconv_row_ssse3(const uint16_t *src, unsigned char *dst, int npx, bool doubled)
+{
+	int xx = 0;
+	if(doubled)
+	{
+		for(; xx + 8 <= npx; xx += 8)
+		{
+			__m128i px = _mm_loadu_si128((const __m128i*)(src + xx));
+			fbconv_8px_ssse3(_mm_unpacklo_epi16(px, px), dst);
+			fbconv_8px_ssse3(_mm_unpackhi_epi16(px, px), dst + 24);
+			dst += 48;
+		}
+	}
+	else
+	{
+		for(; xx + 8 <= npx; xx += 8)
+		{
+			fbconv_8px_ssse3(_mm_loadu_si128((const __m128i*)(src + xx)), dst);
+			dst += 24;
+		}
+	}
+
+	fbconv_row_scalar(src + xx, dst, npx - xx, doubled);
+}
+
+//Converts 16 RGB565 pixels to 48 bytes of RGB
+__attribute__((target("avx2")))
+static inline void fbconv_16px_avx2(__m256i px, unsigned char *dst)
+{
+	//Same as the SSSE3 version, but each 128-bit lane holds 8 pixels
+	__m256i r = _mm256_slli_epi16(_mm256_srli_epi16(px, 11), 3);
+	__m256i g = _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(px, 5), _mm256_set1_epi16(0x3F)), 2);
+	__m256i b = _mm256_slli_epi16(_mm256_and_si256(px, _mm256_set1_epi16(0x1F)), 3);
+
+	__m256i rg = _mm256_or_si256(r, _mm256_slli_epi16(g, 8));
+	__m256i lo = _mm256_unpacklo_epi16(rg, b); //Pixels 0-3 and 8-11
+	__m256i hi = _mm256_unpackhi_epi16(rg, b); //Pixels 4-7 and 12-15
+	const __m256i squeeze = _mm256_setr_epi8(
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	lo = _mm256_shuffle_epi8(lo, squeeze);
+	hi = _mm256_shuffle_epi8(hi, squeeze);
+
+	//Output each lane's 24 bytes
+	__m128i lo0 = _mm256_castsi256_si128(lo);
+	__m128i hi0 = _mm256_castsi256_si128(hi);
+	__m128i lo1 = _mm256_extracti128_si256(lo, 1);
+	__m128i hi1 = _mm256_extracti128_si256(hi, 1);
+	_mm_storeu_si128((__m128i*)(dst + 0), _mm_or_si128(lo0, _mm_slli_si128(hi0, 12)));
+	_mm_storel_epi64((__m128i*)(dst + 16), _mm_srli_si128(hi0, 4));
+	_mm_storeu_si128((__m128i*)(dst + 24), _mm_or_si128(lo1, _mm_slli_si128(hi1, 12)));
+	_mm_storel_epi64((__m128i*)(dst + 40), _mm_srli_si128(hi1, 4));
+}
+
+__attribute__((target("avx2")))
+static void fbconv_row_avx2(const uint16_t *src, unsigned char *dst, int npx, bool doubled)
+{
+	int xx = 0;
+	if(doubled)
+	{
+		for(; xx + 16 <= npx; xx += 16)
+		{
+			//Unpacking works within lanes, so line the pixels up first to keep them in order
+			__m256i px = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i*)(src + xx)), 0xD8);
+			fbconv_16px_avx2(_mm256_unpacklo_epi16(px, px), dst);
+			fbconv_16px_avx2(_mm256_unpackhi_epi16(px, px), dst + 48);
+			dst += 96;
+		}
+	}
+	else
+	{
+		for(; xx + 16 <= npx; xx += 16)
+		{
+			fbconv_16px_avx2(_mm256_loadu_si256((const __m256i*)(src + xx)), dst);
+			dst += 48;
+		}
+	}
+
+	fbconv_row_scalar(src + xx, dst, npx - xx, doubled);
+}
+
+#endif //FBCONV_X86
+
+//Kernel chosen for this host
+typedef void (*fbconv_row_fn)(const uint16_t *src, unsigned char *dst, int npx, bool doubled);
+static fbconv_row_fn fbconv_fn;
+static const char *fbconv_name;
+
+//Picks the best kernel the host CPU supports
+static void fbconv_pick(void)
+{
+	fbconv_fn = fbconv_row_scalar;
+	fbconv_name = "scalar";
+
+	#if FBCONV_X86
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx2"))
+		{
+			fbconv_fn = fbconv_row_avx2;
+			fbconv_name = "avx2";
+		}
+		else if(__builtin_cpu_supports("ssse3"))
+		{
+			fbconv_fn = fbconv_row_ssse3;
+			fbconv_name = "ssse3";
+		}
+	#endif
+}
+
+void fbconv_row(const uint16_t *src, unsigned char *dst, int npx, bool doubled)
+{
+	if(fbconv_fn == NULL)
+		fbconv_pick();
+
+	fbconv_fn(src, dst, npx, doubled);
+}
+
+const char *fbconv_kernel(void)
+{
+	if(fbconv_fn == NULL)
+		fbconv_pick();
+
+	return fbconv_name;
+}
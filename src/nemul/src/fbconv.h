@@ -0,0 +1,23 @@
+//fbconv.h
+//Framebuffer pixel conversion for Neki32 simulator display
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#ifndef _FBCONV_H
+#define _FBCONV_H
+
+#include <stdint.h>
+
+//Converts a row of RGB565 pixels to 24bpp RGB, as wxImage wants it.
+//Each source pixel is written once, or twice side-by-side if "doubled" is set.
+void fbconv_row(const uint16_t *src, unsigned char *dst, int npx, bool doubled);
+
+//Returns the name of the conversion kernel in use, for diagnostics
+const char *fbconv_kernel(void);
+
+#endif //_FBCONV_H
@@ -0,0 +1,1162 @@
+//fuzz_interp.cpp
+//Compares ARM interpreter with a reference model on random instructions
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#if FUZZ_INTERP
+//Generates random ARMv5TE instructions and register states, and runs each through interp_step_force
+//and through a reference model written separately from the ARM ARM pseudocode.
+//Any difference is shrunk down to the simplest instruction and registers that still show it,
+//then printed in the same format as the GDB logs that compare_interp reads, so it can be kept as a test case.
+//The reference only covers encodings that are architecturally defined and that Nemul claims to run.
+//Memory accesses follow Nemul's rules rather than the hardware's - misaligned words fault, and the bottom 4KB is unmapped.
+//Pairs of instructions the interpreter fuses are also run through interp_step_pair and compared with running them singly.
+//Usage: fuzz_interp.elf [cases [seed]]
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "interp.h"
+
+//Memory given to each test case, and where the instruction pretends to be
+#define FUZZ_MEMSZ 0x4000
+#define FUZZ_PC    0x2000
+
+//Flags in CPSR
+#define REF_N (1u << 31)
+#define REF_Z (1u << 30)
+#define REF_C (1u << 29)
+#define REF_V (1u << 28)
+#define REF_Q (1u << 27)
+
+//Returned by the reference model for encodings it doesn't cover
+#define REF_SKIP (-1)
+
+//Registers and flags that an instruction works on
+typedef struct fuzz_state_s
+{
+	uint32_t regs[16];
+	uint32_t cpsr;
+} fuzz_state_t;
+
+//Kinds of instruction generated, so each gets a fair share of the cases
+typedef enum fuzz_class_e
+{
+	FUZZ_CLASS_DPIMM = 0, //Data processing, rotated immediate
+	FUZZ_CLASS_DPSHIFT, //Data processing, register shifted by immediate
+	FUZZ_CLASS_DPREG, //Data processing, register shifted by register
+	FUZZ_CLASS_MUL, //MUL, MLA, and the long multiplies
+	FUZZ_CLASS_DSPMUL, //Halfword multiplies from v5TE
+	FUZZ_CLASS_CLZ, //Count leading zeroes
+	FUZZ_CLASS_LSWORD, //Word and unsigned byte loads/stores
+	FUZZ_CLASS_LSMISC, //Halfword, signed byte, and doubleword loads/stores
+	FUZZ_CLASS_LSM, //Load/store multiple
+	FUZZ_CLASS_BRANCH, //B, BL, BX, BLX
+	FUZZ_CLASS_MAX
+} fuzz_class_t;
+
+static const char *fuzz_class_names[FUZZ_CLASS_MAX] =
+{
+	"dpimm", "dpshift", "dpreg", "mul", "dspmul", "clz", "lsword", "lsmisc", "lsm", "branch"
+};
+
+//Starting memory contents, and the copies given to the interpreter and reference
+static uint32_t fuzz_image[FUZZ_MEMSZ / 4];
+static uint32_t fuzz_simmem[FUZZ_MEMSZ / 4];
+static uint32_t fuzz_refmem[FUZZ_MEMSZ / 4];
+
+//Set when either side writes memory, so we know to compare and restore it
+static bool fuzz_sim_stored;
+static bool fuzz_ref_stored;
+
+//Random number generator (xorshift64*), seeded from the command line so runs can be repeated
+static uint64_t fuzz_rng = 0x9E3779B97F4A7C15ull;
+static uint32_t fuzz_rand(void)
+{
+	fuzz_rng ^= fuzz_rng >> 12;
+	fuzz_rng ^= fuzz_rng << 25;
+	fuzz_rng ^= fuzz_rng >> 27;
+	return (fuzz_rng * 0x2545F4914F6CDD1Dull) >> 32;
+}
+
+//Called by the interpreter before each store
+static void fuzz_storehook(uint32_t addr, uint32_t oldword)
+{
+	(void)addr;
+	(void)oldword;
+	fuzz_sim_stored = true;
+}
+
+//Reference model
+
+static bool ref_cond(uint32_t cond, uint32_t cpsr)
+{
+	bool n = cpsr & REF_N;
+	bool z = cpsr & REF_Z;
+	bool c = cpsr & REF_C;
+	bool v = cpsr & REF_V;
+	switch(cond)
+	{
+		case 0x0: return z;
+		case 0x1: return !z;
+		case 0x2: return c;
+		case 0x3: return !c;
+		case 0x4: return n;
+		case 0x5: return !n;
+		case 0x6: return v;
+		case 0x7: return !v;
+		case 0x8: return c && !z;
+		case 0x9: return !c || z;
+		case 0xA: return n == v;
+		case 0xB: return n != v;
+		case 0xC: return !z && (n == v);
+		case 0xD: return z || (n != v);
+		default: return true;
+	}
+}
+
+//AddWithCarry from the ARM ARM - every add, subtract, and compare goes through here
+static uint32_t ref_addc(uint32_t a, uint32_t b, uint32_t cin, bool *c_out, bool *v_out)
+{
+	uint64_t usum = (uint64_t)a + (uint64_t)b + cin;
+	int64_t ssum = (int64_t)(int32_t)a + (int64_t)(int32_t)b + cin;
+	uint32_t result = (uint32_t)usum;
+	*c_out = (usum >> 32) != 0;
+	*v_out = (int64_t)(int32_t)result != ssum;
+	return result;
+}
+
+//Shifts for amounts of 1 and up, done in 64 bits so big amounts fall out naturally
+static uint32_t ref_lsl_c(uint32_t x, uint32_t n, bool *c_out)
+{
+	if(n > 33)
+		n = 33;
+	
+	uint64_t wide = (uint64_t)x << n;
+	*c_out = (wide >> 32) & 1;
+	return (uint32_t)wide;
+}
+
+static uint32_t ref_lsr_c(uint32_t x, uint32_t n, bool *c_out)
+{
+	if(n > 33)
+		n = 33;
+	
+	*c_out = ((uint64_t)x >> (n - 1)) & 1;
+	return (uint32_t)((uint64_t)x >> n);
+}
+
+static uint32_t ref_asr_c(uint32_t x, uint32_t n, bool *c_out)
+{
+	if(n > 32)
+		n = 32;
+	
+	int64_t wide = (int32_t)x;
+	*c_out = (wide >> (n - 1)) & 1;
+	return (uint32_t)(wide >> n);
+}
+
+static uint32_t ref_ror_c(uint32_t x, uint32_t n, bool *c_out)
+{
+	uint64_t doubled = ((uint64_t)x << 32) | x;
+	uint32_t result = (uint32_t)(doubled >> (n % 32));
+	*c_out = result >> 31;
+	return result;
+}
+
+//Shifter operand for register forms (addressing mode 1 and the scaled offsets of mode 2)
+static uint32_t ref_shift(uint32_t x, int type, uint32_t amount, bool by_reg, bool c_in, bool *c_out)
+{
+	if(by_reg && amount == 0)
+	{
+		*c_out = c_in;
+		return x;
+	}
+	
+	switch(type)
+	{
+		case 0:
+			if(amount == 0)
+			{
+				*c_out = c_in;
+				return x;
+			}
+			return ref_lsl_c(x, amount, c_out);
+		case 1:
+			return ref_lsr_c(x, (amount == 0) ? 32 : amount, c_out);
+		case 2:
+			return ref_asr_c(x, (amount == 0) ? 32 : amount, c_out);
+		default:
+			if(!by_reg && amount == 0)
+			{
+				//RRX
+				*c_out = x & 1;
+				return (x >> 1) | (c_in ? 0x80000000u : 0);
+			}
+			if(by_reg && (amount % 32) == 0)
+			{
+				*c_out = x >> 31;
+				return x;
+			}
+			return ref_ror_c(x, amount, c_out);
+	}
+}
+
+static void ref_setnz(fuzz_state_t *st, uint32_t result)
+{
+	st->cpsr &= ~(REF_N | REF_Z);
+	st->cpsr |= (result & 0x80000000u) ? REF_N : 0;
+	st->cpsr |= (result == 0) ? REF_Z : 0;
+}
+
+static void ref_setcv(fuzz_state_t *st, bool c, bool v)
+{
+	st->cpsr &= ~(REF_C | REF_V);
+	st->cpsr |= c ? REF_C : 0;
+	st->cpsr |= v ? REF_V : 0;
+}
+
+static void ref_dataproc(fuzz_state_t *st, uint32_t ir, uint32_t a, uint32_t b, bool shifter_c)
+{
+	int opcode = (ir >> 21) & 0xF;
+	int rd = (ir >> 12) & 0xF;
+	uint32_t cin = (st->cpsr & REF_C) ? 1 : 0;
+	bool c = shifter_c;
+	bool v = (st->cpsr & REF_V) != 0;
+	uint32_t result = 0;
+	switch(opcode)
+	{
+		case 0x0: case 0x8: result = a & b; break;
+		case 0x1: case 0x9: result = a ^ b; break;
+		case 0x2: case 0xA: result = ref_addc(a, ~b, 1, &c, &v); break;
+		case 0x3: result = ref_addc(b, ~a, 1, &c, &v); break;
+		case 0x4: case 0xB: result = ref_addc(a, b, 0, &c, &v); break;
+		case 0x5: result = ref_addc(a, b, cin, &c, &v); break;
+		case 0x6: result = ref_addc(a, ~b, cin, &c, &v); break;
+		case 0x7: result = ref_addc(b, ~a, cin, &c, &v); break;
+		case 0xC: result = a | b; break;
+		case 0xD: result = b; break;
+		case 0xE: result = a & ~b; break;
+		case 0xF: result = ~b; break;
+	}
+	
+	if(ir & (1u << 20))
+	{
+		ref_setnz(st, result);
+		ref_setcv(st, c, v);
+	}
+	
+	if((opcode & 0xC) != 0x8)
+		st->regs[rd] = result;
+}
+
+//Checks a memory access against Nemul's rules
+static int ref_check(uint32_t addr, uint32_t size)
+{
+	if(addr % size)
+		return INTERP_RESULT_AC;
+	
+	if(addr < 0x1000 || (uint64_t)addr + size > FUZZ_MEMSZ)
+		return INTERP_RESULT_ABT;
+	
+	return INTERP_RESULT_OK;
+}
+
+static uint32_t ref_load(uint32_t addr, uint32_t size)
+{
+	const uint8_t *bytes = (const uint8_t*)fuzz_refmem;
+	uint32_t value = 0;
+	for(uint32_t bb = 0; bb < size; bb++)
+	{
+		value |= (uint32_t)bytes[addr + bb] << (8 * bb);
+	}
+	return value;
+}
+
+static void ref_store(uint32_t addr, uint32_t size, uint32_t value)
+{
+	uint8_t *bytes = (uint8_t*)fuzz_refmem;
+	for(uint32_t bb = 0; bb < size; bb++)
+	{
+		bytes[addr + bb] = value >> (8 * bb);
+	}
+	fuzz_ref_stored = true;
+}
+
+//Runs one instruction on the reference model. Returns an interp_result_t, or REF_SKIP if the encoding isn't covered.
+static int ref_step(fuzz_state_t *st, uint32_t ir)
+{
+	uint32_t *r = st->regs;
+	const uint32_t pc = r[15];
+	const uint32_t cond = ir >> 28;
+	const int rn = (ir >> 16) & 0xF;
+	const int rd = (ir >> 12) & 0xF;
+	const int rs = (ir >> 8) & 0xF;
+	const int rm = (ir >> 0) & 0xF;
+	const bool p = ir & (1u << 24);
+	const bool u = ir & (1u << 23);
+	const bool w = ir & (1u << 21);
+	const bool l = ir & (1u << 20);
+	const bool writeback = !p || w;
+	const bool pass = ref_cond(cond, st->cpsr);
+	const bool c_in = (st->cpsr & REF_C) != 0;
+	
+	//Reading r15 gives the address of the instruction plus 8
+	#define REF_READ(n) (((n) == 15) ? (pc + 8) : r[(n)])
+	
+	//Instructions that the interpreter treats specially, and the unconditional space
+	if(cond == 0xF || ir == 0xE7F009F2 || ir == 0xE7FFDEFE || ir == 0xEAFFFFFE)
+		return REF_SKIP;
+	
+	r[15] = pc + 4;
+	
+	if((ir & 0x0E000000) == 0x0A000000)
+	{
+		//B, BL
+		if(!pass)
+			return INTERP_RESULT_OK;
+		
+		uint32_t offset = (uint32_t)((int32_t)(ir << 8) >> 6);
+		if(ir & (1u << 24))
+			r[14] = pc + 4;
+		
+		r[15] = pc + 8 + offset;
+		return INTERP_RESULT_OK;
+	}
+	
+	if((ir & 0x0E000000) == 0x08000000)
+	{
+		//LDM, STM
+		uint32_t list = ir & 0xFFFF;
+		if((ir & (1u << 22)) || list == 0 || (list & 0x8000) || rn == 15 || (w && (list & (1u << rn))))
+			return REF_SKIP;
+		
+		if(!pass)
+			return INTERP_RESULT_OK;
+		
+		uint32_t count = __builtin_popcount(list);
+		uint32_t start = 0;
+		if(u)
+			start = p ? (r[rn] + 4) : r[rn];
+		else
+			start = p ? (r[rn] - 4 * count) : (r[rn] - 4 * count + 4);
+		
+		for(uint32_t ww = 0; ww < count; ww++)
+		{
+			int check = ref_check(start + 4 * ww, 4);
+			if(check != INTERP_RESULT_OK)
+				return check;
+		}
+		
+		uint32_t addr = start;
+		for(int rr = 0; rr < 16; rr++)
+		{
+			if(!(list & (1u << rr)))
+				continue;
+			
+			if(l)
+				r[rr] = ref_load(addr, 4);
+			else
+				ref_store(addr, 4, r[rr]);
+			
+			addr += 4;
+		}
+		
+		if(w)
+			r[rn] = u ? (r[rn] + 4 * count) : (r[rn] - 4 * count);
+		
+		return INTERP_RESULT_OK;
+	}
+	
+	if((ir & 0x0C000000) == 0x04000000)
+	{
+		//LDR, STR, LDRB, STRB
+		bool regoffset = ir & (1u << 25);
+		if(regoffset && (ir & 0x10))
+			return REF_SKIP; //Media instructions
+		if(!p && w)
+			return REF_SKIP; //User-mode translation variants
+		if(rd == 15)
+			return REF_SKIP;
+		if(writeback && (rn == 15 || rn == rd))
+			return REF_SKIP;
+		if(regoffset && (rm == 15 || (writeback && rm == rn)))
+			return REF_SKIP;
+		
+		if(!pass)
+			return INTERP_RESULT_OK;
+		
+		uint32_t offset = ir & 0xFFF;
+		if(regoffset)
+		{
+			bool unused_c = false;
+			offset = ref_shift(r[rm], (ir >> 5) & 3, (ir >> 7) & 0x1F, false, c_in, &unused_c);
+		}
+		
+		uint32_t base = REF_READ(rn);
+		uint32_t offsetaddr = u ? (base + offset) : (base - offset);
+		uint32_t addr = p ? offsetaddr : base;
+		uint32_t size = (ir & (1u << 22)) ? 1 : 4;
+		
+		int check = ref_check(addr, size);
+		if(check != INTERP_RESULT_OK)
+			return check;
+		
+		if(l)
+			r[rd] = ref_load(addr, size);
+		else
+			ref_store(addr, size, r[rd]);
+		
+		if(writeback)
+			r[rn] = offsetaddr;
+		
+		return INTERP_RESULT_OK;
+	}
+	
+	if((ir & 0x0E000000) == 0x02000000)
+	{
+		//Data processing, rotated immediate
+		int opcode = (ir >> 21) & 0xF;
+		if(((opcode & 0xC) == 0x8) && !(ir & (1u << 20)))
+			return REF_SKIP; //MSR and undefined
+		if(rd == 15)
+			return REF_SKIP;
+		
+		if(!pass)
+			return INTERP_RESULT_OK;
+		
+		uint32_t rotate = ((ir >> 8) & 0xF) * 2;
+		bool c = c_in;
+		uint32_t imm = ir & 0xFF;
+		if(rotate != 0)
+			imm = ref_ror_c(imm, rotate, &c);
+		
+		ref_dataproc(st, ir, REF_READ(rn), imm, c);
+		return INTERP_RESULT_OK;
+	}
+	
+	if((ir & 0x0E000000) != 0)
+		return REF_SKIP; //Coprocessor, SWI, undefined
+	
+	if((ir & 0x0F0000F0) == 0x00000090)
+	{
+		//Multiplies
+		int op = (ir >> 21) & 7;
+		bool s = ir & (1u << 20);
+		if(op == 2 || op == 3)
+			return REF_SKIP; //v6
+		if(rn == 15 || rd == 15 || rs == 15 || rm == 15)
+			return REF_SKIP;
+		if(op == 0 && rd != 0)
+			return REF_SKIP; //Should-be-zero
+		if(op < 2 && rn == rm)
+			return REF_SKIP;
+		if(op >= 4 && (rn == rd || rn == rm || rd == rm))
+			return REF_SKIP;
+		
+		if(!pass)
+			return INTERP_RESULT_OK;
+		
+		if(op < 2)
+		{
+			uint32_t result = r[rm] * r[rs];
+			if(op == 1)
+				result += r[rd];
+			
+			r[rn] = result;
+			if(s)
+				ref_setnz(st, result);
+			
+			return INTERP_RESULT_OK;
+		}
+		
+		uint64_t product = 0;
+		if(op & 2)
+			product = (uint64_t)((int64_t)(int32_t)r[rm] * (int64_t)(int32_t)r[rs]);
+		else
+			product = (uint64_t)r[rm] * (uint64_t)r[rs];
+		
+		if(op & 1)
+			product += ((uint64_t)r[rn] << 32) | r[rd];
+		
+		r[rd] = (uint32_t)product;
+		r[rn] = (uint32_t)(product >> 32);
+		if(s)
+		{
+			st->cpsr &= ~(REF_N | REF_Z);
+			st->cpsr |= (product >> 63) ? REF_N : 0;
+			st->cpsr |= (product == 0) ? REF_Z : 0;
+		}
+		return INTERP_RESULT_OK;
+	}
+	
+	if((ir & 0x0E000090) == 0x00000090)
+	{
+		//Extra loads and stores - halfword, signed byte, doubleword (and SWP, not covered)
+		int sh = (ir >> 5) & 3;
+		bool immform = ir & (1u << 22);
+		bool dword = !l && (sh & 2);
+		if(sh == 0)
+			return REF_SKIP;
+		if(!immform && (rs != 0 || rm == 15))
+			return REF_SKIP;
+		if(!p && w)
+			return REF_SKIP;
+		if(rd == 15)
+			return REF_SKIP;
+		if(writeback && (rn == 15 || rn == rd))
+			return REF_SKIP;
+		if(!immform && writeback && rm == rn)
+			return REF_SKIP;
+		if(dword && ((rd & 1) || rd == 14))
+			return REF_SKIP;
+		if(dword && writeback && rn == rd + 1)
+			return REF_SKIP;
+		if(dword && !immform && (rm == rd || rm == rd + 1))
+			return REF_SKIP;
+		
+		if(!pass)
+			return INTERP_RESULT_OK;
+		
+		uint32_t offset = immform ? (((ir >> 4) & 0xF0) | (ir & 0xF)) : r[rm];
+		uint32_t base = REF_READ(rn);
+		uint32_t offsetaddr = u ? (base + offset) : (base - offset);
+		uint32_t addr = p ? offsetaddr : base;
+		uint32_t size = dword ? 8 : ((l && sh == 2) ? 1 : 2);
+		
+		int check = ref_check(addr, size);
+		if(check != INTERP_RESULT_OK)
+			return check;
+		
+		if(dword && sh == 2)
+		{
+			r[rd] = ref_load(addr, 4);
+			r[rd + 1] = ref_load(addr + 4, 4);
+		}
+		else if(dword)
+		{
+			ref_store(addr, 4, r[rd]);
+			ref_store(addr + 4, 4, r[rd + 1]);
+		}
+		else if(!l)
+		{
+			ref_store(addr, 2, r[rd]);
+		}
+		else
+		{
+			uint32_t value = ref_load(addr, size);
+			if(sh == 2)
+				value = (uint32_t)(int32_t)(int8_t)value;
+			else if(sh == 3)
+				value = (uint32_t)(int32_t)(int16_t)value;
+			
+			r[rd] = value;
+		}
+		
+		if(writeback)
+			r[rn] = offsetaddr;
+		
+		return INTERP_RESULT_OK;
+	}
+	
+	if((ir & 0x01900000) == 0x01000000)
+	{
+		//Miscellaneous instructions in the compare-without-S space
+		if((ir & 0x0FFFFFD0) == 0x012FFF10)
+		{
+			//BX, BLX (register)
+			if(rm == 15 || (r[rm] & 3))
+				return REF_SKIP; //Thumb isn't supported, and ARM targets must be aligned
+			
+			if(!pass)
+				return INTERP_RESULT_OK;
+			
+			uint32_t target = r[rm];
+			if(ir & 0x20)
+				r[14] = pc + 4;
+			
+			r[15] = target;
+			return INTERP_RESULT_OK;
+		}
+		
+		if((ir & 0x0FFF0FF0) == 0x016F0F10)
+		{
+			//CLZ
+			if(rd == 15 || rm == 15)
+				return REF_SKIP;
+			
+			if(!pass)
+				return INTERP_RESULT_OK;
+			
+			r[rd] = (r[rm] == 0) ? 32 : __builtin_clz(r[rm]);
+			return INTERP_RESULT_OK;
+		}
+		
+		int dspop = (ir >> 21) & 3;
+		if((ir & 0x0F900090) == 0x01000080 && dspop != 1)
+		{
+			//SMLAxy, SMLALxy, SMULxy (destination in the rn position)
+			if(rn == 15 || rd == 15 || rs == 15 || rm == 15)
+				return REF_SKIP;
+			if(dspop == 3 && rd != 0)
+				return REF_SKIP; //Should-be-zero
+			if(dspop == 2 && rn == rd)
+				return REF_SKIP;
+			
+			if(!pass)
+				return INTERP_RESULT_OK;
+			
+			int32_t opa = (int16_t)((ir & (1u << 5)) ? (r[rm] >> 16) : r[rm]);
+			int32_t opb = (int16_t)((ir & (1u << 6)) ? (r[rs] >> 16) : r[rs]);
+			int32_t product = opa * opb;
+			if(dspop == 0)
+			{
+				int64_t sum = (int64_t)product + (int64_t)(int32_t)r[rd];
+				r[rn] = (uint32_t)sum;
+				if(sum != (int64_t)(int32_t)sum)
+					st->cpsr |= REF_Q;
+			}
+			else if(dspop == 2)
+			{
+				uint64_t accum = ((uint64_t)r[rn] << 32) | r[rd];
+				accum += (uint64_t)(int64_t)product;
+				r[rd] = (uint32_t)accum;
+				r[rn] = (uint32_t)(accum >> 32);
+			}
+			else
+			{
+				r[rn] = (uint32_t)product;
+			}
+			return INTERP_RESULT_OK;
+		}
+		
+		return REF_SKIP; //MRS, MSR, QADD and friends, BKPT, SMULWy...
+	}
+	
+	if((ir & 0x90) == 0x90)
+		return REF_SKIP; //Shouldn't get here, but don't treat it as data processing
+	
+	//Data processing, register shifted by immediate or by register
+	bool by_reg = ir & 0x10;
+	if(rd == 15)
+		return REF_SKIP;
+	if(by_reg && (rn == 15 || rs == 15 || rm == 15))
+		return REF_SKIP;
+	
+	if(!pass)
+		return INTERP_RESULT_OK;
+	
+	uint32_t amount = by_reg ? (r[rs] & 0xFF) : ((ir >> 7) & 0x1F);
+	bool c = c_in;
+	uint32_t operand = ref_shift(REF_READ(rm), (ir >> 5) & 3, amount, by_reg, c_in, &c);
+	ref_dataproc(st, ir, REF_READ(rn), operand, c);
+	return INTERP_RESULT_OK;
+	
+	#undef REF_READ
+}
+
+//Test cases
+
+//One instruction and the state it starts from
+typedef struct fuzz_case_s
+{
+	fuzz_state_t state;
+	uint32_t ir;
+} fuzz_case_t;
+
+//What each side made of a test case
+typedef struct fuzz_outcome_s
+{
+	int ref_result;
+	interp_result_t sim_result;
+	fuzz_state_t ref;
+	fuzz_state_t sim;
+	bool memdiff;
+} fuzz_outcome_t;
+
+//Register values that tend to find edge cases
+static uint32_t fuzz_value(void)
+{
+	static const uint32_t interesting[] =
+	{
+		0, 1, 2, 31, 32, 33, 0x7F, 0x80, 0xFF, 0x100, 0x7FFF, 0x8000, 0xFFFF,
+		0x7FFFFFFF, 0x80000000, 0x80000001, 0xFFFFFFFE, 0xFFFFFFFF
+	};
+	
+	switch(fuzz_rand() % 4)
+	{
+		case 0: return interesting[fuzz_rand() % (sizeof(interesting) / sizeof(interesting[0]))];
+		case 1: return fuzz_rand() & 0xFF;
+		default: return fuzz_rand();
+	}
+}
+
+//Addresses for loads and stores - mostly good ones, some misaligned, some outside of memory
+static uint32_t fuzz_address(void)
+{
+	switch(fuzz_rand() % 8)
+	{
+		case 0: return fuzz_rand();
+		case 1: return fuzz_rand() % 0x1000;
+		case 2: return 0xFFFFFFF0u + (fuzz_rand() % 16);
+		case 3: return 0x1000 + (fuzz_rand() % (FUZZ_MEMSZ - 0x1000));
+		default: return (0x1000 + (fuzz_rand() % (FUZZ_MEMSZ - 0x1000))) & ~7u;
+	}
+}
+
+//Makes a random instruction of the given class, and registers to suit it
+static void fuzz_generate(fuzz_class_t cls, fuzz_case_t *out)
+{
+	fuzz_state_t *st = &(out->state);
+	for(int rr = 0; rr < 15; rr++)
+	{
+		st->regs[rr] = fuzz_value();
+	}
+	st->regs[15] = FUZZ_PC;
+	st->cpsr = (fuzz_rand() & 0xF8000000u) | 0x10;
+	
+	uint32_t bits = fuzz_rand();
+	uint32_t ir = 0;
+	switch(cls)
+	{
+		case FUZZ_CLASS_DPIMM:
+			ir = (bits & 0x01FFFFFF) | 0x02000000;
+			break;
+		case FUZZ_CLASS_DPSHIFT:
+			ir = (bits & 0x01FFFFEF);
+			if(fuzz_rand() % 4 == 0)
+				ir &= ~0xF80u; //Shift amount of 0 has special meanings
+			break;
+		case FUZZ_CLASS_DPREG:
+			ir = (bits & 0x01FFFF6F) | 0x10;
+			st->regs[(ir >> 8) & 0xF] = (fuzz_rand() % 2) ? (fuzz_rand() % 40) : fuzz_value();
+			break;
+		case FUZZ_CLASS_MUL:
+		{
+			static const uint32_t ops[] = { 0, 1, 4, 5, 6, 7 };
+			ir = (bits & 0x001FFF0F) | (ops[fuzz_rand() % 6] << 21) | 0x90;
+			break;
+		}
+		case FUZZ_CLASS_DSPMUL:
+		{
+			static const uint32_t ops[] = { 0, 2, 3 };
+			ir = (bits & 0x000FFF6F) | (ops[fuzz_rand() % 3] << 21) | 0x01000080;
+			break;
+		}
+		case FUZZ_CLASS_CLZ:
+			ir = (bits & 0x0000F00F) | 0x016F0F10;
+			break;
+		case FUZZ_CLASS_LSWORD:
+			ir = (bits & 0x03FFFFFF) | 0x04000000;
+			if(ir & (1u << 25))
+			{
+				ir &= ~0x10u;
+				if(fuzz_rand() % 4 == 0)
+					ir &= ~0xF80u;
+				
+				st->regs[ir & 0xF] = (fuzz_rand() % 2) ? (fuzz_rand() % 64) : fuzz_value();
+			}
+			else if(fuzz_rand() % 2)
+			{
+				ir &= ~0xF00u; //Keep immediate offsets small, so more accesses land in memory
+			}
+			st->regs[(ir >> 16) & 0xF] = fuzz_address();
+			break;
+		case FUZZ_CLASS_LSMISC:
+			ir = (bits & 0x01FFFF6F) | 0x90;
+			if(!(ir & 0x60))
+				ir |= 0x20;
+			if(!(ir & (1u << 22)))
+			{
+				ir &= ~0xF00u;
+				st->regs[ir & 0xF] = (fuzz_rand() % 2) ? (fuzz_rand() % 64) : fuzz_value();
+			}
+			st->regs[(ir >> 16) & 0xF] = fuzz_address();
+			break;
+		case FUZZ_CLASS_LSM:
+			ir = (bits & 0x01BF7FFF) | 0x08000000;
+			st->regs[(ir >> 16) & 0xF] = fuzz_address() & ~3u;
+			break;
+		case FUZZ_CLASS_BRANCH:
+			if(bits & 1)
+			{
+				ir = (fuzz_rand() & 0x01FFFFFF) | 0x0A000000;
+			}
+			else
+			{
+				ir = 0x012FFF10 | ((bits & 2) ? 0x20 : 0) | ((bits >> 4) & 0xF);
+				st->regs[ir & 0xF] = fuzz_rand() & ~3u;
+			}
+			break;
+		default:
+			break;
+	}
+	
+	//Mostly unconditional, so the instructions actually run
+	uint32_t cond = (fuzz_rand() % 2) ? 0xE : (fuzz_rand() % 15);
+	out->ir = (ir & 0x0FFFFFFF) | (cond << 28);
+}
+
+//Runs a test case through both sides. Returns false if the reference doesn't cover it.
+static bool fuzz_run(const fuzz_case_t *tc, fuzz_outcome_t *out)
+{
+	//Zero would make interp_step_force fetch from memory instead
+	if(tc->ir == 0)
+		return false;
+	
+	out->ref = tc->state;
+	fuzz_ref_stored = false;
+	out->ref_result = ref_step(&(out->ref), tc->ir);
+	if(out->ref_result == REF_SKIP)
+	{
+		if(fuzz_ref_stored)
+			memcpy(fuzz_refmem, fuzz_image, sizeof(fuzz_refmem));
+		
+		return false;
+	}
+	
+	out->sim = tc->state;
+	fuzz_sim_stored = false;
+	out->sim_result = interp_step_force(out->sim.regs, &(out->sim.cpsr), fuzz_simmem, FUZZ_MEMSZ, tc->ir);
+	
+	out->memdiff = false;
+	if(fuzz_sim_stored || fuzz_ref_stored)
+	{
+		out->memdiff = memcmp(fuzz_simmem, fuzz_refmem, FUZZ_MEMSZ) != 0;
+		memcpy(fuzz_simmem, fuzz_image, sizeof(fuzz_simmem));
+		memcpy(fuzz_refmem, fuzz_image, sizeof(fuzz_refmem));
+	}
+	
+	return true;
+}
+
+//Checks whether the two sides disagreed.
+//After a fault, the state left behind doesn't matter, as the process gets a signal.
+static bool fuzz_mismatch(const fuzz_outcome_t *oc)
+{
+	if(oc->ref_result != (int)(oc->sim_result))
+		return true;
+	
+	if(oc->ref_result != INTERP_RESULT_OK)
+		return false;
+	
+	if(memcmp(oc->ref.regs, oc->sim.regs, sizeof(oc->ref.regs)) != 0)
+		return true;
+	
+	if(oc->ref.cpsr != oc->sim.cpsr)
+		return true;
+	
+	return oc->memdiff;
+}
+
+//Checks whether a test case is covered by the reference and still shows a mismatch
+static bool fuzz_fails(const fuzz_case_t *tc)
+{
+	fuzz_outcome_t oc;
+	return fuzz_run(tc, &oc) && fuzz_mismatch(&oc);
+}
+
+//Shrinks a failing test case, clearing bits of the instruction, registers, and flags while it still fails
+static void fuzz_minimize(fuzz_case_t *tc)
+{
+	bool progress = true;
+	while(progress)
+	{
+		progress = false;
+		
+		fuzz_case_t trial = *tc;
+		trial.ir = (tc->ir & 0x0FFFFFFF) | 0xE0000000;
+		if(trial.ir != tc->ir && fuzz_fails(&trial))
+		{
+			*tc = trial;
+			progress = true;
+		}
+		
+		for(int bb = 0; bb < 28; bb++)
+		{
+			trial = *tc;
+			trial.ir &= ~(1u << bb);
+			if(trial.ir != tc->ir && fuzz_fails(&trial))
+			{
+				*tc = trial;
+				progress = true;
+			}
+		}
+		
+		for(int rr = 0; rr < 15; rr++)
+		{
+			if(tc->state.regs[rr] == 0)
+				continue;
+			
+			trial = *tc;
+			trial.state.regs[rr] = 0;
+			if(fuzz_fails(&trial))
+			{
+				*tc = trial;
+				progress = true;
+				continue;
+			}
+			
+			for(int bb = 31; bb >= 0; bb--)
+			{
+				trial = *tc;
+				trial.state.regs[rr] &= ~(1u << bb);
+				if(trial.state.regs[rr] != tc->state.regs[rr] && fuzz_fails(&trial))
+				{
+					*tc = trial;
+					progress = true;
+				}
+			}
+		}
+		
+		for(int bb = 27; bb < 32; bb++)
+		{
+			trial = *tc;
+			trial.state.cpsr &= ~(1u << bb);
+			if(trial.state.cpsr != tc->state.cpsr && fuzz_fails(&trial))
+			{
+				*tc = trial;
+				progress = true;
+			}
+		}
+	}
+}
+
+//Fused pairs
+
+//Memory given to the fused and single-stepped runs of a pair
+static uint32_t fuzz_pairmem[2][FUZZ_MEMSZ / 4];
+
+//Makes a random data processing instruction in one of the forms that's fused, with or without S
+static uint32_t fuzz_pair_dp(bool s)
+{
+	uint32_t ir = 0xE0000000u | (fuzz_rand() & 0x01EFF000u) | (s ? (1u << 20) : 0);
+	if(!s && ((ir >> 21) & 0xC) == 0x8)
+		ir ^= 0x4u << 21; //No compares without S
+	
+	if(fuzz_rand() % 2)
+		ir |= 0x02000000u | (fuzz_rand() & 0xFFF);
+	else
+		ir |= fuzz_rand() & 0xF;
+	
+	return ir;
+}
+
+//Makes a random pair of instructions that the interpreter might fuse
+static void fuzz_pair_generate(fuzz_state_t *st, uint32_t *ir0, uint32_t *ir1)
+{
+	for(int rr = 0; rr < 15; rr++)
+	{
+		st->regs[rr] = fuzz_value();
+	}
+	st->regs[15] = FUZZ_PC;
+	st->cpsr = (fuzz_rand() & 0xF8000000u) | 0x10;
+	
+	switch(fuzz_rand() % 4)
+	{
+		case 0:
+			*ir0 = fuzz_pair_dp(true);
+			*ir1 = 0x0A000000u | ((fuzz_rand() % 15) << 28) | ((fuzz_rand() % 64) - 32) % 0x1000000u;
+			break;
+		case 1:
+			*ir0 = fuzz_pair_dp(false);
+			*ir1 = fuzz_pair_dp(false);
+			break;
+		case 2:
+			*ir0 = 0xE4100000u | (fuzz_rand() & 0x01FFFFFFu & ~0x00600000u);
+			if(fuzz_rand() % 2)
+				*ir0 &= ~0xF00u;
+			
+			*ir1 = fuzz_pair_dp(false);
+			if(((*ir0 >> 16) & 0xF) != 15)
+				st->regs[(*ir0 >> 16) & 0xF] = fuzz_address();
+			break;
+		default:
+			*ir0 = fuzz_pair_dp(false);
+			*ir1 = 0xE12FFF1Eu;
+			st->regs[14] = (fuzz_rand() % 8) ? (fuzz_address() & ~3u) : fuzz_rand();
+			break;
+	}
+	
+	//Sometimes not unconditional, which mustn't be fused
+	if(fuzz_rand() % 8 == 0)
+		*ir0 = (*ir0 & 0x0FFFFFFF) | ((fuzz_rand() % 15) << 28);
+}
+
+//Runs random pairs through interp_step_pair and through interp_step twice. Returns the number of mismatches.
+static int fuzz_pairs(long cases, long *fused_out)
+{
+	int nfailed = 0;
+	*fused_out = 0;
+	for(long cc = 0; cc < cases && nfailed < 4; cc++)
+	{
+		fuzz_state_t start;
+		uint32_t ir0 = 0;
+		uint32_t ir1 = 0;
+		fuzz_pair_generate(&start, &ir0, &ir1);
+		
+		fuzz_state_t st[2] = { start, start };
+		interp_result_t res[2] = { INTERP_RESULT_OK, INTERP_RESULT_OK };
+		for(int ss = 0; ss < 2; ss++)
+		{
+			memcpy(fuzz_pairmem[ss], fuzz_image, sizeof(fuzz_pairmem[ss]));
+			fuzz_pairmem[ss][FUZZ_PC / 4] = ir0;
+			fuzz_pairmem[ss][(FUZZ_PC / 4) + 1] = ir1;
+			
+			//Either way, run the second instruction if the first one led to it
+			uint32_t ran = 1;
+			if(ss == 0)
+				res[ss] = interp_step_pair(st[ss].regs, &(st[ss].cpsr), fuzz_pairmem[ss], FUZZ_MEMSZ, &ran);
+			else
+				res[ss] = interp_step(st[ss].regs, &(st[ss].cpsr), fuzz_pairmem[ss], FUZZ_MEMSZ);
+			
+			if(ran == 2)
+				(*fused_out)++;
+			else if(res[ss] == INTERP_RESULT_OK && st[ss].regs[15] == FUZZ_PC + 4)
+				res[ss] = interp_step(st[ss].regs, &(st[ss].cpsr), fuzz_pairmem[ss], FUZZ_MEMSZ);
+		}
+		
+		bool same = (res[0] == res[1]);
+		if(same && res[0] == INTERP_RESULT_OK)
+		{
+			same = !memcmp(st[0].regs, st[1].regs, sizeof(st[0].regs)) && st[0].cpsr == st[1].cpsr;
+			same = same && !memcmp(fuzz_pairmem[0], fuzz_pairmem[1], sizeof(fuzz_pairmem[0]));
+		}
+		
+		if(same)
+			continue;
+		
+		fprintf(stderr, "Mismatch in fused pair %8.8X %8.8X: fused result %d, single result %d\n", ir0, ir1, res[0], res[1]);
+		fprintf(stderr, "%s", "reg\ttestcase\tsingle\tfused\n");
+		for(int rr = 0; rr < 17; rr++)
+		{
+			uint32_t in = (rr == 16) ? start.cpsr : start.regs[rr];
+			uint32_t ex = (rr == 16) ? st[1].cpsr : st[1].regs[rr];
+			uint32_t sm = (rr == 16) ? st[0].cpsr : st[0].regs[rr];
+			if(rr == 16)
+				fprintf(stderr, "%s", "CPSR=\t");
+			else
+				fprintf(stderr, "r%d=\t", rr);
+			
+			fprintf(stderr, "%8.8X\t%8.8X\t%8.8X%s\n", in, ex, sm, (ex != sm) ? " <--" : "");
+		}
+		nfailed++;
+	}
+	return nfailed;
+}
+
+//Prints registers the way GDB's "info registers" does
+static void fuzz_printregs(FILE *fp, const fuzz_state_t *st)
+{
+	static const char *names[16] = { "r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7",
+		"r8", "r9", "r10", "r11", "r12", "sp", "lr", "pc" };
+	
+	for(int rr = 0; rr < 16; rr++)
+	{
+		fprintf(fp, "%-14s 0x%x\n", names[rr], st->regs[rr]);
+	}
+	fprintf(fp, "%-14s 0x%x\n", "cpsr", st->cpsr);
+}
+
+//Describes a failing test case, and prints it in a form compare_interp can read back
+static void fuzz_report(fuzz_class_t cls, int testn, const fuzz_case_t *tc)
+{
+	fuzz_outcome_t oc;
+	fuzz_run(tc, &oc);
+	
+	fprintf(stderr, "Mismatch in %s: IR=0x%8.8X, reference result %d, interpreter result %d%s\n",
+		fuzz_class_names[cls], tc->ir, oc.ref_result, oc.sim_result, oc.memdiff ? ", memory differs" : "");
+	fprintf(stderr, "%s", "reg\ttestcase\texpected\tsimulated\n");
+	for(int rr = 0; rr < 17; rr++)
+	{
+		uint32_t in = (rr == 16) ? tc->state.cpsr : tc->state.regs[rr];
+		uint32_t ex = (rr == 16) ? oc.ref.cpsr : oc.ref.regs[rr];
+		uint32_t sm = (rr == 16) ? oc.sim.cpsr : oc.sim.regs[rr];
+		if(rr == 16)
+			fprintf(stderr, "%s", "CPSR=\t");
+		else
+			fprintf(stderr, "r%d=\t", rr);
+		
+		fprintf(stderr, "%8.8X\t%8.8X\t%8.8X%s\n", in, ex, sm, (ex != sm) ? " <--" : "");
+	}
+	
+	printf("test_begin %d\n", testn);
+	fuzz_printregs(stdout, &(tc->state));
+	printf("ir 0x%8.8X ... \n", tc->ir);
+	fuzz_printregs(stdout, &(oc.ref));
+	printf("%s", "test_end\n");
+}
+
+int main(int argc, const char **argv)
+{
+	long cases = (argc > 1) ? atol(argv[1]) : 1000000;
+	uint64_t seed = (argc > 2) ? strtoull(argv[2], NULL, 0) : (uint64_t)time(NULL);
+	fprintf(stderr, "Fuzzing %ld cases with seed %llu\n", cases, (unsigned long long)seed);
+	
+	fuzz_rng ^= seed * 0xD1342543DE82EF95ull;
+	if(fuzz_rng == 0)
+		fuzz_rng = 1;
+	
+	for(int ww = 0; ww < FUZZ_MEMSZ / 4; ww++)
+	{
+		fuzz_image[ww] = fuzz_rand();
+	}
+	memcpy(fuzz_simmem, fuzz_image, sizeof(fuzz_simmem));
+	memcpy(fuzz_refmem, fuzz_image, sizeof(fuzz_refmem));
+	interp_setstorehook(fuzz_storehook);
+	
+	//Stop looking in a class once it's failed, and report each failure once
+	long ran[FUZZ_CLASS_MAX] = {0};
+	long skipped[FUZZ_CLASS_MAX] = {0};
+	bool failed[FUZZ_CLASS_MAX] = {0};
+	int nfailed = 0;
+	for(long cc = 0; cc < cases; cc++)
+	{
+		fuzz_class_t cls = (fuzz_class_t)(cc % FUZZ_CLASS_MAX);
+		if(failed[cls])
+			continue;
+		
+		fuzz_case_t tc;
+		fuzz_generate(cls, &tc);
+		
+		fuzz_outcome_t oc;
+		if(!fuzz_run(&tc, &oc))
+		{
+			skipped[cls]++;
+			continue;
+		}
+		
+		ran[cls]++;
+		if(!fuzz_mismatch(&oc))
+			continue;
+		
+		fuzz_minimize(&tc);
+		fuzz_report(cls, (int)cc, &tc);
+		failed[cls] = true;
+		nfailed++;
+	}
+	
+	fprintf(stderr, "%-8s %10s %10s %s\n", "CLASS", "RAN", "SKIPPED", "RESULT");
+	for(int cls = 0; cls < FUZZ_CLASS_MAX; cls++)
+	{
+		fprintf(stderr, "%-8s %10ld %10ld %s\n", fuzz_class_names[cls], ran[cls], skipped[cls], failed[cls] ? "MISMATCH" : "ok");
+	}
+	
+	//Fused pairs aren't checked against the reference, but against the interpreter running them singly
+	long fused = 0;
+	int pairfailed = fuzz_pairs(cases / FUZZ_CLASS_MAX, &fused);
+	fprintf(stderr, "%-8s %10ld %10ld %s\n", "fused", fused, (cases / FUZZ_CLASS_MAX) - fused, pairfailed ? "MISMATCH" : "ok");
+	nfailed += pairfailed;
+	
+	return (nfailed > 0) ? 1 : 0;
+}
+
+#endif //FUZZ_INTERP
@@ -0,0 +1,570 @@
+//heap.cpp
+//Tracking of the heap allocations made by games in the Neki32 simulator
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#define FILE_TRACE_CAT TRACE_CAT_PROCESS
+#include "trace.h"
+
+#include "heap.h"
+#include "elfsym.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <new>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+
+//Games run out of memory with no idea what's using it. Given the game's ELF, we learn where malloc and friends are.
+//When a process enters one, we note the arguments and who called, and when it returns to the caller, we see what it
+//gave back. Calls the functions make to each other, like calloc to malloc, are part of the outer call.
+//The functions run as usual - we only watch. Fused instruction pairs never jump into the middle of a pair,
+//so calls and returns are always seen between steps.
+
+//A call in progress in some process
+typedef struct heap_call_s
+{
+	int pid; //0 if nothing is in progress
+	heap_fn_t fn;
+	uint32_t lr; //Where it returns to
+	uint32_t sp; //Stack pointer on entry, which it's restored to on return
+	uint32_t args[2];
+} heap_call_t;
+
+//A block allocated
+typedef struct heap_block_s
+{
+	uint32_t size;
+	uint32_t site;
+	uint32_t frame;
+} heap_block_t;
+
+//Allocations made from one place in the code
+typedef struct heap_site_s
+{
+	heap_fn_t fn; //Function called there
+	uint64_t calls;
+	uint64_t bytes;
+	uint64_t live_blocks;
+	uint64_t live_bytes;
+	uint64_t peak_bytes;
+	uint32_t frames; //Frames that allocated here
+	uint32_t last_frame; //Frame of the last allocation here, plus one
+	uint64_t leaked_blocks;
+	uint64_t leaked_bytes;
+} heap_site_t;
+
+//Blocks left allocated from one call site when a process exited
+typedef struct heap_leak_s
+{
+	uint32_t site;
+	uint64_t blocks;
+	uint64_t bytes;
+} heap_leak_t;
+
+//Allocations tracked in one emulated console
+struct heap_ctx_s
+{
+	bool enabled = false;
+	
+	//Functions learned from the ELF, and the names of everything else there for reporting call sites
+	elfsym_func_t funcs[HEAP_FN_MAX];
+	int nfuncs = 0;
+	elfsym_name_t *names = NULL;
+	int nnames = 0;
+	
+	//Process each table entry was last checked for having the functions, and which it has
+	int checked_pid[PROCESS_MAX];
+	uint32_t checked_mask[PROCESS_MAX];
+	
+	//Calls in progress, by process table entry
+	heap_call_t calls[PROCESS_MAX];
+	
+	//Blocks allocated, by process ID and address, and where allocations came from
+	std::unordered_map<uint64_t, heap_block_t> blocks;
+	std::unordered_map<uint32_t, heap_site_t> sites;
+	
+	//Frames finished, kept as a ring, and the one in progress
+	heap_frame_t ring[HEAP_HISTORY];
+	int head = 0;
+	int count = 0;
+	heap_frame_t cur;
+	
+	heap_stats_t stats;
+	
+	~heap_ctx_s() { free(names); }
+};
+
+//State used when no console is selected, and the one selected on this thread
+static heap_ctx_t heap_default;
+static thread_local heap_ctx_t *heap_st = &heap_default;
+
+//Symbols of each function
+static const char *const heap_names[HEAP_FN_MAX] = { "malloc", "calloc", "realloc", "memalign", "free" };
+
+heap_ctx_t *heap_ctx_new(void)
+{
+	return new(std::nothrow) heap_ctx_t();
+}
+
+void heap_ctx_delete(heap_ctx_t *st)
+{
+	delete st;
+}
+
+void heap_select(heap_ctx_t *st)
+{
+	heap_st = (st != NULL) ? st : &heap_default;
+}
+
+const char *heap_fnname(heap_fn_t fn)
+{
+	return (fn >= 0 && fn < HEAP_FN_MAX) ? heap_names[fn] : "unknown";
+}
+
+//Forgets which processes have the functions and any calls in progress
+static void heap_forget(void)
+{
+	memset(heap_st->checked_pid, 0, sizeof(heap_st->checked_pid));
+	memset(heap_st->calls, 0, sizeof(heap_st->calls));
+}
+
+void heap_clear(void)
+{
+	heap_st->nfuncs = 0;
+	memset(heap_st->funcs, 0, sizeof(heap_st->funcs));
+	free(heap_st->names);
+	heap_st->names = NULL;
+	heap_st->nnames = 0;
+	heap_forget();
+}
+
+void heap_setenabled(bool enabled)
+{
+	heap_st->enabled = enabled;
+	heap_forget();
+}
+
+bool heap_loadelf(const char *path)
+{
+	heap_clear();
+	
+	int nfound = elfsym_funcs(path, heap_names, HEAP_FN_MAX, heap_st->funcs);
+	if(nfound <= 0 || heap_st->funcs[HEAP_FN_FREE].size == 0)
+	{
+		TWARNING("No heap functions to track in %s\n", path);
+		heap_clear();
+		return false;
+	}
+	
+	for(int ff = 0; ff < HEAP_FN_MAX; ff++)
+	{
+		if(heap_st->funcs[ff].size != 0)
+			TINFO("Tracking %s at %8.8X\n", heap_names[ff], heap_st->funcs[ff].addr);
+	}
+	heap_st->nfuncs = nfound;
+	
+	//Call sites are easier to find by function name, but we can do without
+	heap_st->nnames = elfsym_names(path, &(heap_st->names));
+	if(heap_st->nnames < 0)
+		heap_st->nnames = 0;
+	
+	return true;
+}
+
+void heap_init(const prefs_t *prefs)
+{
+	heap_setenabled(prefs->heap_enabled);
+	if(prefs->hle_elf_path[0] != '\0')
+		heap_loadelf(prefs->hle_elf_path);
+	else
+		heap_clear();
+}
+
+void heap_reset(void)
+{
+	heap_forget();
+	heap_st->blocks.clear();
+	heap_st->sites.clear();
+	heap_st->head = 0;
+	heap_st->count = 0;
+	memset(&(heap_st->cur), 0, sizeof(heap_st->cur));
+	memset(&(heap_st->stats), 0, sizeof(heap_st->stats));
+}
+
+bool heap_switch(const process_t *pptr)
+{
+	if(!heap_st->enabled || heap_st->nfuncs == 0)
+		return false;
+	
+	//See which functions are where the ELF puts them, once for each image
+	int slot = pptr->pid % PROCESS_MAX;
+	if(heap_st->checked_pid[slot] != pptr->pid)
+	{
+		uint32_t mask = 0;
+		for(int ff = 0; ff < HEAP_FN_MAX; ff++)
+		{
+			if(elfsym_matches(pptr->mem, pptr->size, &(heap_st->funcs[ff]), heap_st->funcs[ff].addr))
+				mask |= 1u << ff;
+		}
+		
+		if(mask != 0)
+			TDEBUG("Tracking heap of process %d\n", pptr->pid);
+		
+		heap_st->checked_pid[slot] = pptr->pid;
+		heap_st->checked_mask[slot] = mask;
+		memset(&(heap_st->calls[slot]), 0, sizeof(heap_st->calls[slot]));
+	}
+	
+	return heap_st->checked_mask[slot] != 0;
+}
+
+//Finds the call site record for an address
+static heap_site_t *heap_site(uint32_t site, heap_fn_t fn)
+{
+	heap_site_t *sptr = &(heap_st->sites[site]);
+	if(sptr->calls == 0)
+		sptr->fn = fn;
+	
+	return sptr;
+}
+
+//Adds a block that was allocated
+static void heap_add(int pid, uint32_t addr, uint64_t size, uint32_t site, heap_fn_t fn)
+{
+	heap_stats_t *stats = &(heap_st->stats);
+	heap_site_t *sptr = heap_site(site, fn);
+	sptr->calls++;
+	sptr->bytes += size;
+	if(sptr->last_frame != stats->frames + 1)
+	{
+		sptr->last_frame = stats->frames + 1;
+		sptr->frames++;
+	}
+	
+	heap_st->cur.allocs++;
+	heap_st->cur.bytes += size;
+	
+	//A block already at the address was lost track of - like when a process starts over without exiting
+	uint64_t key = ((uint64_t)(uint32_t)pid << 32) | addr;
+	std::unordered_map<uint64_t, heap_block_t>::iterator old = heap_st->blocks.find(key);
+	if(old != heap_st->blocks.end())
+	{
+		heap_site_t *optr = &(heap_st->sites[old->second.site]);
+		optr->live_blocks--;
+		optr->live_bytes -= old->second.size;
+		stats->live_blocks--;
+		stats->live_bytes -= old->second.size;
+		heap_st->blocks.erase(old);
+	}
+	
+	heap_block_t block = { (uint32_t)size, site, stats->frames };
+	heap_st->blocks[key] = block;
+	
+	sptr->live_blocks++;
+	sptr->live_bytes += size;
+	if(sptr->live_bytes > sptr->peak_bytes)
+		sptr->peak_bytes = sptr->live_bytes;
+	
+	stats->live_blocks++;
+	stats->live_bytes += size;
+	if(stats->live_bytes > stats->peak_bytes)
+	{
+		stats->peak_bytes = stats->live_bytes;
+		stats->peak_frame = stats->frames;
+	}
+}
+
+//Removes a block that was freed
+static void heap_remove(int pid, uint32_t addr)
+{
+	uint64_t key = ((uint64_t)(uint32_t)pid << 32) | addr;
+	std::unordered_map<uint64_t, heap_block_t>::iterator bb = heap_st->blocks.find(key);
+	if(bb == heap_st->blocks.end())
+	{
+		TDEBUG("Process %d freed %8.8X, which we didn't see allocated\n", pid, addr);
+		heap_st->stats.unknown_frees++;
+		return;
+	}
+	
+	heap_site_t *sptr = &(heap_st->sites[bb->second.site]);
+	sptr->live_blocks--;
+	sptr->live_bytes -= bb->second.size;
+	heap_st->stats.live_blocks--;
+	heap_st->stats.live_bytes -= bb->second.size;
+	heap_st->cur.frees++;
+	heap_st->blocks.erase(bb);
+}
+
+//Finishes a call when it returns
+static void heap_return(const process_t *pptr, const heap_call_t *cptr)
+{
+	uint32_t result = pptr->regs[0];
+	uint32_t site = cptr->lr - 4;
+	uint64_t size = 0;
+	switch(cptr->fn)
+	{
+		case HEAP_FN_MALLOC:
+			size = cptr->args[0];
+			break;
+		case HEAP_FN_CALLOC:
+			size = (uint64_t)cptr->args[0] * cptr->args[1];
+			break;
+		case HEAP_FN_MEMALIGN:
+		case HEAP_FN_REALLOC:
+			size = cptr->args[1];
+			break;
+		case HEAP_FN_FREE:
+			if(cptr->args[0] != 0)
+				heap_remove(pptr->pid, cptr->args[0]);
+			return;
+		default:
+			return;
+	}
+	
+	//Reallocating to nothing frees the block
+	if(cptr->fn == HEAP_FN_REALLOC && cptr->args[0] != 0 && (result != 0 || size == 0))
+		heap_remove(pptr->pid, cptr->args[0]);
+	
+	if(result == 0)
+	{
+		if(size != 0)
+		{
+			TDEBUG("Process %d failed to %s %llu bytes at %8.8X\n", pptr->pid, heap_names[cptr->fn],
+				(unsigned long long)size, site);
+			heap_st->stats.failed++;
+		}
+		return;
+	}
+	
+	heap_add(pptr->pid, result, size, site, cptr->fn);
+}
+
+void heap_observe(const process_t *pptr)
+{
+	int slot = pptr->pid % PROCESS_MAX;
+	heap_call_t *cptr = &(heap_st->calls[slot]);
+	uint32_t pc = pptr->regs[15];
+	if(cptr->pid == pptr->pid)
+	{
+		//Anything before the return is part of the call
+		if(pc == cptr->lr && pptr->regs[13] == cptr->sp)
+		{
+			heap_return(pptr, cptr);
+			cptr->pid = 0;
+		}
+		return;
+	}
+	
+	uint32_t mask = heap_st->checked_mask[slot];
+	for(int ff = 0; ff < HEAP_FN_MAX; ff++)
+	{
+		if(pc != heap_st->funcs[ff].addr || !(mask & (1u << ff)))
+			continue;
+		
+		heap_st->stats.calls[ff]++;
+		cptr->pid = pptr->pid;
+		cptr->fn = (heap_fn_t)ff;
+		cptr->lr = pptr->regs[14];
+		cptr->sp = pptr->regs[13];
+		cptr->args[0] = pptr->regs[0];
+		cptr->args[1] = pptr->regs[1];
+		return;
+	}
+}
+
+void heap_flip(void)
+{
+	if(!heap_st->enabled || heap_st->nfuncs == 0)
+		return;
+	
+	heap_stats_t *stats = &(heap_st->stats);
+	heap_frame_t *fptr = &(heap_st->cur);
+	fptr->frame = stats->frames;
+	fptr->live_bytes = stats->live_bytes;
+	fptr->peak_bytes = stats->peak_bytes;
+	if(fptr->allocs > 0)
+		stats->alloc_frames++;
+	if(fptr->allocs > stats->max_frame_allocs)
+		stats->max_frame_allocs = fptr->allocs;
+	
+	heap_st->ring[heap_st->head] = *fptr;
+	heap_st->head = (heap_st->head + 1) % HEAP_HISTORY;
+	if(heap_st->count < HEAP_HISTORY)
+		heap_st->count++;
+	
+	memset(fptr, 0, sizeof(*fptr));
+	stats->frames++;
+}
+
+//Describes a call site by the function holding it
+static void heap_sitename(uint32_t site, char *buf, size_t len)
+{
+	const elfsym_name_t *nptr = elfsym_lookup(heap_st->names, heap_st->nnames, site);
+	if(nptr != NULL)
+		snprintf(buf, len, "%8.8X %s+0x%X", site, nptr->name, site - nptr->addr);
+	else
+		snprintf(buf, len, "%8.8X", site);
+}
+
+void heap_exit(int pid)
+{
+	int slot = pid % PROCESS_MAX;
+	if(slot < 0)
+		return;
+	
+	heap_st->checked_pid[slot] = 0;
+	memset(&(heap_st->calls[slot]), 0, sizeof(heap_st->calls[slot]));
+	
+	//Whatever the process still had allocated is leaked, summed up by where it came from
+	std::unordered_map<uint32_t, heap_leak_t> leaks;
+	uint64_t nblocks = 0;
+	uint64_t nbytes = 0;
+	for(std::unordered_map<uint64_t, heap_block_t>::iterator bb = heap_st->blocks.begin(); bb != heap_st->blocks.end(); )
+	{
+		if((int)(bb->first >> 32) != pid)
+		{
+			++bb;
+			continue;
+		}
+		
+		heap_site_t *sptr = &(heap_st->sites[bb->second.site]);
+		sptr->live_blocks--;
+		sptr->live_bytes -= bb->second.size;
+		sptr->leaked_blocks++;
+		sptr->leaked_bytes += bb->second.size;
+		
+		heap_leak_t *lptr = &(leaks[bb->second.site]);
+		lptr->site = bb->second.site;
+		lptr->blocks++;
+		lptr->bytes += bb->second.size;
+		
+		nblocks++;
+		nbytes += bb->second.size;
+		bb = heap_st->blocks.erase(bb);
+	}
+	
+	if(nblocks == 0)
+		return;
+	
+	heap_st->stats.live_blocks -= nblocks;
+	heap_st->stats.live_bytes -= nbytes;
+	heap_st->stats.leaked_blocks += nblocks;
+	heap_st->stats.leaked_bytes += nbytes;
+	
+	std::vector<heap_leak_t> sorted;
+	for(const std::pair<const uint32_t, heap_leak_t> &ll : leaks)
+	{
+		sorted.push_back(ll.second);
+	}
+	std::sort(sorted.begin(), sorted.end(), [](const heap_leak_t &a, const heap_leak_t &b) { return a.bytes > b.bytes; });
+	
+	TINFO("Process %d left %llu blocks (%llu bytes) allocated\n", pid, (unsigned long long)nblocks, (unsigned long long)nbytes);
+	for(size_t ll = 0; ll < sorted.size() && ll < 5; ll++)
+	{
+		char name[128];
+		heap_sitename(sorted[ll].site, name, sizeof(name));
+		TINFO("  %llu blocks (%llu bytes) from %s\n", (unsigned long long)sorted[ll].blocks,
+			(unsigned long long)sorted[ll].bytes, name);
+	}
+}
+
+void heap_getstats(heap_stats_t *out)
+{
+	*out = heap_st->stats;
+}
+
+int heap_history(heap_frame_t *out, int max)
+{
+	int ncopy = (heap_st->count < max) ? heap_st->count : max;
+	for(int ff = 0; ff < ncopy; ff++)
+	{
+		out[ff] = heap_st->ring[(heap_st->head + HEAP_HISTORY - ncopy + ff) % HEAP_HISTORY];
+	}
+	return ncopy;
+}
+
+//Writes one table of call sites, for those where the given count is nonzero, sorted by it
+static void heap_sitetable(FILE *fp, const char *title, uint64_t heap_site_t::*sortby)
+{
+	std::vector<std::pair<uint32_t, const heap_site_t*>> sorted;
+	for(const std::pair<const uint32_t, heap_site_t> &ss : heap_st->sites)
+	{
+		if(ss.second.*sortby != 0)
+			sorted.push_back(std::make_pair(ss.first, &(ss.second)));
+	}
+	std::sort(sorted.begin(), sorted.end(), [sortby](const std::pair<uint32_t, const heap_site_t*> &a,
+		const std::pair<uint32_t, const heap_site_t*> &b) { return a.second->*sortby > b.second->*sortby; });
+	
+	fprintf(fp, "\n%s\n", title);
+	fprintf(fp, "%-8s %10s %12s %8s %12s %12s %8s %8s %12s  %s\n", "function", "calls", "bytes", "frames",
+		"live blocks", "live bytes", "peak", "leaked", "leak bytes", "site");
+	for(const std::pair<uint32_t, const heap_site_t*> &ss : sorted)
+	{
+		const heap_site_t *sptr = ss.second;
+		char name[128];
+		heap_sitename(ss.first, name, sizeof(name));
+		fprintf(fp, "%-8s %10llu %12llu %8u %12llu %12llu %8llu %8llu %12llu  %s\n", heap_names[sptr->fn],
+			(unsigned long long)sptr->calls, (unsigned long long)sptr->bytes, sptr->frames,
+			(unsigned long long)sptr->live_blocks, (unsigned long long)sptr->live_bytes,
+			(unsigned long long)sptr->peak_bytes, (unsigned long long)sptr->leaked_blocks,
+			(unsigned long long)sptr->leaked_bytes, name);
+	}
+}
+
+bool heap_savereport(const char *path)
+{
+	FILE *fp = fopen(path, "w");
+	if(fp == NULL)
+	{
+		TERROR("Failed to open %s for heap report: %s\n", path, strerror(errno));
+		return false;
+	}
+	
+	const heap_stats_t *stats = &(heap_st->stats);
+	fprintf(fp, "Heap report\n");
+	for(int ff = 0; ff < HEAP_FN_MAX; ff++)
+	{
+		fprintf(fp, "%-22s %llu\n", heap_names[ff], (unsigned long long)stats->calls[ff]);
+	}
+	fprintf(fp, "%-22s %llu\n", "Failed allocations", (unsigned long long)stats->failed);
+	fprintf(fp, "%-22s %llu\n", "Unknown frees", (unsigned long long)stats->unknown_frees);
+	fprintf(fp, "%-22s %llu blocks, %llu bytes\n", "Allocated now", (unsigned long long)stats->live_blocks,
+		(unsigned long long)stats->live_bytes);
+	fprintf(fp, "%-22s %llu bytes at frame %u\n", "Peak", (unsigned long long)stats->peak_bytes, stats->peak_frame);
+	fprintf(fp, "%-22s %llu blocks, %llu bytes\n", "Leaked at exit", (unsigned long long)stats->leaked_blocks,
+		(unsigned long long)stats->leaked_bytes);
+	fprintf(fp, "%-22s %u of %u (most %u in one frame)\n", "Frames allocating", stats->alloc_frames, stats->frames,
+		stats->max_frame_allocs);
+	
+	heap_sitetable(fp, "Call sites by bytes allocated", &heap_site_t::bytes);
+	heap_sitetable(fp, "Call sites by blocks leaked at exit", &heap_site_t::leaked_blocks);
+	heap_sitetable(fp, "Call sites by bytes allocated now", &heap_site_t::live_bytes);
+	
+	fprintf(fp, "\nFrames\n");
+	fprintf(fp, "%8s %8s %8s %12s %12s %12s\n", "frame", "allocs", "frees", "bytes", "live bytes", "peak");
+	for(int ff = heap_st->count; ff > 0; ff--)
+	{
+		const heap_frame_t *fptr = &(heap_st->ring[(heap_st->head + HEAP_HISTORY - ff) % HEAP_HISTORY]);
+		fprintf(fp, "%8u %8u %8u %12llu %12llu %12llu\n", fptr->frame, fptr->allocs, fptr->frees,
+			(unsigned long long)fptr->bytes, (unsigned long long)fptr->live_bytes, (unsigned long long)fptr->peak_bytes);
+	}
+	
+	bool ok = !ferror(fp);
+	if(fclose(fp) != 0)
+		ok = false;
+	
+	if(!ok)
+		TERROR("Failed to write heap report to %s\n", path);
+	
+	return ok;
+}
@@ -0,0 +1,110 @@
+//heap.h
+//Tracking of the heap allocations made by games in the Neki32 simulator
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#ifndef _HEAP_H
+#define _HEAP_H
+
+#include <stdint.h>
+#include "prefs.h"
+#include "process.h"
+
+//C library functions that are watched
+typedef enum heap_fn_e
+{
+	HEAP_FN_MALLOC = 0,
+	HEAP_FN_CALLOC,
+	HEAP_FN_REALLOC,
+	HEAP_FN_MEMALIGN,
+	HEAP_FN_FREE,
+	HEAP_FN_MAX
+} heap_fn_t;
+
+//Counts of allocations since the last reset
+typedef struct heap_stats_s
+{
+	uint64_t calls[HEAP_FN_MAX]; //Calls made, by function
+	uint64_t failed; //Allocations that returned NULL
+	uint64_t unknown_frees; //Frees of blocks we didn't see allocated
+	uint64_t live_blocks; //Blocks allocated now
+	uint64_t live_bytes;
+	uint64_t peak_bytes; //Most bytes allocated at once
+	uint32_t peak_frame; //Frame when that happened
+	uint64_t leaked_blocks; //Blocks still allocated when their process exited
+	uint64_t leaked_bytes;
+	uint32_t frames; //Frames flipped while tracking
+	uint32_t alloc_frames; //Frames that allocated anything
+	uint32_t max_frame_allocs; //Most allocations in one frame
+} heap_stats_t;
+
+//What one frame did to the heap
+typedef struct heap_frame_s
+{
+	uint32_t frame; //Frames flipped before this one
+	uint32_t allocs; //Blocks allocated
+	uint32_t frees; //Blocks freed
+	uint64_t bytes; //Bytes allocated
+	uint64_t live_bytes; //Bytes allocated at the end of the frame
+	uint64_t peak_bytes; //Most bytes allocated at once, so far
+} heap_frame_t;
+
+//Number of frames kept
+#define HEAP_HISTORY 3600
+
+//Allocations tracked in one emulated console
+typedef struct heap_ctx_s heap_ctx_t;
+
+//Makes or frees the state for a console
+heap_ctx_t *heap_ctx_new(void);
+void heap_ctx_delete(heap_ctx_t *st);
+
+//Selects the state used by later calls on this thread, or NULL for the one used when there's no console
+void heap_select(heap_ctx_t *st);
+
+//Learns where malloc and friends are from the symbol table of the game's ELF, replacing anything learned before.
+//Returns false if the file can't be read or has none of them.
+bool heap_loadelf(const char *path);
+
+//Forgets the functions learned
+void heap_clear(void);
+
+//Turns tracking on or off
+void heap_setenabled(bool enabled);
+
+//Applies the preferences - tracking is on if asked, with the symbols of the ELF given for native routines
+void heap_init(const prefs_t *prefs);
+
+//Forgets all allocations and counts, for a new run of the simulation
+void heap_reset(void);
+
+//Gets ready to run the given process. Returns false if nothing it does needs watching.
+bool heap_switch(const process_t *pptr);
+
+//Watches the process about to run its next instruction, for calls to and returns from the heap functions
+void heap_observe(const process_t *pptr);
+
+//Notes that a frame was flipped, ending the current frame's counts. Frames are counted for the whole console.
+void heap_flip(void);
+
+//Notes that a process exited or replaced its image, counting what it left allocated as leaked
+void heap_exit(int pid);
+
+//Returns the counts since the last reset
+void heap_getstats(heap_stats_t *out);
+
+//Copies out the most recent frames, oldest first. Returns the number copied.
+int heap_history(heap_frame_t *out, int max);
+
+//Writes a report of allocations by call site, leaks, and allocations each frame. Returns false on failure.
+bool heap_savereport(const char *path);
+
+//Returns the name of a heap function
+const char *heap_fnname(heap_fn_t fn);
+
+#endif //_HEAP_H
@@ -0,0 +1,362 @@
+//hle.cpp
+//Native implementations of hot C library routines for the Neki32 simulator
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#define FILE_TRACE_CAT TRACE_CAT_PROCESS
+#include "trace.h"
+
+#include "hle.h"
+#include "interp.h"
+#include "elfsym.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <new>
+
+//Games spend a lot of their time in memcpy and friends, which the interpreter runs a byte or word at a time.
+//Given the game's ELF, we learn where those routines are and what their code looks like. When a process calls
+//into code that matches, we do the work on host memory and return to the caller, charging the process about
+//as many instructions as the routine would have taken.
+
+//Code of a routine learned from an ELF
+typedef struct hle_routine_s
+{
+	hle_kind_t kind;
+	elfsym_func_t func;
+} hle_routine_t;
+
+//Routine entries found in process images, hashed by address with linear probing.
+//Entries aren't tied to a process - the code at the entry is checked on each call.
+#define HLE_ENTRY_HASH 256
+#define HLE_ENTRY_MAX (HLE_ENTRY_HASH / 2)
+typedef struct hle_entry_s
+{
+	uint32_t addr; //0 if this slot is empty
+	int routine;
+} hle_entry_t;
+
+//Library routines known to one emulated console
+struct hle_ctx_s
+{
+	bool enabled = true;
+	
+	//Routines learned from the ELF, and a count that changes whenever they do
+	hle_routine_t routines[HLE_KIND_MAX];
+	int nroutines = 0;
+	uint32_t generation = 1;
+	
+	//Where routines have been found
+	hle_entry_t entries[HLE_ENTRY_HASH];
+	int nentries = 0;
+	
+	//Process and generation of routines each process table entry was last searched for
+	int searched_pid[PROCESS_MAX];
+	uint32_t searched_gen[PROCESS_MAX];
+	
+	//Routine found by the last hle_find
+	int found;
+	
+	hle_stats_t stats;
+};
+
+//State used when no console is selected, and the one selected on this thread
+static hle_ctx_t hle_default;
+static thread_local hle_ctx_t *hle_st = &hle_default;
+
+//Symbols of each kind of routine
+static const char *const hle_names[HLE_KIND_MAX] = { "memcpy", "memmove", "memset", "strlen" };
+
+hle_ctx_t *hle_ctx_new(void)
+{
+	return new(std::nothrow) hle_ctx_t();
+}
+
+void hle_ctx_delete(hle_ctx_t *st)
+{
+	delete st;
+}
+
+void hle_select(hle_ctx_t *st)
+{
+	hle_st = (st != NULL) ? st : &hle_default;
+}
+
+const char *hle_kindname(hle_kind_t kind)
+{
+	return (kind >= 0 && kind < HLE_KIND_MAX) ? hle_names[kind] : "unknown";
+}
+
+//Forgets where routines were found, so processes are searched again
+static void hle_forget(void)
+{
+	memset(hle_st->entries, 0, sizeof(hle_st->entries));
+	hle_st->nentries = 0;
+	memset(hle_st->searched_pid, 0, sizeof(hle_st->searched_pid));
+	hle_st->generation++;
+}
+
+void hle_clear(void)
+{
+	hle_st->nroutines = 0;
+	hle_forget();
+}
+
+void hle_setenabled(bool enabled)
+{
+	hle_st->enabled = enabled;
+}
+
+void hle_reset(void)
+{
+	hle_forget();
+	memset(&(hle_st->stats), 0, sizeof(hle_st->stats));
+}
+
+void hle_newimage(int pid)
+{
+	for(int pp = 0; pp < PROCESS_MAX; pp++)
+	{
+		if(hle_st->searched_pid[pp] == pid)
+			hle_st->searched_pid[pp] = 0;
+	}
+}
+
+bool hle_loadelf(const char *path)
+{
+	hle_clear();
+	
+	elfsym_func_t funcs[HLE_KIND_MAX];
+	int nfound = elfsym_funcs(path, hle_names, HLE_KIND_MAX, funcs);
+	if(nfound < 0)
+		return false;
+	
+	for(int kk = 0; kk < HLE_KIND_MAX; kk++)
+	{
+		if(funcs[kk].size == 0)
+			continue;
+		
+		TINFO("Running %s at %8.8X natively\n", hle_names[kk], funcs[kk].addr);
+		hle_routine_t *rptr = &(hle_st->routines[hle_st->nroutines]);
+		rptr->kind = (hle_kind_t)kk;
+		rptr->func = funcs[kk];
+		hle_st->nroutines++;
+	}
+	
+	if(nfound == 0)
+	{
+		TWARNING("No library routines to run natively in %s\n", path);
+		return false;
+	}
+	
+	return true;
+}
+
+void hle_init(const prefs_t *prefs)
+{
+	hle_setenabled(prefs->hle_enabled);
+	if(prefs->hle_elf_path[0] != '\0')
+		hle_loadelf(prefs->hle_elf_path);
+	else
+		hle_clear();
+}
+
+//Checks if the given routine's code is at the given address in a process
+static bool hle_matches(const process_t *pptr, const hle_routine_t *rptr, uint32_t addr)
+{
+	return elfsym_matches(pptr->mem, pptr->size, &(rptr->func), addr);
+}
+
+//Returns where an entry would go in the hash table, or the slot already holding it
+static int hle_entry_slot(uint32_t addr)
+{
+	int ss = (addr / 4) % HLE_ENTRY_HASH;
+	while(hle_st->entries[ss].addr != 0 && hle_st->entries[ss].addr != addr)
+	{
+		ss = (ss + 1) % HLE_ENTRY_HASH;
+	}
+	return ss;
+}
+
+//Searches a process image for the code of each routine
+static void hle_search(const process_t *pptr)
+{
+	uint32_t nwords = pptr->size / 4;
+	for(int rr = 0; rr < hle_st->nroutines; rr++)
+	{
+		const hle_routine_t *rptr = &(hle_st->routines[rr]);
+		for(uint32_t ww = 0x1000 / 4; ww + rptr->func.ncode <= nwords; ww++)
+		{
+			if(pptr->mem[ww] != rptr->func.code[0] || !hle_matches(pptr, rptr, ww * 4))
+				continue;
+			
+			int ss = hle_entry_slot(ww * 4);
+			if(hle_st->entries[ss].addr != 0)
+				continue; //Already known
+			
+			if(hle_st->nentries >= HLE_ENTRY_MAX)
+			{
+				TWARNING("Too many copies of library routines to run natively, ignoring %s at %8.8X\n",
+					hle_names[rptr->kind], ww * 4);
+				return;
+			}
+			
+			TDEBUG("Found %s at %8.8X in process %d\n", hle_names[rptr->kind], ww * 4, pptr->pid);
+			hle_st->entries[ss].addr = ww * 4;
+			hle_st->entries[ss].routine = rr;
+			hle_st->nentries++;
+		}
+	}
+}
+
+bool hle_switch(const process_t *pptr)
+{
+	if(!hle_st->enabled || hle_st->nroutines == 0)
+		return false;
+	
+	//Look through each process image once, and again whenever it's replaced or we learn new routines
+	int idx = pptr - process_table;
+	if(idx >= 0 && idx < PROCESS_MAX &&
+		(hle_st->searched_pid[idx] != pptr->pid || hle_st->searched_gen[idx] != hle_st->generation))
+	{
+		hle_search(pptr);
+		hle_st->searched_pid[idx] = pptr->pid;
+		hle_st->searched_gen[idx] = hle_st->generation;
+	}
+	
+	return hle_st->nentries > 0;
+}
+
+bool hle_find(const process_t *pptr, uint32_t *start_out, uint32_t *end_out)
+{
+	uint32_t pc = pptr->regs[15];
+	const hle_entry_t *eptr = &(hle_st->entries[hle_entry_slot(pc)]);
+	if(eptr->addr == 0)
+		return false;
+	
+	//Make sure this process really has the routine there
+	const hle_routine_t *rptr = &(hle_st->routines[eptr->routine]);
+	if(!hle_matches(pptr, rptr, pc))
+		return false;
+	
+	hle_st->found = eptr->routine;
+	*start_out = pc;
+	*end_out = pc + rptr->func.size;
+	return true;
+}
+
+//Checks that a range of memory is in bounds for a process and not watched by the debugger
+static bool hle_range_ok(const process_t *pptr, uint32_t addr, uint32_t len, int kind)
+{
+	if(len == 0)
+		return true;
+	
+	if(addr < 0x1000 || (uint64_t)addr + len > pptr->size)
+		return false;
+	
+	return !interp_watch_find(pptr->pid, addr, len, kind);
+}
+
+uint32_t hle_run(process_t *pptr, uint32_t limit)
+{
+	const hle_routine_t *rptr = &(hle_st->routines[hle_st->found]);
+	uint32_t *regs = pptr->regs;
+	uint8_t *bytes = (uint8_t*)(pptr->mem);
+	
+	//Returning to Thumb code isn't something the interpreter can do either
+	if(regs[14] & 3)
+	{
+		hle_st->stats.declined++;
+		return 0;
+	}
+	
+	//Estimate how long the routine would have run, from the work it does
+	uint32_t len = 0;
+	uint64_t instrs = 0;
+	switch(rptr->kind)
+	{
+		case HLE_KIND_MEMCPY:
+		case HLE_KIND_MEMMOVE:
+		{
+			len = regs[2];
+			if(!hle_range_ok(pptr, regs[1], len, INTERP_WATCH_READ) || !hle_range_ok(pptr, regs[0], len, INTERP_WATCH_WRITE))
+			{
+				hle_st->stats.declined++;
+				return 0;
+			}
+			
+			//Same alignment copies words four at a time, otherwise bytes go one by one
+			memmove(bytes + regs[0], bytes + regs[1], len);
+			bool aligned = ((regs[0] ^ regs[1]) & 3) == 0;
+			instrs = 16 + (aligned ? (len * 3ull / 4) : (len * 4ull));
+			break;
+		}
+		case HLE_KIND_MEMSET:
+		{
+			len = regs[2];
+			if(!hle_range_ok(pptr, regs[0], len, INTERP_WATCH_WRITE))
+			{
+				hle_st->stats.declined++;
+				return 0;
+			}
+			
+			memset(bytes + regs[0], regs[1] & 0xFF, len);
+			instrs = 16 + (len / 2);
+			break;
+		}
+		case HLE_KIND_STRLEN:
+		{
+			//Let the interpreter fault on an unterminated string
+			uint32_t str = regs[0];
+			const uint8_t *nul = NULL;
+			if(str >= 0x1000 && str < pptr->size)
+				nul = (const uint8_t*)memchr(bytes + str, 0, pptr->size - str);
+			
+			if(nul == NULL)
+			{
+				hle_st->stats.declined++;
+				return 0;
+			}
+			
+			len = nul - (bytes + str);
+			if(!hle_range_ok(pptr, str, len + 1, INTERP_WATCH_READ))
+			{
+				hle_st->stats.declined++;
+				return 0;
+			}
+			
+			regs[0] = len;
+			instrs = 12 + (len * 3ull / 2);
+			break;
+		}
+		default:
+		{
+			return 0;
+		}
+	}
+	
+	//Everything but strlen returns the destination, which is already in r0
+	regs[15] = regs[14];
+	hle_st->stats.calls[rptr->kind]++;
+	hle_st->stats.bytes[rptr->kind] += len;
+	
+	if(instrs < 1)
+		instrs = 1;
+	if(instrs > limit)
+		instrs = limit;
+	
+	return instrs;
+}
+
+void hle_getstats(hle_stats_t *out)
+{
+	*out = hle_st->stats;
+}
@@ -0,0 +1,83 @@
+//hle.h
+//Native implementations of hot C library routines for the Neki32 simulator
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#ifndef _HLE_H
+#define _HLE_H
+
+#include <stdint.h>
+#include "prefs.h"
+#include "process.h"
+
+//Routines that can be run natively
+typedef enum hle_kind_e
+{
+	HLE_KIND_MEMCPY = 0,
+	HLE_KIND_MEMMOVE,
+	HLE_KIND_MEMSET,
+	HLE_KIND_STRLEN,
+	HLE_KIND_MAX
+} hle_kind_t;
+
+//Counts of routines run natively, by kind
+typedef struct hle_stats_s
+{
+	uint64_t calls[HLE_KIND_MAX]; //Calls run natively
+	uint64_t bytes[HLE_KIND_MAX]; //Bytes copied, set or scanned by them
+	uint64_t declined; //Calls interpreted instead, because of bad arguments or the debugger
+} hle_stats_t;
+
+//Library routines known to one emulated console
+typedef struct hle_ctx_s hle_ctx_t;
+
+//Makes or frees the state for a console
+hle_ctx_t *hle_ctx_new(void);
+void hle_ctx_delete(hle_ctx_t *st);
+
+//Selects the state used by later calls on this thread, or NULL for the one used when there's no console
+void hle_select(hle_ctx_t *st);
+
+//Learns the library routines in the given ELF from its symbol table, replacing any learned before.
+//Their code is then looked for in each process, so it's found even if linked elsewhere.
+//Returns false if the file can't be read or has none of the routines.
+bool hle_loadelf(const char *path);
+
+//Forgets all library routines
+void hle_clear(void);
+
+//Turns native routines on or off, without forgetting what's been learned
+void hle_setenabled(bool enabled);
+
+//Applies the preferences - loads the ELF given there, if any
+void hle_init(const prefs_t *prefs);
+
+//Forgets where routines were found in each process, and the counts, for a new run of the simulation
+void hle_reset(void);
+
+//Notes that a process has a new image, so it's searched again
+void hle_newimage(int pid);
+
+//Gets ready to run the given process. Returns false if no routine can be run natively in it.
+bool hle_switch(const process_t *pptr);
+
+//Checks if the process is at the entry of a known routine, and if so, gives the extent of its code
+bool hle_find(const process_t *pptr, uint32_t *start_out, uint32_t *end_out);
+
+//Runs the routine found by hle_find natively and returns to the caller.
+//Returns the instructions the routine would have taken to interpret, but no more than the given limit,
+//or 0 if it must be interpreted instead - then the interpreter finds any fault at the right instruction.
+uint32_t hle_run(process_t *pptr, uint32_t limit);
+
+//Returns the counts since the last reset
+void hle_getstats(hle_stats_t *out);
+
+//Returns the name of a kind of routine
+const char *hle_kindname(hle_kind_t kind);
+
+#endif //_HLE_H
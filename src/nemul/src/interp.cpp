@@ -13,6 +13,11 @@
 
 #include "interp.h"
 
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
 //ARM flag register contents
 #define FLAG_V (1u << 28)
 #define FLAG_C (1u << 29)
@@ -21,6 +26,353 @@
 #define FLAG_Q (1u << 27)
 #define FLAG_GE(n) (1u << (16 + n))
 
+//Watchpoint set by the debugger
+typedef struct interp_watch_s
+{
+	int pid; //Process watched, or <= 0 for all
+	uint32_t addr; //First byte watched
+	uint32_t len; //Number of bytes watched
+	int kind; //INTERP_WATCH_* bits
+} interp_watch_t;
+
+//State of the interpreter for one emulated console
+struct interp_ctx_s
+{
+	//Watchpoints set by the debugger
+	interp_watch_t watch_table[INTERP_WATCH_MAX];
+	int watch_count;
+	
+	//Watchpoints that apply to the process being run, and the range of addresses they cover.
+	//Loads and stores only look at these if the count is nonzero and they fall in the range.
+	const interp_watch_t *watch_active[INTERP_WATCH_MAX];
+	int watch_nactive;
+	uint32_t watch_lo;
+	uint32_t watch_hi;
+	int watch_pid;
+	
+	//Whether the current instruction touched a watched address, and what it was
+	bool watch_pending;
+	uint32_t watch_hit_addr;
+	int watch_hit_kind;
+	
+	//Totals for performance statistics
+	interp_counts_t count;
+	
+	//Function told about stores before they happen, if any
+	interp_storehook_t storehook;
+	
+	//Function told about each access to memory, if any
+	interp_accesshook_t accesshook;
+	
+	//Whether to count instruction pairs, the last instruction and its kind, and the counts
+	bool pairs_on;
+	uint32_t pairs_lastpc;
+	interp_class_t pairs_last;
+	uint64_t pairs[INTERP_CLASS_MAX][INTERP_CLASS_MAX];
+};
+
+//State used when no console is selected, and the one selected on this thread
+static interp_ctx_t interp_default;
+static thread_local interp_ctx_t *interp_st = &interp_default;
+
+interp_ctx_t *interp_ctx_new(void)
+{
+	return (interp_ctx_t*)calloc(1, sizeof(interp_ctx_t));
+}
+
+void interp_ctx_delete(interp_ctx_t *st)
+{
+	free(st);
+}
+
+void interp_select(interp_ctx_t *st)
+{
+	interp_st = (st != NULL) ? st : &interp_default;
+}
+
+//Rebuilds the list of watchpoints checked for the selected process
+static void interp_watch_rebuild(void)
+{
+	interp_st->watch_nactive = 0;
+	interp_st->watch_lo = 0xFFFFFFFFu;
+	interp_st->watch_hi = 0;
+	for(int ww = 0; ww < interp_st->watch_count; ww++)
+	{
+		const interp_watch_t *wptr = &(interp_st->watch_table[ww]);
+		if(wptr->pid > 0 && wptr->pid != interp_st->watch_pid)
+			continue;
+		
+		interp_st->watch_active[interp_st->watch_nactive] = wptr;
+		interp_st->watch_nactive++;
+		
+		if(wptr->addr < interp_st->watch_lo)
+			interp_st->watch_lo = wptr->addr;
+		if(wptr->addr + wptr->len > interp_st->watch_hi)
+			interp_st->watch_hi = wptr->addr + wptr->len;
+	}
+}
+
+bool interp_watch_add(int pid, uint32_t addr, uint32_t len, int kind)
+{
+	if(interp_st->watch_count >= INTERP_WATCH_MAX || len == 0 || addr + len < addr)
+		return false;
+	
+	interp_watch_t *wptr = &(interp_st->watch_table[interp_st->watch_count]);
+	wptr->pid = pid;
+	wptr->addr = addr;
+	wptr->len = len;
+	wptr->kind = kind;
+	interp_st->watch_count++;
+	
+	interp_watch_rebuild();
+	return true;
+}
+
+bool interp_watch_remove(int pid, uint32_t addr, uint32_t len, int kind)
+{
+	for(int ww = 0; ww < interp_st->watch_count; ww++)
+	{
+		const interp_watch_t *wptr = &(interp_st->watch_table[ww]);
+		if(wptr->pid != pid || wptr->addr != addr || wptr->len != len || wptr->kind != kind)
+			continue;
+		
+		//Keep the table packed by moving the last entry into the hole
+		interp_st->watch_count--;
+		interp_st->watch_table[ww] = interp_st->watch_table[interp_st->watch_count];
+		interp_watch_rebuild();
+		return true;
+	}
+	return false;
+}
+
+void interp_watch_clear(void)
+{
+	interp_st->watch_count = 0;
+	interp_st->watch_pending = false;
+	interp_watch_rebuild();
+}
+
+void interp_watch_select(int pid)
+{
+	if(pid == interp_st->watch_pid)
+		return;
+	
+	interp_st->watch_pid = pid;
+	if(interp_st->watch_count > 0)
+		interp_watch_rebuild();
+}
+
+void interp_watch_hit(uint32_t *addr_out, int *kind_out)
+{
+	*addr_out = interp_st->watch_hit_addr;
+	*kind_out = interp_st->watch_hit_kind;
+}
+
+bool interp_watch_find(int pid, uint32_t addr, uint32_t len, int kind)
+{
+	for(int ww = 0; ww < interp_st->watch_count; ww++)
+	{
+		const interp_watch_t *wptr = &(interp_st->watch_table[ww]);
+		if(wptr->pid > 0 && wptr->pid != pid)
+			continue;
+		if(!(wptr->kind & kind))
+			continue;
+		if(addr + len <= wptr->addr || addr >= wptr->addr + wptr->len)
+			continue;
+		
+		interp_st->watch_hit_addr = (addr > wptr->addr) ? addr : wptr->addr;
+		interp_st->watch_hit_kind = wptr->kind;
+		return true;
+	}
+	return false;
+}
+
+//Looks for watchpoints covering the given access, once it's passed the range filter
+static void interp_watch_scan(uint32_t addr, uint32_t len, int kind)
+{
+	for(int ww = 0; ww < interp_st->watch_nactive; ww++)
+	{
+		const interp_watch_t *wptr = interp_st->watch_active[ww];
+		if(!(wptr->kind & kind))
+			continue;
+		if(addr + len <= wptr->addr || addr >= wptr->addr + wptr->len)
+			continue;
+		
+		//Report the first hit in each instruction, at an address inside the watched range
+		if(!interp_st->watch_pending)
+		{
+			interp_st->watch_pending = true;
+			interp_st->watch_hit_addr = (addr > wptr->addr) ? addr : wptr->addr;
+			interp_st->watch_hit_kind = wptr->kind;
+		}
+		return;
+	}
+}
+
+//Checks a memory access against the watchpoints of the running process
+static inline void interp_watch_check(uint32_t addr, uint32_t len, int kind)
+{
+	if(interp_st->watch_nactive == 0)
+		return; //Nothing watched, the usual case
+	
+	if(addr + len <= interp_st->watch_lo || addr >= interp_st->watch_hi)
+		return; //Outside everything watched
+	
+	interp_watch_scan(addr, len, kind);
+}
+
+void interp_counts(interp_counts_t *out)
+{
+	*out = interp_st->count;
+}
+
+void interp_setstorehook(interp_storehook_t hook)
+{
+	interp_st->storehook = hook;
+}
+
+void interp_setaccesshook(interp_accesshook_t hook)
+{
+	interp_st->accesshook = hook;
+}
+
+interp_class_t interp_classify(uint32_t ir)
+{
+	if(ir == 0xE7F009F2)
+		return INTERP_CLASS_SYSCALL;
+	if((ir & 0x0FFFFFF0) == 0x012FFF10)
+		return INTERP_CLASS_BX;
+	
+	switch((ir >> 25) & 0x7)
+	{
+		case 0x5:
+			if(ir & (1u << 24))
+				return INTERP_CLASS_BL;
+			return ((ir >> 28) == 0xE) ? INTERP_CLASS_B : INTERP_CLASS_BCC;
+		case 0x4:
+			return (ir & (1u << 20)) ? INTERP_CLASS_LDM : INTERP_CLASS_STM;
+		case 0x3:
+			if(ir & (1u << 4))
+				return INTERP_CLASS_OTHER; //Media instructions
+			return (ir & (1u << 20)) ? INTERP_CLASS_LDR : INTERP_CLASS_STR;
+		case 0x2:
+			return (ir & (1u << 20)) ? INTERP_CLASS_LDR : INTERP_CLASS_STR;
+		case 0x0:
+			if((ir & 0x90) == 0x90)
+				return (ir & 0x60) ? INTERP_CLASS_LDRH : INTERP_CLASS_MUL;
+			break;
+		case 0x1:
+			break;
+		default:
+			return INTERP_CLASS_OTHER;
+	}
+	
+	//Data processing, apart from the miscellaneous instructions where the compares would be without S
+	int opcode = (ir >> 21) & 0xF;
+	bool s = ir & (1u << 20);
+	if(opcode >= 8 && opcode <= 11)
+		return s ? INTERP_CLASS_CMP : INTERP_CLASS_OTHER;
+	if(s)
+		return INTERP_CLASS_ALUS;
+	if(opcode == 13 || opcode == 15)
+		return INTERP_CLASS_MOV;
+	
+	return INTERP_CLASS_ALU;
+}
+
+const char *interp_classname(interp_class_t cls)
+{
+	static const char *names[INTERP_CLASS_MAX] =
+	{
+		"other", "cmp", "alus", "mov", "alu", "mul", "ldr", "str",
+		"ldrh", "ldm", "stm", "b", "bcc", "bl", "bx", "syscall"
+	};
+	return (cls >= 0 && cls < INTERP_CLASS_MAX) ? names[cls] : "unknown";
+}
+
+void interp_pairs_enable(bool enable)
+{
+	interp_st->pairs_on = enable;
+	interp_st->pairs_lastpc = 0;
+}
+
+//Counts an instruction about to run against the one before it, if it followed on from there
+static void interp_pairs_count(uint32_t pc, uint32_t ir)
+{
+	interp_class_t cls = interp_classify(ir);
+	if(pc == interp_st->pairs_lastpc + 4)
+		interp_st->pairs[interp_st->pairs_last][cls]++;
+	
+	interp_st->pairs_lastpc = pc;
+	interp_st->pairs_last = cls;
+}
+
+bool interp_pairs_save(const char *path)
+{
+	FILE *fp = fopen(path, "w");
+	if(fp == NULL)
+	{
+		TERROR("Failed to open %s for instruction pairs: %s\n", path, strerror(errno));
+		return false;
+	}
+	
+	uint64_t total = 0;
+	for(int ff = 0; ff < INTERP_CLASS_MAX; ff++)
+	{
+		for(int ss = 0; ss < INTERP_CLASS_MAX; ss++)
+		{
+			total += interp_st->pairs[ff][ss];
+		}
+	}
+	
+	//Picking out the biggest each time is slow, but there's only a couple of hundred
+	bool listed[INTERP_CLASS_MAX][INTERP_CLASS_MAX];
+	memset(listed, 0, sizeof(listed));
+	fprintf(fp, "first,second,count,percent\n");
+	while(1)
+	{
+		int bestf = -1;
+		int bests = -1;
+		for(int ff = 0; ff < INTERP_CLASS_MAX; ff++)
+		{
+			for(int ss = 0; ss < INTERP_CLASS_MAX; ss++)
+			{
+				if(listed[ff][ss] || interp_st->pairs[ff][ss] == 0)
+					continue;
+				if(bestf < 0 || interp_st->pairs[ff][ss] > interp_st->pairs[bestf][bests])
+				{
+					bestf = ff;
+					bests = ss;
+				}
+			}
+		}
+		
+		if(bestf < 0)
+			break;
+		
+		listed[bestf][bests] = true;
+		uint64_t count = interp_st->pairs[bestf][bests];
+		fprintf(fp, "%s,%s,%llu,%.3f\n", interp_classname((interp_class_t)bestf), interp_classname((interp_class_t)bests),
+			(unsigned long long)count, total ? (count * 100.0 / total) : 0.0);
+	}
+	
+	bool ok = !ferror(fp);
+	if(fclose(fp) != 0)
+		ok = false;
+	
+	if(!ok)
+		TERROR("Failed to write instruction pairs to %s\n", path);
+	
+	return ok;
+}
+
+//Tells the access hook about an access, if there is one
+static inline void interp_access(int kind, uint32_t addr, uint32_t len)
+{
+	if(interp_st->accesshook != NULL)
+		interp_st->accesshook(kind, addr, len);
+}
+
 static interp_result_t interp_store_d(uint32_t *mem, uint32_t memsz, uint32_t addr, uint64_t data)
 {
 	if(addr & 7)
@@ -29,12 +381,22 @@ static interp_result_t interp_store_d(uint32_t *mem, uint32_t memsz, uint32_t ad
 		return INTERP_RESULT_AC;
 	}
 	
-	if(addr + 8 > memsz || addr < 0x1000)
+	if((uint64_t)addr + 8 > memsz || addr < 0x1000)
 	{
 		TWARNING("Out-of-bounds doubleword store to %8.8X\n", addr);
 		return INTERP_RESULT_ABT;
 	}
 	
+	interp_watch_check(addr, 8, INTERP_WATCH_WRITE);
+	interp_access(INTERP_ACCESS_STORE, addr, 8);
+	interp_st->count.stores++;
+	
+	if(interp_st->storehook != NULL)
+	{
+		interp_st->storehook(addr + 0, mem[ (addr/4) + 0 ]);
+		interp_st->storehook(addr + 4, mem[ (addr/4) + 1 ]);
+	}
+	
 	mem[ (addr/4) + 0 ] = data >>  0;
 	mem[ (addr/4) + 1 ] = data >> 32;
 	return INTERP_RESULT_OK;
@@ -48,30 +410,44 @@ static interp_result_t interp_store_w(uint32_t *mem, uint32_t memsz, uint32_t ad
 		return INTERP_RESULT_AC;
 	}
 	
-	if(addr + 4 > memsz || addr < 0x1000)
+	if((uint64_t)addr + 4 > memsz || addr < 0x1000)
 	{
 		TWARNING("Out-of-bounds word store to %8.8X\n", addr);
 		return INTERP_RESULT_ABT;
 	}
 	
+	interp_watch_check(addr, 4, INTERP_WATCH_WRITE);
+	interp_access(INTERP_ACCESS_STORE, addr, 4);
+	interp_st->count.stores++;
+	
+	if(interp_st->storehook != NULL)
+		interp_st->storehook(addr, mem[addr/4]);
+	
 	mem[addr/4] = data;
 	return INTERP_RESULT_OK;
 }
 
 static interp_result_t interp_store_h(uint32_t *mem, uint32_t memsz, uint32_t addr, uint16_t data)
 {
-	if(addr % 1)
+	if(addr & 1)
 	{
 		TWARNING("Misaligned halfword store of %4.4X to addr %8.8X\n", data, addr);
 		return INTERP_RESULT_AC;
 	}
 	
-	if(addr + 2 > memsz || addr < 0x1000)
+	if((uint64_t)addr + 2 > memsz || addr < 0x1000)
 	{
 		TWARNING("Out-of-bounds halfword store to %8.8X\n", addr);
 		return INTERP_RESULT_ABT;
 	}
 	
+	interp_watch_check(addr, 2, INTERP_WATCH_WRITE);
+	interp_access(INTERP_ACCESS_STORE, addr, 2);
+	interp_st->count.stores++;
+	
+	if(interp_st->storehook != NULL)
+		interp_st->storehook(addr & ~3u, mem[addr/4]);
+	
 	switch(addr % 4)
 	{
 		case 0:
@@ -91,12 +467,19 @@ static interp_result_t interp_store_h(uint32_t *mem, uint32_t memsz, uint32_t ad
 
 static interp_result_t interp_store_b(uint32_t *mem, uint32_t memsz, uint32_t addr, uint8_t data)
 {
-	if(addr + 1 > memsz || addr < 0x1000)
+	if((uint64_t)addr + 1 > memsz || addr < 0x1000)
 	{
 		TWARNING("Out-of-bounds byte store to %8.8X\n", addr);
 		return INTERP_RESULT_ABT;
 	}
 	
+	interp_watch_check(addr, 1, INTERP_WATCH_WRITE);
+	interp_access(INTERP_ACCESS_STORE, addr, 1);
+	interp_st->count.stores++;
+	
+	if(interp_st->storehook != NULL)
+		interp_st->storehook(addr & ~3u, mem[addr/4]);
+	
 	switch(addr % 4)
 	{
 		case 0:
@@ -128,12 +511,16 @@ static interp_result_t interp_load_d(const uint32_t *mem, uint32_t memsz, uint32
 		return INTERP_RESULT_AC;
 	}
 	
-	if(addr + 8 > memsz || addr < 0x1000)
+	if((uint64_t)addr + 8 > memsz || addr < 0x1000)
 	{
 		TWARNING("Out-of-bounds doubleword load from %8.8X\n", addr);
 		return INTERP_RESULT_ABT;
 	}
 	
+	interp_watch_check(addr, 8, INTERP_WATCH_READ);
+	interp_access(INTERP_ACCESS_LOAD, addr, 8);
+	interp_st->count.loads++;
+	
 	*data = mem[ (addr/4) + 0 ];
 	*data |= ((uint64_t)mem[ (addr/4) + 1 ]) << 32;
 	return INTERP_RESULT_OK;
@@ -147,12 +534,16 @@ static interp_result_t interp_load_w(const uint32_t *mem, uint32_t memsz, uint32
 		return INTERP_RESULT_AC;
 	}
 
-	if(addr + 4 > memsz || addr < 0x1000)
+	if((uint64_t)addr + 4 > memsz || addr < 0x1000)
 	{
 		TWARNING("Out-of-bounds word load from %8.8X\n", addr);
 		return INTERP_RESULT_ABT;
 	}	
 	
+	interp_watch_check(addr, 4, INTERP_WATCH_READ);
+	interp_access(INTERP_ACCESS_LOAD, addr, 4);
+	interp_st->count.loads++;
+	
 	*data = mem[addr/4];
 	return INTERP_RESULT_OK;
 }
@@ -165,12 +556,16 @@ static interp_result_t interp_load_h(const uint32_t *mem, uint32_t memsz, uint32
 		return INTERP_RESULT_AC;
 	}	
 	
-	if(addr + 2 > memsz || addr < 0x1000)
+	if((uint64_t)addr + 2 > memsz || addr < 0x1000)
 	{
 		TWARNING("Out-of-bounds halfword load from %8.8X\n", addr);
 		return INTERP_RESULT_ABT;
 	}	
 	
+	interp_watch_check(addr, 2, INTERP_WATCH_READ);
+	interp_access(INTERP_ACCESS_LOAD, addr, 2);
+	interp_st->count.loads++;
+	
 	switch(addr % 4)
 	{
 		case 0:
@@ -185,12 +580,16 @@ static interp_result_t interp_load_h(const uint32_t *mem, uint32_t memsz, uint32
 
 static interp_result_t interp_load_b(const uint32_t *mem, uint32_t memsz, uint32_t addr, uint32_t *data)
 {
-	if(addr + 1 > memsz || addr < 0x1000)
+	if((uint64_t)addr + 1 > memsz || addr < 0x1000)
 	{
 		TWARNING("Out-of-bounds byte load from %8.8X\n", addr);
 		return INTERP_RESULT_ABT;
 	}	
 	
+	interp_watch_check(addr, 1, INTERP_WATCH_READ);
+	interp_access(INTERP_ACCESS_LOAD, addr, 1);
+	interp_st->count.loads++;
+	
 	switch(addr % 4)
 	{
 		case 0: *data = (mem[addr/4] >>  0) & 0xFF; return INTERP_RESULT_OK; 
@@ -400,6 +799,33 @@ static void interp_dataproc(int opcode, uint32_t *dest, uint32_t *cpsr, uint32_t
 	TDEBUG("%s", "\n");
 }
 
+//Checks whether the flags satisfy the condition field of an instruction
+static inline bool interp_cond(int cond, uint32_t cpsr)
+{
+	bool fz = cpsr & FLAG_Z;
+	bool fc = cpsr & FLAG_C;
+	bool fn = cpsr & FLAG_N;
+	bool fv = cpsr & FLAG_V;
+	switch(cond)
+	{
+		case  0: return fz;
+		case  1: return !fz;
+		case  2: return fc;
+		case  3: return !fc;
+		case  4: return fn;
+		case  5: return !fn;
+		case  6: return fv;
+		case  7: return !fv;
+		case  8: return fc && (!fz);
+		case  9: return (!fc) || fz;
+		case 10: return (fn && fv) || ((!fn) && (!fv));
+		case 11: return (fn && (!fv)) || ((!fn) && fv);
+		case 12: return (!fz) && ( (fn && fv) || ((!fn)&&(!fv)) );
+		case 13: return fz || (fn && (!fv)) || ((!fn) && fv);
+		default: return true;
+	}
+}
+
 static interp_result_t interp_step_inner(uint32_t *regs, uint32_t *cpsr, uint32_t *mem, size_t memsz, uint32_t force_ir)
 {
 	//Validate program counter
@@ -414,7 +840,7 @@ static interp_result_t interp_step_inner(uint32_t *regs, uint32_t *cpsr, uint32_
 			TERROR("Misaligned program counter %8.8X\n", regs[15]);
 			return INTERP_RESULT_FATAL;
 		}
-		if(regs[15] < 0x1000 || regs[15] + 4 > memsz)
+		if(regs[15] < 0x1000 || (uint64_t)regs[15] + 4 > memsz)
 		{
 			//Out of bounds program counter, simulate as prefetch abort
 			TWARNING("Out-of-bounds program counter %8.8X, memsz=%8.8X\n", regs[15], (uint32_t)memsz);
@@ -423,7 +849,12 @@ static interp_result_t interp_step_inner(uint32_t *regs, uint32_t *cpsr, uint32_
 	}
 	
 	//Fetch next instruction
+	if(!force_ir)
+		interp_access(INTERP_ACCESS_FETCH, regs[15], 4);
+	
 	const uint32_t ir = (force_ir) ? (force_ir) : (mem[regs[15] / 4]);
+	if(interp_st->pairs_on)
+		interp_pairs_count(regs[15], ir);
 	if(force_ir)
 		TWARNING("%s", "(IR FORCED) ");
 	
@@ -492,33 +923,8 @@ static interp_result_t interp_step_inner(uint32_t *regs, uint32_t *cpsr, uint32_
 		return INTERP_RESULT_FATAL;
 	}
 	
-	bool condsatisfied = true;
-	bool fz = *cpsr & FLAG_Z;
-	bool fc = *cpsr & FLAG_C;
-	bool fn = *cpsr & FLAG_N;
-	bool fv = *cpsr & FLAG_V;
-	switch(cond)
-	{
-		case  0: condsatisfied = fz; break;
-		case  1: condsatisfied = !fz; break;
-		case  2: condsatisfied = fc; break;
-		case  3: condsatisfied = !fc; break;
-		case  4: condsatisfied = fn; break;
-		case  5: condsatisfied = !fn; break;
-		case  6: condsatisfied = fv; break;
-		case  7: condsatisfied = !fv; break;
-		case  8: condsatisfied = fc && (!fz); break;
-		case  9: condsatisfied = (!fc) || fz; break;
-		case 10: condsatisfied = (fn && fv) || ((!fn) && (!fv)); break;
-		case 11: condsatisfied = (fn && (!fv)) || ((!fn) && fv); break;
-		case 12: condsatisfied = (!fz) && ( (fn && fv) || ((!fn)&&(!fv)) ); break;
-		case 13: condsatisfied = fz || (fn && (!fv)) || ((!fn) && fv); break;
-		case 14: condsatisfied = true; break;
-		case 15: condsatisfied = true; break;
-		default:
-			TERROR("Bad condition code %d\n", cond);
-			return INTERP_RESULT_FATAL;
-	}
+	const bool fc = *cpsr & FLAG_C;
+	bool condsatisfied = interp_cond(cond, *cpsr);
 	if(!condsatisfied)
 	{
 		TDEBUG("%s", "Skipping as condition not met.\n");
@@ -657,18 +1063,33 @@ static interp_result_t interp_step_inner(uint32_t *regs, uint32_t *cpsr, uint32_
 					break;
 				case 1:
 					TDEBUG("%s", "(LSR)");
-					shifted |= srcdata >> effective_shift;
+					if(effective_shift != 0) //LSR #0 means LSR #32
+						shifted |= srcdata >> effective_shift;
 					break;
 				case 2:
 					TDEBUG("%s", "(ASR)");
-					shifted |= srcdata >> effective_shift;
-					if(srcdata & 0x80000000u)
-						shifted |= 0xFFFFFFFF << (32 - effective_shift);
+					if(effective_shift == 0) //ASR #0 means ASR #32
+					{
+						shifted = (srcdata & 0x80000000u) ? 0xFFFFFFFFu : 0;
+					}
+					else
+					{
+						shifted |= srcdata >> effective_shift;
+						if(srcdata & 0x80000000u)
+							shifted |= 0xFFFFFFFF << (32 - effective_shift);
+					}
 					break;
 				case 3:
 					TDEBUG("%s", "(ROR)");
-					shifted |= srcdata >> effective_shift;
-					shifted |= srcdata << (32 - effective_shift);
+					if(effective_shift == 0) //ROR #0 means RRX
+					{
+						shifted = (srcdata >> 1) | (fc ? 0x80000000u : 0);
+					}
+					else
+					{
+						shifted |= srcdata >> effective_shift;
+						shifted |= srcdata << (32 - effective_shift);
+					}
 					break;
 				default:
 					TERROR("Bad shift operation %d\n", shift);
@@ -841,7 +1262,8 @@ static interp_result_t interp_step_inner(uint32_t *regs, uint32_t *cpsr, uint32_
 		{
 			//Data processing immediate
 			uint32_t imm8rotated = (uint32_t)imm8 >> (rotate*2);
-			imm8rotated |= (uint32_t)imm8 << (32 - (rotate*2));
+			if(rotate != 0)
+				imm8rotated |= (uint32_t)imm8 << (32 - (rotate*2));
 			
 			//Seriously this is what it says on Page A5-6 of ARM DDI01001
 			int shifter_carry = 0;
@@ -1340,7 +1762,7 @@ static interp_result_t interp_step_inner(uint32_t *regs, uint32_t *cpsr, uint32_
 					
 					int16_t mula = (ir & (1u << 5)) ? ((regs[rm] >> 16) & 0xFFFF) : (regs[rm] & 0xFFFF);
 					int16_t mulb = (ir & (1u << 6)) ? ((regs[rs] >> 16) & 0xFFFF) : (regs[rs] & 0xFFFF);
-					int64_t result = ((int64_t)mula * (int64_t)mulb) + (int64_t)regs[rd];
+					int64_t result = ((int64_t)mula * (int64_t)mulb) + (int64_t)(int32_t)regs[rd];
 					if(result < (int64_t)(0xFFFFFFFF80000000) || result > (int64_t)0x7FFFFFFF)
 						*cpsr |= FLAG_Q;
 						
@@ -1353,8 +1775,9 @@ static interp_result_t interp_step_inner(uint32_t *regs, uint32_t *cpsr, uint32_
 				{
 					//Branch and link and exchange thumb state (blx)
 					TDEBUG("Branch and link and exchange to register r%d = %8.8X ", rm, regs[rm]); 
+					uint32_t target = regs[rm]; //in case rm==lr
 					regs[14] = regs[15] - 4;
-					regs[15] = regs[rm] + 4; //We store PC offset
+					regs[15] = target + 4; //We store PC offset
 					TDEBUG("saved %8.8X in LR\n", regs[14]);
 		
 					return INTERP_RESULT_OK;
@@ -1484,6 +1907,8 @@ static interp_result_t interp_step_inner(uint32_t *regs, uint32_t *cpsr, uint32_
 							shifter_operand = regs[rm] >> to_shift;
 							if(regs[rm] & (1u << 31))
 								shifter_operand |= (0xFFFFFFFFu) << (32 - to_shift);
+							
+							shifter_carry_out = regs[rm] & (1u << (to_shift - 1));
 						}
 					}
 					else
@@ -1584,9 +2009,20 @@ static interp_result_t interp_step_inner(uint32_t *regs, uint32_t *cpsr, uint32_
 interp_result_t interp_step(uint32_t *regs, uint32_t *cpsr, uint32_t *mem, size_t memsz)
 {
 	//Dumb stuff about what "PC" actually reads as during an instruction
+	uint32_t next_pc = regs[15] + 4;
 	regs[15] += 4;
 	interp_result_t r = interp_step_inner(regs, cpsr, mem, memsz, 0);
 	regs[15] -= 4;
+	if(regs[15] != next_pc && r == INTERP_RESULT_OK)
+		interp_st->count.branches++;
+	
+	//Report watched accesses once the instruction is done, unless something worse happened
+	if(interp_st->watch_pending)
+	{
+		interp_st->watch_pending = false;
+		if(r == INTERP_RESULT_OK)
+			r = INTERP_RESULT_WATCH;
+	}
 		
 	return r;
 }
@@ -1594,10 +2030,203 @@ interp_result_t interp_step(uint32_t *regs, uint32_t *cpsr, uint32_t *mem, size_
 interp_result_t interp_step_force(uint32_t *regs, uint32_t *cpsr, uint32_t *mem, size_t memsz, uint32_t ir)
 {
 	//Dumb stuff about what "PC" actually reads as during an instruction
+	uint32_t next_pc = regs[15] + 4;
 	regs[15] += 4;
 	interp_result_t r = interp_step_inner(regs, cpsr, mem, memsz, ir);
 	regs[15] -= 4;
+	if(regs[15] != next_pc && r == INTERP_RESULT_OK)
+		interp_st->count.branches++;
+	
+	//Report watched accesses once the instruction is done, unless something worse happened
+	if(interp_st->watch_pending)
+	{
+		interp_st->watch_pending = false;
+		if(r == INTERP_RESULT_OK)
+			r = INTERP_RESULT_WATCH;
+	}
 		
 	return r;	
 }
 
+
+//Fused pairs
+//Compiled code is full of the same few pairs of instructions, like a compare and a conditional branch.
+//Running a pair as one operation skips a trip through the scheduler loop and the general decoder.
+//Each fusion checks that both instructions are in a form it handles before changing anything, and otherwise
+//leaves the pair to be run one at a time, so faults are always found by the ordinary path.
+
+//Checks for a data processing instruction in a form that's fused - unconditional, not using the PC,
+//and with either a rotated immediate or an unshifted register for its second operand
+static inline bool interp_fuse_dp_ok(uint32_t ir, bool flags)
+{
+	if((ir >> 28) != 0xE)
+		return false;
+	
+	bool imm = ir & (1u << 25);
+	if(imm ? ((ir & 0x0E000000) != 0x02000000) : ((ir & 0x0E000FF0) != 0))
+		return false;
+	
+	int opcode = (ir >> 21) & 0xF;
+	bool s = ir & (1u << 20);
+	if(s != flags || (!s && opcode >= 8 && opcode <= 11))
+		return false; //Compares without S are other instructions
+	
+	if(((ir >> 16) & 0xF) == 15 || ((ir >> 12) & 0xF) == 15 || (!imm && (ir & 0xF) == 15))
+		return false;
+	
+	return true;
+}
+
+//Runs a data processing instruction checked by interp_fuse_dp_ok
+static inline void interp_fuse_dp(uint32_t *regs, uint32_t *cpsr, uint32_t ir)
+{
+	int opcode = (ir >> 21) & 0xF;
+	uint32_t operand = regs[ir & 0xF];
+	bool carry = (*cpsr) & FLAG_C;
+	if(ir & (1u << 25))
+	{
+		uint32_t rot = ((ir >> 8) & 0xF) * 2;
+		uint32_t imm = ir & 0xFF;
+		operand = rot ? ((imm >> rot) | (imm << (32 - rot))) : imm;
+		if(rot)
+			carry = operand >> 31;
+	}
+	
+	uint32_t discard = 0;
+	uint32_t *dest = (opcode >= 8 && opcode <= 11) ? &discard : &(regs[(ir >> 12) & 0xF]);
+	interp_dataproc(opcode, dest, cpsr, regs[(ir >> 16) & 0xF], operand, ir & (1u << 20), carry);
+}
+
+//Flag-setting data processing then a conditional branch - CMP+BNE, SUBS+BNE at the end of loops
+static bool interp_fuse_dps_bcc(uint32_t *regs, uint32_t *cpsr, uint32_t *mem, size_t memsz, uint32_t ir0, uint32_t ir1)
+{
+	(void)mem;
+	(void)memsz;
+	if(!interp_fuse_dp_ok(ir0, true) || (ir1 >> 28) >= 0xE)
+		return false;
+	
+	uint32_t pc = regs[15];
+	interp_fuse_dp(regs, cpsr, ir0);
+	if(interp_cond(ir1 >> 28, *cpsr))
+	{
+		uint32_t offset = ir1 & 0xFFFFFFu;
+		if(offset & 0x800000u)
+			offset |= 0xFF000000u;
+		
+		regs[15] = pc + 12 + (offset * 4);
+		if(regs[15] != pc + 8)
+			interp_st->count.branches++;
+	}
+	else
+	{
+		regs[15] = pc + 8;
+	}
+	return true;
+}
+
+//Load of a word at an immediate offset, or post-indexed, then data processing - LDR+ADD walking arrays
+static bool interp_fuse_ldr_dp(uint32_t *regs, uint32_t *cpsr, uint32_t *mem, size_t memsz, uint32_t ir0, uint32_t ir1)
+{
+	if(!interp_fuse_dp_ok(ir1, false))
+		return false;
+	
+	int rn = (ir0 >> 16) & 0xF;
+	int rd = (ir0 >> 12) & 0xF;
+	bool pre = ir0 & (1u << 24);
+	if((ir0 >> 28) != 0xE || rn == 15 || rd == 15 || (!pre && rn == rd))
+		return false;
+	
+	uint32_t offset = ir0 & 0xFFF;
+	uint32_t moved = (ir0 & (1u << 23)) ? (regs[rn] + offset) : (regs[rn] - offset);
+	uint32_t addr = pre ? moved : regs[rn];
+	if((addr & 3) || (uint64_t)addr + 4 > memsz || addr < 0x1000)
+		return false; //Let the ordinary path fault
+	
+	interp_st->count.loads++;
+	if(!pre)
+		regs[rn] = moved;
+	
+	regs[rd] = mem[addr / 4];
+	interp_fuse_dp(regs, cpsr, ir1);
+	regs[15] += 8;
+	return true;
+}
+
+//Two data processing instructions without flags - MOV and ADD setting up arguments and addresses
+static bool interp_fuse_dp_dp(uint32_t *regs, uint32_t *cpsr, uint32_t *mem, size_t memsz, uint32_t ir0, uint32_t ir1)
+{
+	(void)mem;
+	(void)memsz;
+	if(!interp_fuse_dp_ok(ir0, false) || !interp_fuse_dp_ok(ir1, false))
+		return false;
+	
+	interp_fuse_dp(regs, cpsr, ir0);
+	interp_fuse_dp(regs, cpsr, ir1);
+	regs[15] += 8;
+	return true;
+}
+
+//Data processing then a return - MOV r0 and BX LR ending functions
+static bool interp_fuse_dp_ret(uint32_t *regs, uint32_t *cpsr, uint32_t *mem, size_t memsz, uint32_t ir0, uint32_t ir1)
+{
+	(void)mem;
+	(void)memsz;
+	(void)ir1;
+	if(!interp_fuse_dp_ok(ir0, false) || ((ir0 >> 12) & 0xF) == 14)
+		return false;
+	if(regs[14] & 3)
+		return false; //Thumb isn't supported - let the ordinary path complain
+	
+	uint32_t pc = regs[15];
+	interp_fuse_dp(regs, cpsr, ir0);
+	regs[15] = regs[14];
+	if(regs[15] != pc + 8)
+		interp_st->count.branches++;
+	return true;
+}
+
+//Pairs that are fused, checked in order. Picked from the most common pairs counted by interp_pairs_save.
+typedef bool (*interp_fusefn_t)(uint32_t *regs, uint32_t *cpsr, uint32_t *mem, size_t memsz, uint32_t ir0, uint32_t ir1);
+typedef struct interp_fusion_s
+{
+	uint32_t mask0; //Bits of the first instruction that must match
+	uint32_t match0;
+	uint32_t mask1; //Bits of the second instruction that must match
+	uint32_t match1;
+	interp_fusefn_t fn; //Runs the pair, or returns false without changing anything if it can't
+} interp_fusion_t;
+static const interp_fusion_t interp_fusions[] =
+{
+	{ 0x0C100000, 0x00100000, 0x0F000000, 0x0A000000, interp_fuse_dps_bcc }, //cmp,bcc alus,bcc
+	{ 0x0C100000, 0x00000000, 0x0C000000, 0x00000000, interp_fuse_dp_dp }, //alu,mov alu,alu mov,alu mov,mov
+	{ 0x0E700000, 0x04100000, 0x0C100000, 0x00000000, interp_fuse_ldr_dp }, //ldr,alu
+	{ 0x0C100000, 0x00000000, 0xFFFFFFFF, 0xE12FFF1E, interp_fuse_dp_ret }, //mov,bx
+};
+
+interp_result_t interp_step_pair(uint32_t *regs, uint32_t *cpsr, uint32_t *mem, size_t memsz, uint32_t *ran_out)
+{
+	//Anything looking at single instructions or accesses sees them run one at a time
+	uint32_t pc = regs[15];
+	bool fusable = interp_st->watch_nactive == 0 && interp_st->accesshook == NULL && !interp_st->pairs_on;
+	if(fusable && !(pc & 3) && pc >= 0x1000 && (uint64_t)pc + 8 <= memsz)
+	{
+		uint32_t ir0 = mem[pc / 4];
+		uint32_t ir1 = mem[(pc / 4) + 1];
+		for(size_t ff = 0; ff < sizeof(interp_fusions) / sizeof(interp_fusions[0]); ff++)
+		{
+			const interp_fusion_t *fptr = &(interp_fusions[ff]);
+			if((ir0 & fptr->mask0) != fptr->match0 || (ir1 & fptr->mask1) != fptr->match1)
+				continue;
+			
+			if(fptr->fn(regs, cpsr, mem, memsz, ir0, ir1))
+			{
+				interp_st->count.fused++;
+				*ran_out = 2;
+				return INTERP_RESULT_OK;
+			}
+		}
+	}
+	
+	*ran_out = 1;
+	return interp_step(regs, cpsr, mem, memsz);
+}
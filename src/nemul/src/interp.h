@@ -23,6 +23,7 @@ typedef enum interp_result_e
 	INTERP_RESULT_PF, //Prefetch abort (access to bad instruction memory)
 	INTERP_RESULT_SYSCALL, //System call triggered
 	INTERP_RESULT_BKPT, //GDB breakpoint hit
+	INTERP_RESULT_WATCH, //Instruction completed, but touched memory watched by the debugger
 	INTERP_RESULT_FATAL, //Something so horrible happened that we can't keep emulating
 	INTERP_RESULT_MAX //Number of valid interpreter results
 } interp_result_t;
@@ -34,5 +35,111 @@ interp_result_t interp_step(uint32_t *regs, uint32_t *cpsr, uint32_t *mem, size_
 //Runs ARM interpreter but forces the instruction register to be the given instruction
 interp_result_t interp_step_force(uint32_t *regs, uint32_t *cpsr, uint32_t *mem, size_t memsz, uint32_t ir);
 
+//Runs the instruction at the PC, or it and the one after together if they're a pair the interpreter fuses.
+//Gives the number of instructions run. Pairs are only fused when no watchpoint, hook or pair count needs to
+//see each instruction by itself, and never when the first one would fault.
+interp_result_t interp_step_pair(uint32_t *regs, uint32_t *cpsr, uint32_t *mem, size_t memsz, uint32_t *ran_out);
+
+//Kinds of memory access a watchpoint catches, as in GDB's Z2/Z3/Z4 packets
+#define INTERP_WATCH_WRITE  1
+#define INTERP_WATCH_READ   2
+#define INTERP_WATCH_ACCESS (INTERP_WATCH_WRITE | INTERP_WATCH_READ)
+
+//Most watchpoints that can be set at once
+#define INTERP_WATCH_MAX 32
+
+//Watches a range of memory in the given process, or in every process if pid <= 0.
+//Returns false if there's no room for another watchpoint.
+bool interp_watch_add(int pid, uint32_t addr, uint32_t len, int kind);
+
+//Removes a watchpoint added by interp_watch_add. Returns false if there was no such watchpoint.
+bool interp_watch_remove(int pid, uint32_t addr, uint32_t len, int kind);
+
+//Removes all watchpoints
+void interp_watch_clear(void);
+
+//Selects whose watchpoints are checked by later interp_step calls.
+//Loads and stores don't check anything unless the selected process has watchpoints.
+void interp_watch_select(int pid);
+
+//Returns the address and kind of watchpoint behind the last INTERP_RESULT_WATCH
+void interp_watch_hit(uint32_t *addr_out, int *kind_out);
+
+//Checks if any of the given process's watchpoints of the given kind cover an access, outside of interp_step.
+//If so, it's reported by interp_watch_hit as if the interpreter hit it.
+bool interp_watch_find(int pid, uint32_t addr, uint32_t len, int kind);
+
+//Running totals of what the interpreter has done, for performance statistics
+typedef struct interp_counts_s
+{
+	uint64_t loads; //Memory reads, counting each word of a multiple load
+	uint64_t stores; //Memory writes, likewise
+	uint64_t branches; //Instructions that went somewhere other than the next instruction
+	uint64_t fused; //Pairs of instructions run together by interp_step_pair
+} interp_counts_t;
+
+//Gets the totals since startup - callers take the difference across whatever they're measuring
+void interp_counts(interp_counts_t *out);
+
+//Function told the old contents of each word of memory, before the interpreter stores to it
+typedef void (*interp_storehook_t)(uint32_t addr, uint32_t oldword);
+
+//Sets a function to call before each store, or NULL for none
+void interp_setstorehook(interp_storehook_t hook);
+
+//Kinds of memory access told to the access hook
+#define INTERP_ACCESS_FETCH 0
+#define INTERP_ACCESS_LOAD  1
+#define INTERP_ACCESS_STORE 2
+
+//Function told about every instruction fetch, load and store the interpreter makes, for modelling the memory system
+typedef void (*interp_accesshook_t)(int kind, uint32_t addr, uint32_t len);
+
+//Sets a function to call on each access, or NULL for none
+void interp_setaccesshook(interp_accesshook_t hook);
+
+//Kinds of instruction told apart when counting which ones run one after another
+typedef enum interp_class_e
+{
+	INTERP_CLASS_OTHER = 0, //Anything not below
+	INTERP_CLASS_CMP, //CMP, CMN, TST, TEQ
+	INTERP_CLASS_ALUS, //Other data processing that sets flags, like SUBS
+	INTERP_CLASS_MOV, //MOV and MVN
+	INTERP_CLASS_ALU, //Other data processing
+	INTERP_CLASS_MUL, //Multiplies
+	INTERP_CLASS_LDR, //Word and byte loads
+	INTERP_CLASS_STR, //Word and byte stores
+	INTERP_CLASS_LDRH, //Halfword, signed and doubleword loads and stores
+	INTERP_CLASS_LDM, //Load multiple
+	INTERP_CLASS_STM, //Store multiple
+	INTERP_CLASS_B, //Unconditional branch
+	INTERP_CLASS_BCC, //Conditional branch
+	INTERP_CLASS_BL, //Branch with link
+	INTERP_CLASS_BX, //Branch and exchange, usually a return
+	INTERP_CLASS_SYSCALL, //System call
+	INTERP_CLASS_MAX
+} interp_class_t;
+
+//Returns what kind of instruction this is, and the name of a kind
+interp_class_t interp_classify(uint32_t ir);
+const char *interp_classname(interp_class_t cls);
+
+//Turns on or off counting how often each kind of instruction is run straight after each other kind.
+//This is what the pairs the interpreter fuses were chosen from.
+void interp_pairs_enable(bool enable);
+
+//Writes the counts of instruction pairs as CSV, most frequent first. Returns false on failure.
+bool interp_pairs_save(const char *path);
+
+//Watchpoints, counts and hooks of one emulated console
+typedef struct interp_ctx_s interp_ctx_t;
+
+//Makes or frees the interpreter state for a console
+interp_ctx_t *interp_ctx_new(void);
+void interp_ctx_delete(interp_ctx_t *st);
+
+//Selects the state used by later calls on this thread, or NULL for the one used when there's no console
+void interp_select(interp_ctx_t *st);
+
 #endif //INTERP_H
 
@@ -0,0 +1,528 @@
+//joy.cpp
+//Host joysticks and gamepads as emulated pad inputs in Neki32 simulator
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#define FILE_TRACE_CAT TRACE_CAT_JOY
+#include "trace.h"
+
+#include "joy.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#ifdef __linux__
+	#include <dirent.h>
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/inotify.h>
+	#include <sys/ioctl.h>
+	#include <linux/input.h>
+#endif
+
+//Buttons held on each pad, published by the polling thread for the emulation to pick up
+static std::atomic<uint16_t> joy_pads[PREFS_PAD_MAX];
+
+//Last control pushed, as the joystick number above the control, and a count of pushes
+static std::atomic<uint32_t> joy_press_val;
+static std::atomic<uint32_t> joy_press_seq;
+
+//Joysticks open now
+static std::atomic<int> joy_ndevs;
+
+//Polling thread and a flag telling it to finish
+static std::thread joy_thread;
+static std::atomic<bool> joy_running;
+
+//Messages from the polling thread, which can't safely write trace messages itself, waiting for joy_poll
+#define JOY_NOTE_MAX 16
+static std::mutex joy_note_mutex;
+static char joy_notes[JOY_NOTE_MAX][256];
+static int joy_nnotes;
+
+//Bindings and thresholds, only changed while the thread is stopped
+static prefs_pad_t joy_cfg[PREFS_PAD_MAX];
+static int joy_press_pct;
+static int joy_release_pct;
+
+//Leaves a message for joy_poll to trace
+static void joy_note(const char *fmt, ...)
+{
+	std::lock_guard<std::mutex> lock(joy_note_mutex);
+	if(joy_nnotes >= JOY_NOTE_MAX)
+		return;
+	
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(joy_notes[joy_nnotes], sizeof(joy_notes[joy_nnotes]), fmt, ap);
+	va_end(ap);
+	joy_nnotes++;
+}
+
+#ifdef __linux__
+
+//State of one joystick, kept by the polling thread
+typedef struct joy_dev_s
+{
+	int fd;
+	int num; //Number of its /dev/input/event node
+	uint8_t keys[(KEY_CNT + 7) / 8]; //Buttons held
+	int abs_min[ABS_CNT];
+	int abs_max[ABS_CNT];
+	int8_t abs_dir[ABS_CNT]; //Which way each axis is pushed past the thresholds, or 0
+} joy_dev_t;
+
+static joy_dev_t joy_devs[JOY_DEV_MAX];
+
+//Event nodes already found not to be joysticks, so they aren't opened again and again.
+//Forgotten when inotify says the node changed, as the number may now belong to another device.
+#define JOY_NODE_MAX 1024
+static bool joy_rejected[JOY_NODE_MAX];
+
+//Watch on /dev/input for nodes appearing or changing, or -1 if we have to look for them periodically
+static int joy_inotify_fd = -1;
+
+//Orders event node numbers
+static int joy_numcompare(const void *a, const void *b)
+{
+	return *(const int*)a - *(const int*)b;
+}
+
+//Tests a bit in a bitmap read from the input subsystem
+static bool joy_testbit(const uint8_t *bits, int bit)
+{
+	return (bits[bit / 8] >> (bit % 8)) & 1;
+}
+
+//Notes that a control was pushed, for binding it
+static void joy_pressed(int dd, int val)
+{
+	joy_press_val.store(((uint32_t)dd << 24) | (uint32_t)val, std::memory_order_relaxed);
+	joy_press_seq.fetch_add(1, std::memory_order_release);
+}
+
+//Works out which way an axis is pushed. Once pushed, it stays so until it comes back inside the release threshold.
+static int8_t joy_axisdir(const joy_dev_t *dptr, int axis, int value)
+{
+	int center = (dptr->abs_min[axis] + dptr->abs_max[axis]) / 2;
+	int half = (dptr->abs_max[axis] - dptr->abs_min[axis]) / 2;
+	if(half <= 0)
+		return 0;
+	
+	int pct = (int)(((int64_t)(value - center) * 100) / half);
+	int8_t was = dptr->abs_dir[axis];
+	if(was > 0 && pct > joy_release_pct)
+		return 1;
+	if(was < 0 && -pct > joy_release_pct)
+		return -1;
+	if(pct >= joy_press_pct)
+		return 1;
+	if(-pct >= joy_press_pct)
+		return -1;
+	
+	return 0;
+}
+
+//Reads the whole state of a joystick, when it's opened or after events were lost
+static void joy_sync(joy_dev_t *dptr)
+{
+	memset(dptr->keys, 0, sizeof(dptr->keys));
+	ioctl(dptr->fd, EVIOCGKEY(sizeof(dptr->keys)), dptr->keys);
+	
+	uint8_t absbits[(ABS_CNT + 7) / 8] = {0};
+	ioctl(dptr->fd, EVIOCGBIT(EV_ABS, sizeof(absbits)), absbits);
+	for(int aa = 0; aa < ABS_CNT; aa++)
+	{
+		struct input_absinfo info;
+		memset(&info, 0, sizeof(info));
+		if(!joy_testbit(absbits, aa) || ioctl(dptr->fd, EVIOCGABS(aa), &info) < 0)
+		{
+			dptr->abs_min[aa] = 0;
+			dptr->abs_max[aa] = 0;
+			dptr->abs_dir[aa] = 0;
+			continue;
+		}
+		
+		dptr->abs_min[aa] = info.minimum;
+		dptr->abs_max[aa] = info.maximum;
+		dptr->abs_dir[aa] = 0;
+		dptr->abs_dir[aa] = joy_axisdir(dptr, aa, info.value);
+	}
+}
+
+//Opens any joysticks that have appeared, after those already open
+static void joy_scan(void)
+{
+	DIR *dir = opendir("/dev/input");
+	if(dir == NULL)
+		return;
+	
+	//Event nodes not yet open, in order, so joysticks are numbered the same way each time
+	int nums[256];
+	int nnums = 0;
+	struct dirent *dent = NULL;
+	while((dent = readdir(dir)) != NULL && nnums < 256)
+	{
+		int num = 0;
+		if(sscanf(dent->d_name, "event%d", &num) != 1)
+			continue;
+		
+		bool skip = (num >= 0 && num < JOY_NODE_MAX && joy_rejected[num]);
+		for(int dd = 0; dd < joy_ndevs; dd++)
+		{
+			if(joy_devs[dd].num == num)
+				skip = true;
+		}
+		
+		if(!skip)
+			nums[nnums++] = num;
+	}
+	closedir(dir);
+	
+	qsort(nums, nnums, sizeof(nums[0]), joy_numcompare);
+	
+	for(int nn = 0; nn < nnums && joy_ndevs < JOY_DEV_MAX; nn++)
+	{
+		char path[64] = {0};
+		snprintf(path, sizeof(path), "/dev/input/event%d", nums[nn]);
+		int fd = open(path, O_RDONLY | O_NONBLOCK);
+		if(fd < 0)
+		{
+			//Often not allowed for keyboards and mice, which we don't want anyway.
+			//If permissions change so we can open it, inotify tells us to try again.
+			if(nums[nn] < JOY_NODE_MAX)
+				joy_rejected[nums[nn]] = true;
+			
+			continue;
+		}
+		
+		//Joysticks and gamepads have buttons in the range set aside for them
+		uint8_t keybits[(KEY_CNT + 7) / 8] = {0};
+		bool isjoy = false;
+		if(ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keybits)), keybits) >= 0)
+		{
+			for(int kk = BTN_JOYSTICK; kk < BTN_DIGI; kk++)
+			{
+				if(joy_testbit(keybits, kk))
+					isjoy = true;
+			}
+		}
+		
+		if(!isjoy)
+		{
+			if(nums[nn] < JOY_NODE_MAX)
+				joy_rejected[nums[nn]] = true;
+			
+			close(fd);
+			continue;
+		}
+		
+		char name[128] = {0};
+		ioctl(fd, EVIOCGNAME(sizeof(name) - 1), name);
+		joy_note("Joystick %d is %s (%s)\n", (int)joy_ndevs, name, path);
+		
+		joy_dev_t *dptr = &(joy_devs[(int)joy_ndevs]);
+		dptr->fd = fd;
+		dptr->num = nums[nn];
+		joy_sync(dptr);
+		joy_ndevs++;
+	}
+}
+
+//Closes a joystick that went away, moving later ones down
+static void joy_remove(int dd)
+{
+	joy_note("Joystick %d went away\n", dd);
+	close(joy_devs[dd].fd);
+	for(int ee = dd; ee + 1 < joy_ndevs; ee++)
+	{
+		joy_devs[ee] = joy_devs[ee + 1];
+	}
+	joy_ndevs--;
+}
+
+//Takes in everything that happened on a joystick since last time. Returns false if it's gone.
+static bool joy_read(int dd)
+{
+	joy_dev_t *dptr = &(joy_devs[dd]);
+	while(1)
+	{
+		struct input_event evs[64];
+		ssize_t nread = read(dptr->fd, evs, sizeof(evs));
+		if(nread < 0)
+			return (errno == EAGAIN || errno == EINTR);
+		
+		if(nread == 0)
+			return false;
+		
+		for(int ee = 0; ee < (int)(nread / sizeof(evs[0])); ee++)
+		{
+			const struct input_event *eptr = &(evs[ee]);
+			if(eptr->type == EV_KEY && eptr->code < KEY_CNT && eptr->value != 2)
+			{
+				//Press or release - auto-repeats don't matter
+				bool was = joy_testbit(dptr->keys, eptr->code);
+				if(eptr->value)
+					dptr->keys[eptr->code / 8] |= (1u << (eptr->code % 8));
+				else
+					dptr->keys[eptr->code / 8] &= ~(1u << (eptr->code % 8));
+				
+				if(eptr->value && !was)
+					joy_pressed(dd, eptr->code);
+			}
+			else if(eptr->type == EV_ABS && eptr->code < ABS_CNT)
+			{
+				int8_t dir = joy_axisdir(dptr, eptr->code, eptr->value);
+				if(dir != 0 && dir != dptr->abs_dir[eptr->code])
+					joy_pressed(dd, JOY_VAL_MKAXIS(eptr->code, dir < 0));
+				
+				dptr->abs_dir[eptr->code] = dir;
+			}
+			else if(eptr->type == EV_SYN && eptr->code == SYN_DROPPED)
+			{
+				//Lost some events - start over from the state as it is now
+				joy_sync(dptr);
+			}
+		}
+	}
+}
+
+//Checks if anything appeared or changed in /dev/input since last time, and forgets what we knew about it
+static bool joy_changed(void)
+{
+	bool changed = false;
+	while(1)
+	{
+		alignas(struct inotify_event) char buf[4096];
+		ssize_t nread = read(joy_inotify_fd, buf, sizeof(buf));
+		if(nread <= 0)
+			return changed;
+		
+		for(ssize_t off = 0; off < nread; )
+		{
+			const struct inotify_event *eptr = (const struct inotify_event*)(buf + off);
+			int num = 0;
+			if(eptr->len > 0 && sscanf(eptr->name, "event%d", &num) == 1)
+			{
+				if(num >= 0 && num < JOY_NODE_MAX)
+					joy_rejected[num] = false;
+				
+				changed = true;
+			}
+			off += sizeof(struct inotify_event) + eptr->len;
+		}
+	}
+}
+
+//Works out the buttons held on a pad from its bindings
+static uint16_t joy_padbits(int pp)
+{
+	const prefs_pad_t *cptr = &(joy_cfg[pp]);
+	if(cptr->js_id < 0 || cptr->js_id >= joy_ndevs)
+		return 0;
+	
+	const joy_dev_t *dptr = &(joy_devs[cptr->js_id]);
+	uint16_t bits = 0;
+	for(int bb = 0; bb < PREFS_PAD_BTN_MAX; bb++)
+	{
+		if(cptr->btn_src[bb] != PREFS_PAD_SRC_JOY)
+			continue;
+		
+		int val = cptr->btn_val[bb];
+		bool held = false;
+		if(val & JOY_VAL_AXIS)
+		{
+			int axis = ((val & ~JOY_VAL_AXIS) >> 1) % ABS_CNT;
+			held = dptr->abs_dir[axis] == ((val & JOY_VAL_AXIS_NEG) ? -1 : 1);
+		}
+		else if(val >= 0 && val < KEY_CNT)
+		{
+			held = joy_testbit(dptr->keys, val);
+		}
+		
+		if(held)
+			bits |= (1u << bb);
+	}
+	
+	return bits;
+}
+
+//Polling thread - takes in joystick events every millisecond, and publishes the pads they make
+static void joy_threadfunc(void)
+{
+	//Look at everything once, then only at nodes that appear or change.
+	//Without inotify, look for new nodes once a second instead.
+	memset(joy_rejected, 0, sizeof(joy_rejected));
+	joy_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(joy_inotify_fd >= 0 && inotify_add_watch(joy_inotify_fd, "/dev/input", IN_CREATE | IN_ATTRIB | IN_DELETE) < 0)
+	{
+		close(joy_inotify_fd);
+		joy_inotify_fd = -1;
+	}
+	
+	auto next = std::chrono::steady_clock::now();
+	for(uint32_t polls = 0; joy_running; polls++)
+	{
+		if(polls == 0)
+			joy_scan();
+		else if(joy_inotify_fd >= 0 && joy_changed())
+			joy_scan();
+		else if(joy_inotify_fd < 0 && polls % JOY_POLL_HZ == 0)
+			joy_scan();
+		
+		for(int dd = 0; dd < joy_ndevs; dd++)
+		{
+			if(!joy_read(dd))
+			{
+				joy_remove(dd);
+				dd--;
+			}
+		}
+		
+		for(int pp = 0; pp < PREFS_PAD_MAX; pp++)
+		{
+			joy_pads[pp].store(joy_padbits(pp), std::memory_order_relaxed);
+		}
+		
+		//Keep a steady rate, without trying to catch up if the host stalled
+		next += std::chrono::microseconds(1000000 / JOY_POLL_HZ);
+		auto now = std::chrono::steady_clock::now();
+		if(next < now)
+			next = now;
+		
+		std::this_thread::sleep_until(next);
+	}
+	
+	while(joy_ndevs > 0)
+	{
+		close(joy_devs[joy_ndevs - 1].fd);
+		joy_ndevs--;
+	}
+	
+	if(joy_inotify_fd >= 0)
+	{
+		close(joy_inotify_fd);
+		joy_inotify_fd = -1;
+	}
+}
+
+#endif //__linux__
+
+void joy_init(const prefs_t *prefs)
+{
+	joy_shutdown();
+	
+	memcpy(joy_cfg, prefs->pads, sizeof(joy_cfg));
+	
+	//Thresholds may have been edited by hand. A press at 0% would hold every axis down,
+	//and release has to be inside press or buttons would never let go.
+	joy_press_pct = prefs->joy_press_pct;
+	if(joy_press_pct < 1)
+		joy_press_pct = 1;
+	if(joy_press_pct > 100)
+		joy_press_pct = 100;
+	
+	joy_release_pct = prefs->joy_release_pct;
+	if(joy_release_pct < 0)
+		joy_release_pct = 0;
+	if(joy_release_pct > joy_press_pct)
+		joy_release_pct = joy_press_pct;
+	
+	#ifdef __linux__
+		joy_running = true;
+		joy_thread = std::thread(joy_threadfunc);
+	#else
+		joy_note("%s", "Joysticks are only supported on Linux\n");
+	#endif
+}
+
+void joy_shutdown(void)
+{
+	if(joy_thread.joinable())
+	{
+		joy_running = false;
+		joy_thread.join();
+	}
+	
+	for(int pp = 0; pp < PREFS_PAD_MAX; pp++)
+	{
+		joy_pads[pp] = 0;
+	}
+}
+
+void joy_poll(void)
+{
+	//Trace what the polling thread found, from here where it's safe
+	char notes[JOY_NOTE_MAX][256];
+	int nnotes = 0;
+	{
+		std::lock_guard<std::mutex> lock(joy_note_mutex);
+		memcpy(notes, joy_notes, sizeof(notes));
+		nnotes = joy_nnotes;
+		joy_nnotes = 0;
+	}
+	
+	for(int nn = 0; nn < nnotes; nn++)
+	{
+		TINFO("%s", notes[nn]);
+	}
+}
+
+void joy_getpads(uint16_t *pads)
+{
+	for(int pp = 0; pp < PREFS_PAD_MAX; pp++)
+	{
+		pads[pp] = joy_pads[pp].load(std::memory_order_relaxed);
+	}
+}
+
+uint32_t joy_lastpress(int *js_id_out, int *val_out)
+{
+	uint32_t seq = joy_press_seq.load(std::memory_order_acquire);
+	uint32_t packed = joy_press_val.load(std::memory_order_relaxed);
+	if(js_id_out != NULL)
+		*js_id_out = packed >> 24;
+	if(val_out != NULL)
+		*val_out = packed & 0xFFFFFF;
+	return seq;
+}
+
+int joy_count(void)
+{
+	return joy_ndevs;
+}
+
+void joy_valname(int val, char *buf, int len)
+{
+	if(val & JOY_VAL_AXIS)
+	{
+		//Name the usual axes of a gamepad
+		static const char *axisnames[] = { "X", "Y", "Z", "RX", "RY", "RZ" };
+		int axis = (val & ~JOY_VAL_AXIS) >> 1;
+		char sign = (val & JOY_VAL_AXIS_NEG) ? '-' : '+';
+		if(axis < (int)(sizeof(axisnames) / sizeof(axisnames[0])))
+			snprintf(buf, len, "Axis %s%c", axisnames[axis], sign);
+		else if(axis >= 0x10 && axis <= 0x17)
+			snprintf(buf, len, "Hat %d%c%c", (axis - 0x10) / 2, ((axis - 0x10) % 2) ? 'Y' : 'X', sign);
+		else
+			snprintf(buf, len, "Axis %d%c", axis, sign);
+	}
+	else
+	{
+		//Joystick buttons start at 0x120
+		snprintf(buf, len, "Button %d", (val >= 0x120) ? (val - 0x120) : val);
+	}
+}
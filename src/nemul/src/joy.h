@@ -0,0 +1,51 @@
+//joy.h
+//Host joysticks and gamepads as emulated pad inputs in Neki32 simulator
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#ifndef _JOY_H
+#define _JOY_H
+
+#include <stdint.h>
+#include "prefs.h"
+
+//Joystick controls, as kept in btn_val of a pad when btn_src is PREFS_PAD_SRC_JOY.
+//Buttons are their Linux input event codes. Axes have JOY_VAL_AXIS set, with the axis code and direction below it.
+#define JOY_VAL_AXIS 0x10000
+#define JOY_VAL_AXIS_NEG 0x1
+#define JOY_VAL_MKAXIS(axis, neg) (JOY_VAL_AXIS | ((axis) << 1) | ((neg) ? JOY_VAL_AXIS_NEG : 0))
+
+//Joysticks watched at once, at most. A pad's js_id picks one of them in the order they were found.
+#define JOY_DEV_MAX 8
+
+//Rate at which joysticks are polled
+#define JOY_POLL_HZ 1000
+
+//Starts the host thread that polls joysticks, with the bindings and thresholds given
+void joy_init(const prefs_t *prefs);
+
+//Stops polling joysticks
+void joy_shutdown(void);
+
+//Traces joysticks found or lost since last time. Call it wherever the emulation can write trace messages.
+void joy_poll(void);
+
+//Gets the buttons held on each pad through joystick bindings, as last polled. Doesn't block.
+void joy_getpads(uint16_t *pads);
+
+//Gets the last joystick control pushed, for binding it to a button.
+//Returns a number that changes each time one is pushed, so callers can tell if there's a new one.
+uint32_t joy_lastpress(int *js_id_out, int *val_out);
+
+//Returns the number of joysticks being polled
+int joy_count(void);
+
+//Describes a joystick control for showing the user
+void joy_valname(int val, char *buf, int len);
+
+#endif //_JOY_H
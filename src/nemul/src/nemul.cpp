@@ -10,23 +10,43 @@
 
 #include <wx/wx.h>
 #include <wx/filedlg.h>
+#include <wx/dirdlg.h>
 
 #include "process.h"
 #include "prefs.h"
 #include "sysc.h"
 #include "cfgwin.h"
 #include "rsp.h"
+#include "snd.h"
+#include "nvm.h"
+#include "fbconv.h"
+#include "telem.h"
+#include "emul.h"
+#include "cache.h"
+#include "hle.h"
+#include "heap.h"
+#include "stracewin.h"
+#include "dbgout.h"
+#include "joy.h"
 
-/*
 enum EmulCommands
 {
-	ID_Restart = 1,
+	ID_TelemOverlay = wxID_HIGHEST + 1,
+	ID_TelemSave,
+	ID_CacheModel,
+	ID_CacheSave,
+	ID_HleSymbols,
+	ID_HleEnabled,
+	ID_DbgOutDir,
+	ID_HeapEnabled,
+	ID_HeapSave,
+	ID_StraceWin,
 };
-*/
 
 int tracing = 0;
 prefs_t EmulPrefs;
 int YelledAboutCrash = 0;
+bool EmulShowTelem = false;
 
 class EmulTimer : public wxTimer
 {
@@ -39,12 +59,22 @@ public:
 };
 
 bool EmulTimer::RunMode = false;
-uint32_t EmulTimerTicks = 0;
-uint32_t EmulVsyncs = 0;
 int EmulDisk = -1;
 
 uint16_t EmulPadState[PREFS_PAD_MAX] = {0};
 
+//Sends the buttons held on the keyboard and on joysticks to the emulation. Only changes make input events.
+static void EmulPushPads(void)
+{
+	uint16_t pads[PREFS_PAD_MAX] = {0};
+	joy_getpads(pads);
+	for(int pp = 0; pp < PREFS_PAD_MAX; pp++)
+	{
+		pads[pp] |= EmulPadState[pp];
+	}
+	sysc_pushpads(pads);
+}
+
 EmulTimer::EmulTimer(wxPanel *ScreenPanel)
 : wxTimer()
 {
@@ -55,19 +85,40 @@ EmulTimer::EmulTimer(wxPanel *ScreenPanel)
 
 void EmulTimer::Notify()
 {
+	//The debugger is served on its own thread, and waits while we run the processes
+	wxString crashmsg;
+	rsp_core_lock();
+	
 	for(int tt = 0; tt < 2; tt++) //Compensate for being 2ms instead of 1ms
 	{
-		rsp_poll();
-		
 		if(RunMode)
 		{
-			process_step();
-			EmulTimerTicks++;
-			if(EmulTimerTicks * 60ull > EmulVsyncs * 1000ull)
+			//Joysticks are polled on their own thread - pick up what they're doing each emulated millisecond
+			joy_poll();
+			EmulPushPads();
+			
+			if(emul_tick())
 			{
-				EmulVsyncs++;
 				ScreenPanel->Refresh();
 				
+				//Show how busy each process is, and how frames are coming along, once a second
+				if(emul_cur->vsyncs % 60 == 0)
+				{
+					char cpubuf[256] = {0};
+					process_cpureport(cpubuf, sizeof(cpubuf));
+					int cpulen = strlen(cpubuf);
+					if(cache_enabled() && cpulen + 2 < (int)sizeof(cpubuf))
+					{
+						cpubuf[cpulen] = ' ';
+						cache_statusline(cpubuf + cpulen + 1, sizeof(cpubuf) - (cpulen + 1));
+					}
+					dynamic_cast<wxFrame*>(wxGetTopLevelParent(ScreenPanel))->SetStatusText(cpubuf, 1);
+					
+					char telembuf[512] = {0};
+					telem_statusline(telembuf, sizeof(telembuf));
+					dynamic_cast<wxFrame*>(wxGetTopLevelParent(ScreenPanel))->SetStatusText(telembuf, 2);
+				}
+				
 				//Check if there's a debug-stopped program with no debugger attached
 				if(!rsp_present())
 				{
@@ -89,6 +140,10 @@ void EmulTimer::Notify()
 						reasons[PROCESS_DBGSTOP_CTRLC] = "Interrupted by User";
 						reasons[PROCESS_DBGSTOP_SIGNAL] = "Signal Sent";
 						reasons[PROCESS_DBGSTOP_BKPT] = "Breakpoint Hit";
+						reasons[PROCESS_DBGSTOP_HWBKPT] = "Breakpoint Hit";
+						reasons[PROCESS_DBGSTOP_WATCH] = "Watchpoint Hit";
+						reasons[PROCESS_DBGSTOP_STEP] = "Single-Step";
+						reasons[PROCESS_DBGSTOP_HISTORY] = "Start of Recorded History";
 						reasons[PROCESS_DBGSTOP_ABT] = "Data Abort";
 						reasons[PROCESS_DBGSTOP_AC] = "Alignment Check";
 						reasons[PROCESS_DBGSTOP_PF] = "Prefetch Abort";
@@ -99,14 +154,12 @@ void EmulTimer::Notify()
 						
 						dynamic_cast<wxFrame*>(wxGetTopLevelParent(ScreenPanel))->SetStatusText(emsg);
 						
-						wxString emsg2 = wxString::Format(
+						crashmsg = wxString::Format(
 							"The process with PID %d has stopped due to a crash.\n\n"
 							"The cause is: %s, at program location 0x%8.8X.\n\n"
 							"Attach a debugger or restart the simulation to continue.",
 							pptr->pid, reasons[pptr->dbgstop], pptr->regs[15]);
 						
-						wxMessageBox(emsg2, "Simulated Crash", wxICON_STOP);
-						
 						YelledAboutCrash = 1;
 					}
 					else if(YelledAboutCrash && (nstopped == 0))
@@ -118,20 +171,27 @@ void EmulTimer::Notify()
 			}
 		}
 	}
+	
+	//Let the debugger back in before waiting on the user
+	rsp_core_unlock();
+	
+	if(!crashmsg.IsEmpty())
+		wxMessageBox(crashmsg, "Simulated Crash", wxICON_STOP);
 }
 
 class EmulScreenPanel : public wxPanel
 {
 public:
 	EmulScreenPanel(wxFrame *parent);
-
+	
 	void paintEvent(wxPaintEvent &evt);
 	void paintNow();
 	void render(wxDC &dc);
-
-
+	void renderTelem(wxDC &dc, const telem_frame_t *frames, int nframes, const telem_summary_t *summary);
+	
+	
 	void OnKey(wxKeyEvent &event);
-
+	
 	DECLARE_EVENT_TABLE()
 };
 
@@ -171,59 +231,142 @@ void EmulScreenPanel::render(wxDC &dc)
 	dc.SetBackground(bb);
 	dc.Clear();
 	
-	//Get RGB565 buffer from emulation
+	//Get RGB565 buffer from emulation.
+	//It's in process memory, so keep the debugger from changing it out from under us.
+	rsp_core_lock();
 	uint16_t *fb_ptr = NULL;
 	int fb_mode = 0;
 	sysc_popfbptr(&fb_ptr, &fb_mode);
 	
-	//Stretch out to 640x480 24bpp for wxWidgets to draw
+	//Stretch out to 640x480 24bpp for wxWidgets to draw.
+	//The image wraps our buffer directly, and the bitmap is only remade when the frame changes.
+	//(Allocated once and kept, rather than static objects destroyed after wxWidgets shuts down.)
 	static unsigned char scaledpx[480][640][3];
-	if(fb_mode == 0)
-	{
-		memset(scaledpx, 0, sizeof(scaledpx));
-	}
-	else if(fb_mode == 1)
+	static wxImage *scaledimg = new wxImage(640, 480, &(scaledpx[0][0][0]), true);
+	static wxBitmap *scaledbmp = new wxBitmap();
+	
+	//Copy of the last frame converted, so unchanged frames can skip conversion and upload
+	static uint16_t lastfb[480][640];
+	static int lastmode = -1;
+	
+	static const int fb_pixels[] = { 0, 640*480, 320*240 };
+	bool dirty = (fb_mode != lastmode) || !scaledbmp->IsOk();
+	if(!dirty && fb_mode != 0)
+		dirty = (memcmp(lastfb, fb_ptr, fb_pixels[fb_mode] * sizeof(uint16_t)) != 0);
+	
+	if(dirty)
 	{
-		//640x480 RGB565
-		for(int yy = 0; yy < 480; yy++)
+		if(fb_mode == 0)
+		{
+			memset(scaledpx, 0, sizeof(scaledpx));
+		}
+		else if(fb_mode == 1)
 		{
-			for(int xx = 0; xx < 640; xx++)
+			//640x480 RGB565
+			for(int yy = 0; yy < 480; yy++)
 			{
-				scaledpx[yy][xx][2] = (((*fb_ptr) >>  0) & 0x1F) << 3;
-				scaledpx[yy][xx][1] = (((*fb_ptr) >>  5) & 0x3F) << 2;
-				scaledpx[yy][xx][0] = (((*fb_ptr) >> 11) & 0x1F) << 3;
-				fb_ptr++;
+				fbconv_row(fb_ptr + (yy * 640), &(scaledpx[yy][0][0]), 640, false);
 			}
 		}
-	}
-	else if(fb_mode == 2)
-	{
-		//320x240 RGB565
-		for(int yy = 0; yy < 480; yy += 2)
+		else if(fb_mode == 2)
 		{
-			for(int xx = 0; xx < 640; xx += 2)
+			//320x240 RGB565, each pixel doubled across and then each line doubled down
+			for(int yy = 0; yy < 480; yy += 2)
 			{
-				scaledpx[yy][xx][2] = (((*fb_ptr) >>  0) & 0x1F) << 3;
-				scaledpx[yy][xx][1] = (((*fb_ptr) >>  5) & 0x3F) << 2;
-				scaledpx[yy][xx][0] = (((*fb_ptr) >> 11) & 0x1F) << 3;
-				fb_ptr++;
-				
-				for(int cc = 0; cc < 3; cc++)
-				{
-					scaledpx[yy+1][xx  ][cc] = scaledpx[yy][xx][cc];
-					scaledpx[yy  ][xx+1][cc] = scaledpx[yy][xx][cc];
-					scaledpx[yy+1][xx+1][cc] = scaledpx[yy][xx][cc];
-				}
+				fbconv_row(fb_ptr + ((yy / 2) * 320), &(scaledpx[yy][0][0]), 320, true);
+				memcpy(&(scaledpx[yy+1][0][0]), &(scaledpx[yy][0][0]), sizeof(scaledpx[yy]));
 			}
 		}
+		
+		if(fb_mode != 0)
+			memcpy(lastfb, fb_ptr, fb_pixels[fb_mode] * sizeof(uint16_t));
+		
+		lastmode = fb_mode;
+	}
+	
+	//Take a copy of recent frame timing, if we're showing it
+	static telem_frame_t telemframes[150];
+	int ntelem = 0;
+	telem_summary_t telemsum;
+	if(EmulShowTelem)
+	{
+		ntelem = telem_history(telemframes, sizeof(telemframes) / sizeof(telemframes[0]));
+		telem_summarize(&telemsum);
 	}
 	
-	dc.DrawBitmap(wxBitmap(wxImage(640,480,&(scaledpx[0][0][0]),true)), 0, 0);
+	rsp_core_unlock();
+	
+	if(dirty)
+		*scaledbmp = wxBitmap(*scaledimg);
+	
+	dc.DrawBitmap(*scaledbmp, 0, 0);
 	
-	//Submit new controls to emulation
-	sysc_pushpads(EmulPadState);
+	if(EmulShowTelem)
+		renderTelem(dc, telemframes, ntelem, &telemsum);
 }
 
+void EmulScreenPanel::renderTelem(wxDC &dc, const telem_frame_t *frames, int nframes, const telem_summary_t *summary)
+{
+	//Graph in the bottom-left corner - a bar for each vsync, 2 pixels per emulated millisecond
+	const int graph_left = 8;
+	const int graph_bottom = 472;
+	const int graph_height = 100;
+	
+	dc.SetPen(*wxTRANSPARENT_PEN);
+	dc.SetBrush(*wxBLACK_BRUSH);
+	dc.DrawRectangle(graph_left - 4, graph_bottom - graph_height - 36, (nframes * 2) + 8 > 320 ? (nframes * 2) + 8 : 320, graph_height + 40);
+	
+	for(int ff = 0; ff < nframes; ff++)
+	{
+		const telem_frame_t *fptr = &(frames[ff]);
+		int height = 0;
+		if(fptr->fresh)
+		{
+			//New frame - green if it kept up with vsync, yellow if it took two, red if more
+			height = (int)(fptr->frame_ms * 2.0f);
+			if(fptr->frame_ms <= 17.0f)
+				dc.SetBrush(*wxGREEN_BRUSH);
+			else if(fptr->frame_ms <= 34.0f)
+				dc.SetBrush(*wxYELLOW_BRUSH);
+			else
+				dc.SetBrush(*wxRED_BRUSH);
+		}
+		else if(fptr->missed)
+		{
+			//Repeated the last frame
+			height = 4;
+			dc.SetBrush(*wxRED_BRUSH);
+		}
+		
+		if(height > graph_height)
+			height = graph_height;
+		
+		if(height > 0)
+			dc.DrawRectangle(graph_left + (ff * 2), graph_bottom - height, 2, height);
+	}
+	
+	//Line at one vsync
+	dc.SetPen(*wxWHITE_PEN);
+	dc.DrawLine(graph_left, graph_bottom - 33, graph_left + (nframes * 2), graph_bottom - 33);
+	
+	//Numbers above
+	dc.SetTextForeground(*wxWHITE);
+	dc.DrawText(wxString::Format("%d%% speed  %d fps  %d missed  %.1fms worst  %.1fms latency  %.1fms input",
+		summary->speed_pct, summary->fps, summary->missed, summary->frame_ms_max, summary->latency_ms_avg, summary->input_ms_avg),
+		graph_left, graph_bottom - graph_height - 34);
+	
+	wxString cpustr = "CPU ms:";
+	if(nframes > 0)
+	{
+		const telem_frame_t *fptr = &(frames[nframes - 1]);
+		for(int pp = 0; pp < PROCESS_MAX; pp++)
+		{
+			if(fptr->pid[pp] > 0)
+				cpustr += wxString::Format(" %d:%.1f", fptr->pid[pp], fptr->cpu_ms[pp]);
+		}
+	}
+	dc.DrawText(cpustr, graph_left, graph_bottom - graph_height - 18);
+}
 
 void EmulScreenPanel::OnKey(wxKeyEvent &event)
 {
@@ -247,6 +390,14 @@ void EmulScreenPanel::OnKey(wxKeyEvent &event)
 		}
 	}
 	
+	//Submit each change to emulation as it happens, so presses shorter than a frame aren't lost
+	if(bound)
+	{
+		rsp_core_lock();
+		EmulPushPads();
+		rsp_core_unlock();
+	}
+	
 	if(!bound)
 		event.Skip();
 }
@@ -258,7 +409,7 @@ public:
 
 private:
 	void ResetSim(void);
-
+	
 	void OnRestart(wxCommandEvent &event);
 	void OnExit(wxCommandEvent &event);
 	void OnAbout(wxCommandEvent &event);
@@ -266,6 +417,19 @@ private:
 	void OnOpenDevice(wxCommandEvent &event);
 	void OnOpenMenu(wxCommandEvent &event);
 	void OnPreferences(wxCommandEvent &event);
+	void OnTelemOverlay(wxCommandEvent &event);
+	void OnTelemSave(wxCommandEvent &event);
+	void OnCacheModel(wxCommandEvent &event);
+	void OnCacheSave(wxCommandEvent &event);
+	void OnHleSymbols(wxCommandEvent &event);
+	void OnHleEnabled(wxCommandEvent &event);
+	void OnHeapEnabled(wxCommandEvent &event);
+	void OnHeapSave(wxCommandEvent &event);
+	void OnDbgOutDir(wxCommandEvent &event);
+	void OnStraceWin(wxCommandEvent &event);
+	
+	//System call window, once it's been opened
+	StraceWin *Strace = NULL;
 
 };
 
@@ -279,22 +443,40 @@ EmulFrame::EmulFrame()
 	menuFile->AppendSeparator();
 	menuFile->Append(wxID_REFRESH, "&Restart\tCtrl-R", "Restart the current game");
 	menuFile->AppendSeparator();
+	menuFile->Append(ID_TelemSave, "Save &Telemetry...", "Save recent frame timing as CSV");
+	menuFile->Append(ID_CacheSave, "Save Cache &Profile...", "Save cache misses at each instruction for gprof");
+	menuFile->Append(ID_HleSymbols, "Load Game &Symbols...", "Find library routines to run natively in the game's ELF");
+	menuFile->Append(ID_HeapSave, "Save &Heap Report...", "Save the game's allocations by call site and by frame");
+	menuFile->Append(ID_DbgOutDir, "Program &Output Folder...", "Choose where games can write profiles and logs with _sc_dbg_fwrite");
+	menuFile->AppendSeparator();
 	menuFile->Append(wxID_EXIT);
-
+	
 	wxMenu *menuEdit = new wxMenu;
 	menuEdit->Append(wxID_PREFERENCES, "&Preferences\tCtrl-P", "Setup controls and audiovisual options");
 	
+	wxMenu *menuView = new wxMenu;
+	menuView->AppendCheckItem(ID_TelemOverlay, "Frame &Timing\tCtrl-T", "Show frame timing over the display");
+	menuView->AppendCheckItem(ID_CacheModel, "&Cache Model", "Model the hardware caches and predict clock cycles needed");
+	menuView->Check(ID_CacheModel, EmulPrefs.cache_enabled);
+	menuView->AppendCheckItem(ID_HleEnabled, "&Native Library Routines", "Run memcpy and friends natively when symbols are loaded");
+	menuView->Check(ID_HleEnabled, EmulPrefs.hle_enabled);
+	menuView->AppendCheckItem(ID_HeapEnabled, "&Heap Tracking", "Watch the game's calls to malloc and free when symbols are loaded");
+	menuView->Check(ID_HeapEnabled, EmulPrefs.heap_enabled);
+	menuView->AppendSeparator();
+	menuView->Append(ID_StraceWin, "System &Calls...", "Show how often each system call is made and how long it takes");
+	
 	wxMenu *menuHelp = new wxMenu;
 	menuHelp->Append(wxID_ABOUT);
 	
 	wxMenuBar *menuBar = new wxMenuBar;
 	menuBar->Append(menuFile, "&File");
 	menuBar->Append(menuEdit, "&Edit");
+	menuBar->Append(menuView, "&View");
 	menuBar->Append(menuHelp, "&Help");
 	
 	SetMenuBar(menuBar);
 	
-	CreateStatusBar();
+	CreateStatusBar(3);
 	SetStatusText("Neki32 Simulator - No Image Loaded");
 	
 	Bind(wxEVT_MENU, &EmulFrame::OnExit, this, wxID_EXIT);
@@ -304,6 +486,16 @@ EmulFrame::EmulFrame()
 	Bind(wxEVT_MENU, &EmulFrame::OnOpenDevice, this, wxID_CDROM);
 	Bind(wxEVT_MENU, &EmulFrame::OnOpenMenu, this, wxID_EXECUTE);
 	Bind(wxEVT_MENU, &EmulFrame::OnPreferences, this, wxID_PREFERENCES);
+	Bind(wxEVT_MENU, &EmulFrame::OnTelemOverlay, this, ID_TelemOverlay);
+	Bind(wxEVT_MENU, &EmulFrame::OnTelemSave, this, ID_TelemSave);
+	Bind(wxEVT_MENU, &EmulFrame::OnCacheModel, this, ID_CacheModel);
+	Bind(wxEVT_MENU, &EmulFrame::OnCacheSave, this, ID_CacheSave);
+	Bind(wxEVT_MENU, &EmulFrame::OnHleSymbols, this, ID_HleSymbols);
+	Bind(wxEVT_MENU, &EmulFrame::OnHleEnabled, this, ID_HleEnabled);
+	Bind(wxEVT_MENU, &EmulFrame::OnDbgOutDir, this, ID_DbgOutDir);
+	Bind(wxEVT_MENU, &EmulFrame::OnHeapEnabled, this, ID_HeapEnabled);
+	Bind(wxEVT_MENU, &EmulFrame::OnHeapSave, this, ID_HeapSave);
+	Bind(wxEVT_MENU, &EmulFrame::OnStraceWin, this, ID_StraceWin);
 	
 	wxBoxSizer *sizer = new wxBoxSizer(wxHORIZONTAL);
 	EmulScreenPanel *screen = new EmulScreenPanel(this);
@@ -353,11 +545,10 @@ void EmulFrame::OnAbout(wxCommandEvent &event)
 void EmulFrame::ResetSim()
 {
 	EmulTimer::RunMode = false;
-	EmulTimerTicks = 0;
-	EmulVsyncs = 0;
 	
-	sysc_setdiskfd(EmulDisk);
-	process_reset();
+	rsp_core_lock();
+	emul_reset(EmulDisk);
+	rsp_core_unlock();
 	
 	EmulTimer::RunMode = true;	
 }
@@ -436,9 +627,16 @@ void EmulFrame::OnPreferences(wxCommandEvent &event)
 		//Take new prefs
 		EmulPrefs = w->MutablePrefs;
 		prefs_write(&EmulPrefs);
+		snd_init(&EmulPrefs);
+		nvm_init(&EmulPrefs);
+		process_setquantum(EmulPrefs.sched_quantum);
 		
 		//Reset pad state
 		memset(EmulPadState, 0, sizeof(EmulPadState));
+		joy_init(&EmulPrefs);
+		rsp_core_lock();
+		EmulPushPads();
+		rsp_core_unlock();
 	}
 	else
 	{
@@ -447,11 +645,212 @@ void EmulFrame::OnPreferences(wxCommandEvent &event)
 	w->Destroy();
 }
 
+void EmulFrame::OnTelemOverlay(wxCommandEvent &event)
+{
+	EmulShowTelem = event.IsChecked();
+}
+
+void EmulFrame::OnTelemSave(wxCommandEvent &event)
+{
+	(void)event;
+	
+	wxFileDialog dlg(
+		this,
+		_("Save Telemetry"),
+		"",
+		"telemetry.csv",
+		"CSV files (*.csv)|*.csv",
+		wxFD_SAVE|wxFD_OVERWRITE_PROMPT);
+	
+	if(dlg.ShowModal() == wxID_CANCEL)
+		return; //User canceled
+	
+	rsp_core_lock();
+	bool saved = telem_savecsv(dlg.GetPath().c_str());
+	rsp_core_unlock();
+	
+	if(!saved)
+	{
+		wxMessageBox(
+			wxString::Format("Cannot write the given file (%s): %s\n", dlg.GetPath(), strerror(errno)),
+			_("Failed to save"), wxICON_ERROR | wxOK, this);
+	}
+}
+
+void EmulFrame::OnCacheModel(wxCommandEvent &event)
+{
+	EmulPrefs.cache_enabled = event.IsChecked();
+	prefs_write(&EmulPrefs);
+	
+	rsp_core_lock();
+	cache_init(&EmulPrefs);
+	rsp_core_unlock();
+}
+
+void EmulFrame::OnCacheSave(wxCommandEvent &event)
+{
+	(void)event;
+	
+	if(!cache_enabled())
+	{
+		wxMessageBox(_("Turn on the cache model in the View menu, and run the game for a while first."),
+			_("No cache profile"), wxICON_INFORMATION | wxOK, this);
+		return;
+	}
+	
+	wxFileDialog dlg(
+		this,
+		_("Save Cache Profile"),
+		"",
+		"gmon.out",
+		"gprof data (*.out)|*.out",
+		wxFD_SAVE|wxFD_OVERWRITE_PROMPT);
+	
+	if(dlg.ShowModal() == wxID_CANCEL)
+		return; //User canceled
+	
+	//Profile whichever process is missing most - usually the game
+	rsp_core_lock();
+	int pid = cache_busiest();
+	bool saved = cache_savegmon(dlg.GetPath().c_str(), pid);
+	rsp_core_unlock();
+	
+	if(saved)
+	{
+		SetStatusText(wxString::Format("Saved cache profile of PID %d.", pid));
+	}
+	else
+	{
+		wxMessageBox(
+			wxString::Format("Cannot write the given file (%s): %s\n", dlg.GetPath(), strerror(errno)),
+			_("Failed to save"), wxICON_ERROR | wxOK, this);
+	}
+}
+
+void EmulFrame::OnHleSymbols(wxCommandEvent &event)
+{
+	(void)event;
+	
+	wxFileDialog dlg(
+		this,
+		_("Load Game Symbols"),
+		"",
+		"",
+		"ELF executables (*.elf)|*.elf|All files|*",
+		wxFD_OPEN|wxFD_FILE_MUST_EXIST);
+	
+	if(dlg.ShowModal() == wxID_CANCEL)
+		return; //User canceled
+	
+	rsp_core_lock();
+	bool loaded = hle_loadelf(dlg.GetPath().c_str());
+	heap_loadelf(dlg.GetPath().c_str());
+	rsp_core_unlock();
+	
+	if(!loaded)
+	{
+		wxMessageBox(
+			wxString::Format("No library routines to run natively were found in %s.\n", dlg.GetPath()),
+			_("Failed to load symbols"), wxICON_ERROR | wxOK, this);
+		return;
+	}
+	
+	//Remember it for next time
+	strncpy(EmulPrefs.hle_elf_path, (const char*)(dlg.GetPath().c_str()), sizeof(EmulPrefs.hle_elf_path)-1);
+	prefs_write(&EmulPrefs);
+	SetStatusText("Loaded symbols for native library routines.");
+}
+
+void EmulFrame::OnHleEnabled(wxCommandEvent &event)
+{
+	EmulPrefs.hle_enabled = event.IsChecked();
+	prefs_write(&EmulPrefs);
+	
+	rsp_core_lock();
+	hle_setenabled(EmulPrefs.hle_enabled);
+	rsp_core_unlock();
+}
+
+void EmulFrame::OnHeapEnabled(wxCommandEvent &event)
+{
+	EmulPrefs.heap_enabled = event.IsChecked();
+	prefs_write(&EmulPrefs);
+	
+	rsp_core_lock();
+	heap_setenabled(EmulPrefs.heap_enabled);
+	rsp_core_unlock();
+}
+
+void EmulFrame::OnHeapSave(wxCommandEvent &event)
+{
+	(void)event;
+	
+	if(!EmulPrefs.heap_enabled)
+	{
+		wxMessageBox(_("Load the game's symbols and turn on heap tracking in the View menu, then run the game for a while first."),
+			_("No heap report"), wxICON_INFORMATION | wxOK, this);
+		return;
+	}
+	
+	wxFileDialog dlg(
+		this,
+		_("Save Heap Report"),
+		"",
+		"heap.txt",
+		"Text files (*.txt)|*.txt",
+		wxFD_SAVE|wxFD_OVERWRITE_PROMPT);
+	
+	if(dlg.ShowModal() == wxID_CANCEL)
+		return; //User canceled
+	
+	rsp_core_lock();
+	bool saved = heap_savereport(dlg.GetPath().c_str());
+	rsp_core_unlock();
+	
+	if(!saved)
+	{
+		wxMessageBox(
+			wxString::Format("Cannot write the given file (%s): %s\n", dlg.GetPath(), strerror(errno)),
+			_("Failed to save"), wxICON_ERROR | wxOK, this);
+	}
+}
+
+void EmulFrame::OnDbgOutDir(wxCommandEvent &event)
+{
+	(void)event;
+	
+	wxDirDialog dlg(
+		this,
+		_("Choose Program Output Folder"),
+		EmulPrefs.dbgout_dir,
+		wxDD_DEFAULT_STYLE);
+	
+	if(dlg.ShowModal() == wxID_CANCEL)
+		return; //User canceled
+	
+	strncpy(EmulPrefs.dbgout_dir, (const char*)(dlg.GetPath().c_str()), sizeof(EmulPrefs.dbgout_dir)-1);
+	prefs_write(&EmulPrefs);
+	dbgout_init(&EmulPrefs);
+	SetStatusText(wxString::Format("Programs now write files in %s", dlg.GetPath()));
+}
+
+void EmulFrame::OnStraceWin(wxCommandEvent &event)
+{
+	(void)event;
+	
+	//Counts keep updating while the window is up, alongside the game
+	if(Strace == NULL)
+		Strace = new StraceWin(this);
+	
+	Strace->Show();
+	Strace->Raise();
+}
 
 class EmulApp : public wxApp
 {
 public:
 	virtual bool OnInit();
+	virtual int OnExit();
 };
 
 bool EmulApp::OnInit()
@@ -461,10 +860,31 @@ bool EmulApp::OnInit()
 	prefs_read(&EmulPrefs);
 	process_reset();
 	rsp_init(&EmulPrefs);
+	snd_init(&EmulPrefs);
+	nvm_init(&EmulPrefs);
+	cache_init(&EmulPrefs);
+	hle_init(&EmulPrefs);
+	heap_init(&EmulPrefs);
+	dbgout_init(&EmulPrefs);
+	joy_init(&EmulPrefs);
+	process_setquantum(EmulPrefs.sched_quantum);
 	
 	EmulFrame *frame = new EmulFrame();
 	frame->Show(true);
 	return true;
 }
 
+int EmulApp::OnExit()
+{
+	//Finish off any audio being written to a file
+	snd_shutdown();
+	
+	//Stop polling joysticks
+	joy_shutdown();
+	
+	//Stop serving the debugger
+	rsp_shutdown();
+	return wxApp::OnExit();
+}
+
 wxIMPLEMENT_APP(EmulApp);
@@ -0,0 +1,481 @@
+//nvm.cpp
+//Emulated nonvolatile memory for Neki32 simulator
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#define FILE_TRACE_CAT TRACE_CAT_NVM
+#include "trace.h"
+
+#include "nvm.h"
+#include "sysc.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <chrono>
+
+//Compatibility shim for making directories and replacing files durably
+#if !defined(__MINGW32__)
+	static int nvm_c_mkdir(const char *path)
+		{ return mkdir(path, 0777); }
+	static int nvm_c_fsync(int fd)
+		{ return fsync(fd); }
+	static int nvm_c_replace(const char *from, const char *to)
+		{ return rename(from, to); }
+#else
+	#include <windows.h>
+	#include <io.h>
+	static int nvm_c_mkdir(const char *path)
+		{ return mkdir(path); }
+	static int nvm_c_fsync(int fd)
+		{ return _commit(fd); }
+	static int nvm_c_replace(const char *from, const char *to)
+		{ return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) ? 0 : -1; }
+#endif
+#ifndef O_BINARY
+	#define O_BINARY 0
+#endif
+
+//Each record is stored in its own file, laid out as follows:
+//4 bytes - magic number
+//4 bytes - length of payload, little-endian
+//32 bytes - SHA256 of payload
+//x bytes - payload
+#define NVM_MAGIC "NVM1"
+#define NVM_HDR_BYTES 40
+
+//Directory holding a subdirectory of records for each card
+static char nvm_dir[1024];
+
+//Records accessed by one emulated console
+struct nvm_ctx_s
+{
+	//Card whose records are accessed, by volume ID made safe for use in a filename
+	char card[64];
+	
+	//Record configured for saving and loading
+	char name[NVM_NAME_MAX + 1];
+	
+	//Copy of the configured record as last loaded or saved, so repeated loads needn't touch disk
+	unsigned char *cache_buf;
+	uint32_t cache_len;
+	bool cache_valid;
+	
+	//Statistics for benchmarking
+	nvm_stats_t stats;
+};
+
+//State used when no console is selected, and the one selected on this thread
+static nvm_ctx_t nvm_default;
+static thread_local nvm_ctx_t *nvm_st = &nvm_default;
+
+nvm_ctx_t *nvm_ctx_new(void)
+{
+	return (nvm_ctx_t*)calloc(1, sizeof(nvm_ctx_t));
+}
+
+void nvm_ctx_delete(nvm_ctx_t *st)
+{
+	if(st == NULL)
+		return;
+	
+	free(st->cache_buf);
+	free(st);
+}
+
+void nvm_select(nvm_ctx_t *st)
+{
+	nvm_st = (st != NULL) ? st : &nvm_default;
+}
+
+//SHA256 round constants
+static const uint32_t nvm_sha256_k[64] =
+{
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static uint32_t nvm_ror(uint32_t x, int n)
+{
+	return (x >> n) | (x << (32 - n));
+}
+
+//Processes one 64-byte block of SHA256 input
+static void nvm_sha256_block(uint32_t *state, const unsigned char *block)
+{
+	uint32_t w[64];
+	for(int ii = 0; ii < 16; ii++)
+	{
+		w[ii] = ((uint32_t)block[ii*4 + 0] << 24) | ((uint32_t)block[ii*4 + 1] << 16) |
+			((uint32_t)block[ii*4 + 2] << 8) | ((uint32_t)block[ii*4 + 3] << 0);
+	}
+	for(int ii = 16; ii < 64; ii++)
+	{
+		uint32_t s0 = nvm_ror(w[ii-15], 7) ^ nvm_ror(w[ii-15], 18) ^ (w[ii-15] >> 3);
+		uint32_t s1 = nvm_ror(w[ii-2], 17) ^ nvm_ror(w[ii-2], 19) ^ (w[ii-2] >> 10);
+		w[ii] = w[ii-16] + s0 + w[ii-7] + s1;
+	}
+	
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+	uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+	for(int ii = 0; ii < 64; ii++)
+	{
+		uint32_t s1 = nvm_ror(e, 6) ^ nvm_ror(e, 11) ^ nvm_ror(e, 25);
+		uint32_t ch = (e & f) ^ (~e & g);
+		uint32_t t1 = h + s1 + ch + nvm_sha256_k[ii] + w[ii];
+		uint32_t s0 = nvm_ror(a, 2) ^ nvm_ror(a, 13) ^ nvm_ror(a, 22);
+		uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+		uint32_t t2 = s0 + maj;
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+	
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+	state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+//Computes the SHA256 of the given data
+static void nvm_sha256(const void *data, uint32_t len, unsigned char *hash_out)
+{
+	uint32_t state[8] =
+	{
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+	
+	//Whole blocks straight from the input
+	const unsigned char *bytes = (const unsigned char*)data;
+	uint32_t whole = len & ~63u;
+	for(uint32_t bb = 0; bb < whole; bb += 64)
+		nvm_sha256_block(state, bytes + bb);
+	
+	//Remainder, padding, and length in one or two final blocks
+	unsigned char tail[128] = {0};
+	uint32_t rem = len - whole;
+	memcpy(tail, bytes + whole, rem);
+	tail[rem] = 0x80;
+	uint32_t taillen = (rem < 56) ? 64 : 128;
+	uint64_t bits = (uint64_t)len * 8;
+	for(int ii = 0; ii < 8; ii++)
+		tail[taillen - 1 - ii] = (bits >> (ii * 8)) & 0xFF;
+	
+	for(uint32_t bb = 0; bb < taillen; bb += 64)
+		nvm_sha256_block(state, tail + bb);
+	
+	for(int ii = 0; ii < 8; ii++)
+	{
+		hash_out[ii*4 + 0] = state[ii] >> 24;
+		hash_out[ii*4 + 1] = state[ii] >> 16;
+		hash_out[ii*4 + 2] = state[ii] >> 8;
+		hash_out[ii*4 + 3] = state[ii] >> 0;
+	}
+}
+
+//Checks that a record name is acceptable, as on the real system
+static bool nvm_name_valid(const char *name)
+{
+	size_t len = strlen(name);
+	if(len < 1 || len > NVM_NAME_MAX)
+		return false;
+	
+	for(size_t cc = 0; cc < len; cc++)
+	{
+		char ch = name[cc];
+		bool ok = (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || (ch == '_');
+		if(!ok)
+			return false;
+	}
+	
+	return true;
+}
+
+//Builds the host path for the configured record, with the given suffix
+static int nvm_path(char *out, size_t outlen, const char *suffix)
+{
+	if(nvm_dir[0] == '\0' || nvm_st->card[0] == '\0' || nvm_st->name[0] == '\0')
+		return -PVMK_ENOENT;
+	
+	int len = snprintf(out, outlen, "%s/%s/%s.nvm%s", nvm_dir, nvm_st->card, nvm_st->name, suffix);
+	if(len < 0 || (size_t)len >= outlen)
+		return -PVMK_ENOENT;
+	
+	return 0;
+}
+
+//Makes sure the directory for the current card's records exists
+static int nvm_mkdirs(void)
+{
+	char path[1200];
+	snprintf(path, sizeof(path), "%s", nvm_dir);
+	
+	//Create each component of the configured directory in turn, then the card's directory
+	for(char *sep = strchr(path + 1, '/'); sep != NULL; sep = strchr(sep + 1, '/'))
+	{
+		*sep = '\0';
+		nvm_c_mkdir(path);
+		*sep = '/';
+	}
+	nvm_c_mkdir(path);
+	
+	snprintf(path, sizeof(path), "%s/%s", nvm_dir, nvm_st->card);
+	if(nvm_c_mkdir(path) != 0 && errno != EEXIST)
+	{
+		TERROR("Failed to create NVM directory %s: %s\n", path, strerror(errno));
+		return -PVMK_ENOSPC;
+	}
+	
+	return 0;
+}
+
+//Throws away the cached copy of the record
+static void nvm_cache_drop(void)
+{
+	free(nvm_st->cache_buf);
+	nvm_st->cache_buf = NULL;
+	nvm_st->cache_len = 0;
+	nvm_st->cache_valid = false;
+}
+
+//Remembers the given data as the contents of the configured record
+static void nvm_cache_set(const void *data, uint32_t len)
+{
+	nvm_cache_drop();
+	nvm_st->cache_buf = (unsigned char*)malloc(len ? len : 1);
+	if(nvm_st->cache_buf == NULL)
+		return; //Just don't cache it
+	
+	memcpy(nvm_st->cache_buf, data, len);
+	nvm_st->cache_len = len;
+	nvm_st->cache_valid = true;
+}
+
+//Reads the configured record from disk into the cache, checking its integrity
+static int nvm_fill(void)
+{
+	char path[1200];
+	int patherr = nvm_path(path, sizeof(path), "");
+	if(patherr < 0)
+		return patherr;
+	
+	int fd = open(path, O_RDONLY | O_BINARY);
+	if(fd < 0)
+		return -PVMK_ENOENT;
+	
+	unsigned char hdr[NVM_HDR_BYTES];
+	unsigned char *payload = NULL;
+	uint32_t len = 0;
+	bool ok = false;
+	if(read(fd, hdr, sizeof(hdr)) == (ssize_t)sizeof(hdr) && memcmp(hdr, NVM_MAGIC, 4) == 0)
+	{
+		len = (uint32_t)hdr[4] | ((uint32_t)hdr[5] << 8) | ((uint32_t)hdr[6] << 16) | ((uint32_t)hdr[7] << 24);
+		if(len <= NVM_RECORD_MAX)
+		{
+			payload = (unsigned char*)malloc(len ? len : 1);
+			if(payload == NULL)
+			{
+				//Out of memory on the host - that says nothing about the record, so leave it be
+				TERROR("No memory on the host to load NVM record %s\n", path);
+				close(fd);
+				return -PVMK_ENOMEM;
+			}
+			
+			if(read(fd, payload, len) == (ssize_t)len)
+			{
+				unsigned char hash[32];
+				nvm_sha256(payload, len, hash);
+				ok = (memcmp(hash, hdr + 8, 32) == 0);
+			}
+		}
+	}
+	close(fd);
+	
+	if(!ok)
+	{
+		//The real system loses records that fail their integrity check
+		TWARNING("NVM record %s is corrupt, erasing\n", path);
+		free(payload);
+		unlink(path);
+		return -PVMK_ENOENT;
+	}
+	
+	nvm_cache_drop();
+	nvm_st->cache_buf = payload;
+	nvm_st->cache_len = len;
+	nvm_st->cache_valid = true;
+	return 0;
+}
+
+void nvm_init(const prefs_t *prefs)
+{
+	snprintf(nvm_dir, sizeof(nvm_dir), "%s", prefs->nvm_dir);
+	
+	//Strip trailing separators so paths come out clean
+	size_t len = strlen(nvm_dir);
+	while(len > 1 && nvm_dir[len-1] == '/')
+		nvm_dir[--len] = '\0';
+	
+	nvm_cache_drop();
+	TINFO("Storing NVM records in %s\n", nvm_dir);
+}
+
+void nvm_setcard(const char *volid)
+{
+	nvm_cache_drop();
+	nvm_st->card[0] = '\0';
+	nvm_st->name[0] = '\0';
+	
+	if(volid == NULL)
+		return;
+	
+	//Volume IDs are padded with spaces and might contain characters unsuitable for a filename
+	size_t len = strlen(volid);
+	while(len > 0 && volid[len-1] == ' ')
+		len--;
+	if(len > NVM_NAME_MAX)
+		len = NVM_NAME_MAX;
+	
+	for(size_t cc = 0; cc < len; cc++)
+	{
+		char ch = volid[cc];
+		bool ok = (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || (ch == '_');
+		nvm_st->card[cc] = ok ? ch : '_';
+	}
+	nvm_st->card[len] = '\0';
+	
+	if(nvm_st->card[0] == '\0')
+		return;
+	
+	//The system configures a record named after the card before running it
+	memcpy(nvm_st->name, nvm_st->card, len + 1);
+	TINFO("NVM configured for card %s\n", nvm_st->card);
+}
+
+int nvm_ident(const char *name)
+{
+	if(!nvm_name_valid(name))
+		return -PVMK_EINVAL;
+	
+	if(nvm_st->card[0] == '\0')
+		return -PVMK_ENXIO;
+	
+	if(strcmp(name, nvm_st->name) != 0)
+	{
+		nvm_cache_drop();
+		snprintf(nvm_st->name, sizeof(nvm_st->name), "%s", name);
+	}
+	
+	return 0;
+}
+
+int nvm_save(const void *data, uint32_t len)
+{
+	if(len > NVM_RECORD_MAX)
+		return -PVMK_ENOSPC;
+	
+	auto start = std::chrono::steady_clock::now();
+	
+	char path[1200];
+	char tmppath[1200];
+	int patherr = nvm_path(path, sizeof(path), "");
+	if(patherr < 0)
+		return patherr;
+	nvm_path(tmppath, sizeof(tmppath), ".tmp");
+	
+	int direrr = nvm_mkdirs();
+	if(direrr < 0)
+		return direrr;
+	
+	//Write the whole new record beside the old one, then swap it in, so a crash leaves one or the other
+	unsigned char hdr[NVM_HDR_BYTES];
+	memcpy(hdr, NVM_MAGIC, 4);
+	hdr[4] = len >> 0;
+	hdr[5] = len >> 8;
+	hdr[6] = len >> 16;
+	hdr[7] = len >> 24;
+	nvm_sha256(data, len, hdr + 8);
+	
+	int fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666);
+	if(fd < 0)
+	{
+		TERROR("Failed to create %s: %s\n", tmppath, strerror(errno));
+		return -PVMK_ENOSPC;
+	}
+	
+	bool ok = true;
+	ok = ok && (write(fd, hdr, sizeof(hdr)) == (ssize_t)sizeof(hdr));
+	ok = ok && (len == 0 || write(fd, data, len) == (ssize_t)len);
+	ok = ok && (nvm_c_fsync(fd) == 0);
+	ok = (close(fd) == 0) && ok;
+	ok = ok && (nvm_c_replace(tmppath, path) == 0);
+	if(!ok)
+	{
+		TERROR("Failed to write %s: %s\n", path, strerror(errno));
+		unlink(tmppath);
+		nvm_cache_drop();
+		return -PVMK_ENOSPC;
+	}
+	
+	nvm_cache_set(data, len);
+	
+	uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	nvm_st->stats.saves++;
+	nvm_st->stats.save_us_total += us;
+	if(us > nvm_st->stats.save_us_max)
+		nvm_st->stats.save_us_max = us;
+	
+	TDEBUG("Saved %u bytes to %s in %llu us\n", len, path, (unsigned long long)us);
+	return 0;
+}
+
+int nvm_load(void *buf, uint32_t len)
+{
+	nvm_st->stats.loads++;
+	if(nvm_st->cache_valid)
+	{
+		nvm_st->stats.load_hits++;
+	}
+	else
+	{
+		int fillerr = nvm_fill();
+		if(fillerr < 0)
+			return fillerr;
+	}
+	
+	uint32_t nread = (nvm_st->cache_len < len) ? nvm_st->cache_len : len;
+	memcpy(buf, nvm_st->cache_buf, nread);
+	return nread;
+}
+
+int nvm_delete(void)
+{
+	char path[1200];
+	int patherr = nvm_path(path, sizeof(path), "");
+	if(patherr < 0)
+		return patherr;
+	
+	nvm_cache_drop();
+	if(unlink(path) != 0)
+		return -PVMK_ENOENT;
+	
+	return 0;
+}
+
+void nvm_getstats(nvm_stats_t *out)
+{
+	*out = nvm_st->stats;
+}
@@ -0,0 +1,65 @@
+//nvm.h
+//Emulated nonvolatile memory for Neki32 simulator
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#ifndef _NVM_H
+#define _NVM_H
+
+#include <stdint.h>
+#include "prefs.h"
+
+//Largest record that can be saved
+#define NVM_RECORD_MAX (1024*1024)
+
+//Longest record name, not including NUL, as in _sc_nvm_ident
+#define NVM_NAME_MAX 63
+
+//Statistics about NVM access, for measuring save latency off-device
+typedef struct nvm_stats_s
+{
+	uint32_t saves; //Number of records written to disk
+	uint32_t loads; //Number of loads serviced
+	uint32_t load_hits; //Number of loads serviced from the in-memory cache
+	uint64_t save_us_total; //Total time spent saving, in microseconds
+	uint64_t save_us_max; //Longest time spent on a single save, in microseconds
+} nvm_stats_t;
+
+//Sets where records are stored on the host
+void nvm_init(const prefs_t *prefs);
+
+//Card, record and cache of one emulated console
+typedef struct nvm_ctx_s nvm_ctx_t;
+
+//Makes or frees the NVM state for a console
+nvm_ctx_t *nvm_ctx_new(void);
+void nvm_ctx_delete(nvm_ctx_t *st);
+
+//Selects the state used by later calls on this thread, or NULL for the one used when there's no console
+void nvm_select(nvm_ctx_t *st);
+
+//Sets the card whose records are being accessed, by its volume ID, and resets the configured record.
+//Pass NULL or an empty string if no card is inserted.
+void nvm_setcard(const char *volid);
+
+//Configures the record accessed by later saves and loads. Returns 0 or a negative error number.
+int nvm_ident(const char *name);
+
+//Replaces the configured record with the given data. Returns 0 or a negative error number.
+int nvm_save(const void *data, uint32_t len);
+
+//Reads the configured record. Returns the number of bytes read or a negative error number.
+int nvm_load(void *buf, uint32_t len);
+
+//Erases the configured record. Returns 0 or a negative error number.
+int nvm_delete(void);
+
+//Returns statistics about NVM access so far
+void nvm_getstats(nvm_stats_t *out);
+
+#endif //_NVM_H
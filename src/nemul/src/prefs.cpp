@@ -10,6 +10,7 @@
 
 #include "prefs.h"
 #include <wx/config.h>
+#include <wx/stdpaths.h>
 
 #include <stdio.h>
 #include <string.h>
@@ -22,6 +23,11 @@ void prefs_read(prefs_t *out)
 	memset(out, 0, sizeof(*out));
 	out->rsp_port = 14292;
 	out->rsp_enabled = 1;
+	out->rsp_undo_mb = 64;
+	out->sched_quantum = 300 * 1000;
+	out->hle_enabled = 1;
+	out->joy_press_pct = 50;
+	out->joy_release_pct = 35;
 	
 	//Load pad input bindings
 	for(int pp = 0; pp < PREFS_PAD_MAX; pp++)
@@ -40,11 +46,58 @@ void prefs_read(prefs_t *out)
 			wxConfigBase::Get()->Read(key, &val);
 			out->pads[pp].btn_val[cc] = val;
 		}
+		
+		char jskey[64] = {0};
+		snprintf(jskey, sizeof(jskey)-1, "/Pad%c/JsId", pp + 'A');
+		wxConfigBase::Get()->Read(jskey, &(out->pads[pp].js_id));
 	}
-
+	
 	//Load RSP configuration
 	wxConfigBase::Get()->Read("/Rsp/Enabled", &(out->rsp_enabled));
 	wxConfigBase::Get()->Read("/Rsp/Port", &(out->rsp_port));
+	wxConfigBase::Get()->Read("/Rsp/UndoMB", &(out->rsp_undo_mb));
+	
+	//Load audio configuration
+	int sink = 0;
+	wxConfigBase::Get()->Read("/Snd/Sink", &sink);
+	out->snd_sink = (prefs_snd_sink_t)sink;
+	
+	wxString wavpath;
+	wxConfigBase::Get()->Read("/Snd/WavPath", &wavpath);
+	strncpy(out->snd_wav_path, (const char*)(wavpath.c_str()), sizeof(out->snd_wav_path)-1);
+	
+	//Load NVM configuration, defaulting to somewhere in the user's application data
+	wxString nvmdir = wxStandardPaths::Get().GetUserDataDir() + "/nvm";
+	wxConfigBase::Get()->Read("/Nvm/Dir", &nvmdir, nvmdir);
+	strncpy(out->nvm_dir, (const char*)(nvmdir.c_str()), sizeof(out->nvm_dir)-1);
+	
+	//Load scheduler configuration
+	wxConfigBase::Get()->Read("/Sched/Quantum", &(out->sched_quantum));
+	
+	//Load cache model configuration
+	wxConfigBase::Get()->Read("/Cache/Enabled", &(out->cache_enabled));
+	wxConfigBase::Get()->Read("/Cache/ICacheKB", &(out->cache_icache_kb));
+	wxConfigBase::Get()->Read("/Cache/DCacheKB", &(out->cache_dcache_kb));
+	wxConfigBase::Get()->Read("/Cache/Ways", &(out->cache_ways));
+	wxConfigBase::Get()->Read("/Cache/MissCycles", &(out->cache_miss_cycles));
+	
+	//Load native library routine configuration
+	wxConfigBase::Get()->Read("/Hle/Enabled", &(out->hle_enabled));
+	wxString elfpath;
+	wxConfigBase::Get()->Read("/Hle/ElfPath", &elfpath);
+	strncpy(out->hle_elf_path, (const char*)(elfpath.c_str()), sizeof(out->hle_elf_path)-1);
+	
+	//Load heap tracking configuration
+	wxConfigBase::Get()->Read("/Heap/Enabled", &(out->heap_enabled));
+	
+	//Load folder for files written by programs, defaulting to somewhere in the user's application data
+	wxString dbgoutdir = wxStandardPaths::Get().GetUserDataDir() + "/output";
+	wxConfigBase::Get()->Read("/DbgOut/Dir", &dbgoutdir, dbgoutdir);
+	strncpy(out->dbgout_dir, (const char*)(dbgoutdir.c_str()), sizeof(out->dbgout_dir)-1);
+	
+	//Load joystick thresholds
+	wxConfigBase::Get()->Read("/Joy/PressPct", &(out->joy_press_pct));
+	wxConfigBase::Get()->Read("/Joy/ReleasePct", &(out->joy_release_pct));
 }
 
 //Writes configuration
@@ -65,12 +118,48 @@ void prefs_write(const prefs_t *in)
 			int val = in->pads[pp].btn_val[cc];
 			wxConfigBase::Get()->Write(key, val);
 		}
+		
+		char jskey[64] = {0};
+		snprintf(jskey, sizeof(jskey)-1, "/Pad%c/JsId", pp + 'A');
+		wxConfigBase::Get()->Write(jskey, in->pads[pp].js_id);
 	}
 	
 	//Write RSP configuration
 	wxConfigBase::Get()->Write("/Rsp/Enabled", in->rsp_enabled);
 	wxConfigBase::Get()->Write("/Rsp/Port", in->rsp_port);
-
+	wxConfigBase::Get()->Write("/Rsp/UndoMB", in->rsp_undo_mb);
+	
+	//Write audio configuration
+	wxConfigBase::Get()->Write("/Snd/Sink", (int)(in->snd_sink));
+	wxConfigBase::Get()->Write("/Snd/WavPath", wxString(in->snd_wav_path));
+	
+	//Write NVM configuration
+	wxConfigBase::Get()->Write("/Nvm/Dir", wxString(in->nvm_dir));
+	
+	//Write scheduler configuration
+	wxConfigBase::Get()->Write("/Sched/Quantum", in->sched_quantum);
+	
+	//Write cache model configuration
+	wxConfigBase::Get()->Write("/Cache/Enabled", in->cache_enabled);
+	wxConfigBase::Get()->Write("/Cache/ICacheKB", in->cache_icache_kb);
+	wxConfigBase::Get()->Write("/Cache/DCacheKB", in->cache_dcache_kb);
+	wxConfigBase::Get()->Write("/Cache/Ways", in->cache_ways);
+	wxConfigBase::Get()->Write("/Cache/MissCycles", in->cache_miss_cycles);
+	
+	//Write native library routine configuration
+	wxConfigBase::Get()->Write("/Hle/Enabled", in->hle_enabled);
+	wxConfigBase::Get()->Write("/Hle/ElfPath", wxString(in->hle_elf_path));
+	
+	//Write heap tracking configuration
+	wxConfigBase::Get()->Write("/Heap/Enabled", in->heap_enabled);
+	
+	//Write folder for files written by programs
+	wxConfigBase::Get()->Write("/DbgOut/Dir", wxString(in->dbgout_dir));
+	
+	//Write joystick thresholds
+	wxConfigBase::Get()->Write("/Joy/PressPct", in->joy_press_pct);
+	wxConfigBase::Get()->Write("/Joy/ReleasePct", in->joy_release_pct);
+	
 	//Make sure it gets out to disk
 	wxConfigBase::Get()->Flush();
 }
\ No newline at end of file
@@ -16,10 +16,18 @@ typedef enum prefs_pad_src_e
 {
 	PREFS_PAD_SRC_NONE = 0, //Unconfigured
 	PREFS_PAD_SRC_KEY, //Keyboard
-	PREFS_PAD_SRC_JOY, //Joystick via wxWidgets joystick interface
+	PREFS_PAD_SRC_JOY, //Joystick or gamepad on the host, polled on its own thread
 	PREFS_PAD_SRC_MAX //Number of different sources
 } prefs_pad_src_t;
 
+//Places that emulated audio output can be sent
+typedef enum prefs_snd_sink_e
+{
+	PREFS_SND_SINK_NULL = 0, //Discarded after being timed like the real DAC
+	PREFS_SND_SINK_WAV, //Written to a WAV file
+	PREFS_SND_SINK_MAX //Number of different sinks
+} prefs_snd_sink_t;
+
 //Enumeration of button bits that can be trigered, as in real hardware
 typedef enum prefs_pad_btn_e
 {
@@ -41,7 +49,7 @@ typedef enum prefs_pad_btn_e
 //Configuration of a gamepad
 typedef struct prefs_pad_s
 {
-	int             js_id; //Joystick ID used with this input
+	int             js_id; //Joystick used with this input, numbered in the order they're found
 	prefs_pad_src_t btn_src[PREFS_PAD_BTN_MAX]; //Source of each button input, key or button
 	int             btn_val[PREFS_PAD_BTN_MAX]; //Which key/button is used to trigger each button
 } prefs_pad_t;
@@ -56,6 +64,38 @@ typedef struct prefs_s
 	//Configuration of GDB-RSP debug listener
 	bool rsp_enabled;
 	int rsp_port;
+	int rsp_undo_mb; //Memory for recording execution history, to run backwards
+	
+	//Configuration of audio output
+	prefs_snd_sink_t snd_sink;
+	char snd_wav_path[1024];
+	
+	//Directory where NVM records are stored
+	char nvm_dir[1024];
+	
+	//Instructions a process can run before the scheduler moves on to the next
+	int sched_quantum;
+	
+	//Configuration of the cache model, with 0 for the default of each size
+	bool cache_enabled;
+	int cache_icache_kb;
+	int cache_dcache_kb;
+	int cache_ways;
+	int cache_miss_cycles;
+	
+	//Whether to run hot library routines natively, and the game ELF to find them in
+	bool hle_enabled;
+	char hle_elf_path[1024];
+	
+	//Whether to track the game's heap allocations, using the symbols of that ELF
+	bool heap_enabled;
+	
+	//Directory where programs can write files with _sc_dbg_fwrite, like profiles from gcov
+	char dbgout_dir[1024];
+	
+	//How far a joystick axis moves from center, in percent, before it presses a button, and comes back before releasing it
+	int joy_press_pct;
+	int joy_release_pct;
 	
 } prefs_t;
 
@@ -15,23 +15,103 @@
 #include "interp.h"
 #include "sysc.h"
 #include "rsp.h"
+#include "undo.h"
+#include "cache.h"
+#include "hle.h"
+#include "heap.h"
+#include "strace.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 
+#include <new>
+
 //PID1 process image from actual kernel build system
 #include "init.inc"
 
-//Storage for process table, as declared in process.h.
-process_t process_table[PROCESS_MAX];
+//Debugger breakpoints, hashed by process and address with linear probing.
+//PID 0 holds breakpoints that apply to every process.
+typedef struct process_bkpt_s
+{
+	int pid;
+	uint32_t addr;
+	int refs; //Number of times set, or 0 if this slot is empty
+} process_bkpt_t;
+#define PROCESS_BKPT_HASH (PROCESS_BKPT_MAX * 2)
+
+//Processes and scheduling of one emulated console
+struct process_ctx_s
+{
+	//Storage for the process table
+	process_t table[PROCESS_MAX];
+	
+	//Instructions a process can run before another gets a turn
+	uint32_t quantum = PROCESS_TICK_INSTRS;
+	
+	//Process table index where the scheduler looks first for the next process to run
+	int rr_cursor;
+	
+	//Instructions that could have been run, but nothing was runnable
+	uint64_t idle_instrs;
+	
+	//Instructions run and system calls made by all processes since the table was reset
+	uint64_t total_instrs;
+	uint64_t total_syscalls;
+	
+	//Instructions that could have been run since the table was reset, idle or not, for keeping time
+	uint64_t elapsed_instrs;
+	
+	//Debugger breakpoints
+	process_bkpt_t bkpt_hash[PROCESS_BKPT_HASH];
+	int bkpt_count;
+	
+	//Set when running backwards takes back a write to watched memory
+	bool reverse_watched;
+	
+	//Usage at the time of the last CPU report
+	uint64_t report_instrs[PROCESS_MAX];
+	int report_pid[PROCESS_MAX];
+	uint64_t report_idle;
+};
+
+//State used when no console is selected, and the one selected on this thread
+static process_ctx_t process_default;
+static thread_local process_ctx_t *process_st = &process_default;
+
+//Process table of the selected console, as declared in process.h.
+thread_local process_t *process_table = process_default.table;
+
+process_ctx_t *process_ctx_new(void)
+{
+	return new(std::nothrow) process_ctx_t();
+}
+
+void process_ctx_delete(process_ctx_t *st)
+{
+	if(st == NULL)
+		return;
+	
+	for(int pp = 0; pp < PROCESS_MAX; pp++)
+	{
+		free(st->table[pp].mem);
+		free(st->table[pp].mexec_mem);
+	}
+	delete st;
+}
+
+void process_select(process_ctx_t *st)
+{
+	process_st = (st != NULL) ? st : &process_default;
+	process_table = process_st->table;
+}
 
 void process_reset(void)
 {
 	TINFO("%s", "Resetting process table...\n");
 	
 	//Free all the dynamically allocated parts of the process table
-	//This is just the user memory for the moment
+	//This is the user memory and any pending mexec image
 	for(int pp = 0; pp < PROCESS_MAX; pp++)
 	{
 		if(process_table[pp].mem != NULL)
@@ -39,10 +119,19 @@ void process_reset(void)
 			TDEBUG("Freeing memory from process %d\n", process_table[pp].pid);
 			free(process_table[pp].mem); process_table[pp].mem = NULL;
 		}
+		if(process_table[pp].mexec_mem != NULL)
+		{
+			free(process_table[pp].mexec_mem); process_table[pp].mexec_mem = NULL;
+		}
 	}
 	
-	//Clear the process table
-	memset(process_table, 0, sizeof(process_table));
+	//Clear the process table, and any history of the old one
+	memset(process_table, 0, sizeof(process_st->table));
+	undo_barrier();
+	process_st->rr_cursor = 0;
+	process_st->total_instrs = 0;
+	process_st->total_syscalls = 0;
+	process_st->elapsed_instrs = 0;
 	TINFO("%s", "Process table reset.\n");
 	
 	//Make the initial process
@@ -65,58 +154,243 @@ void process_reset(void)
 	TDEBUG("PID1 set up, %lu bytes in init process.\n", sizeof(init));
 }
 
-void process_step(void)
+//Returns where a breakpoint would go in the hash table, if there's no collision
+static int process_bkpt_home(int pid, uint32_t addr)
 {
-	TDEBUG("%s", "=== PROCESS STEP ===\n");
-	
-	//Pick a process to run
-	process_t *pptr = NULL;
-	for(int pp = 0; pp < PROCESS_MAX; pp++)
+	uint32_t key = (addr >> 2) ^ ((uint32_t)pid << 24);
+	return (key * 2654435761u) % PROCESS_BKPT_HASH;
+}
+
+//Finds the hash table slot holding the given breakpoint, or the empty slot where it would go
+static int process_bkpt_slot(int pid, uint32_t addr)
+{
+	int ss = process_bkpt_home(pid, addr);
+	while(process_st->bkpt_hash[ss].refs > 0)
 	{
-		if(process_table[pp].state != PROCESS_STATE_ALIVE)
-			continue; //Not an alive process - dead or nonexistant
-		
-		if(process_table[pp].paused && !process_table[pp].unpaused)
-			continue; //Called _sc_pause and nobody's unpaused them yet
+		if(process_st->bkpt_hash[ss].pid == pid && process_st->bkpt_hash[ss].addr == addr)
+			break;
 		
-		if(process_table[pp].dbgstop)
-			continue; //Stopped for debugging
+		ss = (ss + 1) % PROCESS_BKPT_HASH;
+	}
+	return ss;
+}
+
+bool process_bkpt_add(int pid, uint32_t addr)
+{
+	if(pid < 0)
+		pid = 0;
+	
+	int ss = process_bkpt_slot(pid, addr);
+	if(process_st->bkpt_hash[ss].refs == 0)
+	{
+		//New breakpoint - keep the table at most half full so probing stays short
+		if(process_st->bkpt_count >= PROCESS_BKPT_MAX)
+			return false;
 		
-		//Likely candidate - todo, replicate scheduling algo from real kernel
-		pptr = &(process_table[pp]);
-		break;
+		process_st->bkpt_hash[ss].pid = pid;
+		process_st->bkpt_hash[ss].addr = addr;
+		process_st->bkpt_count++;
+	}
+	
+	process_st->bkpt_hash[ss].refs++;
+	return true;
+}
+
+bool process_bkpt_remove(int pid, uint32_t addr)
+{
+	if(pid < 0)
+		pid = 0;
+	
+	int ss = process_bkpt_slot(pid, addr);
+	if(process_st->bkpt_hash[ss].refs == 0)
+		return false;
+	
+	process_st->bkpt_hash[ss].refs--;
+	if(process_st->bkpt_hash[ss].refs > 0)
+		return true;
+	
+	process_st->bkpt_count--;
+	
+	//Shift back any later entries in the run that would no longer be found past the hole
+	int hole = ss;
+	int next = (hole + 1) % PROCESS_BKPT_HASH;
+	while(process_st->bkpt_hash[next].refs > 0)
+	{
+		int home = process_bkpt_home(process_st->bkpt_hash[next].pid, process_st->bkpt_hash[next].addr);
+		int dist_hole = (hole - home + PROCESS_BKPT_HASH) % PROCESS_BKPT_HASH;
+		int dist_next = (next - home + PROCESS_BKPT_HASH) % PROCESS_BKPT_HASH;
+		if(dist_hole < dist_next)
+		{
+			process_st->bkpt_hash[hole] = process_st->bkpt_hash[next];
+			process_st->bkpt_hash[next].refs = 0;
+			hole = next;
+		}
+		next = (next + 1) % PROCESS_BKPT_HASH;
 	}
+	return true;
+}
+
+void process_bkpt_clear(void)
+{
+	memset(process_st->bkpt_hash, 0, sizeof(process_st->bkpt_hash));
+	process_st->bkpt_count = 0;
+}
+
+//Checks if the process is about to run an instruction with a debugger breakpoint on it
+static bool process_bkpt_hit(process_t *pptr)
+{
+	uint32_t pc = pptr->regs[15];
 	
-	if(pptr == NULL)
+	//Let the process run the instruction it last stopped on, if it's been resumed there
+	if(pptr->bkpt_skip)
 	{
-		TDEBUG("%s", "No runnable processes.\n");
-		return;
+		pptr->bkpt_skip = false;
+		if(pc == pptr->bkpt_skip_pc)
+			return false;
 	}
 	
-	TDEBUG("Scheduled process %d\n", pptr->pid);
+	if(process_st->bkpt_hash[process_bkpt_slot(pptr->pid, pc)].refs > 0)
+		return true;
+	if(process_st->bkpt_hash[process_bkpt_slot(0, pc)].refs > 0)
+		return true;
 	
-	//A process that was paused and then unpaused can be paused again
-	if(pptr->paused && pptr->unpaused)
+	return false;
+}
+
+//Checks if there's a debugger breakpoint anywhere in a range of the process's code
+static bool process_bkpt_within(const process_t *pptr, uint32_t start, uint32_t end)
+{
+	if(process_st->bkpt_count == 0)
+		return false;
+	
+	for(uint32_t addr = start; addr < end; addr += 4)
 	{
-		pptr->paused = 0;
-		pptr->unpaused = 0;
+		if(process_st->bkpt_hash[process_bkpt_slot(pptr->pid, addr)].refs > 0)
+			return true;
+		if(process_st->bkpt_hash[process_bkpt_slot(0, addr)].refs > 0)
+			return true;
 	}
 	
-	//This is super approximate but whatever
-	//The Nuvoton chip runs 300MHz so one millisecond is about 300K instructions (dev version)
-	//The Allwinner chip is a bit faster, 500MHz or so (consumer version prototype)
-	interp_result_t result = INTERP_RESULT_OK;
-	for(int instr = 0; instr < 300 * 1000; instr++)
+	return false;
+}
+
+void process_dbgstep(process_t *pptr, uint32_t start, uint32_t end)
+{
+	pptr->step_active = true;
+	pptr->step_start = start;
+	pptr->step_end = end;
+	pptr->dbgstop = PROCESS_DBGSTOP_NONE;
+}
+
+//Checks if a process being stepped by the debugger has left its range
+static bool process_step_done(const process_t *pptr)
+{
+	uint32_t pc = pptr->regs[15];
+	return pc < pptr->step_start || pc >= pptr->step_end;
+}
+
+//Checks memory changed by running backwards against write watchpoints
+static void process_reverse_memcb(process_t *pptr, uint32_t addr, uint32_t len)
+{
+	if(interp_watch_find(pptr->pid, addr, len, INTERP_WATCH_WRITE))
+		process_st->reverse_watched = true;
+}
+
+void process_dbgreverse(int pid, bool step)
+{
+	process_st->reverse_watched = false;
+	while(1)
 	{
-		result = interp_step(pptr->regs, &(pptr->cpsr), pptr->mem, pptr->size);
-		if(result != INTERP_RESULT_OK)
+		process_t *pptr = undo_back(process_reverse_memcb);
+		if(pptr == NULL)
 		{
-			//Something happened that would have caused a CPU exception/interrupt
-			break;
+			//Out of history - report it on the process the debugger asked about, or whoever's left
+			process_t *report = process_find(pid);
+			for(int pp = 0; report == NULL && pp < PROCESS_MAX; pp++)
+			{
+				if(process_table[pp].state == PROCESS_STATE_ALIVE)
+					report = &(process_table[pp]);
+			}
+			
+			if(report != NULL)
+				rsp_dbgstop(report->pid, PROCESS_DBGSTOP_HISTORY);
+			
+			return;
+		}
+		
+		//Now sitting before the instruction just taken back
+		if(process_st->reverse_watched)
+		{
+			rsp_dbgstop(pptr->pid, PROCESS_DBGSTOP_WATCH);
+			return;
+		}
+		
+		if(step && (pid <= 0 || pptr->pid == pid))
+		{
+			rsp_dbgstop(pptr->pid, PROCESS_DBGSTOP_STEP);
+			return;
+		}
+		
+		if(!step && process_st->bkpt_count > 0)
+		{
+			uint32_t pc = pptr->regs[15];
+			if(process_st->bkpt_hash[process_bkpt_slot(pptr->pid, pc)].refs > 0 || process_st->bkpt_hash[process_bkpt_slot(0, pc)].refs > 0)
+			{
+				//Let it run forwards from the breakpoint when resumed
+				pptr->bkpt_skip = true;
+				pptr->bkpt_skip_pc = pc;
+				rsp_dbgstop(pptr->pid, PROCESS_DBGSTOP_HWBKPT);
+				return;
+			}
 		}
 	}
+}
+
+//Checks if the given process can be run
+static bool process_runnable(const process_t *pptr)
+{
+	if(pptr->state != PROCESS_STATE_ALIVE)
+		return false; //Not an alive process - dead or nonexistant
+	
+	if(pptr->paused && !pptr->unpaused)
+		return false; //Called _sc_pause and nobody's unpaused them yet
 	
-	//See what happened to the process
+	if(pptr->dbgstop)
+		return false; //Stopped for debugging
+	
+	return true;
+}
+
+//Checks if a process was paused and has since been woken up
+static bool process_woken(const process_t *pptr)
+{
+	return process_runnable(pptr) && pptr->paused && pptr->unpaused;
+}
+
+//Picks the next process to run
+static process_t *process_pick(void)
+{
+	//Only the highest priority level with anything runnable gets to run.
+	//Within it, processes just woken from _sc_pause go first, so they can respond to whatever woke them.
+	//Otherwise processes take turns, starting with whichever holds the cursor.
+	process_t *best = NULL;
+	for(int nn = 0; nn < PROCESS_MAX; nn++)
+	{
+		process_t *pptr = &(process_table[(process_st->rr_cursor + nn) % PROCESS_MAX]);
+		if(!process_runnable(pptr))
+			continue;
+		
+		if(best == NULL || pptr->prio > best->prio)
+			best = pptr;
+		else if(pptr->prio == best->prio && process_woken(pptr) && !process_woken(best))
+			best = pptr;
+	}
+	return best;
+}
+
+//Handles whatever stopped the interpreter running a process
+static void process_result(process_t *pptr, interp_result_t result)
+{
 	switch(result)
 	{
 		case INTERP_RESULT_OK:
@@ -128,6 +402,7 @@ void process_step(void)
 		case INTERP_RESULT_SYSCALL:
 		{
 			//User code triggered a system-call, handle it before continuing
+			process_st->total_syscalls++;
 			sysc(pptr);
 			break;
 		}
@@ -138,6 +413,12 @@ void process_step(void)
 			rsp_dbgstop(pptr->pid, PROCESS_DBGSTOP_BKPT);
 			break;
 		}
+		case INTERP_RESULT_WATCH:
+		{
+			//Touched watched memory - the instruction is done, so stop after it
+			rsp_dbgstop(pptr->pid, PROCESS_DBGSTOP_WATCH);
+			break;
+		}
 		case INTERP_RESULT_FATAL:
 		{
 			//Interpreter failure
@@ -172,8 +453,227 @@ void process_step(void)
 			exit(-1);
 		}
 	}
+}
+
+void process_setquantum(uint32_t instrs)
+{
+	process_st->quantum = (instrs > 0) ? instrs : PROCESS_TICK_INSTRS;
+}
+
+bool process_setprio(int pid, int prio)
+{
+	if(prio < PROCESS_PRIO_MIN || prio > PROCESS_PRIO_MAX)
+		return false;
+	
+	process_t *pptr = process_find(pid);
+	if(pptr == NULL || pptr->state != PROCESS_STATE_ALIVE)
+		return false;
+	
+	pptr->prio = prio;
+	return true;
+}
+
+void process_step(void)
+{
+	TDEBUG("%s", "=== PROCESS STEP ===\n");
+	
+	//This is super approximate but whatever - share out a millisecond's worth of instructions.
+	//Like the real kernel, a process keeps the CPU until it blocks or uses its quantum.
+	uint32_t budget = PROCESS_TICK_INSTRS;
+	
+	//Count the millisecond against anyone blocked in a system call
+	for(int pp = 0; pp < PROCESS_MAX; pp++)
+	{
+		if(process_table[pp].state == PROCESS_STATE_ALIVE && process_table[pp].paused && !process_table[pp].unpaused)
+			process_table[pp].stats.paused_ms++;
+	}
 	
-	return;
+	while(budget > 0)
+	{
+		process_t *pptr = process_pick();
+		if(pptr == NULL)
+		{
+			TDEBUG("%s", "No runnable processes.\n");
+			process_st->idle_instrs += budget;
+			process_st->elapsed_instrs += budget;
+			return;
+		}
+		
+		int idx = pptr - process_table;
+		process_st->rr_cursor = idx;
+		if(pptr->slice_left == 0)
+			pptr->slice_left = process_st->quantum;
+		
+		TDEBUG("Scheduled process %d\n", pptr->pid);
+		strace_resume(pptr);
+		
+		//A process that was paused and then unpaused can be paused again
+		if(pptr->paused && pptr->unpaused)
+		{
+			pptr->paused = 0;
+			pptr->unpaused = 0;
+		}
+		
+		//Run until something happens or the process is out of time
+		interp_watch_select(pptr->pid);
+		cache_switch(pptr->pid);
+		uint32_t limit = (pptr->slice_left < budget) ? pptr->slice_left : budget;
+		uint32_t ran = 0;
+		interp_result_t result = INTERP_RESULT_OK;
+		bool recording = undo_active();
+		bool dbgcheck = (process_st->bkpt_count > 0) || pptr->step_active || recording;
+		bool hlecheck = hle_switch(pptr) && !recording && !pptr->step_active && !cache_enabled();
+		bool heapcheck = heap_switch(pptr);
+		bool bkpt = false;
+		bool stepped = false;
+		interp_counts_t counts_before;
+		interp_counts(&counts_before);
+		while(ran < limit)
+		{
+			//Stop short of any instruction with a debugger breakpoint on it
+			if(dbgcheck && process_st->bkpt_count > 0 && process_bkpt_hit(pptr))
+			{
+				bkpt = true;
+				break;
+			}
+			
+			//Keep what's needed to run backwards over the instruction, if the debugger wants that
+			if(dbgcheck && recording)
+				undo_begin(pptr);
+			
+			//Watch for calls to malloc and friends, if we're tracking them
+			if(heapcheck)
+				heap_observe(pptr);
+			
+			//Run whole library routines natively where we can, unless the debugger wants to stop in them
+			uint32_t hle_start = 0;
+			uint32_t hle_end = 0;
+			if(hlecheck && hle_find(pptr, &hle_start, &hle_end) && !process_bkpt_within(pptr, hle_start, hle_end))
+			{
+				uint32_t hle_instrs = hle_run(pptr, limit - ran);
+				if(hle_instrs > 0)
+				{
+					ran += hle_instrs;
+					continue;
+				}
+			}
+			
+			//Without the debugger looking at each instruction, common pairs can run together
+			uint32_t nrun = 1;
+			if(!dbgcheck && limit - ran >= 2)
+				result = interp_step_pair(pptr->regs, &(pptr->cpsr), pptr->mem, pptr->size, &nrun);
+			else
+				result = interp_step(pptr->regs, &(pptr->cpsr), pptr->mem, pptr->size);
+			
+			ran += nrun;
+			if(result != INTERP_RESULT_OK)
+			{
+				//Something happened that would have caused a CPU exception/interrupt
+				break;
+			}
+			
+			if(dbgcheck && recording)
+				undo_end(pptr);
+			
+			//Keep stepping without bothering the debugger until we leave the range it gave
+			if(dbgcheck && pptr->step_active && process_step_done(pptr))
+			{
+				stepped = true;
+				break;
+			}
+		}
+		
+		budget -= ran;
+		pptr->slice_left -= ran;
+		pptr->cpu_instrs += ran;
+		process_st->total_instrs += ran;
+		process_st->elapsed_instrs += ran;
+		
+		interp_counts_t counts_after;
+		interp_counts(&counts_after);
+		pptr->stats.loads += counts_after.loads - counts_before.loads;
+		pptr->stats.stores += counts_after.stores - counts_before.stores;
+		pptr->stats.branches += counts_after.branches - counts_before.branches;
+		
+		//See what happened to the process
+		if(bkpt)
+		{
+			pptr->bkpt_skip = true;
+			pptr->bkpt_skip_pc = pptr->regs[15];
+			rsp_dbgstop(pptr->pid, PROCESS_DBGSTOP_HWBKPT);
+		}
+		else
+		{
+			process_result(pptr, result);
+			
+			//Finish recording the instruction, now that any system call it made is done
+			if(recording)
+				undo_end(pptr);
+			
+			//A system call counts as a step too, if it returned
+			if(result == INTERP_RESULT_SYSCALL && pptr->step_active && process_runnable(pptr))
+				stepped = process_step_done(pptr);
+		}
+		
+		if(stepped)
+			rsp_dbgstop(pptr->pid, PROCESS_DBGSTOP_STEP);
+		
+		//Move on to the next process if this one's turn is over.
+		//If it's still going, but woke up someone else, the next pick lets them respond first.
+		if(pptr->slice_left == 0 || !process_runnable(pptr))
+		{
+			pptr->slice_left = 0;
+			process_st->rr_cursor = (idx + 1) % PROCESS_MAX;
+		}
+	}
+}
+
+void process_cpureport(char *buf, int len)
+{
+	//Usage since last report, as a share of all instructions we could have run
+	uint64_t total = process_st->idle_instrs - process_st->report_idle;
+	uint64_t delta[PROCESS_MAX] = {0};
+	for(int pp = 0; pp < PROCESS_MAX; pp++)
+	{
+		if(process_table[pp].pid == process_st->report_pid[pp] && process_table[pp].cpu_instrs >= process_st->report_instrs[pp])
+			delta[pp] = process_table[pp].cpu_instrs - process_st->report_instrs[pp];
+		else
+			delta[pp] = process_table[pp].cpu_instrs;
+		
+		total += delta[pp];
+		process_st->report_instrs[pp] = process_table[pp].cpu_instrs;
+		process_st->report_pid[pp] = process_table[pp].pid;
+	}
+	
+	int used = snprintf(buf, len, "CPU:");
+	for(int pp = 0; pp < PROCESS_MAX && used < len; pp++)
+	{
+		if(process_table[pp].state != PROCESS_STATE_ALIVE)
+			continue;
+		
+		int pct = total ? (int)((delta[pp] * 100) / total) : 0;
+		used += snprintf(buf + used, len - used, " %d:%d%%", process_table[pp].pid, pct);
+	}
+	if(used < len)
+	{
+		int idle = total ? (int)(((process_st->idle_instrs - process_st->report_idle) * 100) / total) : 100;
+		snprintf(buf + used, len - used, " idle:%d%%", idle);
+	}
+	
+	process_st->report_idle = process_st->idle_instrs;
+}
+
+void process_totals(uint64_t *instrs_out, uint64_t *syscalls_out)
+{
+	*instrs_out = process_st->total_instrs;
+	*syscalls_out = process_st->total_syscalls;
+}
+
+uint64_t process_elapsed_ns(void)
+{
+	uint64_t ms = process_st->elapsed_instrs / PROCESS_TICK_INSTRS;
+	uint64_t part = process_st->elapsed_instrs % PROCESS_TICK_INSTRS;
+	return (ms * 1000000) + ((part * 1000000) / PROCESS_TICK_INSTRS);
 }
 
 int process_fork(int parent)
@@ -195,6 +695,9 @@ int process_fork(int parent)
 		exit(-1);
 	}
 	
+	//Can't take back creating a process
+	undo_barrier();
+	
 	//Find free spot for child
 	int child_idx = -1;
 	for(int pp = 0; pp < PROCESS_MAX; pp++)
@@ -235,6 +738,17 @@ int process_fork(int parent)
 	child_pptr->state = PROCESS_STATE_ALIVE;
 	child_pptr->paused = false;
 	child_pptr->unpaused = false;
+	child_pptr->dbgstop = PROCESS_DBGSTOP_NONE;
+	child_pptr->waitst = 0;
+	child_pptr->slice_left = 0;
+	child_pptr->cpu_instrs = 0;
+	memset(&(child_pptr->stats), 0, sizeof(child_pptr->stats));
+	child_pptr->bkpt_skip = false;
+	child_pptr->step_active = false;
+	
+	//Signal mask and priority are inherited
+	child_pptr->sigmask = parent_pptr->sigmask;
+	child_pptr->prio = parent_pptr->prio;
 	
 	//Child gets a PID corresponding to its index in the process table
 	child_pptr->pid += PROCESS_MAX;
@@ -273,4 +787,82 @@ process_t *process_find(int pid)
 		return &(process_table[pp]);
 	}
 	return NULL;
-}
\ No newline at end of file
+}
+void process_kill(process_t *pptr, uint32_t waitst)
+{
+	TDEBUG("Process %d died with status %8.8X\n", pptr->pid, waitst);
+	
+	//Can't take back freeing its memory
+	undo_barrier();
+	heap_exit(pptr->pid);
+	
+	//Dead processes don't need their memory, only their status
+	if(pptr->mem != NULL)
+	{
+		free(pptr->mem);
+		pptr->mem = NULL;
+	}
+	pptr->size = 0;
+	
+	if(pptr->mexec_mem != NULL)
+	{
+		free(pptr->mexec_mem);
+		pptr->mexec_mem = NULL;
+	}
+	pptr->mexec_size = 0;
+	
+	pptr->state = PROCESS_STATE_DEAD;
+	pptr->waitst = waitst;
+	
+	//Orphaned children are adopted by PID1, which then has to reap them
+	process_t *init_pptr = process_find(1);
+	for(int pp = 0; pp < PROCESS_MAX; pp++)
+	{
+		if(process_table[pp].state == PROCESS_STATE_NONE)
+			continue;
+		if(process_table[pp].ppid != pptr->pid)
+			continue;
+		
+		process_table[pp].ppid = 1;
+		if(process_table[pp].state == PROCESS_STATE_DEAD && init_pptr != NULL && init_pptr->state == PROCESS_STATE_ALIVE)
+			init_pptr->unpaused = true;
+	}
+	
+	//Parent might be waiting for this
+	process_t *parent_pptr = process_find(pptr->ppid);
+	if(parent_pptr != NULL && parent_pptr->state == PROCESS_STATE_ALIVE)
+	{
+		parent_pptr->unpaused = true;
+	}
+	else if(pptr->pid != 1)
+	{
+		//Nobody left to collect the status
+		TWARNING("Process %d died with no parent, reaping\n", pptr->pid);
+		process_reap(pptr);
+	}
+	else
+	{
+		TWARNING("PID1 died with status %8.8X\n", waitst);
+	}
+}
+
+void process_reap(process_t *pptr)
+{
+	TDEBUG("Reaping process %d\n", pptr->pid);
+	assert(pptr->state == PROCESS_STATE_DEAD);
+	assert(pptr->mem == NULL && pptr->mexec_mem == NULL);
+	
+	//Leave the PID in place - process_fork uses it to hand out the next PID for this entry
+	pptr->state = PROCESS_STATE_NONE;
+	pptr->ppid = 0;
+	pptr->paused = false;
+	pptr->unpaused = false;
+	pptr->dbgstop = PROCESS_DBGSTOP_NONE;
+	pptr->sigmask = 0;
+	pptr->waitst = 0;
+	pptr->env_len = 0;
+	pptr->slice_left = 0;
+	pptr->prio = PROCESS_PRIO_NORMAL;
+	pptr->cpu_instrs = 0;
+	memset(&(pptr->stats), 0, sizeof(pptr->stats));
+}
@@ -29,6 +29,10 @@ typedef enum process_dbgstop_e
 	PROCESS_DBGSTOP_CTRLC, //Interrupted by user / debugger just connected
 	PROCESS_DBGSTOP_SIGNAL, //Stopped instead of taking a signal
 	PROCESS_DBGSTOP_BKPT, //Hit a GDB breakpoint instruction
+	PROCESS_DBGSTOP_HWBKPT, //Reached a breakpoint set by the debugger
+	PROCESS_DBGSTOP_WATCH, //Touched memory watched by the debugger
+	PROCESS_DBGSTOP_STEP, //Finished stepping as the debugger asked
+	PROCESS_DBGSTOP_HISTORY, //Ran backwards to the start of recorded history
 	PROCESS_DBGSTOP_ABT, //Data abort exception
 	PROCESS_DBGSTOP_AC, //Alignment check exception
 	PROCESS_DBGSTOP_PF, //Prefetch abort exception
@@ -36,6 +40,20 @@ typedef enum process_dbgstop_e
 	PROCESS_DBGSTOP_MAX
 } process_dbgstop_t;
 
+//Performance counters kept for each process, for developers to measure their games.
+//Instructions retired are counted by cpu_instrs.
+#define PROCESS_STATS_SYSCALLS 256
+typedef struct process_stats_s
+{
+	uint64_t loads; //Memory words/halfwords/bytes read
+	uint64_t stores; //Memory words/halfwords/bytes written
+	uint64_t branches; //Taken branches and other writes to the PC
+	uint64_t paused_ms; //Time spent blocked in system calls
+	uint64_t disk_bytes; //Bytes read from disk
+	uint64_t flips; //Framebuffers enqueued for display
+	uint64_t syscalls[PROCESS_STATS_SYSCALLS]; //System calls made, by number
+} process_stats_t;
+
 //Process control block + saved context + reference to memory space
 //Everything about each emulated process
 typedef struct process_s
@@ -76,22 +94,115 @@ typedef struct process_s
 	//If the process is stopped by the debugger, and why
 	process_dbgstop_t dbgstop;
 	
+	//Signals blocked by the process
+	uint32_t sigmask;
+	
+	//Wait status to be delivered to the parent, once the process is dead
+	uint32_t waitst;
+	
+	//Instructions left in the process's current scheduling quantum
+	uint32_t slice_left;
+	
+	//Scheduling priority - runnable processes at a higher level always go first.
+	//Games can't set this, so everything runs at PROCESS_PRIO_NORMAL unless the debugger changes it.
+	int prio;
+	
+	//Instructions executed by the process, for CPU accounting
+	uint64_t cpu_instrs;
+	
+	//Other performance counters
+	process_stats_t stats;
+	
+	//Set when the process stops on a debugger breakpoint, so it can get past it when resumed
+	bool bkpt_skip;
+	uint32_t bkpt_skip_pc;
+	
+	//Whether the debugger asked the process to step, and the range of addresses to step through.
+	//Stepping stops once the PC is outside the range, so an empty range steps one instruction.
+	bool step_active;
+	uint32_t step_start;
+	uint32_t step_end;
+	
 } process_t;
 
-//Table of emulated processes - fixed number like the real machine (8 as of kernel r0u3)
+//Table of emulated processes - fixed number like the real machine (8 as of kernel r0u3).
+//Points at the table of the console selected on this thread.
 #define PROCESS_MAX 8
-extern process_t process_table[PROCESS_MAX];
+extern thread_local process_t *process_table;
+
+//Process table, scheduler and breakpoints of one emulated console
+typedef struct process_ctx_s process_ctx_t;
+
+//Makes or frees the process state for a console. Freeing it frees the memory of its processes.
+process_ctx_t *process_ctx_new(void);
+void process_ctx_delete(process_ctx_t *st);
+
+//Selects the state used by later calls on this thread, or NULL for the one used when there's no console
+void process_select(process_ctx_t *st);
 
 //Finds process by PID
 process_t *process_find(int pid);
 
+//Instructions that can run in one 1ms tick of simulation.
+//The Nuvoton chip runs 300MHz so one millisecond is about 300K instructions (dev version)
+//The Allwinner chip is a bit faster, 500MHz or so (consumer version prototype)
+#define PROCESS_TICK_INSTRS (300 * 1000)
+
 //Resets process table for new run of the emulator
 void process_reset(void);
 
-//Runs approximately 1ms of simulation on a runnable process, if any
+//Sets how many instructions a process can run before the next runnable process gets a turn
+void process_setquantum(uint32_t instrs);
+
+//Range of scheduling priorities, higher running first
+#define PROCESS_PRIO_MIN (-8)
+#define PROCESS_PRIO_NORMAL 0
+#define PROCESS_PRIO_MAX 8
+
+//Sets the scheduling priority of a process. Returns false if there's no such process or the level is out of range.
+bool process_setprio(int pid, int prio);
+
+//Runs approximately 1ms of simulation, sharing it among runnable processes
 void process_step(void);
 
+//Describes CPU usage of each process since the last call
+void process_cpureport(char *buf, int len);
+
+//Gets the instructions run and system calls made by all processes since the table was reset
+void process_totals(uint64_t *instrs_out, uint64_t *syscalls_out);
+
+//Gets the emulated time since the table was reset, to the instruction, in nanoseconds
+uint64_t process_elapsed_ns(void);
+
 //Tries to make a copy of the given process
 int process_fork(int parent);
 
+//Kills the given process, freeing its memory and leaving the given wait status for its parent
+void process_kill(process_t *pptr, uint32_t waitst);
+
+//Frees the process table entry of a dead process after its parent collects its status
+void process_reap(process_t *pptr);
+
+//Most debugger breakpoints that can be set at once
+#define PROCESS_BKPT_MAX 256
+
+//Sets a debugger breakpoint at the given address in the given process, or in every process if pid <= 0.
+//Setting the same breakpoint again needs another removal to clear it.
+//Returns false if there's no room for another breakpoint.
+bool process_bkpt_add(int pid, uint32_t addr);
+
+//Removes a breakpoint set by process_bkpt_add. Returns false if there was no such breakpoint.
+bool process_bkpt_remove(int pid, uint32_t addr);
+
+//Removes all debugger breakpoints
+void process_bkpt_clear(void);
+
+//Resumes a process stopped by the debugger, letting it run until it leaves the given range of addresses.
+//An empty range runs a single instruction.
+void process_dbgstep(process_t *pptr, uint32_t start, uint32_t end);
+
+//Runs the emulation backwards, taking back one instruction of the given process, or until a breakpoint or
+//watchpoint is hit if not stepping. Stops at the start of recorded history if it gets there first.
+void process_dbgreverse(int pid, bool step);
+
 #endif //_PROCESS_H
@@ -13,11 +13,21 @@
 
 #include "rsp.h"
 #include "process.h"
+#include "interp.h"
+#include "undo.h"
+#include "emul.h"
+#include "strace.h"
+#include "hle.h"
+#include "heap.h"
 
 #include <string.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
 
 //Compatibility shim for cross-platform TCP stuff
 //Todo - mangle this for WinSock if we're on Windows
@@ -30,6 +40,8 @@
 	#include <sys/types.h>
 	#include <sys/socket.h>
 	#include <netdb.h>
+	#include <netinet/in.h>
+	#include <netinet/tcp.h>
 	#include <errno.h>
 	#include <unistd.h>
 	#include <fcntl.h>
@@ -55,6 +67,8 @@
 		{ return strerror(errno); }
 	static int rsp_c_nonblock(int sockfd)
 		{ return fcntl(sockfd, F_SETFL, O_NONBLOCK); }
+	static int rsp_c_nodelay(int sockfd)
+		{ int one = 1; return setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); }
 #else
 	//Winsock mangled names
 	#include <Winsock2.h>
@@ -82,6 +96,8 @@
 		{ return strerror(WSAGetLastError()); }
 	static int rsp_c_nonblock(int sockfd)
 		{ unsigned long mode = 1; return ioctlsocket(sockfd, FIONBIO, &mode); }
+	static int rsp_c_nodelay(int sockfd)
+		{ BOOL one = TRUE; return setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one)); }
 #endif
 
 //Socket accepting new connections for RSP
@@ -95,13 +111,139 @@ static int rsp_port;
 	
 //Number of times RSP listener experienced a failure (to bind, open a socket, whatever)
 static int rsp_giveup_count;
+
+//Held by the emulation core while it runs, and by the RSP thread while it talks to the debugger.
+//Everything else here is only touched with this held.
+static std::mutex rsp_core_mutex;
+
+//Thread serving the debugger, and a flag telling it to finish.
+//(Allocated once and kept, so exiting without rsp_shutdown doesn't destroy a running thread.)
+static std::thread *rsp_thread;
+static std::atomic<bool> rsp_running;
+
+//Console being debugged - the one selected when the listener was set up
+static emul_t *rsp_emul;
+
+//Waiting for activity on the RSP thread.
+//On Linux we use epoll, and the core can wake us with an eventfd when it has a stop-reply to send.
+//Elsewhere we poll the sockets with a short timeout, and pick up stop-replies that way.
+#if defined(__linux__)
+	#include <sys/epoll.h>
+	#include <sys/eventfd.h>
+	
+	static int rsp_epoll_fd = -1;
+	static int rsp_wake_fd = -1;
+	
+	static bool rsp_wait_init(void)
+	{
+		rsp_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		rsp_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if(rsp_epoll_fd < 0 || rsp_wake_fd < 0)
+			return false;
+		
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.fd = rsp_wake_fd;
+		return (epoll_ctl(rsp_epoll_fd, EPOLL_CTL_ADD, rsp_wake_fd, &ev) == 0);
+	}
+	
+	static void rsp_wake(void)
+	{
+		uint64_t one = 1;
+		if(write(rsp_wake_fd, &one, sizeof(one)) < 0)
+			return; //Counter is full, so it's awake anyway
+	}
+	
+	//Sets the events we wait for on a socket.
+	//Closing a socket takes it out of the epoll set, so add it again if it's not there.
+	static void rsp_wait_watch(SOCKET sock, uint32_t events)
+	{
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = events;
+		ev.data.fd = sock;
+		if(epoll_ctl(rsp_epoll_fd, EPOLL_CTL_MOD, sock, &ev) < 0 && errno == ENOENT)
+			epoll_ctl(rsp_epoll_fd, EPOLL_CTL_ADD, sock, &ev);
+	}
+	
+	static void rsp_wait(SOCKET listen_sock, SOCKET client_sock, bool want_write, int timeout_ms)
+	{
+		if(listen_sock != INVALID_SOCKET)
+			rsp_wait_watch(listen_sock, EPOLLIN);
+		if(client_sock != INVALID_SOCKET)
+			rsp_wait_watch(client_sock, EPOLLIN | (want_write ? (uint32_t)EPOLLOUT : 0u));
+		
+		struct epoll_event evs[4];
+		int nev = epoll_wait(rsp_epoll_fd, evs, 4, timeout_ms);
+		for(int ee = 0; ee < nev; ee++)
+		{
+			if(evs[ee].data.fd != rsp_wake_fd)
+				continue;
+			
+			uint64_t count = 0;
+			if(read(rsp_wake_fd, &count, sizeof(count)) < 0)
+				continue; //Already reset
+		}
+	}
+#else
+	#if defined(__MINGW32__)
+		static int rsp_c_poll(struct pollfd *fds, int nfds, int timeout_ms)
+			{ return WSAPoll(fds, nfds, timeout_ms); }
+	#else
+		#include <poll.h>
+		static int rsp_c_poll(struct pollfd *fds, int nfds, int timeout_ms)
+			{ return poll(fds, nfds, timeout_ms); }
+	#endif
+	
+	static bool rsp_wait_init(void)
+	{
+		return true;
+	}
+	
+	static void rsp_wake(void)
+	{
+		//Nothing to do, the RSP thread doesn't wait long
+	}
+	
+	static void rsp_wait(SOCKET listen_sock, SOCKET client_sock, bool want_write, int timeout_ms)
+	{
+		if(timeout_ms < 0 || timeout_ms > 10)
+			timeout_ms = 10;
+		
+		struct pollfd fds[2];
+		int nfds = 0;
+		memset(fds, 0, sizeof(fds));
+		if(listen_sock != INVALID_SOCKET)
+		{
+			fds[nfds].fd = listen_sock;
+			fds[nfds].events = POLLIN;
+			nfds++;
+		}
+		if(client_sock != INVALID_SOCKET)
+		{
+			fds[nfds].fd = client_sock;
+			fds[nfds].events = POLLIN | (want_write ? POLLOUT : 0);
+			nfds++;
+		}
+		
+		if(nfds > 0)
+			rsp_c_poll(fds, nfds, timeout_ms);
+		else
+			std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+	}
+#endif
 				
+//Largest packet GDB can send us, as advertised in qSupported.
+//Big enough that loading a game image over RSP doesn't take thousands of round-trips.
+#define RSP_PACKET_MAX (128*1024)
+
 //Buffer for incoming RSP packet
-static char rsp_incoming_buf[4096];
+static char rsp_incoming_buf[RSP_PACKET_MAX];
 static int rsp_incoming_len;
 		
-//Buffer for outgoing RSP packet
-static char rsp_outgoing_buf[4096];
+//Buffer for outgoing RSP packets - a full-size reply plus some stop-replies and acks
+static char rsp_outgoing_buf[RSP_PACKET_MAX + 4096];
 static int rsp_outgoing_len;
 static int rsp_outgoing_sent;
 static unsigned char rsp_outgoing_checksum;
@@ -135,13 +277,17 @@ static void rsp_fatal(const char *fmt, ...)
 	{
 		rsp_c_close(rsp_client_sock);
 		rsp_client_sock = INVALID_SOCKET;
+		
+		//Debugger isn't around to remove its breakpoints anymore, or to run backwards
+		process_bkpt_clear();
+		interp_watch_clear();
+		undo_enable(false);
 	}
 	
-	memset(rsp_incoming_buf, 0, sizeof(rsp_incoming_buf));
 	rsp_incoming_len = 0;
 	
-	memset(rsp_outgoing_buf, 0, sizeof(rsp_outgoing_buf));
 	rsp_outgoing_len = 0;
+	rsp_outgoing_sent = 0;
 	
 	rsp_giveup_count++;
 	if(rsp_giveup_count > 5)
@@ -168,6 +314,17 @@ static void rsp_putbyte(char byte_out)
 	rsp_outgoing_checksum += byte_out;
 }
 
+//Checks that the given number of bytes can be enqueued at once, for bulk data
+static bool rsp_putroom(int len)
+{
+	if(rsp_outgoing_len + len > (int)sizeof(rsp_outgoing_buf))
+	{
+		rsp_fatal("%s", "Enqueued too much outgoing data. Cannot continue.\n");
+		return false;
+	}
+	return true;
+}
+
 //Enqueues the beginning of a packet to be sent back to GDB
 static void rsp_putpkt_start(void)
 {
@@ -200,6 +357,54 @@ static void rsp_putpkt_char(char bb)
 	}
 }
 
+//Enqueues a run of bytes hex-encoded, as in memory-read replies
+static void rsp_putpkt_hexbytes(const unsigned char *data, int len)
+{
+	if(!rsp_putroom(len * 2))
+		return;
+	
+	//Hex digits never need escaping, so they can go straight in the buffer
+	const char *hexmap = "0123456789ABCDEF";
+	char *out = rsp_outgoing_buf + rsp_outgoing_len;
+	unsigned char sum = 0;
+	for(int bb = 0; bb < len; bb++)
+	{
+		out[0] = hexmap[(data[bb] >> 4) & 0xF];
+		out[1] = hexmap[(data[bb] >> 0) & 0xF];
+		sum += out[0] + out[1];
+		out += 2;
+	}
+	rsp_outgoing_len += len * 2;
+	rsp_outgoing_checksum += sum;
+}
+
+//Enqueues a run of bytes as escaped binary data, as in binary memory-read replies
+static void rsp_putpkt_binary(const unsigned char *data, int len)
+{
+	//Worst case every byte is escaped
+	if(!rsp_putroom(len * 2))
+		return;
+	
+	char *out = rsp_outgoing_buf + rsp_outgoing_len;
+	unsigned char sum = 0;
+	for(int bb = 0; bb < len; bb++)
+	{
+		char ch = data[bb];
+		if(ch == '$' || ch == '#' || ch == '}' || ch == '*')
+		{
+			*out = 0x7D;
+			sum += *out;
+			out++;
+			ch ^= 0x20;
+		}
+		*out = ch;
+		sum += *out;
+		out++;
+	}
+	rsp_outgoing_len = out - rsp_outgoing_buf;
+	rsp_outgoing_checksum += sum;
+}
+
 //Enqueues a string to be sent back to GDB
 static void rsp_putpkt_str(const char *str)
 {
@@ -432,7 +637,9 @@ int rsp_parse_tid(const char *buf, int len, int *pid_out, int *tid_out)
 static void rsp_cmd_qsupported(const char *remain_buf, int remain_len)
 {
 	rsp_putpkt_start();
-	rsp_putpkt_str("PacketSize=ff0;multiprocess+;error-message+;hwbreak+");
+	rsp_putpkt_str("PacketSize=");
+	rsp_putpkt_hex32(RSP_PACKET_MAX);
+	rsp_putpkt_str(";multiprocess+;error-message+;hwbreak+;ReverseStep+;ReverseContinue+");
 	rsp_putpkt_end();
 	
 	(void)remain_len; //todo - windows lacks strnstr
@@ -448,7 +655,7 @@ static void rsp_cmd_vcontq(const char *remain_buf, int remain_len)
 	(void)remain_buf;
 	(void)remain_len;
 	rsp_putpkt_start();
-	rsp_putpkt_str("OK");
+	rsp_putpkt_str("vCont;c;C;s;S;r");
 	rsp_putpkt_end();
 	return;
 }
@@ -767,16 +974,77 @@ static void rsp_cmd_mread(const char *remain_buf, int remain_len)
 		return;
 	}
 	
-	//Read as many bytes as continue to be valid
+	//Read as many bytes as continue to be valid, and fit in a packet
+	if(length > (int)pptr->size - address)
+		length = (int)pptr->size - address;
+	if(length > (RSP_PACKET_MAX / 2) - 16)
+		length = (RSP_PACKET_MAX / 2) - 16;
+	if(length < 0)
+		length = 0;
+	
 	rsp_putpkt_start();
-	const char *membytes = (const char*)(pptr->mem);
-	for(int aa = address; aa < address + length; aa++)
+	rsp_putpkt_hexbytes((const unsigned char*)(pptr->mem) + address, length);
+	rsp_putpkt_end();
+	return;
+}
+
+//Command handler - read memory in binary
+static void rsp_cmd_xread(const char *remain_buf, int remain_len)
+{
+	//Same format as memory-read in hex
+	int address = 0;
+	int address_consumed = rsp_parse_hex(remain_buf, remain_len, &address);
+	remain_buf += address_consumed;
+	remain_len -= address_consumed;
+	
+	int comma_consumed = 0;
+	if(remain_len > 0 && remain_buf[0] == ',')
 	{
-		if(aa >= (int)pptr->size)
-			break;
-		
-		rsp_putpkt_hex8(membytes[aa]);
+		comma_consumed = 1;
+		remain_buf++;
+		remain_len--;
+	}
+	
+	int length = 0;
+	int length_consumed = rsp_parse_hex(remain_buf, remain_len, &length);
+	remain_buf += length_consumed;
+	remain_len -= length_consumed;
+	
+	if(!(address_consumed && comma_consumed && length_consumed))
+	{
+		rsp_putpkt_errpkt_safe("Bad format of binary memory-read command.");
+		return;
+	}
+	
+	process_t *pptr = process_find(rsp_pid_g);
+	if(pptr == NULL)
+	{
+		rsp_putpkt_errpkt_safe("No such process");
+		return;
+	}
+	if(pptr->mem == NULL)
+	{
+		rsp_putpkt_errpkt_safe("Process had no memory space, possibly dead already");
+		return;
 	}
+	
+	if(address < 4096 || address >= (int)pptr->size)
+	{
+		rsp_putpkt_errpkt_safe("Memory read starts at invalid address %X", address);
+		return;
+	}
+	
+	//Escaping can double the size of the data, so limit to what'll fit in a packet
+	if(length > (int)pptr->size - address)
+		length = (int)pptr->size - address;
+	if(length > (RSP_PACKET_MAX / 2) - 16)
+		length = (RSP_PACKET_MAX / 2) - 16;
+	if(length < 0)
+		length = 0;
+	
+	rsp_putpkt_start();
+	rsp_putpkt_char('b');
+	rsp_putpkt_binary((const unsigned char*)(pptr->mem) + address, length);
 	rsp_putpkt_end();
 	return;
 }
@@ -840,6 +1108,7 @@ static void rsp_cmd_detach(const char *remain_buf, int remain_len)
 		for(int pp = 0; pp < PROCESS_MAX; pp++)
 		{
 			process_table[pp].dbgstop = PROCESS_DBGSTOP_NONE;
+			process_table[pp].step_active = false;
 		}
 	}
 	else
@@ -852,6 +1121,7 @@ static void rsp_cmd_detach(const char *remain_buf, int remain_len)
 			return;
 		}
 		pptr->dbgstop = PROCESS_DBGSTOP_NONE;
+		pptr->step_active = false;
 	}
 	
 	rsp_putpkt_start();
@@ -889,6 +1159,7 @@ static void rsp_cmd_qthreadextrainfo(const char *remain_buf, int remain_len)
 		rsp_putpkt_hexprintf(" Paused=0");
 	
 	rsp_putpkt_hexprintf(" DbgStop=%d", pptr->dbgstop);
+	rsp_putpkt_hexprintf(" Instrs=%llu", (unsigned long long)(pptr->cpu_instrs));
 	
 	rsp_putpkt_end();
 	return;
@@ -952,6 +1223,9 @@ static void rsp_cmd_mwrite(const char *remain_buf, int remain_len)
 		return;
 	}
 	
+	//Recorded history can't be replayed over memory the debugger changed
+	undo_barrier();
+	
 	//Read bytes and write them into memory
 	while(length > 0)
 	{
@@ -974,9 +1248,114 @@ static void rsp_cmd_mwrite(const char *remain_buf, int remain_len)
 	return;
 }
 
+//Command handler - write memory in binary
+static void rsp_cmd_xwrite(const char *remain_buf, int remain_len)
+{
+	//Read address
+	int address = 0;
+	int address_consumed = rsp_parse_hex(remain_buf, remain_len, &address);
+	remain_buf += address_consumed;
+	remain_len -= address_consumed;
+	
+	//Read comma
+	if(remain_len > 0 && remain_buf[0] == ',')
+	{
+		remain_buf++;
+		remain_len--;
+	}
+	else
+	{
+		rsp_putpkt_errpkt("Invalid format for binary memory-write command.");
+		return;
+	}
+	
+	//Read length of data to write
+	int length = 0;
+	int length_consumed = rsp_parse_hex(remain_buf, remain_len, &length);
+	remain_buf += length_consumed;
+	remain_len -= length_consumed;
+	
+	//Read colon
+	if(remain_len > 0 && remain_buf[0] == ':')
+	{
+		remain_buf++;
+		remain_len--;
+	}
+	else
+	{
+		rsp_putpkt_errpkt("Invalid format for binary memory-write command.");
+		return;
+	}
+	
+	//GDB probes for support with a zero-length write
+	if(length == 0)
+	{
+		rsp_putpkt_start();
+		rsp_putpkt_str("OK");
+		rsp_putpkt_end();
+		return;
+	}
+	
+	//Make sure we can find the process to operate on
+	process_t *pptr = process_find(rsp_pid_g);
+	if(pptr == NULL)
+	{
+		rsp_putpkt_errpkt("No such process 0x%X", rsp_pid_g);
+		return;
+	}
+	if(pptr->mem == NULL)
+	{
+		rsp_putpkt_errpkt("Process 0x%X has no memory - already dead, perhaps.", rsp_pid_g);
+		return;
+	}
+	
+	if(address < 0 || length < 0 || address >= (int)pptr->size || length > (int)pptr->size - address)
+	{
+		rsp_putpkt_errpkt("Memory write is outside size of process memory.");
+		return;
+	}
+	
+	//Recorded history can't be replayed over memory the debugger changed
+	undo_barrier();
+	
+	//Unescape the data straight into memory
+	unsigned char *dst = ((unsigned char*)(pptr->mem)) + address;
+	int written = 0;
+	while(written < length && remain_len > 0)
+	{
+		unsigned char data = remain_buf[0];
+		remain_buf++;
+		remain_len--;
+		
+		if(data == 0x7D && remain_len > 0)
+		{
+			data = remain_buf[0] ^ 0x20;
+			remain_buf++;
+			remain_len--;
+		}
+		
+		dst[written] = data;
+		written++;
+	}
+	
+	if(written != length)
+	{
+		rsp_putpkt_errpkt("Binary memory-write had %d bytes, expected %d.", written, length);
+		return;
+	}
+	
+	rsp_putpkt_start();
+	rsp_putpkt_str("OK");
+	rsp_putpkt_end();
+	return;
+}
+
 //Command handler - continue (verbose)
 void rsp_cmd_vcont(const char *remain_buf, int remain_len)
 {
+	//Each process takes the first action that applies to it
+	bool acted[PROCESS_MAX] = {0};
+	
 	//Read list of actions and thread IDs
 	while(remain_len > 0)
 	{
@@ -994,49 +1373,81 @@ void rsp_cmd_vcont(const char *remain_buf, int remain_len)
 		
 		//Then should give an action
 		char action = 0;
-		//unsigned char sig = 0;
-		if(remain_len >= 1 && remain_buf[0] == 'c')
+		unsigned char sig = 0;
+		int range_start = 0;
+		int range_end = 0;
+		if(remain_len >= 1 && (remain_buf[0] == 'c' || remain_buf[0] == 's'))
 		{
-			//Continue
-			action = 'c';
+			//Continue or step
+			action = remain_buf[0];
 			remain_buf++;
 			remain_len--;
 		}
-		//else if(remain_len >= 3 && remain_buf[0] == 'C')
-		//{
-		//	//Continue with signal
-		//	action = 'C';
-		//	remain_buf++;
-		//	remain_len--;
-		//	
-		//	int sig_consumed = rsp_parse_hex8(remain_buf, remain_len, &sig);
-		//	remain_buf += sig_consumed;
-		//	remain_len -= sig_consumed;
-		//}
-		else
+		else if(remain_len >= 3 && (remain_buf[0] == 'C' || remain_buf[0] == 'S'))
 		{
-			rsp_putpkt_errpkt("Unknown action %c in vCont packet", action);
-			return;
+			//Continue or step with signal.
+			//We don't deliver signals from the debugger, so these are the same as without.
+			action = remain_buf[0] - 'A' + 'a';
+			remain_buf++;
+			remain_len--;
+			
+			int sig_consumed = rsp_parse_hex8(remain_buf, remain_len, &sig);
+			remain_buf += sig_consumed;
+			remain_len -= sig_consumed;
+			
+			if(sig != 0)
+				TINFO("Ignoring signal %d given by debugger\n", sig);
 		}
-		
-		//Then a colon
-		if(remain_len > 0 && remain_buf[0] == ':')
+		else if(remain_len >= 1 && remain_buf[0] == 'r')
 		{
+			//Step while in range
+			action = 'r';
 			remain_buf++;
 			remain_len--;
+			
+			int start_consumed = rsp_parse_hex(remain_buf, remain_len, &range_start);
+			remain_buf += start_consumed;
+			remain_len -= start_consumed;
+			
+			if(remain_len > 0 && remain_buf[0] == ',')
+			{
+				remain_buf++;
+				remain_len--;
+			}
+			else
+			{
+				rsp_putpkt_errpkt("Bad format in vCont packet, no comma in range");
+				return;
+			}
+			
+			int end_consumed = rsp_parse_hex(remain_buf, remain_len, &range_end);
+			remain_buf += end_consumed;
+			remain_len -= end_consumed;
 		}
 		else
 		{
-			rsp_putpkt_errpkt("Bad format in vCont packet, no colon");
+			rsp_putpkt_errpkt("Unknown action %c in vCont packet", (remain_len > 0) ? remain_buf[0] : ' ');
 			return;
 		}
 		
-		//Then the thread ID
-		int pid = 0;
+		//Then optionally a colon and the thread ID. Without one, the action applies to all processes.
+		int pid = -1;
 		int tid = 0;
-		int tid_consumed = rsp_parse_tid(remain_buf, remain_len, &pid, &tid);
-		remain_buf += tid_consumed;
-		remain_len -= tid_consumed;
+		bool explicit_tid = false;
+		if(remain_len > 0 && remain_buf[0] == ':')
+		{
+			remain_buf++;
+			remain_len--;
+			
+			int tid_consumed = rsp_parse_tid(remain_buf, remain_len, &pid, &tid);
+			remain_buf += tid_consumed;
+			remain_len -= tid_consumed;
+			explicit_tid = true;
+			
+			//Processes are single-threaded, so a bare thread ID names the process
+			if(pid <= 0 && tid > 0)
+				pid = tid;
+		}
 		
 		//So do that
 		int matched = 0;
@@ -1045,14 +1456,27 @@ void rsp_cmd_vcont(const char *remain_buf, int remain_len)
 			if(process_table[pp].pid == pid || pid == -1)
 			{
 				matched++;
+				if(acted[pp])
+					continue;
+				
+				acted[pp] = true;
 				if(action == 'c')
 				{
+					process_table[pp].step_active = false;
 					process_table[pp].dbgstop = PROCESS_DBGSTOP_NONE;
 				}
+				else if(action == 's')
+				{
+					process_dbgstep(&(process_table[pp]), 0, 0);
+				}
+				else if(action == 'r')
+				{
+					process_dbgstep(&(process_table[pp]), range_start, range_end);
+				}
 			}
 		}
 		
-		if(matched == 0)
+		if(matched == 0 && explicit_tid)
 		{
 			//No such process...? Say that it exited
 			rsp_putpkt_start();
@@ -1126,6 +1550,9 @@ static void rsp_cmd_pwrite(const char *remain_buf, int remain_len)
 		return;
 	}
 	
+	//Recorded history can't be replayed over registers the debugger changed
+	undo_barrier();
+	
 	rsp_putpkt_start();
 	rsp_putpkt_str("OK");
 	rsp_putpkt_end();
@@ -1180,39 +1607,200 @@ static void rsp_cmd_talive(const char *remain_buf, int remain_len)
 	}
 }
 
-//Remote monitor command handler - reset process table as if booting a new game
-static void rsp_rcmd_prep(void)
+//Runs backwards, from a bs or bc packet
+static void rsp_cmd_reverse(bool step)
 {
-	rsp_putpkt_start();
-	rsp_putpkt_hexprintf("Resetting process table...\n");
-	rsp_putpkt_end();
-	
-	//Clear memory for game process
-	if(process_table[0].mem != NULL)
-	{
-		free(process_table[0].mem);
-		process_table[0].mem = NULL;
-	}
-	if(process_table[0].mexec_mem != NULL)
+	if(!undo_active())
 	{
-		free(process_table[0].mexec_mem);
-		process_table[0].mexec_mem = NULL;
+		rsp_putpkt_errpkt("Not recording execution history");
+		return;
 	}
 	
-	memset(&(process_table[0]), 0, sizeof(process_table[0]));
-	
-	process_table[0].mem = (uint32_t*)calloc(1, 24*1024*1024);
-	process_table[0].size = 24*1024*1024;
-	
-	//Copy environment from init process
-	memcpy(process_table[0].env_buf, process_table[1].env_buf, sizeof(process_table[0].env_buf));
-	process_table[0].env_len = process_table[1].env_len;
-	
-	//Reset identity
-	process_table[0].pid = PROCESS_MAX;
-	process_table[0].ppid = 1;
+	//Step the process picked for continuing, or for general ops, or any if neither is picked
+	int pid = -1;
+	if(process_find(rsp_pid_c) != NULL)
+		pid = rsp_pid_c;
+	else if(process_find(rsp_pid_g) != NULL)
+		pid = rsp_pid_g;
 	
-	//Stop process at entry point
+	//Stop-reply is sent when it gets where it's going
+	process_dbgreverse(pid, step);
+}
+
+//Command handler - reverse step
+static void rsp_cmd_bs(const char *remain_buf, int remain_len)
+{
+	(void)remain_buf;
+	(void)remain_len;
+	rsp_cmd_reverse(true);
+}
+
+//Command handler - reverse continue
+static void rsp_cmd_bc(const char *remain_buf, int remain_len)
+{
+	(void)remain_buf;
+	(void)remain_len;
+	rsp_cmd_reverse(false);
+}
+
+//Sets or clears a breakpoint or watchpoint, from a Z or z packet
+static void rsp_cmd_zpoint(const char *remain_buf, int remain_len, bool insert)
+{
+	//Packet gives type, address, and kind (length, for watchpoints)
+	int type = -1;
+	int type_consumed = rsp_parse_hex(remain_buf, remain_len, &type);
+	remain_buf += type_consumed;
+	remain_len -= type_consumed;
+	
+	int address = 0;
+	if(remain_len > 0 && remain_buf[0] == ',')
+	{
+		remain_buf++;
+		remain_len--;
+		
+		int address_consumed = rsp_parse_hex(remain_buf, remain_len, &address);
+		remain_buf += address_consumed;
+		remain_len -= address_consumed;
+	}
+	else
+	{
+		rsp_putpkt_errpkt("Bad format in breakpoint command, no comma after type");
+		return;
+	}
+	
+	int kind = 0;
+	if(remain_len > 0 && remain_buf[0] == ',')
+	{
+		remain_buf++;
+		remain_len--;
+		
+		int kind_consumed = rsp_parse_hex(remain_buf, remain_len, &kind);
+		remain_buf += kind_consumed;
+		remain_len -= kind_consumed;
+	}
+	else
+	{
+		rsp_putpkt_errpkt("Bad format in breakpoint command, no comma after address");
+		return;
+	}
+	
+	//Any conditions or commands that follow are evaluated by GDB, not us
+	
+	//Breakpoints and watchpoints apply to the process selected for general ops, or all of them
+	bool done = false;
+	switch(type)
+	{
+		case 0: //Software breakpoint
+		case 1: //Hardware breakpoint
+		{
+			//Either way we keep them in the interpreter, rather than changing the process's memory
+			if(insert)
+				done = process_bkpt_add(rsp_pid_g, address);
+			else
+				done = process_bkpt_remove(rsp_pid_g, address);
+			break;
+		}
+		case 2: //Write watchpoint
+		case 3: //Read watchpoint
+		case 4: //Access watchpoint
+		{
+			static const int watch_kinds[5] = { 0, 0, INTERP_WATCH_WRITE, INTERP_WATCH_READ, INTERP_WATCH_ACCESS };
+			if(kind <= 0)
+			{
+				rsp_putpkt_errpkt("Bad length 0x%X for watchpoint", kind);
+				return;
+			}
+			
+			if(insert)
+				done = interp_watch_add(rsp_pid_g, address, kind, watch_kinds[type]);
+			else
+				done = interp_watch_remove(rsp_pid_g, address, kind, watch_kinds[type]);
+			break;
+		}
+		default:
+		{
+			//Unsupported type - empty response
+			rsp_putpkt_start();
+			rsp_putpkt_end();
+			return;
+		}
+	}
+	
+	if(!done)
+	{
+		if(insert)
+			rsp_putpkt_errpkt("No room for another breakpoint or watchpoint");
+		else
+			rsp_putpkt_errpkt("No such breakpoint or watchpoint");
+		return;
+	}
+	
+	rsp_putpkt_start();
+	rsp_putpkt_str("OK");
+	rsp_putpkt_end();
+}
+
+//Command handler - insert breakpoint or watchpoint
+static void rsp_cmd_zinsert(const char *remain_buf, int remain_len)
+{
+	rsp_cmd_zpoint(remain_buf, remain_len, true);
+}
+
+//Command handler - remove breakpoint or watchpoint
+static void rsp_cmd_zremove(const char *remain_buf, int remain_len)
+{
+	rsp_cmd_zpoint(remain_buf, remain_len, false);
+}
+
+//Remote monitor command handler - reset process table as if booting a new game
+static void rsp_rcmd_prep(const char *args)
+{
+	(void)args;
+	rsp_putpkt_start();
+	rsp_putpkt_hexprintf("Resetting process table...\n");
+	rsp_putpkt_end();
+	
+	//Can't take back reloading everything
+	undo_barrier();
+	
+	//Forget what we learned about the images being thrown away, as their PIDs get used again
+	for(int pp = 0; pp < PROCESS_MAX; pp++)
+	{
+		if(pp == 1 || process_table[pp].state == PROCESS_STATE_NONE)
+			continue;
+		
+		hle_newimage(process_table[pp].pid);
+		heap_exit(process_table[pp].pid);
+	}
+	hle_newimage(PROCESS_MAX);
+	heap_exit(PROCESS_MAX);
+	
+	//Clear memory for game process
+	if(process_table[0].mem != NULL)
+	{
+		free(process_table[0].mem);
+		process_table[0].mem = NULL;
+	}
+	if(process_table[0].mexec_mem != NULL)
+	{
+		free(process_table[0].mexec_mem);
+		process_table[0].mexec_mem = NULL;
+	}
+	
+	memset(&(process_table[0]), 0, sizeof(process_table[0]));
+	
+	process_table[0].mem = (uint32_t*)calloc(1, 24*1024*1024);
+	process_table[0].size = 24*1024*1024;
+	
+	//Copy environment from init process
+	memcpy(process_table[0].env_buf, process_table[1].env_buf, sizeof(process_table[0].env_buf));
+	process_table[0].env_len = process_table[1].env_len;
+	
+	//Reset identity
+	process_table[0].pid = PROCESS_MAX;
+	process_table[0].ppid = 1;
+	
+	//Stop process at entry point
 	process_table[0].regs[15] = 0x1000;
 	process_table[0].dbgstop = PROCESS_DBGSTOP_CTRLC;
 	process_table[0].state = PROCESS_STATE_ALIVE;
@@ -1240,26 +1828,116 @@ static void rsp_rcmd_prep(void)
 	
 }
 
+//Remote monitor command - lists processes and their CPU usage
+static void rsp_rcmd_ps(const char *args)
+{
+	(void)args;
+	static const char *states[PROCESS_STATE_MAX] = {0};
+	states[PROCESS_STATE_NONE] = "none";
+	states[PROCESS_STATE_ALIVE] = "alive";
+	states[PROCESS_STATE_DEAD] = "dead";
+	
+	rsp_putpkt_start();
+	rsp_putpkt_hexprintf("%5s %5s %6s %6s %4s %16s\n", "PID", "PPID", "STATE", "PAUSED", "PRIO", "INSTRS");
+	for(int pp = 0; pp < PROCESS_MAX; pp++)
+	{
+		const process_t *pptr = &(process_table[pp]);
+		if(pptr->state == PROCESS_STATE_NONE)
+			continue;
+		
+		rsp_putpkt_hexprintf("%5d %5d %6s %6d %4d %16llu\n", pptr->pid, pptr->ppid, states[pptr->state],
+			(pptr->paused && !pptr->unpaused) ? 1 : 0, pptr->prio, (unsigned long long)(pptr->cpu_instrs));
+	}
+	rsp_putpkt_end();
+}
+
+//Remote monitor command - shows performance counters of each process
+static void rsp_rcmd_stats(const char *args)
+{
+	(void)args;
+	rsp_putpkt_start();
+	for(int pp = 0; pp < PROCESS_MAX; pp++)
+	{
+		const process_t *pptr = &(process_table[pp]);
+		if(pptr->state == PROCESS_STATE_NONE)
+			continue;
+		
+		const process_stats_t *sptr = &(pptr->stats);
+		rsp_putpkt_hexprintf("Process %d:\n", pptr->pid);
+		rsp_putpkt_hexprintf("%16s %16llu\n", "instrs", (unsigned long long)(pptr->cpu_instrs));
+		rsp_putpkt_hexprintf("%16s %16llu\n", "loads", (unsigned long long)(sptr->loads));
+		rsp_putpkt_hexprintf("%16s %16llu\n", "stores", (unsigned long long)(sptr->stores));
+		rsp_putpkt_hexprintf("%16s %16llu\n", "branches", (unsigned long long)(sptr->branches));
+		rsp_putpkt_hexprintf("%16s %16llu\n", "paused ms", (unsigned long long)(sptr->paused_ms));
+		rsp_putpkt_hexprintf("%16s %16llu\n", "disk bytes", (unsigned long long)(sptr->disk_bytes));
+		rsp_putpkt_hexprintf("%16s %16llu\n", "flips", (unsigned long long)(sptr->flips));
+		for(int ss = 0; ss < PROCESS_STATS_SYSCALLS; ss++)
+		{
+			if(sptr->syscalls[ss] != 0)
+				rsp_putpkt_hexprintf("%11s 0x%2.2X %16llu\n", "syscall", ss, (unsigned long long)(sptr->syscalls[ss]));
+		}
+	}
+	rsp_putpkt_end();
+}
+
+//Remote monitor command - shows counts and latency of each system call
+static void rsp_rcmd_strace(const char *args)
+{
+	(void)args;
+	static char summary[64 * 1024];
+	strace_summary(summary, sizeof(summary));
+	
+	//Send it a line at a time, as formatting only takes so much at once
+	rsp_putpkt_start();
+	for(char *line = summary; *line != '\0'; )
+	{
+		char *next = strchr(line, '\n');
+		next = (next != NULL) ? (next + 1) : (line + strlen(line));
+		rsp_putpkt_hexprintf("%.*s", (int)(next - line), line);
+		line = next;
+	}
+	rsp_putpkt_end();
+}
+
+//Remote monitor command - sets the scheduling priority of a process
+static void rsp_rcmd_nice(const char *args)
+{
+	int pid = 0;
+	int prio = 0;
+	rsp_putpkt_start();
+	if(sscanf(args, "%d %d", &pid, &prio) != 2)
+		rsp_putpkt_hexprintf("Usage: monitor nice <pid> <priority %d to %d>\n", PROCESS_PRIO_MIN, PROCESS_PRIO_MAX);
+	else if(!process_setprio(pid, prio))
+		rsp_putpkt_hexprintf("Can't set process %d to priority %d\n", pid, prio);
+	else
+		rsp_putpkt_hexprintf("Process %d now at priority %d\n", pid, prio);
+	rsp_putpkt_end();
+}
+
 //Remote monitor command ("monitor ...") decoding table
 typedef struct rsp_rcmd_s
 {
 	const char *cmd;
 	const char *help;
-	void (*func)(void);
+	void (*func)(const char *args);
 } rsp_rcmd_t;
 static const rsp_rcmd_t rsp_rcmd_table[] = 
 {
 	{ .cmd = "prep", .help = "Resets process-table as if booting a game", .func = rsp_rcmd_prep },
+	{ .cmd = "ps",   .help = "Lists processes and instructions each has run", .func = rsp_rcmd_ps },
+	{ .cmd = "nice", .help = "Sets scheduling priority of a process (nice <pid> <prio>)", .func = rsp_rcmd_nice },
+	{ .cmd = "stats", .help = "Shows performance counters of each process", .func = rsp_rcmd_stats },
+	{ .cmd = "strace", .help = "Shows counts and latency of each system call", .func = rsp_rcmd_strace },
 	{}
 };
 
 //Command handler - "monitor" remote commands
 static void rsp_cmd_rcmd(const char *remain_buf, int remain_len)
 {
-	//Parse out the command given - for now just single tokens
-	char decoded_cmd[16] = {0};
+	//Parse out the command given, and split any arguments off after the first space
+	char decoded_cmd[64] = {0};
 	int decoded_len = 0;
-	while(remain_len > 0 && decoded_len < (int)sizeof(decoded_cmd))
+	while(remain_len > 0 && decoded_len < (int)sizeof(decoded_cmd) - 1)
 	{
 		unsigned char byte_val = 0;
 		int byte_consumed = rsp_parse_hex8(remain_buf, remain_len, &byte_val);
@@ -1270,6 +1948,14 @@ static void rsp_cmd_rcmd(const char *remain_buf, int remain_len)
 		decoded_len++;
 	}
 	
+	const char *decoded_args = "";
+	char *space = strchr(decoded_cmd, ' ');
+	if(space != NULL)
+	{
+		*space = '\0';
+		decoded_args = space + 1;
+	}
+	
 	//Check if they want a listing of the available commands
 	if(!strcmp(decoded_cmd, "help") || decoded_cmd[0] == '\0')
 	{
@@ -1292,7 +1978,7 @@ static void rsp_cmd_rcmd(const char *remain_buf, int remain_len)
 		if(!strcmp(decoded_cmd, cc->cmd))
 		{
 			//Found it
-			(cc->func)();
+			(cc->func)(decoded_args);
 			return;
 		}
 	}
@@ -1322,6 +2008,8 @@ static const rsp_cmd_t rsp_cmd_table[] =
 	{ .prefix = "vCont?",               .handler = rsp_cmd_vcontq },
 	{ .prefix = "vCont",                .handler = rsp_cmd_vcont },
 	{ .prefix = "qC",                   .handler = rsp_cmd_qc },
+	{ .prefix = "bs",                   .handler = rsp_cmd_bs },
+	{ .prefix = "bc",                   .handler = rsp_cmd_bc },
 	{ .prefix = "!",                    .handler = rsp_cmd_exclam },
 	{ .prefix = "H",                    .handler = rsp_cmd_H },
 	{ .prefix = "g",                    .handler = rsp_cmd_g },
@@ -1330,8 +2018,12 @@ static const rsp_cmd_t rsp_cmd_table[] =
 	{ .prefix = "p",                    .handler = rsp_cmd_pread },
 	{ .prefix = "D",                    .handler = rsp_cmd_detach },
 	{ .prefix = "M",                    .handler = rsp_cmd_mwrite },
+	{ .prefix = "X",                    .handler = rsp_cmd_xwrite },
+	{ .prefix = "x",                    .handler = rsp_cmd_xread },
 	{ .prefix = "P",                    .handler = rsp_cmd_pwrite },
 	{ .prefix = "T",                    .handler = rsp_cmd_talive },
+	{ .prefix = "Z",                    .handler = rsp_cmd_zinsert },
+	{ .prefix = "z",                    .handler = rsp_cmd_zremove },
 	{  }, //Sentinel
 };
 
@@ -1364,9 +2056,6 @@ static void rsp_gotbyte(char byte_in)
 	if(byte_in == '$')
 	{
 		//Dollarsign always starts a new packet
-		memset(rsp_incoming_buf, 0, sizeof(rsp_incoming_buf));
-		rsp_incoming_len = 0;
-		
 		rsp_incoming_buf[0] = '$';
 		rsp_incoming_len = 1;
 		return;
@@ -1401,7 +2090,6 @@ static void rsp_gotbyte(char byte_in)
 	if(rsp_incoming_len >= (int)sizeof(rsp_incoming_buf))
 	{
 		//Overlong packet, discard
-		memset(rsp_incoming_buf, 0, sizeof(rsp_incoming_buf));
 		rsp_incoming_len = 0;
 		rsp_putbyte('-');
 		return;
@@ -1436,8 +2124,10 @@ static void rsp_gotbyte(char byte_in)
 		
 		if(computed_checksum == stated_checksum)
 		{
-			//Packet seems valid, acknowledge and pass to decoding
+			//Packet seems valid, acknowledge and pass to decoding.
+			//Terminate it in place of the '#' so handlers can treat it as a string.
 			rsp_putbyte('+');
+			rsp_incoming_buf[rsp_incoming_len - 3] = '\0';
 			rsp_cmd(rsp_incoming_buf + 1, rsp_incoming_len - 4);
 		}
 		else
@@ -1447,39 +2137,53 @@ static void rsp_gotbyte(char byte_in)
 		}
 		
 		//Done with the packet
-		memset(rsp_incoming_buf, 0, sizeof(rsp_incoming_buf));
 		rsp_incoming_len = 0;
 		return;
 	}	
 }
 	
-void rsp_init(const prefs_t *prefs)
+//Sends as much outgoing data as the client will take. Returns false if the connection failed.
+static bool rsp_flush(void)
 {
-	//Close existing sockets if any
-	if(rsp_listen_sock != INVALID_SOCKET)
-	{
-		rsp_c_close(rsp_listen_sock);
-		rsp_listen_sock = INVALID_SOCKET;
-	}
-	
-	if(rsp_client_sock != INVALID_SOCKET)
-	{
-		rsp_c_close(rsp_client_sock);
-		rsp_client_sock = INVALID_SOCKET;
-	}
-	
-	//Check if we're actually supposed to be running
-	if(!prefs->rsp_enabled)
+	while(rsp_outgoing_len > 0)
 	{
-		TWARNING("%s", "GDB-RSP listener disabled in preferences. Not starting.\n");
-		return;
+		if(rsp_outgoing_sent >= rsp_outgoing_len)
+		{
+			//Drained the entire outgoing buffer.
+			rsp_outgoing_sent = 0;
+			rsp_outgoing_len = 0;
+			break;
+		}
+		
+		int nsent = rsp_c_write(rsp_client_sock, rsp_outgoing_buf + rsp_outgoing_sent, rsp_outgoing_len - rsp_outgoing_sent);
+		if(nsent < 0 && errno == EAGAIN)
+		{
+			//Pipe is stuffed up, need to wait
+			return true;
+		}
+		
+		if(nsent < 0)
+		{
+			//Other error while sending
+			rsp_fatal("Failed to write to RSP socket: %s\n", rsp_c_errstr());
+			return false;
+		}
+		
+		if(nsent == 0)
+		{
+			//Client disconnected from us
+			rsp_fatal("%s", "Client disconnected.\n");
+			return false;
+		}
+		
+		//Sent some bytes successfully
+		rsp_outgoing_sent += nsent;
 	}
-	
-	rsp_port = prefs->rsp_port;
-	TINFO("Setting up GDB-RSP listener on port %d\n", rsp_port);
+	return true;
 }
 
-void rsp_poll(void)
+//Sets up the connection to the debugger, and acts on whatever it's sent us
+static void rsp_service(void)
 {
 	if(rsp_port <= 0)
 	{
@@ -1584,6 +2288,13 @@ void rsp_poll(void)
 			return;
 		}
 		
+		//Replies are small and each one is waited on, so don't let TCP hold them back to coalesce
+		if(rsp_c_nodelay(rsp_client_sock) < 0)
+			TWARNING("Failed to disable Nagle on RSP socket: %s\n", rsp_c_errstr());
+		
+		//Keep history while the debugger is around, so it can run backwards
+		undo_enable(true);
+		
 		//Great, we got a connection
 		return;
 	}
@@ -1599,53 +2310,14 @@ void rsp_poll(void)
 	rsp_giveup_count = 0;
 	
 	//Drain outgoing data to the client before reading more commands
-	while(1)
-	{
-		if(rsp_outgoing_len == 0)
-		{
-			//Nothing to send.
-			break;
-		}
-		
-		if(rsp_outgoing_sent >= rsp_outgoing_len)
-		{
-			//Drained the entire outgoing buffer.
-			rsp_outgoing_sent = 0;
-			rsp_outgoing_len = 0;
-			memset(rsp_outgoing_buf, 0, sizeof(rsp_outgoing_buf));
-			break;
-		}
-		
-		int nsent = rsp_c_write(rsp_client_sock, rsp_outgoing_buf + rsp_outgoing_sent, rsp_outgoing_len - rsp_outgoing_sent);
-		if(nsent < 0 && errno == EAGAIN)
-		{
-			//Pipe is stuffed up, need to wait
-			return;
-		}
-		
-		if(nsent < 0)
-		{
-			//Other error while sending
-			rsp_fatal("Failed to write to RSP socket: %s\n", rsp_c_errstr());
-			return;
-		}
-		
-		if(nsent == 0)
-		{
-			//Client disconnected from us
-			rsp_fatal("%s", "Client disconnected.\n");
-			return;
-		}
-		
-		//Sent some bytes successfully
-		rsp_outgoing_sent += nsent;
-	}
+	if(!rsp_flush())
+		return;
 	
 	//Read incoming data and process commands
 	while(1)
 	{
 		//Get next set of incoming bytes
-		char readbuf[256] = {0};
+		static char readbuf[64*1024];
 		int nread = rsp_c_read(rsp_client_sock, readbuf, sizeof(readbuf));
 		if(nread < 0 && errno == EAGAIN)
 		{
@@ -1671,10 +2343,102 @@ void rsp_poll(void)
 		for(int bb = 0; bb < nread; bb++)
 		{
 			rsp_gotbyte(readbuf[bb]);
+			if(rsp_client_sock == INVALID_SOCKET)
+				return; //Failed while handling the command
 		}
+		
+		//Send replies right away rather than waiting for the next poll, so round-trips are quick.
+		//Stop reading if GDB isn't taking our replies, so they don't pile up.
+		if(!rsp_flush() || rsp_outgoing_len > 0)
+			return;
+	}
+}
+
+//RSP thread - waits for the debugger, then stops the emulation core while acting on what it sent
+static void rsp_threadfunc(void)
+{
+	while(rsp_running)
+	{
+		rsp_core_mutex.lock();
+		emul_select(rsp_emul);
+		rsp_service();
+		SOCKET listen_sock = rsp_listen_sock;
+		SOCKET client_sock = rsp_client_sock;
+		bool want_write = (rsp_outgoing_len > 0);
+		rsp_core_mutex.unlock();
+		
+		//If we failed to set up a listener, wait a bit before trying again
+		bool retry = (rsp_port > 0) && (listen_sock == INVALID_SOCKET) && (client_sock == INVALID_SOCKET);
+		rsp_wait(listen_sock, client_sock, want_write, retry ? 100 : -1);
 	}
 }
 
+void rsp_init(const prefs_t *prefs)
+{
+	std::lock_guard<std::mutex> lock(rsp_core_mutex);
+	
+	//Close existing sockets if any
+	if(rsp_listen_sock != INVALID_SOCKET)
+	{
+		rsp_c_close(rsp_listen_sock);
+		rsp_listen_sock = INVALID_SOCKET;
+	}
+	
+	if(rsp_client_sock != INVALID_SOCKET)
+	{
+		rsp_c_close(rsp_client_sock);
+		rsp_client_sock = INVALID_SOCKET;
+	}
+	
+	//Check if we're actually supposed to be running
+	if(!prefs->rsp_enabled)
+	{
+		TWARNING("%s", "GDB-RSP listener disabled in preferences. Not starting.\n");
+		return;
+	}
+	
+	rsp_port = prefs->rsp_port;
+	rsp_emul = emul_cur;
+	undo_setbudget(prefs->rsp_undo_mb);
+	TINFO("Setting up GDB-RSP listener on port %d\n", rsp_port);
+	
+	//Serve the debugger from its own thread, so it doesn't wait on emulation timing
+	if(rsp_thread == NULL)
+	{
+		if(!rsp_wait_init())
+		{
+			TERROR("Failed to set up waiting for RSP connections: %s\n", strerror(errno));
+			rsp_port = 0;
+			return;
+		}
+		
+		rsp_running = true;
+		rsp_thread = new std::thread(rsp_threadfunc);
+	}
+}
+
+void rsp_shutdown(void)
+{
+	if(rsp_thread != NULL)
+	{
+		rsp_running = false;
+		rsp_wake();
+		rsp_thread->join();
+		delete rsp_thread;
+		rsp_thread = NULL;
+	}
+}
+
+void rsp_core_lock(void)
+{
+	rsp_core_mutex.lock();
+}
+
+void rsp_core_unlock(void)
+{
+	rsp_core_mutex.unlock();
+}
+
 void rsp_dbgstop(int pid, process_dbgstop_t reason)
 {
 	process_t *pptr = process_find(pid);
@@ -1685,10 +2449,19 @@ void rsp_dbgstop(int pid, process_dbgstop_t reason)
 	}
 	
 	pptr->dbgstop = reason;
+	pptr->step_active = false;
+	
+	//Stop-replies are only wanted by a connected debugger
+	if(rsp_client_sock == INVALID_SOCKET)
+		return;
 		
 	static int signal_mapping[PROCESS_DBGSTOP_MAX] =  {0};
 	signal_mapping[PROCESS_DBGSTOP_AC] = 10; //GDB SIGBUS
 	signal_mapping[PROCESS_DBGSTOP_BKPT] = 5; //GDB SIGTRAP
+	signal_mapping[PROCESS_DBGSTOP_HWBKPT] = 5; //GDB SIGTRAP
+	signal_mapping[PROCESS_DBGSTOP_WATCH] = 5; //GDB SIGTRAP
+	signal_mapping[PROCESS_DBGSTOP_STEP] = 5; //GDB SIGTRAP
+	signal_mapping[PROCESS_DBGSTOP_HISTORY] = 5; //GDB SIGTRAP
 	signal_mapping[PROCESS_DBGSTOP_ABT] = 11; //GDB SIGSEGV
 	signal_mapping[PROCESS_DBGSTOP_PF] = 11; //GDB SIGSEGV
 	signal_mapping[PROCESS_DBGSTOP_FATAL] = 32; //GDB SIGPWR = power-failure
@@ -1705,7 +2478,36 @@ void rsp_dbgstop(int pid, process_dbgstop_t reason)
 	rsp_putpkt_str(".");
 	rsp_putpkt_hex32(pptr->pid);
 	rsp_putpkt_str(";");
+	
+	//Say which breakpoint or watchpoint was responsible
+	if(reason == PROCESS_DBGSTOP_HWBKPT)
+	{
+		rsp_putpkt_str("hwbreak:;");
+	}
+	else if(reason == PROCESS_DBGSTOP_HISTORY)
+	{
+		rsp_putpkt_str("replaylog:begin;");
+	}
+	else if(reason == PROCESS_DBGSTOP_WATCH)
+	{
+		uint32_t watch_addr = 0;
+		int watch_kind = 0;
+		interp_watch_hit(&watch_addr, &watch_kind);
+		if(watch_kind == INTERP_WATCH_WRITE)
+			rsp_putpkt_str("watch:");
+		else if(watch_kind == INTERP_WATCH_READ)
+			rsp_putpkt_str("rwatch:");
+		else
+			rsp_putpkt_str("awatch:");
+		
+		rsp_putpkt_hex32(watch_addr);
+		rsp_putpkt_str(";");
+	}
+	
 	rsp_putpkt_end();
+	
+	//Called from the emulation core, so let the RSP thread know there's something to send
+	rsp_wake();
 }
 
 bool rsp_present(void)
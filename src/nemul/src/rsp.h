@@ -14,11 +14,16 @@
 #include "prefs.h"
 #include "process.h"
 
-//Initializes RSP listener
+//Initializes RSP listener and starts the thread serving it, debugging the console selected now
 void rsp_init(const prefs_t *prefs);
 
-//Polls TCP socket and acts on RSP commands
-void rsp_poll(void);
+//Stops the RSP thread
+void rsp_shutdown(void);
+
+//Keeps the debugger from acting on the process table while the emulation core uses it.
+//The RSP thread only looks at emulation state while it holds this lock itself.
+void rsp_core_lock(void);
+void rsp_core_unlock(void);
 
 //Sets a process to debug-stopped and notifies the debugger
 void rsp_dbgstop(int pid, process_dbgstop_t reason);
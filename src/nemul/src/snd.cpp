@@ -0,0 +1,338 @@
+//snd.cpp
+//Emulated audio output for Neki32 simulator
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#define FILE_TRACE_CAT TRACE_CAT_SND
+#include "trace.h"
+
+#include "snd.h"
+#include "sysc.h"
+#include "process.h"
+
+#include <string.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <new>
+#include <thread>
+
+//Audio output of one emulated console
+struct snd_ctx_s
+{
+	//Ring buffer of samples enqueued by the game and not yet played.
+	//Protected by the mutex, as it's filled by the emulation and drained by the audio thread.
+	std::mutex mutex;
+	unsigned char buf[SND_BUF_BYTES];
+	uint32_t rptr;
+	uint32_t len;
+	
+	//Whether the buffer had audio in it last time the audio thread looked (for counting underruns)
+	bool active;
+	
+	//Statistics kept by the audio thread, under the mutex
+	snd_stats_t stats;
+	
+	//Process that last enqueued audio, which gets woken as space frees up
+	int pid;
+	
+	//Set by the audio thread when it frees up space in the buffer, cleared by snd_poll
+	std::atomic<bool> drained;
+	
+	//Number of underruns already reported in the trace log (which only the emulation thread writes)
+	uint32_t underruns_logged;
+	
+	//Audio taken out of the buffer, on its way to the sink
+	unsigned char outbuf[SND_BUF_BYTES];
+};
+
+//State used when no console is selected, and the one selected on this thread
+static snd_ctx_t snd_default;
+static thread_local snd_ctx_t *snd_st = &snd_default;
+
+snd_ctx_t *snd_ctx_new(void)
+{
+	return new(std::nothrow) snd_ctx_t();
+}
+
+void snd_ctx_delete(snd_ctx_t *st)
+{
+	delete st;
+}
+
+void snd_select(snd_ctx_t *st)
+{
+	snd_st = (st != NULL) ? st : &snd_default;
+}
+
+//Host audio thread and a flag telling it to finish
+static std::thread snd_thread;
+static std::atomic<bool> snd_running;
+
+//Console whose buffer the audio thread drains
+static snd_ctx_t *snd_thread_st;
+
+//Output file, if audio is going to a WAV file, and how many data bytes were written to it
+static FILE *snd_wav;
+static uint64_t snd_wav_bytes;
+
+//Most data a WAV file can hold in whole frames, as the sizes in its header are 32-bit
+#define SND_WAV_MAX_BYTES (((0xFFFFFFFFull - 36) / SND_FRAME_BYTES) * SND_FRAME_BYTES)
+
+//Set by the audio thread when the WAV file filled up and was finished early, cleared by snd_poll
+static std::atomic<bool> snd_wav_full;
+
+//Writes a WAV header describing the given length of data at the start of the file
+static void snd_wav_header(FILE *f, uint32_t datalen)
+{
+	unsigned char hdr[44];
+	memcpy(hdr + 0, "RIFF", 4);
+	uint32_t riff_len = 36 + datalen;
+	memcpy(hdr + 4, &riff_len, 4);
+	memcpy(hdr + 8, "WAVEfmt ", 8);
+	
+	uint32_t fmt_len = 16;
+	uint16_t fmt_tag = 1; //PCM
+	uint16_t fmt_channels = 2;
+	uint32_t fmt_rate = SND_RATE;
+	uint32_t fmt_byterate = SND_RATE * SND_FRAME_BYTES;
+	uint16_t fmt_align = SND_FRAME_BYTES;
+	uint16_t fmt_bits = 16;
+	memcpy(hdr + 16, &fmt_len, 4);
+	memcpy(hdr + 20, &fmt_tag, 2);
+	memcpy(hdr + 22, &fmt_channels, 2);
+	memcpy(hdr + 24, &fmt_rate, 4);
+	memcpy(hdr + 28, &fmt_byterate, 4);
+	memcpy(hdr + 32, &fmt_align, 2);
+	memcpy(hdr + 34, &fmt_bits, 2);
+	
+	memcpy(hdr + 36, "data", 4);
+	memcpy(hdr + 40, &datalen, 4);
+	
+	fseek(f, 0, SEEK_SET);
+	fwrite(hdr, 1, sizeof(hdr), f);
+	fseek(f, 0, SEEK_END);
+}
+
+//Sends drained audio to whatever sink is configured
+static void snd_sink_write(const unsigned char *data, uint32_t len)
+{
+	if(snd_wav == NULL)
+		return; //Null sink
+	
+	if(snd_wav_bytes + len > SND_WAV_MAX_BYTES)
+	{
+		//Stop recording rather than let the sizes in the header wrap around
+		fwrite(data, 1, SND_WAV_MAX_BYTES - snd_wav_bytes, snd_wav);
+		snd_wav_header(snd_wav, (uint32_t)SND_WAV_MAX_BYTES);
+		fclose(snd_wav);
+		snd_wav = NULL;
+		snd_wav_full = true;
+		return;
+	}
+	
+	fwrite(data, 1, len, snd_wav);
+	snd_wav_bytes += len;
+}
+
+//Takes the given number of bytes out of the buffer, as the hardware would play them
+static void snd_drain(uint32_t want)
+{
+	std::unique_lock<std::mutex> lock(snd_st->mutex);
+	
+	uint32_t have = (snd_st->len < want) ? snd_st->len : want;
+	uint32_t first = SND_BUF_BYTES - snd_st->rptr; //Bytes before wrapping around
+	if(first > have)
+		first = have;
+	
+	memcpy(snd_st->outbuf, snd_st->buf + snd_st->rptr, first);
+	memcpy(snd_st->outbuf + first, snd_st->buf, have - first);
+	snd_st->rptr = (snd_st->rptr + have) % SND_BUF_BYTES;
+	snd_st->len -= have;
+	snd_st->stats.frames_played += have / SND_FRAME_BYTES;
+	
+	if(have < want)
+	{
+		//Ran dry - hardware would output silence here, and the game would audibly hitch
+		memset(snd_st->outbuf + have, 0, want - have);
+		snd_st->stats.frames_silent += (want - have) / SND_FRAME_BYTES;
+		if(snd_st->active)
+			snd_st->stats.underruns++;
+		
+		snd_st->active = false;
+	}
+	
+	lock.unlock();
+	
+	if(have > 0)
+		snd_st->drained = true;
+	
+	snd_sink_write(snd_st->outbuf, want);
+}
+
+//Host audio thread - consumes samples at the real-time rate of the console's DAC
+static void snd_threadfunc(void)
+{
+	auto last = std::chrono::steady_clock::now();
+	uint64_t frac = 0; //Leftover frames*microseconds not yet drained
+	snd_select(snd_thread_st);
+	while(snd_running)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		
+		auto now = std::chrono::steady_clock::now();
+		uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(now - last).count();
+		last = now;
+		
+		//Work out how many whole frames elapsed, carrying the remainder forward
+		frac += us * SND_RATE;
+		uint64_t frames = frac / 1000000;
+		frac %= 1000000;
+		
+		//Don't try to catch up more than the buffer holds (if the host stalled for a while)
+		if(frames > SND_RATE)
+			frames = SND_RATE;
+		
+		snd_drain(frames * SND_FRAME_BYTES);
+	}
+}
+
+void snd_init(const prefs_t *prefs)
+{
+	snd_shutdown();
+	
+	if(prefs->snd_sink == PREFS_SND_SINK_WAV && prefs->snd_wav_path[0] != '\0')
+	{
+		snd_wav = fopen(prefs->snd_wav_path, "wb");
+		if(snd_wav == NULL)
+		{
+			TERROR("Failed to open %s for audio output\n", prefs->snd_wav_path);
+		}
+		else
+		{
+			TINFO("Writing audio output to %s\n", prefs->snd_wav_path);
+			snd_wav_bytes = 0;
+			snd_wav_header(snd_wav, 0);
+		}
+	}
+	
+	snd_running = true;
+	snd_thread_st = snd_st;
+	snd_thread = std::thread(snd_threadfunc);
+}
+
+void snd_shutdown(void)
+{
+	if(snd_thread.joinable())
+	{
+		snd_running = false;
+		snd_thread.join();
+	}
+	
+	if(snd_wav != NULL)
+	{
+		//Go back and fill in the sizes in the header now that we know them
+		snd_wav_header(snd_wav, (uint32_t)snd_wav_bytes);
+		fclose(snd_wav);
+		snd_wav = NULL;
+	}
+}
+
+void snd_reset(void)
+{
+	std::lock_guard<std::mutex> lock(snd_st->mutex);
+	snd_st->rptr = 0;
+	snd_st->len = 0;
+	snd_st->active = false;
+	snd_st->pid = 0;
+	snd_st->drained = false;
+	snd_st->underruns_logged = 0;
+	memset(&snd_st->stats, 0, sizeof(snd_st->stats));
+}
+
+int snd_enqueue(int pid, const void *chunk, uint32_t chunkbytes, uint32_t maxbuf)
+{
+	//Partial frames can't be played
+	if(chunkbytes % SND_FRAME_BYTES)
+		return -PVMK_EINVAL;
+	
+	//Can never buffer more than the hardware holds
+	if(maxbuf == 0 || maxbuf > SND_BUF_BYTES)
+		maxbuf = SND_BUF_BYTES;
+	
+	if(chunkbytes > maxbuf)
+		return -PVMK_EINVAL;
+	
+	std::lock_guard<std::mutex> lock(snd_st->mutex);
+	snd_st->pid = pid;
+	
+	//Chunk is either enqueued entirely or rejected
+	if(snd_st->len + chunkbytes > maxbuf)
+		return -PVMK_EAGAIN;
+	
+	if(chunkbytes == 0)
+		return snd_st->len;
+	
+	const unsigned char *src = (const unsigned char*)chunk;
+	uint32_t wptr = (snd_st->rptr + snd_st->len) % SND_BUF_BYTES;
+	uint32_t first = SND_BUF_BYTES - wptr; //Bytes before wrapping around
+	if(first > chunkbytes)
+		first = chunkbytes;
+	
+	memcpy(snd_st->buf + wptr, src, first);
+	memcpy(snd_st->buf, src + first, chunkbytes - first);
+	snd_st->len += chunkbytes;
+	snd_st->active = true;
+	return snd_st->len;
+}
+
+void snd_silence(void)
+{
+	std::lock_guard<std::mutex> lock(snd_st->mutex);
+	snd_st->len = 0;
+	snd_st->active = false;
+}
+
+void snd_advance(uint32_t ms)
+{
+	snd_drain(ms * (SND_RATE / 1000) * SND_FRAME_BYTES);
+}
+
+void snd_poll(void)
+{
+	//Report underruns from here, as the audio thread can't safely write trace messages
+	uint32_t underruns = 0;
+	{
+		std::lock_guard<std::mutex> lock(snd_st->mutex);
+		underruns = snd_st->stats.underruns;
+	}
+	if(underruns != snd_st->underruns_logged)
+	{
+		TINFO("Audio underrun - %u so far\n", underruns);
+		snd_st->underruns_logged = underruns;
+	}
+	
+	if(snd_wav_full.exchange(false))
+		TWARNING("%s", "Audio output file reached the most a WAV file can hold - stopped writing it\n");
+	
+	if(!snd_st->drained.exchange(false))
+		return; //Nothing played since last time
+	
+	//Buffer space freed up - that's "something happening" to the process playing audio
+	process_t *pptr = process_find(snd_st->pid);
+	if(pptr != NULL && pptr->state == PROCESS_STATE_ALIVE)
+		pptr->unpaused = true;
+}
+
+void snd_getstats(snd_stats_t *out)
+{
+	std::lock_guard<std::mutex> lock(snd_st->mutex);
+	*out = snd_st->stats;
+}
@@ -0,0 +1,68 @@
+//snd.h
+//Emulated audio output for Neki32 simulator
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#ifndef _SND_H
+#define _SND_H
+
+#include <stdint.h>
+#include "prefs.h"
+
+//Audio format of the emulated output, as in _SC_SND_MODE_48K_16B_2C
+#define SND_RATE 48000
+#define SND_FRAME_BYTES 4
+
+//Size of the emulated output buffer - one second of audio
+#define SND_BUF_BYTES (SND_RATE * SND_FRAME_BYTES)
+
+//Statistics about audio output, for measuring underruns off-device
+typedef struct snd_stats_s
+{
+	uint64_t frames_played; //Frames drained from the buffer that came from the game
+	uint64_t frames_silent; //Frames of silence output because the buffer was empty
+	uint32_t underruns; //Number of times the buffer ran dry while a game was playing audio
+} snd_stats_t;
+
+//Output buffer of one emulated console
+typedef struct snd_ctx_s snd_ctx_t;
+
+//Makes or frees the audio state for a console
+snd_ctx_t *snd_ctx_new(void);
+void snd_ctx_delete(snd_ctx_t *st);
+
+//Selects the state used by later calls on this thread, or NULL for the one used when there's no console
+void snd_select(snd_ctx_t *st);
+
+//Starts the host audio thread that drains the emulated output buffer of the console selected now
+void snd_init(const prefs_t *prefs);
+
+//Stops the host audio thread and finishes any output file
+void snd_shutdown(void);
+
+//Discards buffered audio for a new run of the emulator
+void snd_reset(void);
+
+//Enqueues a chunk of audio from the given process.
+//Returns the number of bytes now buffered, or a negative error number.
+int snd_enqueue(int pid, const void *chunk, uint32_t chunkbytes, uint32_t maxbuf);
+
+//Stops all sounds, discarding anything buffered
+void snd_silence(void);
+
+//Drains the buffer as the hardware would over the given emulated time.
+//Used instead of snd_init's host audio thread when running faster than real-time.
+void snd_advance(uint32_t ms);
+
+//Wakes the process playing audio if buffer space has freed up since the last call
+void snd_poll(void);
+
+//Returns statistics about audio output so far
+void snd_getstats(snd_stats_t *out);
+
+#endif //_SND_H
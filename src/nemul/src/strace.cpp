@@ -0,0 +1,325 @@
+//strace.cpp
+//Tracing of system calls and their latency in the Neki32 simulator
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#define FILE_TRACE_CAT TRACE_CAT_SYSC
+#include "trace.h"
+
+#include "strace.h"
+
+#include <string.h>
+#include <chrono>
+#include <new>
+
+//Each system call is timed two ways. Emulated time runs from the call until the process next gets the CPU,
+//so it counts time spent blocked, like in _sc_pause, or waiting behind other processes. Host time is what
+//the simulator spent servicing the call, like reading the disk image.
+
+//What we know about each system call, from the same list sysc() dispatches with - the name, and how many arguments to show
+typedef struct strace_info_s
+{
+	uint32_t nr;
+	const char *name;
+	int nargs;
+	bool noreturn; //Whether the caller doesn't get a result back
+} strace_info_t;
+static const strace_info_t strace_info[] =
+{
+	#define SYSC_CALL(nr, name, nargs, noreturn) { nr, #name, nargs, noreturn },
+	#include "sysc_calls.h"
+	#undef SYSC_CALL
+};
+
+//Finds what we know about a system call, or returns NULL for a bad one
+static const strace_info_t *strace_lookup(uint32_t nr)
+{
+	for(size_t ii = 0; ii < sizeof(strace_info) / sizeof(strace_info[0]); ii++)
+	{
+		if(strace_info[ii].nr == nr)
+			return &(strace_info[ii]);
+	}
+	return NULL;
+}
+
+//Lower limit of each histogram bucket, in nanoseconds
+static const uint64_t strace_buckets[STRACE_BUCKETS] =
+{
+	0, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000,
+	1000000, 2000000, 5000000, 10000000, 20000000, 50000000, 100000000, 200000000, 500000000, 1000000000,
+};
+
+//A call in progress in some process
+typedef struct strace_call_s
+{
+	int pid; //0 if nothing is in progress
+	bool serviced; //Whether strace_end has been called for it
+	uint32_t nr;
+	uint32_t args[5];
+	int result;
+	uint64_t start_ns; //Emulated time of the call
+	std::chrono::steady_clock::time_point host_start;
+	uint64_t host_ns;
+} strace_call_t;
+
+//System calls traced in one emulated console
+struct strace_ctx_s
+{
+	//Calls in progress, by process table entry
+	strace_call_t calls[PROCESS_MAX];
+	
+	//Counts of each call number
+	strace_stats_t stats[STRACE_CALLS];
+	
+	//Emulated time when the counts were reset
+	uint64_t reset_ns = 0;
+	
+	//Where each call is written as it finishes, if anywhere
+	FILE *output = NULL;
+};
+
+//State used when no console is selected, and the one selected on this thread
+static strace_ctx_t strace_default;
+static thread_local strace_ctx_t *strace_st = &strace_default;
+
+strace_ctx_t *strace_ctx_new(void)
+{
+	return new(std::nothrow) strace_ctx_t();
+}
+
+void strace_ctx_delete(strace_ctx_t *st)
+{
+	delete st;
+}
+
+void strace_select(strace_ctx_t *st)
+{
+	strace_st = (st != NULL) ? st : &strace_default;
+}
+
+void strace_reset(void)
+{
+	for(int pp = 0; pp < PROCESS_MAX; pp++)
+	{
+		strace_st->calls[pp].pid = 0;
+	}
+	memset(strace_st->stats, 0, sizeof(strace_st->stats));
+	strace_st->reset_ns = process_elapsed_ns();
+}
+
+void strace_setoutput(FILE *fp)
+{
+	strace_st->output = fp;
+}
+
+const char *strace_name(int nr)
+{
+	const strace_info_t *iptr = strace_lookup(nr);
+	return (iptr != NULL) ? iptr->name : NULL;
+}
+
+uint64_t strace_bucket_ns(int bucket)
+{
+	return (bucket >= 0 && bucket < STRACE_BUCKETS) ? strace_buckets[bucket] : 0;
+}
+
+//Returns which histogram bucket a time goes in
+static int strace_bucket(uint64_t ns)
+{
+	int bb = STRACE_BUCKETS - 1;
+	while(bb > 0 && ns < strace_buckets[bb])
+		bb--;
+	
+	return bb;
+}
+
+//Describes a time briefly, in units that suit it
+static void strace_fmttime(uint64_t ns, char *buf, int len)
+{
+	if(ns < 1000000)
+		snprintf(buf, len, "%.3gus", ns / 1000.0);
+	else if(ns < 1000000000)
+		snprintf(buf, len, "%.3gms", ns / 1000000.0);
+	else
+		snprintf(buf, len, "%.3gs", ns / 1000000000.0);
+}
+
+void strace_begin(const process_t *pptr)
+{
+	int slot = pptr->pid % PROCESS_MAX;
+	if(slot < 0)
+		return;
+	
+	strace_call_t *cptr = &(strace_st->calls[slot]);
+	cptr->pid = pptr->pid;
+	cptr->serviced = false;
+	cptr->nr = pptr->regs[0];
+	memcpy(cptr->args, pptr->regs + 1, sizeof(cptr->args));
+	cptr->result = 0;
+	cptr->start_ns = process_elapsed_ns();
+	cptr->host_start = std::chrono::steady_clock::now();
+	cptr->host_ns = 0;
+}
+
+//Counts a call that finished, and writes it out if we're asked to
+static void strace_finish(strace_call_t *cptr)
+{
+	uint64_t emul_ns = process_elapsed_ns() - cptr->start_ns;
+	int pid = cptr->pid;
+	cptr->pid = 0;
+	if(cptr->nr >= STRACE_CALLS)
+		return;
+	
+	const strace_info_t *iptr = strace_lookup(cptr->nr);
+	bool noreturn = (iptr != NULL) && iptr->noreturn;
+	strace_stats_t *sptr = &(strace_st->stats[cptr->nr]);
+	sptr->calls++;
+	if(!noreturn && cptr->result < 0)
+		sptr->errors++;
+	
+	sptr->emul_ns += emul_ns;
+	if(emul_ns > sptr->emul_ns_max)
+		sptr->emul_ns_max = emul_ns;
+	
+	sptr->host_ns += cptr->host_ns;
+	if(cptr->host_ns > sptr->host_ns_max)
+		sptr->host_ns_max = cptr->host_ns;
+	
+	sptr->emul_hist[strace_bucket(emul_ns)]++;
+	sptr->host_hist[strace_bucket(cptr->host_ns)]++;
+	
+	if(strace_st->output == NULL)
+		return;
+	
+	//Like strace - time, process, call with arguments, result, then how long it took
+	FILE *fp = strace_st->output;
+	fprintf(fp, "%12.6f [%d] ", cptr->start_ns / 1e9, pid);
+	if(iptr != NULL)
+		fprintf(fp, "%s(", iptr->name);
+	else
+		fprintf(fp, "syscall_0x%X(", cptr->nr);
+	
+	int nargs = (iptr != NULL) ? iptr->nargs : 5;
+	for(int aa = 0; aa < nargs; aa++)
+	{
+		fprintf(fp, "%s0x%X", aa ? ", " : "", cptr->args[aa]);
+	}
+	
+	char emulbuf[32];
+	char hostbuf[32];
+	strace_fmttime(emul_ns, emulbuf, sizeof(emulbuf));
+	strace_fmttime(cptr->host_ns, hostbuf, sizeof(hostbuf));
+	if(noreturn)
+		fprintf(fp, ") = ? <%s emul, %s host>\n", emulbuf, hostbuf);
+	else
+		fprintf(fp, ") = %d <%s emul, %s host>\n", cptr->result, emulbuf, hostbuf);
+}
+
+void strace_end(const process_t *pptr, int result)
+{
+	int slot = pptr->pid % PROCESS_MAX;
+	if(slot < 0 || strace_st->calls[slot].pid != pptr->pid)
+		return;
+	
+	strace_call_t *cptr = &(strace_st->calls[slot]);
+	
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	cptr->host_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - cptr->host_start).count();
+	cptr->result = result;
+	cptr->serviced = true;
+	
+	//A process that's gone won't run again to finish the call
+	if(pptr->state != PROCESS_STATE_ALIVE)
+		strace_finish(cptr);
+}
+
+void strace_resume(const process_t *pptr)
+{
+	int slot = pptr->pid % PROCESS_MAX;
+	if(slot < 0 || strace_st->calls[slot].pid == 0)
+		return;
+	
+	strace_call_t *cptr = &(strace_st->calls[slot]);
+	
+	if(cptr->pid != pptr->pid || !cptr->serviced)
+	{
+		//Left over from a process that's gone
+		cptr->pid = 0;
+		return;
+	}
+	
+	strace_finish(cptr);
+}
+
+void strace_getstats(int nr, strace_stats_t *out)
+{
+	if(nr >= 0 && nr < STRACE_CALLS)
+		*out = strace_st->stats[nr];
+	else
+		memset(out, 0, sizeof(*out));
+}
+
+void strace_summary(char *buf, int len)
+{
+	if(len <= 0)
+		return;
+	
+	buf[0] = '\0';
+	uint64_t elapsed_ns = process_elapsed_ns() - strace_st->reset_ns;
+	char timebuf[32];
+	strace_fmttime(elapsed_ns, timebuf, sizeof(timebuf));
+	
+	int used = snprintf(buf, len, "System calls in %s emulated\n", timebuf);
+	if(used < len)
+	{
+		used += snprintf(buf + used, len - used, "%-13s %4s %10s %7s %9s %9s %9s %9s %9s\n",
+			"name", "nr", "calls", "errors", "per sec", "emul avg", "emul max", "host avg", "host max");
+	}
+	
+	for(int nr = 0; nr < STRACE_CALLS && used < len; nr++)
+	{
+		const strace_stats_t *sptr = &(strace_st->stats[nr]);
+		if(sptr->calls == 0)
+			continue;
+		
+		char emulavg[32];
+		char emulmax[32];
+		char hostavg[32];
+		char hostmax[32];
+		strace_fmttime(sptr->emul_ns / sptr->calls, emulavg, sizeof(emulavg));
+		strace_fmttime(sptr->emul_ns_max, emulmax, sizeof(emulmax));
+		strace_fmttime(sptr->host_ns / sptr->calls, hostavg, sizeof(hostavg));
+		strace_fmttime(sptr->host_ns_max, hostmax, sizeof(hostmax));
+		
+		const char *name = strace_name(nr);
+		double persec = elapsed_ns ? (sptr->calls * 1e9 / elapsed_ns) : 0.0;
+		used += snprintf(buf + used, len - used, "%-13s 0x%2.2X %10llu %7llu %9.2f %9s %9s %9s %9s\n",
+			(name != NULL) ? name : "unknown", nr, (unsigned long long)sptr->calls,
+			(unsigned long long)sptr->errors, persec, emulavg, emulmax, hostavg, hostmax);
+		
+		//Histograms, leaving out empty buckets
+		for(int hh = 0; hh < 2 && used < len; hh++)
+		{
+			const uint64_t *hist = hh ? sptr->host_hist : sptr->emul_hist;
+			used += snprintf(buf + used, len - used, "    %s", hh ? "host" : "emul");
+			for(int bb = 0; bb < STRACE_BUCKETS && used < len; bb++)
+			{
+				if(hist[bb] == 0)
+					continue;
+				
+				//Label each bucket by its upper limit, or the last by its lower one
+				char limbuf[32];
+				strace_fmttime((bb + 1 < STRACE_BUCKETS) ? strace_buckets[bb + 1] : strace_buckets[bb], limbuf, sizeof(limbuf));
+				used += snprintf(buf + used, len - used, " %s%s:%llu", (bb + 1 < STRACE_BUCKETS) ? "<" : ">=",
+					limbuf, (unsigned long long)hist[bb]);
+			}
+			if(used < len)
+				used += snprintf(buf + used, len - used, "\n");
+		}
+	}
+}
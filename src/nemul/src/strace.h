@@ -0,0 +1,75 @@
+//strace.h
+//Tracing of system calls and their latency in the Neki32 simulator
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#ifndef _STRACE_H
+#define _STRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "process.h"
+
+//Latency histogram buckets - each counts calls taking less than its limit, except the last
+#define STRACE_BUCKETS 20
+
+//Counts of one system call since the last reset
+typedef struct strace_stats_s
+{
+	uint64_t calls; //Calls finished
+	uint64_t errors; //Calls that returned an error
+	uint64_t emul_ns; //Emulated time from each call until the caller ran again, in total
+	uint64_t emul_ns_max;
+	uint64_t host_ns; //Host time spent servicing each call, in total
+	uint64_t host_ns_max;
+	uint64_t emul_hist[STRACE_BUCKETS]; //Calls by emulated time
+	uint64_t host_hist[STRACE_BUCKETS]; //Calls by host time
+} strace_stats_t;
+
+//Number of system call numbers that are tracked
+#define STRACE_CALLS 256
+
+//System calls traced in one emulated console
+typedef struct strace_ctx_s strace_ctx_t;
+
+//Makes or frees the state for a console
+strace_ctx_t *strace_ctx_new(void);
+void strace_ctx_delete(strace_ctx_t *st);
+
+//Selects the state used by later calls on this thread, or NULL for the one used when there's no console
+void strace_select(strace_ctx_t *st);
+
+//Forgets all counts and calls in progress, for a new run of the simulation
+void strace_reset(void);
+
+//Writes a line to the given file as each call finishes, or stops if NULL. The caller closes the file.
+void strace_setoutput(FILE *fp);
+
+//Notes that a process is making the system call in its registers
+void strace_begin(const process_t *pptr);
+
+//Notes the result of the call begun last, once it's been serviced.
+//The call finishes when the process runs again, so time it spends blocked is counted.
+void strace_end(const process_t *pptr, int result);
+
+//Notes that a process is about to run, finishing any call it made
+void strace_resume(const process_t *pptr);
+
+//Returns the counts of a system call since the last reset
+void strace_getstats(int nr, strace_stats_t *out);
+
+//Returns the name of a system call, or NULL if it's not one we know
+const char *strace_name(int nr);
+
+//Returns the lower limit of a histogram bucket in nanoseconds
+uint64_t strace_bucket_ns(int bucket);
+
+//Describes the counts of every system call made as text, with their latency histograms
+void strace_summary(char *buf, int len);
+
+#endif //_STRACE_H
@@ -0,0 +1,70 @@
+//stracewin.cpp
+//Window showing system call counts and latency for Neki32 simulator
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#include "stracewin.h"
+#include "strace.h"
+#include "rsp.h"
+
+StraceWin::StraceWin(wxWindow *parent)
+: wxDialog(parent, wxID_ANY, "System Calls", wxDefaultPosition, wxDefaultSize, wxDEFAULT_DIALOG_STYLE | wxRESIZE_BORDER)
+{
+	wxSizer *main_sizer = new wxBoxSizer(wxVERTICAL);
+	
+	//Counts as text, in a fixed font so the columns line up
+	Text = new wxTextCtrl(this, wxID_ANY, "", wxDefaultPosition, wxSize(760, 480),
+		wxTE_MULTILINE | wxTE_READONLY | wxTE_DONTWRAP);
+	Text->SetFont(wxFont(wxFontInfo(9).Family(wxFONTFAMILY_TELETYPE)));
+	main_sizer->Add(Text, 1, wxEXPAND | wxALL, 8);
+	
+	//Reset to measure from a certain point in the game
+	wxButton *reset_button = new wxButton(this, wxID_ANY, "Reset");
+	reset_button->Bind(wxEVT_BUTTON, &StraceWin::OnReset, this, reset_button->GetId());
+	main_sizer->Add(reset_button, 0, wxALIGN_RIGHT | wxLEFT | wxRIGHT | wxBOTTOM, 8);
+	
+	SetSizerAndFit(main_sizer);
+	
+	//Update once a second while open
+	Timer.SetOwner(this);
+	Bind(wxEVT_TIMER, &StraceWin::OnTimer, this);
+	Timer.Start(1000, wxTIMER_CONTINUOUS);
+	ShowCounts();
+}
+
+void StraceWin::ShowCounts(void)
+{
+	static char summary[64 * 1024];
+	rsp_core_lock();
+	strace_summary(summary, sizeof(summary));
+	rsp_core_unlock();
+	
+	//Keep the scroll position, as this happens all the time
+	long pos = Text->GetInsertionPoint();
+	Text->ChangeValue(summary);
+	Text->SetInsertionPoint((pos < Text->GetLastPosition()) ? pos : Text->GetLastPosition());
+}
+
+void StraceWin::OnReset(wxCommandEvent &event)
+{
+	(void)event;
+	
+	rsp_core_lock();
+	strace_reset();
+	rsp_core_unlock();
+	
+	ShowCounts();
+}
+
+void StraceWin::OnTimer(wxTimerEvent &event)
+{
+	(void)event;
+	
+	if(IsShown())
+		ShowCounts();
+}
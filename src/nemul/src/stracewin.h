@@ -0,0 +1,38 @@
+//stracewin.h
+//Window showing system call counts and latency for Neki32 simulator
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#ifndef _STRACEWIN_H
+#define _STRACEWIN_H
+
+#include <wx/wx.h>
+
+class StraceWin : public wxDialog
+{
+public:
+	StraceWin(wxWindow *parent);
+	
+	//Updates the text with the latest counts
+	void ShowCounts(void);
+	
+private:
+	//Reset button clicked
+	void OnReset(wxCommandEvent &event);
+	
+	//Time to update
+	void OnTimer(wxTimerEvent &event);
+	
+	//Text of the counts
+	wxTextCtrl *Text;
+	
+	//Updates the text while the window is up
+	wxTimer Timer;
+};
+
+#endif //_STRACEWIN_H
@@ -14,32 +14,84 @@
 
 #include "sysc.h"
 #include "prefs.h"
+#include "snd.h"
+#include "nvm.h"
+#include "undo.h"
+#include "telem.h"
+#include "hle.h"
+#include "heap.h"
+#include "strace.h"
+#include "textscr.h"
+#include "dbgout.h"
+#include "emul.h"
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <new>
 
 
-//Process making the system call
-static process_t *sysc_pptr;
+//Inputs waiting to be delivered, at most - enough for every press and release of a few seconds of mashing
+#define SYSC_INPUTQ_MAX 256
 
-//Host file used to service disk reads/writes
-int sysc_diskfd = -1;
+//Input event waiting to be delivered, and the emulated time it happened
+typedef struct sysc_input_s
+{
+	uint32_t data;
+	uint64_t ns;
+} sysc_input_t;
+
+//System-call state of one emulated console
+struct sysc_ctx_s
+{
+	//Process making the system call
+	process_t *pptr;
+	
+	//Host file used to service disk reads/writes
+	int diskfd = -1;
+	
+	//Framebuffer last made active
+	int fb_now_pid;
+	int fb_now_ptr;
+	int fb_now_mode;
+	
+	//Framebuffer yet to be made active
+	int fb_enq_pid;
+	int fb_enq_ptr;
+	int fb_enq_mode;
+	
+	//Inputs waiting to be delivered
+	sysc_input_t inputq[SYSC_INPUTQ_MAX];
+	int inputq_rptr;
+	int inputq_wptr;
+	
+	//Buttons last enqueued for each pad, so only changes make events
+	uint16_t pads_now[PREFS_PAD_MAX];
+	
+	//Processes that read input, in the table entry of each, which are woken when more arrives
+	int reader_pid[PROCESS_MAX];
+	
+	//Counts of input events
+	sysc_inputstats_t inputstats;
+};
+
+//State used when no console is selected, and the one selected on this thread
+static sysc_ctx_t sysc_default;
+static thread_local sysc_ctx_t *sysc_st = &sysc_default;
 
-//Framebuffer last made active
-int sysc_fb_now_pid;
-int sysc_fb_now_ptr;
-int sysc_fb_now_mode;
+sysc_ctx_t *sysc_ctx_new(void)
+{
+	return new(std::nothrow) sysc_ctx_t();
+}
 
-//Framebuffer yet to be made active
-int sysc_fb_enq_pid;
-int sysc_fb_enq_ptr;
-int sysc_fb_enq_mode;
+void sysc_ctx_delete(sysc_ctx_t *st)
+{
+	delete st;
+}
 
-//Inputs waiting to be delivered
-#define SYSC_INPUTQ_MAX (PREFS_PAD_MAX*2)
-uint32_t sysc_inputq_data[SYSC_INPUTQ_MAX];
-int sysc_inputq_rptr;
-int sysc_inputq_wptr;
+void sysc_select(sysc_ctx_t *st)
+{
+	sysc_st = (st != NULL) ? st : &sysc_default;
+}
 
 //Memory size needed for each mode of framebuffer
 const int sysc_fb_sizes[] = 
@@ -49,9 +101,32 @@ const int sysc_fb_sizes[] =
 	320*240*2, //240p RGB565
 };
 
+void sysc_reset(void)
+{
+	sysc_st->fb_now_pid = 0;
+	sysc_st->fb_now_ptr = 0;
+	sysc_st->fb_now_mode = 0;
+	sysc_st->fb_enq_pid = 0;
+	sysc_st->fb_enq_ptr = 0;
+	sysc_st->fb_enq_mode = 0;
+	
+	sysc_st->inputq_rptr = 0;
+	sysc_st->inputq_wptr = 0;
+	memset(sysc_st->pads_now, 0, sizeof(sysc_st->pads_now));
+	memset(sysc_st->reader_pid, 0, sizeof(sysc_st->reader_pid));
+	memset(&(sysc_st->inputstats), 0, sizeof(sysc_st->inputstats));
+}
+
 void sysc_setdiskfd(int fd)
 {
-	sysc_diskfd = fd;
+	sysc_st->diskfd = fd;
+	
+	//NVM records belong to the card, identified by the Volume ID in its ISO9660 primary volume descriptor
+	char volid[33] = {0};
+	if(fd < 0 || lseek(fd, (16 * 2048) + 40, SEEK_SET) != (16 * 2048) + 40 || read(fd, volid, 32) != 32)
+		volid[0] = '\0';
+	
+	nvm_setcard(volid);
 }
 
 void sysc_popfbptr(uint16_t **bufptr_out, int *mode_out)
@@ -61,85 +136,184 @@ void sysc_popfbptr(uint16_t **bufptr_out, int *mode_out)
 	*mode_out = 0;
 	
 	//Enqueued framebuffer is now considered active when the emulator uses it
-	sysc_fb_now_pid = sysc_fb_enq_pid;
-	sysc_fb_now_ptr = sysc_fb_enq_ptr;
-	sysc_fb_now_mode = sysc_fb_enq_mode;
+	sysc_st->fb_now_pid = sysc_st->fb_enq_pid;
+	sysc_st->fb_now_ptr = sysc_st->fb_enq_ptr;
+	sysc_st->fb_now_mode = sysc_st->fb_enq_mode;
+	telem_present(sysc_st->fb_now_mode);
 	
 	//Return the actual location in host memory
 	for(int pp = 0; pp < PROCESS_MAX; pp++)
 	{
-		if(process_table[pp].pid != sysc_fb_now_pid)
+		if(process_table[pp].pid != sysc_st->fb_now_pid)
 			continue; //Wrong process
 		
 		if(process_table[pp].mem == NULL)
-			return; //Process died while display active
+			break; //Process died while display active
+		
+		if(sysc_st->fb_now_mode != 0)
+		{
+			*bufptr_out = (uint16_t*)(process_table[pp].mem + (sysc_st->fb_now_ptr / 4));
+			*mode_out = sysc_st->fb_now_mode;
+		}
 		
-		*bufptr_out = (uint16_t*)(process_table[pp].mem + (sysc_fb_now_ptr / 4));
-		*mode_out = sysc_fb_now_mode;
 		process_table[pp].unpaused = true;
-		return;
+		break;
 	}
 	
-	//Didn't find process displaying something
-	
+	//Text mode, or nothing to display - show what's been printed, like the real machine's console
+	if(*mode_out == 0)
+	{
+		*bufptr_out = (uint16_t*)textscr_render();
+		*mode_out = 1;
+	}
 }
 
-void sysc_pushpads(const uint16_t *pads)
-{	
-	//Just reset the "input queue" each time
-	for(int pp = 0; pp < PREFS_PAD_MAX; pp++)
+void sysc_pushpad(int pad, uint16_t buttons)
+{
+	if(pad < 0 || pad >= PREFS_PAD_MAX || buttons == sysc_st->pads_now[pad])
+		return;
+	
+	sysc_st->pads_now[pad] = buttons;
+	
+	//If the queue is full, nobody's been reading it - lose the oldest event rather than the newest
+	int next = (sysc_st->inputq_wptr + 1) % SYSC_INPUTQ_MAX;
+	if(next == sysc_st->inputq_rptr)
 	{
-		sysc_inputq_data[pp] = pads[pp];
-		sysc_inputq_data[pp] <<= 16;
-		sysc_inputq_data[pp] |= 'A' + pp;
+		sysc_st->inputq_rptr = (sysc_st->inputq_rptr + 1) % SYSC_INPUTQ_MAX;
+		sysc_st->inputstats.dropped++;
 	}
 	
-	sysc_inputq_rptr = 0;
-	sysc_inputq_wptr = PREFS_PAD_MAX;
+	sysc_input_t *iptr = &(sysc_st->inputq[sysc_st->inputq_wptr]);
+	iptr->data = ((uint32_t)buttons << 16) | ('A' + pad);
+	iptr->ns = process_elapsed_ns();
+	sysc_st->inputq_wptr = next;
+	sysc_st->inputstats.pushed++;
 	
-	//Unpause all processes (whatever)
+	//Wake anyone who reads input, so they see it
 	for(int pp = 0; pp < PROCESS_MAX; pp++)
 	{
-		if(process_table[pp].state == PROCESS_STATE_ALIVE)
+		if(process_table[pp].state == PROCESS_STATE_ALIVE && process_table[pp].pid == sysc_st->reader_pid[pp])
 			process_table[pp].unpaused = true;
 	}
 }
 
-void pvmk_sc_none(void)
+void sysc_pushpads(const uint16_t *pads)
+{
+	for(int pp = 0; pp < PREFS_PAD_MAX; pp++)
+	{
+		sysc_pushpad(pp, pads[pp]);
+	}
+}
+
+void sysc_inputstats(sysc_inputstats_t *out)
+{
+	*out = sysc_st->inputstats;
+}
+
+int pvmk_sc_none(void)
 {
 	TDEBUG("%s\n", "pvmk_sc_none");
+	return 0;
 }
 
-void pvmk_sc_pause(void)
+int pvmk_sc_pause(void)
 {
 	TDEBUG("%s\n", "pvmk_sc_pause");
-	sysc_pptr->paused = true;
-	return;
+	sysc_st->pptr->paused = true;
+	return 0;
 }
 
 int pvmk_sc_getticks(void)
 {
 	TDEBUG("%s\n", "pvmk_sc_getticks");
 	
-	extern uint32_t EmulTimerTicks;
-	return EmulTimerTicks & 0x7FFFFFFFu;
+	return emul_cur->ticks & 0x7FFFFFFFu;
 }
 
 int pvmk_sc_fork(void)
 {
 	TDEBUG("%s\n", "pvmk_sc_fork");
-	return process_fork(sysc_pptr->pid);
+	return process_fork(sysc_st->pptr->pid);
+}
+
+//Checks if the given process is the given PID or one of its descendants
+static bool sysc_in_ptree(const process_t *pptr, int root)
+{
+	int pid = pptr->pid;
+	for(int depth = 0; depth < PROCESS_MAX; depth++)
+	{
+		if(pid == root)
+			return true;
+		
+		const process_t *up = process_find(pid);
+		if(up == NULL || up->ppid == pid)
+			return false;
+		
+		pid = up->ppid;
+	}
+	return false;
 }
 
 int pvmk_sc_wait(uint32_t idtype, uint32_t id, uint32_t options, uint32_t buf, uint32_t len)
 {
 	TDEBUG("%s %u %u %X %8.8X %u\n", "pvmk_sc_wait", idtype, id, options, buf, len);
+	
+	if(idtype != PVMK_IDTYPE_ALL && idtype != PVMK_IDTYPE_PID && idtype != PVMK_IDTYPE_PTREE)
+		return -PVMK_EINVAL;
+	
+	//Status is returned as a pair of words - status and PID
+	if(len < 8)
+		return -PVMK_EINVAL;
+	if(buf < 4096 || buf + 8 > sysc_st->pptr->size || (buf % 4))
+		return -PVMK_EFAULT;
+	
+	//Look for children matching the request
+	bool any_child = false;
+	for(int pp = 0; pp < PROCESS_MAX; pp++)
+	{
+		process_t *child = &(process_table[pp]);
+		if(child->state == PROCESS_STATE_NONE)
+			continue;
+		if(child->ppid != sysc_st->pptr->pid || child == sysc_st->pptr)
+			continue;
+		if(idtype == PVMK_IDTYPE_PID && child->pid != (int)id)
+			continue;
+		if(idtype == PVMK_IDTYPE_PTREE && !sysc_in_ptree(child, id))
+			continue;
+		
+		any_child = true;
+		
+		if(child->state != PROCESS_STATE_DEAD || !(options & PVMK_WEXITED))
+			continue; //Nothing to report (we don't emulate stopping/continuing)
+		
+		//Found a dead child, give its status to the caller
+		undo_memblock(sysc_st->pptr, buf, 8);
+		sysc_st->pptr->mem[(buf/4) + 0] = child->waitst;
+		sysc_st->pptr->mem[(buf/4) + 1] = child->pid;
+		
+		if(!(options & PVMK_WNOWAIT))
+			process_reap(child);
+		
+		return 8;
+	}
+	
+	if(!any_child)
+		return -PVMK_ECHILD;
+	
+	//Children exist but haven't changed state
 	return 0;
 }
 
-void pvmk_sc_exit(uint32_t code, uint32_t sig)
+int pvmk_sc_exit(uint32_t code, uint32_t sig)
 {
 	TDEBUG("%s %u %u\n", "pvmk_sc_exit", code, sig);
+	
+	if(sig != 0)
+		process_kill(sysc_st->pptr, PVMK_STATUS_SIGNALED_BIT | ((sig << PVMK_STATUS_TERMSIG_SHIFT) & PVMK_STATUS_TERMSIG_MASK));
+	else
+		process_kill(sysc_st->pptr, PVMK_STATUS_EXITED_BIT | (code & PVMK_STATUS_EXITCODE_MASK));
+	
+	return 0;
 }
 
 int pvmk_sc_gfx_flip(uint32_t mode, uint32_t buffer)
@@ -156,22 +330,29 @@ int pvmk_sc_gfx_flip(uint32_t mode, uint32_t buffer)
 	if(mode != 0 && buffer == 0)
 		return -PVMK_EINVAL;
 	
-	//Validate that the buffer (given how big it is, in the mode) fits in the caller's address space
-	if(buffer < 4096)
-		return -PVMK_EFAULT;
-	
-	if(buffer + sysc_fb_sizes[mode] > sysc_pptr->size)
-		return -PVMK_EFAULT;
+	//Validate that the buffer (given how big it is, in the mode) fits in the caller's address space.
+	//Text mode has no buffer - it shows what's been printed.
+	if(mode != 0)
+	{
+		if(buffer < 4096)
+			return -PVMK_EFAULT;
+		
+		if(buffer + sysc_fb_sizes[mode] > sysc_st->pptr->size || buffer + sysc_fb_sizes[mode] < buffer)
+			return -PVMK_EFAULT;
+	}
 	
 	//Set aside these parameters for next time we "enter vertical blanking" (update the emulator display)
-	sysc_fb_enq_pid = sysc_pptr->pid;
-	sysc_fb_enq_ptr = buffer;
-	sysc_fb_enq_mode = mode;
-	
-	if(sysc_fb_now_pid == sysc_pptr->pid)
+	sysc_st->pptr->stats.flips++;
+	telem_flip(sysc_st->pptr->pid);
+	heap_flip();
+	sysc_st->fb_enq_pid = sysc_st->pptr->pid;
+	sysc_st->fb_enq_ptr = buffer;
+	sysc_st->fb_enq_mode = mode;
+	
+	if(sysc_st->fb_now_pid == sysc_st->pptr->pid)
 	{
 		//The caller currently has an image onscreen - tell them which one
-		return sysc_fb_now_ptr;
+		return sysc_st->fb_now_ptr;
 	}
 	else
 	{
@@ -185,8 +366,8 @@ int pvmk_sc_mem_sbrk(uint32_t req)
 	TDEBUG("%s %u\n", "pvmk_sc_mem_sbrk", req);
 	
 	//Compute new size, cap like real system
-	uint32_t will_be = sysc_pptr->size + req;
-	if(will_be < sysc_pptr->size)
+	uint32_t will_be = sysc_st->pptr->size + req;
+	if(will_be < sysc_st->pptr->size)
 	{
 		TERROR("%s", "Overflow in process size; cannot make process smaller.\n");
 		return -PVMK_EINVAL;
@@ -199,7 +380,7 @@ int pvmk_sc_mem_sbrk(uint32_t req)
 	}
 	
 	//Try to reallocate the user memory
-	void *result = realloc(sysc_pptr->mem, will_be);
+	void *result = realloc(sysc_st->pptr->mem, will_be);
 	if(result == NULL)
 	{
 		//Host didn't have enough memory for it
@@ -208,13 +389,13 @@ int pvmk_sc_mem_sbrk(uint32_t req)
 	}
 	
 	//Clear the new memory
-	memset((char*)result + sysc_pptr->size, 0x00, req);
+	memset((char*)result + sysc_st->pptr->size, 0x00, req);
 	
 	//Sized the process up successfully. Store new info, return old end-of-process
-	uint32_t retval = sysc_pptr->size;
-	sysc_pptr->mem = (uint32_t*)result;
-	sysc_pptr->size = will_be;
-	TDEBUG("Resized process %d from %8.8X to %8.8X\n", sysc_pptr->pid, retval, sysc_pptr->size);
+	uint32_t retval = sysc_st->pptr->size;
+	sysc_st->pptr->mem = (uint32_t*)result;
+	sysc_st->pptr->size = will_be;
+	TDEBUG("Resized process %d from %8.8X to %8.8X\n", sysc_st->pptr->pid, retval, sysc_st->pptr->size);
 	return retval;
 }
 
@@ -222,7 +403,7 @@ int pvmk_sc_input(uint32_t buf, uint32_t each, uint32_t total)
 {
 	TDEBUG("%s %8.8X %u %u\n", "pvmk_sc_input", buf, each, total);
 	
-	if( (buf < 4096) || ((buf+total) > sysc_pptr->size) )
+	if( (buf < 4096) || ((buf+total) > sysc_st->pptr->size) )
 	{
 		//Buffer out of bounds
 		return -PVMK_EFAULT;
@@ -240,12 +421,19 @@ int pvmk_sc_input(uint32_t buf, uint32_t each, uint32_t total)
 		return -PVMK_EINVAL;
 	}
 	
+	//Wake the caller when more input arrives
+	sysc_st->reader_pid[sysc_st->pptr - process_table] = sysc_st->pptr->pid;
+	
 	int nread = 0;
-	while( (sysc_inputq_wptr != sysc_inputq_rptr) && (total >= each) )
+	while( (sysc_st->inputq_wptr != sysc_st->inputq_rptr) && (total >= each) )
 	{
-		sysc_pptr->mem[buf/4] = sysc_inputq_data[sysc_inputq_rptr];
+		const sysc_input_t *iptr = &(sysc_st->inputq[sysc_st->inputq_rptr]);
+		undo_memblock(sysc_st->pptr, buf, 4);
+		sysc_st->pptr->mem[buf/4] = iptr->data;
+		telem_input(sysc_st->pptr->pid, iptr->ns);
+		sysc_st->inputstats.read++;
 		
-		sysc_inputq_rptr = (sysc_inputq_rptr + 1) % SYSC_INPUTQ_MAX;		
+		sysc_st->inputq_rptr = (sysc_st->inputq_rptr + 1) % SYSC_INPUTQ_MAX;		
 		buf += each;
 		total -= each;
 		nread++;
@@ -261,21 +449,79 @@ int pvmk_sc_snd_play(uint32_t mode, uint32_t chunk, uint32_t chunkbytes, uint32_
 {
 	TDEBUG("%s %u %8.8X %u %u\n", "pvmk_sc_snd_play", mode, chunk, chunkbytes, maxbuf);
 	
-	return -PVMK_ENOSYS;
+	//Validate mode parameter
+	if(mode >= PVMK_SND_MODE_MAX)
+		return -PVMK_EINVAL;
+	
+	if(mode == PVMK_SND_MODE_SILENT)
+	{
+		//Stops all sounds
+		snd_silence();
+		return 0;
+	}
+	
+	//Zero-length chunk just reports how much is buffered
+	if(chunkbytes == 0)
+		return snd_enqueue(sysc_st->pptr->pid, NULL, 0, maxbuf);
+	
+	//Validate that the chunk fits in the caller's address space
+	if(chunk < 4096 || chunk + chunkbytes > sysc_st->pptr->size || chunk + chunkbytes < chunk)
+		return -PVMK_EFAULT;
+	
+	//Chunk is enqueued entirely or rejected with -EAGAIN if it would exceed maxbuf
+	return snd_enqueue(sysc_st->pptr->pid, ((const char*)(sysc_st->pptr->mem)) + chunk, chunkbytes, maxbuf);
+}
+
+int pvmk_sc_nvm_ident(uint32_t name)
+{
+	TDEBUG("%s %8.8X\n", "pvmk_sc_nvm_ident", name);
+	
+	//Copy the name out of process memory, bounded by the longest name allowed
+	char namebuf[NVM_NAME_MAX + 2] = {0};
+	for(size_t cc = 0; cc < sizeof(namebuf) - 1; cc++)
+	{
+		uint32_t addr = name + cc;
+		if(addr < 0x1000 || addr >= sysc_st->pptr->size)
+			return -PVMK_EFAULT;
+		
+		namebuf[cc] = sysc_st->pptr->mem[addr/4] >> (8 * (addr%4));
+		if(namebuf[cc] == '\0')
+			break;
+	}
+	
+	return nvm_ident(namebuf);
 }
 
 int pvmk_sc_nvm_save(uint32_t buf, uint32_t len)
 {
 	TDEBUG("%s %8.8X %u\n", "pvmk_sc_nvm_save", buf, len);
 	
-	return -PVMK_ENOSYS;
+	if(len > sysc_st->pptr->size)
+		return -PVMK_EFAULT;
+	if(len > 0 && (buf < 4096 || buf + len > sysc_st->pptr->size || buf + len < buf))
+		return -PVMK_EFAULT;
+	
+	return nvm_save(((const char*)(sysc_st->pptr->mem)) + buf, len);
 }
 
 int pvmk_sc_nvm_load(uint32_t buf, uint32_t len)
 {
 	TDEBUG("%s %8.8X %u\n", "pvmk_sc_nvm_load", buf, len);
 	
-	return -PVMK_ENOSYS;
+	if(len > sysc_st->pptr->size)
+		return -PVMK_EFAULT;
+	if(len > 0 && (buf < 4096 || buf + len > sysc_st->pptr->size || buf + len < buf))
+		return -PVMK_EFAULT;
+	
+	undo_memblock(sysc_st->pptr, buf, len);
+	return nvm_load(((char*)(sysc_st->pptr->mem)) + buf, len);
+}
+
+int pvmk_sc_nvm_delete(void)
+{
+	TDEBUG("%s\n", "pvmk_sc_nvm_delete");
+	
+	return nvm_delete();
 }
 
 int pvmk_sc_env_save(uint32_t buf, uint32_t len)
@@ -284,25 +530,25 @@ int pvmk_sc_env_save(uint32_t buf, uint32_t len)
 	
 	if(buf == 0 && len == 0)
 	{
-		sysc_pptr->env_len = 0;
+		sysc_st->pptr->env_len = 0;
 		return 0;
 	}
 
 	if(len == 0)
 		return 0;
 
-	if(buf < 4096 || buf + len > sysc_pptr->size)
+	if(buf < 4096 || buf + len > sysc_st->pptr->size)
 		return -PVMK_EFAULT;
 	
-	if(len > sizeof(sysc_pptr->env_buf))
+	if(len > sizeof(sysc_st->pptr->env_buf))
 		return -PVMK_EINVAL;
 	
-	if(sysc_pptr->env_len + len > sizeof(sysc_pptr->env_buf))
-		len = sizeof(sysc_pptr->env_buf) - sysc_pptr->env_len;
+	if(sysc_st->pptr->env_len + len > sizeof(sysc_st->pptr->env_buf))
+		len = sizeof(sysc_st->pptr->env_buf) - sysc_st->pptr->env_len;
 	
 	
-	memcpy( sysc_pptr->env_buf + sysc_pptr->env_len, ((char*)(sysc_pptr->mem)) + buf, len);
-	sysc_pptr->env_len += len;
+	memcpy( sysc_st->pptr->env_buf + sysc_st->pptr->env_len, ((char*)(sysc_st->pptr->mem)) + buf, len);
+	sysc_st->pptr->env_len += len;
 	return len;
 }
 
@@ -310,47 +556,64 @@ int pvmk_sc_env_load(uint32_t buf, uint32_t len)
 {
 	TDEBUG("%s %8.8X %u\n", "pvmk_sc_env_load", buf, len);
 	
-	if(len > (unsigned)sysc_pptr->env_len)
-		len = sysc_pptr->env_len;
+	if(len > (unsigned)sysc_st->pptr->env_len)
+		len = sysc_st->pptr->env_len;
 	
-	if(buf < 4096 || buf + len > sysc_pptr->size)
+	if(buf < 4096 || buf + len > sysc_st->pptr->size)
 		return -PVMK_EFAULT;
 	
-	memcpy( ((char*)(sysc_pptr->mem)) + buf, sysc_pptr->env_buf, len);
+	undo_memblock(sysc_st->pptr, buf, len);
+	memcpy( ((char*)(sysc_st->pptr->mem)) + buf, sysc_st->pptr->env_buf, len);
 	return len;
 }
 
-int pvmk_sc_sig_mask(uint32_t mask, uint32_t how)
+int pvmk_sc_sig_mask(uint32_t how, uint32_t bits)
 {
-	TDEBUG("%s %8.8X %u\n", "pvmk_sc_sig_mask", mask, how);
+	TDEBUG("%s %u %8.8X\n", "pvmk_sc_sig_mask", how, bits);
 	
-	return -PVMK_ENOSYS;
+	uint32_t old = sysc_st->pptr->sigmask;
+	switch(how)
+	{
+		case PVMK_SIGMASK_BLOCK:   sysc_st->pptr->sigmask |= bits; break;
+		case PVMK_SIGMASK_UNBLOCK: sysc_st->pptr->sigmask &= ~bits; break;
+		case PVMK_SIGMASK_SETMASK: sysc_st->pptr->sigmask = bits; break;
+		default: return -PVMK_EINVAL;
+	}
+	
+	//Like POSIX, SIGKILL and SIGSTOP can't be blocked
+	sysc_st->pptr->sigmask &= ~((1u << PVMK_SIGKILL) | (1u << PVMK_SIGSTOP));
+	return old;
 }
 
-void pvmk_sc_sig_return(void)
+int pvmk_sc_sig_return(void)
 {
 	TDEBUG("%s\n", "pvmk_sc_sig_return");
+	return 0;
 }
 
 int pvmk_sc_disk_read2k(uint32_t sector_num, uint32_t buf, uint32_t nsectors)
 {
 	TDEBUG("%s %u %8.8X %u\n", "pvmk_sc_disk_read2k", sector_num, buf, nsectors);
 	
-	if(sysc_diskfd < 0)
+	if(sysc_st->diskfd < 0)
 		return -PVMK_ENXIO;
 	
-	if(buf + (2048 * nsectors) > sysc_pptr->size)
+	if(buf + (2048 * nsectors) > sysc_st->pptr->size)
 		return -PVMK_EFAULT;
 	if(buf < 4096)
 		return -PVMK_EFAULT;
 	if(buf % 4)
 		return -PVMK_EFAULT;
 	
-	off_t seeked = lseek(sysc_diskfd, sector_num * 2048ull, SEEK_SET);
+	off_t seeked = lseek(sysc_st->diskfd, sector_num * 2048ull, SEEK_SET);
 	if(seeked != sector_num * 2048ll)
 		return -PVMK_ENOSPC;
 	
-	int nread = read(sysc_diskfd, &(sysc_pptr->mem[buf/4]), 2048 * nsectors);
+	undo_memblock(sysc_st->pptr, buf, 2048 * nsectors);
+	int nread = read(sysc_st->diskfd, &(sysc_st->pptr->mem[buf/4]), 2048 * nsectors);
+	if(nread > 0)
+		sysc_st->pptr->stats.disk_bytes += nread;
+	
 	if(nread != nsectors * 2048ll)
 		return -PVMK_ENOSPC;
 	
@@ -361,21 +624,21 @@ int pvmk_sc_disk_write2k(uint32_t sector_num, uint32_t buf, uint32_t nsectors)
 {
 	TDEBUG("%s %u %8.8X %u\n", "pvmk_sc_disk_write2k", sector_num, buf, nsectors);
 	
-	if(sysc_diskfd < 0)
+	if(sysc_st->diskfd < 0)
 		return -PVMK_ENXIO;
 	
-	if(buf + (2048 * nsectors) > sysc_pptr->size)
+	if(buf + (2048 * nsectors) > sysc_st->pptr->size)
 		return -PVMK_EFAULT;
 	if(buf < 4096)
 		return -PVMK_EFAULT;
 	if(buf % 4)
 		return -PVMK_EFAULT;
 	
-	off_t seeked = lseek(sysc_diskfd, sector_num * 2048ull, SEEK_SET);
+	off_t seeked = lseek(sysc_st->diskfd, sector_num * 2048ull, SEEK_SET);
 	if(seeked != sector_num * 2048ll)
 		return -PVMK_ENOSPC;
 	
-	int nwritten = write(sysc_diskfd, &(sysc_pptr->mem[buf/4]), 2048 * nsectors);
+	int nwritten = write(sysc_st->diskfd, &(sysc_st->pptr->mem[buf/4]), 2048 * nsectors);
 	if(nwritten != nsectors * 2048ll)
 		return -PVMK_ENOSPC;
 	
@@ -390,26 +653,26 @@ int pvmk_sc_mexec_append(uint32_t buf, uint32_t len)
 	if(buf == 0 && len == 0)
 	{
 		//Reset pending image
-		sysc_pptr->mexec_size = 0;
-		if(sysc_pptr->mexec_mem != NULL)
+		sysc_st->pptr->mexec_size = 0;
+		if(sysc_st->pptr->mexec_mem != NULL)
 		{
-			free(sysc_pptr->mexec_mem);
-			sysc_pptr->mexec_mem = NULL;
+			free(sysc_st->pptr->mexec_mem);
+			sysc_st->pptr->mexec_mem = NULL;
 		}
 		return 0;
 	}
 	
 	//Validate resulting image size
-	if(sysc_pptr->mexec_size >= 24*1024*1024)
+	if(sysc_st->pptr->mexec_size >= 24*1024*1024)
 	{
 		//Already too long
 		return 0;
 	}
 	
-	if(sysc_pptr->mexec_size + len > 24*1024*1024)
+	if(sysc_st->pptr->mexec_size + len > 24*1024*1024)
 	{
 		//Overlong after adding to it... truncate how much we add
-		len = (24*1024*1024) - sysc_pptr->mexec_size;
+		len = (24*1024*1024) - sysc_st->pptr->mexec_size;
 	}
 	
 	//Validate incoming buffer (NULL pointer means "zero-fill the memory")
@@ -417,22 +680,22 @@ int pvmk_sc_mexec_append(uint32_t buf, uint32_t len)
 	{
 		if(buf < 4096)
 			return -PVMK_EFAULT;
-		if(buf + len > sysc_pptr->size)
+		if(buf + len > sysc_st->pptr->size)
 			return -PVMK_EFAULT;
 	}
 	
-	const char *src = ((const char*)(sysc_pptr->mem)) + buf;
+	const char *src = ((const char*)(sysc_st->pptr->mem)) + buf;
 	
 	//Resize pending data region on host
-	uint32_t oldsize = sysc_pptr->mexec_size;
-	sysc_pptr->mexec_size += len;
+	uint32_t oldsize = sysc_st->pptr->mexec_size;
+	sysc_st->pptr->mexec_size += len;
 	
-	if(sysc_pptr->mexec_mem == NULL)
-		sysc_pptr->mexec_mem = (char*)calloc(sysc_pptr->mexec_size, 1);
+	if(sysc_st->pptr->mexec_mem == NULL)
+		sysc_st->pptr->mexec_mem = (char*)calloc(sysc_st->pptr->mexec_size, 1);
 	else
-		sysc_pptr->mexec_mem = (char*)realloc(sysc_pptr->mexec_mem, sysc_pptr->mexec_size);
+		sysc_st->pptr->mexec_mem = (char*)realloc(sysc_st->pptr->mexec_mem, sysc_st->pptr->mexec_size);
 	
-	if(sysc_pptr->mexec_mem == NULL)
+	if(sysc_st->pptr->mexec_mem == NULL)
 	{
 		//Failed to allocate enough memory on host
 		return -PVMK_ENOMEM;
@@ -442,79 +705,187 @@ int pvmk_sc_mexec_append(uint32_t buf, uint32_t len)
 	if(buf == 0)
 	{
 		//Zero-fill
-		memset(sysc_pptr->mexec_mem + oldsize, 0, len);
+		memset(sysc_st->pptr->mexec_mem + oldsize, 0, len);
 	}
 	else
 	{
 		//Copy in the data provided
-		memcpy(sysc_pptr->mexec_mem + oldsize, src, len);
+		memcpy(sysc_st->pptr->mexec_mem + oldsize, src, len);
 	}
 
 	//Successfully appended
 	return len;
 }
 
-void pvmk_sc_mexec_apply(void)
+int pvmk_sc_mexec_apply(void)
 {
 	TDEBUG("%s\n", "pvmk_sc_mexec_apply");
 	
-	//Mask all signals
-	//sysc_pptr->
-	
-	//Swap existing process image for new one
-	if(sysc_pptr->mem != NULL)
+	if(sysc_st->pptr->mexec_mem == NULL)
 	{
-		free(sysc_pptr->mem);
-		sysc_pptr->mem = NULL;
+		//No image to run - dies as though killed by SIGSEGV
+		TWARNING("Process %d killed itself by mexec'ing with no pending image\n", sysc_st->pptr->pid);
+		process_kill(sysc_st->pptr, PVMK_STATUS_SIGNALED_BIT | (PVMK_SIGSEGV << PVMK_STATUS_TERMSIG_SHIFT));
+		return 0;
 	}
 	
-	sysc_pptr->mem = (uint32_t*)(sysc_pptr->mexec_mem);
-	sysc_pptr->size = sysc_pptr->mexec_size;
+	//Can't take back replacing the whole image
+	undo_barrier();
 	
-	sysc_pptr->mexec_mem = NULL;
-	sysc_pptr->mexec_size = 0;
+	//Mask all signals
+	sysc_st->pptr->sigmask = 0xFFFFFFFFu & ~((1u << PVMK_SIGKILL) | (1u << PVMK_SIGSTOP));
 	
-	if(sysc_pptr->mem == NULL)
+	//Swap existing process image for new one
+	if(sysc_st->pptr->mem != NULL)
 	{
-		TWARNING("Process %d killed itself by mexec'ing with no pending image\n", sysc_pptr->pid);
-		sysc_pptr->state = PROCESS_STATE_DEAD;
+		free(sysc_st->pptr->mem);
+		sysc_st->pptr->mem = NULL;
 	}
 	
-	//Reset CPU regs
-	memset(sysc_pptr->regs, 0, sizeof(sysc_pptr->regs));
-	sysc_pptr->regs[15] = 0x1000;
-	sysc_pptr->cpsr = 0;
+	sysc_st->pptr->mem = (uint32_t*)(sysc_st->pptr->mexec_mem);
+	sysc_st->pptr->size = sysc_st->pptr->mexec_size;
+	
+	sysc_st->pptr->mexec_mem = NULL;
+	sysc_st->pptr->mexec_size = 0;
+	hle_newimage(sysc_st->pptr->pid);
+	heap_exit(sysc_st->pptr->pid);
 	
+	//Reset CPU regs
+	memset(sysc_st->pptr->regs, 0, sizeof(sysc_st->pptr->regs));
+	sysc_st->pptr->regs[15] = 0x1000;
+	sysc_st->pptr->cpsr = 0;
+	return 0;
+}
+
+//Shows text printed by a process, on the host's console and on the text-mode screen
+static void sysc_console(const char *buf, int len)
+{
+	fwrite(buf, 1, len, stdout);
+	textscr_write(buf, len);
 }
 
 int pvmk_sc_print(uint32_t buf_ptr)
 {
 	TDEBUG("%s %8.8X\n", "pvmk_sc_print", buf_ptr);
 	
+	if(buf_ptr < 0x1000 || buf_ptr >= sysc_st->pptr->size)
+	{
+		TERROR("Bad address %8.8X in _sc_print\n", buf_ptr);
+		return -PVMK_EFAULT;
+	}
+	
 	//Print characters until we reach a NUL terminator or run afoul of memory bounds
-	int printed = 0;
-	while(1)
+	const char *str = ((const char*)(sysc_st->pptr->mem)) + buf_ptr;
+	int printed = strnlen(str, sysc_st->pptr->size - buf_ptr);
+	if(buf_ptr + printed >= sysc_st->pptr->size)
+		TERROR("Unterminated string at %8.8X in _sc_print\n", buf_ptr);
+	
+	sysc_console(str, printed);
+	return printed;
+}
+
+int pvmk_sc_print_len(uint32_t buf_ptr, uint32_t len)
+{
+	TDEBUG("%s %8.8X %u\n", "pvmk_sc_print_len", buf_ptr, len);
+	
+	//Only the simulator has this call so far - it prints a whole buffer at once, NULs and all
+	if(len > sysc_st->pptr->size)
+		return -PVMK_EFAULT;
+	if(len > 0 && (buf_ptr < 4096 || buf_ptr + len > sysc_st->pptr->size || buf_ptr + len < buf_ptr))
+		return -PVMK_EFAULT;
+	
+	sysc_console(((const char*)(sysc_st->pptr->mem)) + buf_ptr, len);
+	return len;
+}
+
+int pvmk_sc_dbg_stats(uint32_t buf, uint32_t len)
+{
+	TDEBUG("%s %8.8X %u\n", "pvmk_sc_dbg_stats", buf, len);
+	
+	//Only the simulator has this call - it returns the caller's performance counters, as a run of words.
+	//Eight 64-bit totals (low word first) followed by 32-bit counts of each system call number.
+	const process_stats_t *sptr = &(sysc_st->pptr->stats);
+	uint64_t syscalls = 0;
+	for(int ss = 0; ss < PROCESS_STATS_SYSCALLS; ss++)
 	{
-		if(buf_ptr < 0x1000 || buf_ptr >= sysc_pptr->size)
-		{
-			TERROR("Bad address %8.8X in _sc_print\n", buf_ptr);
-			return (printed > 0) ? printed : -PVMK_EFAULT;
-		}
+		syscalls += sptr->syscalls[ss];
+	}
+	
+	const uint64_t totals[8] = 
+	{
+		sysc_st->pptr->cpu_instrs,
+		sptr->loads,
+		sptr->stores,
+		sptr->branches,
+		syscalls,
+		sptr->paused_ms,
+		sptr->disk_bytes,
+		sptr->flips,
+	};
+	
+	uint32_t words[16 + PROCESS_STATS_SYSCALLS];
+	for(int tt = 0; tt < 8; tt++)
+	{
+		words[(tt * 2) + 0] = totals[tt] >>  0;
+		words[(tt * 2) + 1] = totals[tt] >> 32;
+	}
+	for(int ss = 0; ss < PROCESS_STATS_SYSCALLS; ss++)
+	{
+		words[16 + ss] = sptr->syscalls[ss];
+	}
+	
+	//Give them as much as fits
+	len &= ~3u;
+	if(len > sizeof(words))
+		len = sizeof(words);
+	
+	if(buf < 4096 || buf + len > sysc_st->pptr->size || buf + len < buf || (buf % 4))
+		return -PVMK_EFAULT;
+	
+	undo_memblock(sysc_st->pptr, buf, len);
+	memcpy(&(sysc_st->pptr->mem[buf/4]), words, len);
+	return len;
+}
+
+int pvmk_sc_dbg_fwrite(uint32_t name, uint32_t buf, uint32_t len, uint32_t flags)
+{
+	TDEBUG("%s %8.8X %8.8X %u %X\n", "pvmk_sc_dbg_fwrite", name, buf, len, flags);
+	
+	//Only the simulator has this call - it writes to a file on the host, like semihosting on a debug probe.
+	//Copy the name out of process memory. It may be a whole path, of which dbgout keeps the last part.
+	char namebuf[1024] = {0};
+	for(size_t cc = 0; cc < sizeof(namebuf) - 1; cc++)
+	{
+		uint32_t addr = name + cc;
+		if(addr < 0x1000 || addr >= sysc_st->pptr->size)
+			return -PVMK_EFAULT;
 		
-		unsigned char to_print = sysc_pptr->mem[buf_ptr/4] >> (8 * (buf_ptr%4));
-		if(to_print == 0)
-		{
-			//End of string, correctly
+		namebuf[cc] = sysc_st->pptr->mem[addr/4] >> (8 * (addr%4));
+		if(namebuf[cc] == '\0')
 			break;
-		}
-		
-		//Todo - collect this for a text-mode buffer like the real machine does
-		printf("%c", to_print);
-		buf_ptr++;
-	}		
-	return printed;
+	}
+	if(namebuf[sizeof(namebuf) - 2] != '\0')
+		return -PVMK_EINVAL;
+	
+	if(flags & ~(uint32_t)PVMK_DBG_FWRITE_TRUNC)
+		return -PVMK_EINVAL;
+	
+	if(len > sysc_st->pptr->size)
+		return -PVMK_EFAULT;
+	if(len > 0 && (buf < 4096 || buf + len > sysc_st->pptr->size || buf + len < buf))
+		return -PVMK_EFAULT;
+	
+	return dbgout_write(namebuf, ((const char*)(sysc_st->pptr->mem)) + buf, len, flags & PVMK_DBG_FWRITE_TRUNC);
 }
 
+//Arguments passed to a handler taking the given number of them, from r1 onwards
+#define SYSC_ARGS_0
+#define SYSC_ARGS_1 regs[1]
+#define SYSC_ARGS_2 regs[1], regs[2]
+#define SYSC_ARGS_3 regs[1], regs[2], regs[3]
+#define SYSC_ARGS_4 regs[1], regs[2], regs[3], regs[4]
+#define SYSC_ARGS_5 regs[1], regs[2], regs[3], regs[4], regs[5]
+
 void sysc(process_t *pptr)
 {
 	TDEBUG("Handling system-call %X from process %d\n", pptr->regs[0], pptr->pid);
@@ -524,35 +895,23 @@ void sysc(process_t *pptr)
 		TDEBUG("\tParm %d: %8.8X\n", pp, regs[pp]);
 	}
 	
-	sysc_pptr = pptr;
+	sysc_st->pptr = pptr;
+	if(regs[0] < PROCESS_STATS_SYSCALLS)
+		pptr->stats.syscalls[regs[0]]++;
+	
+	strace_begin(pptr);
+	
 	int result = 0;
 	switch(regs[0])
 	{
-		case 0x00: /*void*/ pvmk_sc_none(); break;
-		case 0x01: /*void*/ pvmk_sc_pause(); break;
-		case 0x02: result = pvmk_sc_getticks(); break;
-		case 0x05: result = pvmk_sc_fork(); break;
-		case 0x06: result = pvmk_sc_wait(regs[1], regs[2], regs[3], regs[4], regs[5]); break;
-		case 0x07: /* nr */ pvmk_sc_exit(regs[1], regs[2]); break;
-		case 0x08: result = pvmk_sc_env_save(regs[1], regs[2]); break;
-		case 0x09: result = pvmk_sc_env_load(regs[1], regs[2]); break;
-		case 0x20: result = pvmk_sc_sig_mask(regs[1], regs[2]); break;
-		case 0x22: /* nr */ pvmk_sc_sig_return(); break;
-		case 0x30: result = pvmk_sc_gfx_flip(regs[1], regs[2]); break;
-		case 0x40: result = pvmk_sc_mem_sbrk(regs[1]); break;
-		case 0x50: result = pvmk_sc_input(regs[1], regs[2], regs[3]); break;
-		case 0x60: result = pvmk_sc_snd_play(regs[1], regs[2], regs[3], regs[4]); break;
-		case 0x81: result = pvmk_sc_nvm_save(regs[1], regs[2]); break;
-		case 0x82: result = pvmk_sc_nvm_load(regs[1], regs[2]); break;
-		case 0x91: result = pvmk_sc_disk_read2k(regs[1], regs[2], regs[3]); break;
-		case 0x92: result = pvmk_sc_disk_write2k(regs[1], regs[2], regs[3]); break;
-		case 0xA1: result = pvmk_sc_mexec_append(regs[1], regs[2]); break;
-		case 0xA2: /* nr */ pvmk_sc_mexec_apply(); break;
-		case 0xB0: result = pvmk_sc_print(regs[1]); break;
+		#define SYSC_CALL(nr, name, nargs, noreturn) case nr: result = pvmk_sc_##name(SYSC_ARGS_##nargs); break;
+		#include "sysc_calls.h"
+		#undef SYSC_CALL
 		default:   result = -PVMK_ENOSYS; TWARNING("Bad syscall 0x%X\n", regs[0]); break;
 	}
 	
 	TDEBUG("Returning r0=%8.8X from syscall\n", result);
 	regs[0] = result;
+	strace_end(pptr, result);
 	return;
 }
@@ -17,7 +17,10 @@
 //Error numbers as defined by Neki32 system-call interface
 #define PVMK_EPERM  1
 #define PVMK_ENOENT 2
+#define PVMK_ESRCH  3
+#define PVMK_EIO    5
 #define PVMK_ENXIO  6
+#define PVMK_ECHILD 10
 #define PVMK_EAGAIN 11
 #define PVMK_ENOMEM 12
 #define PVMK_EFAULT 14
@@ -25,17 +28,76 @@
 #define PVMK_ENOSPC 28
 #define PVMK_ENOSYS 38
 
+//Wait status bits as defined by Neki32 system-call interface
+#define PVMK_STATUS_EXITCODE_MASK 0xFFu
+#define PVMK_STATUS_TERMSIG_MASK  0xFF0000u
+#define PVMK_STATUS_TERMSIG_SHIFT 16
+#define PVMK_STATUS_EXITED_BIT    0x2000000u
+#define PVMK_STATUS_SIGNALED_BIT  0x4000000u
+
+//ID types and options for waiting as defined by Neki32 system-call interface
+#define PVMK_IDTYPE_ALL   0x0
+#define PVMK_IDTYPE_PID   0x1
+#define PVMK_IDTYPE_PTREE 0x10
+#define PVMK_WNOWAIT 0x1
+#define PVMK_WEXITED 0x4
+
+//Signal numbers and mask operations as defined by Neki32 system-call interface
+#define PVMK_SIGKILL 9
+#define PVMK_SIGSEGV 11
+#define PVMK_SIGSTOP 17
+#define PVMK_SIGMASK_BLOCK   0
+#define PVMK_SIGMASK_UNBLOCK 1
+#define PVMK_SIGMASK_SETMASK 2
+
+//Audio modes as defined by Neki32 system-call interface
+#define PVMK_SND_MODE_SILENT     0
+#define PVMK_SND_MODE_48K_16B_2C 1
+#define PVMK_SND_MODE_MAX        2
+
+//Flags for writing host files as defined by Neki32 system-call interface
+#define PVMK_DBG_FWRITE_TRUNC 0x1
+
+//Counts of input events since the last reset
+typedef struct sysc_inputstats_s
+{
+	uint64_t pushed; //Events enqueued, one for each change of a pad's buttons
+	uint64_t read; //Events returned by _sc_input
+	uint64_t dropped; //Events lost because the queue was full
+} sysc_inputstats_t;
+
+//Disk, display and input state of one emulated console
+typedef struct sysc_ctx_s sysc_ctx_t;
+
+//Makes or frees the system-call state for a console
+sysc_ctx_t *sysc_ctx_new(void);
+void sysc_ctx_delete(sysc_ctx_t *st);
+
+//Selects the state used by later calls on this thread, or NULL for the one used when there's no console
+void sysc_select(sysc_ctx_t *st);
+
 //Performs a system-call
 void sysc(process_t *pptr);
 
+//Forgets the display and any input not yet delivered, for a new run of the simulation
+void sysc_reset(void);
+
 //Sets the host file used to service disk reads/writes
 void sysc_setdiskfd(int fd);
 
 //Gets the latest frontbuffer to be enqueued by a process, and marks it active
 //(Simulates entry to vertical blanking in the game console.)
+//In text mode, the text screen is returned, drawn as a VGA framebuffer.
 void sysc_popfbptr(uint16_t **bufptr_out, int *mode_out);
 
-//Enqueues input events for _sc_input to return
+//Enqueues an input event for _sc_input to return, stamped with the emulated time, if the pad's buttons changed.
+//Wakes the processes that read input.
+void sysc_pushpad(int pad, uint16_t buttons);
+
+//Enqueues input events for each pad whose buttons changed
 void sysc_pushpads(const uint16_t *pads);
 
+//Returns the counts of input events since the last reset
+void sysc_inputstats(sysc_inputstats_t *out);
+
 #endif //_SYSC_H
\ No newline at end of file
@@ -0,0 +1,43 @@
+//sysc_calls.h
+//Table of system calls handled by the Neki32 simulator
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+//No include guard - this is included wherever the list of calls is needed, with SYSC_CALL defined to expand each.
+//Each gives the call number, the handler's name after pvmk_sc_, how many arguments it takes from r1 onwards,
+//and whether the caller never gets a result back.
+#ifndef SYSC_CALL
+	#error "Define SYSC_CALL(nr, name, nargs, noreturn) before including sysc_calls.h"
+#endif
+
+SYSC_CALL(0x00, none,         0, false)
+SYSC_CALL(0x01, pause,        0, false)
+SYSC_CALL(0x02, getticks,     0, false)
+SYSC_CALL(0x05, fork,         0, false)
+SYSC_CALL(0x06, wait,         5, false)
+SYSC_CALL(0x07, exit,         2, true )
+SYSC_CALL(0x08, env_save,     2, false)
+SYSC_CALL(0x09, env_load,     2, false)
+SYSC_CALL(0x20, sig_mask,     2, false)
+SYSC_CALL(0x22, sig_return,   0, true )
+SYSC_CALL(0x30, gfx_flip,     2, false)
+SYSC_CALL(0x40, mem_sbrk,     1, false)
+SYSC_CALL(0x50, input,        3, false)
+SYSC_CALL(0x60, snd_play,     4, false)
+SYSC_CALL(0x80, nvm_ident,    1, false)
+SYSC_CALL(0x81, nvm_save,     2, false)
+SYSC_CALL(0x82, nvm_load,     2, false)
+SYSC_CALL(0x83, nvm_delete,   0, false)
+SYSC_CALL(0x91, disk_read2k,  3, false)
+SYSC_CALL(0x92, disk_write2k, 3, false)
+SYSC_CALL(0xA1, mexec_append, 2, false)
+SYSC_CALL(0xA2, mexec_apply,  0, true )
+SYSC_CALL(0xB0, print,        1, false)
+SYSC_CALL(0xB1, print_len,    2, false)
+SYSC_CALL(0xD0, dbg_stats,    2, false)
+SYSC_CALL(0xD1, dbg_fwrite,   4, false)
@@ -0,0 +1,308 @@
+//telem.cpp
+//Frame timing telemetry for Neki32 simulator
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#define FILE_TRACE_CAT TRACE_CAT_TELEM
+#include "trace.h"
+
+#include "telem.h"
+#include "emul.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <chrono>
+#include <new>
+
+//Telemetry of one emulated console
+struct telem_ctx_s
+{
+	//Intervals finished, kept as a ring
+	telem_frame_t ring[TELEM_HISTORY];
+	int head; //Where the next one goes
+	int count;
+	
+	//Interval in progress, and when it started
+	bool started;
+	telem_frame_t cur;
+	uint32_t cur_tick;
+	std::chrono::steady_clock::time_point cur_host;
+	
+	//CPU usage of each process at the start of the interval
+	int cpu_pid[PROCESS_MAX];
+	uint64_t cpu_instrs[PROCESS_MAX];
+	
+	//Frame enqueued but not yet displayed
+	bool flip_pending;
+	uint32_t flip_tick;
+	float flip_frame_ms;
+	
+	//When each process last flipped
+	int lastflip_pid[PROCESS_MAX];
+	uint32_t lastflip_tick[PROCESS_MAX];
+	
+	//Oldest input each process read since it last flipped
+	int input_pid[PROCESS_MAX];
+	uint64_t input_ns[PROCESS_MAX];
+	
+	//Graphics mode on the display, so we know if a repeated frame counts as missed
+	int mode;
+};
+
+//State used when no console is selected, and the one selected on this thread
+static telem_ctx_t telem_default;
+static thread_local telem_ctx_t *telem_st = &telem_default;
+
+telem_ctx_t *telem_ctx_new(void)
+{
+	return new(std::nothrow) telem_ctx_t();
+}
+
+void telem_ctx_delete(telem_ctx_t *st)
+{
+	delete st;
+}
+
+void telem_select(telem_ctx_t *st)
+{
+	telem_st = (st != NULL) ? st : &telem_default;
+}
+
+void telem_reset(void)
+{
+	telem_st->head = 0;
+	telem_st->count = 0;
+	telem_st->started = false;
+	telem_st->flip_pending = false;
+	telem_st->mode = 0;
+	memset(telem_st->lastflip_pid, 0, sizeof(telem_st->lastflip_pid));
+	memset(telem_st->input_pid, 0, sizeof(telem_st->input_pid));
+}
+
+void telem_input(int pid, uint64_t ns)
+{
+	int slot = pid % PROCESS_MAX;
+	if(slot < 0 || telem_st->input_pid[slot] == pid)
+		return;
+	
+	telem_st->input_pid[slot] = pid;
+	telem_st->input_ns[slot] = ns;
+}
+
+void telem_flip(int pid)
+{
+	int slot = pid % PROCESS_MAX;
+	if(slot < 0)
+		return;
+	
+	//Frame time is from the same process's previous flip - ignore the first
+	float frame_ms = 0.0f;
+	if(telem_st->lastflip_pid[slot] == pid)
+		frame_ms = (float)(emul_cur->ticks - telem_st->lastflip_tick[slot]);
+	
+	telem_st->lastflip_pid[slot] = pid;
+	telem_st->lastflip_tick[slot] = emul_cur->ticks;
+	
+	//Input-to-flip time is from the oldest input read since the last flip
+	if(telem_st->input_pid[slot] == pid)
+	{
+		uint64_t now_ns = process_elapsed_ns();
+		float input_ms = (now_ns > telem_st->input_ns[slot]) ? (float)(now_ns - telem_st->input_ns[slot]) / 1000000.0f : 0.0f;
+		if(!telem_st->cur.input || input_ms > telem_st->cur.input_ms)
+			telem_st->cur.input_ms = input_ms;
+		
+		telem_st->cur.input = true;
+		telem_st->input_pid[slot] = 0;
+	}
+	
+	//A later flip replaces one that wasn't displayed yet, like the real enqueue does
+	telem_st->flip_pending = true;
+	telem_st->flip_tick = emul_cur->ticks;
+	telem_st->flip_frame_ms = frame_ms;
+}
+
+void telem_present(int mode)
+{
+	telem_st->mode = mode;
+	if(!telem_st->flip_pending)
+		return;
+	
+	telem_st->flip_pending = false;
+	telem_st->cur.fresh = true;
+	telem_st->cur.frame_ms = telem_st->flip_frame_ms;
+	telem_st->cur.latency_ms = (float)(emul_cur->ticks - telem_st->flip_tick);
+}
+
+//Starts a new interval
+static void telem_begin(std::chrono::steady_clock::time_point now)
+{
+	memset(&telem_st->cur, 0, sizeof(telem_st->cur));
+	telem_st->cur.vsync = emul_cur->vsyncs;
+	telem_st->cur_tick = emul_cur->ticks;
+	telem_st->cur_host = now;
+	
+	for(int pp = 0; pp < PROCESS_MAX; pp++)
+	{
+		telem_st->cpu_pid[pp] = process_table[pp].pid;
+		telem_st->cpu_instrs[pp] = process_table[pp].cpu_instrs;
+	}
+}
+
+void telem_vsync(void)
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if(!telem_st->started)
+	{
+		telem_st->started = true;
+		telem_begin(now);
+		return;
+	}
+	
+	//Finish the interval in progress
+	telem_st->cur.host_us = std::chrono::duration_cast<std::chrono::microseconds>(now - telem_st->cur_host).count();
+	telem_st->cur.emul_us = (emul_cur->ticks - telem_st->cur_tick) * 1000;
+	telem_st->cur.missed = !telem_st->cur.fresh && (telem_st->mode != 0);
+	for(int pp = 0; pp < PROCESS_MAX; pp++)
+	{
+		const process_t *pptr = &(process_table[pp]);
+		telem_st->cur.pid[pp] = (pptr->state == PROCESS_STATE_ALIVE) ? pptr->pid : 0;
+		
+		uint64_t ran = pptr->cpu_instrs;
+		if(pptr->pid == telem_st->cpu_pid[pp] && ran >= telem_st->cpu_instrs[pp])
+			ran -= telem_st->cpu_instrs[pp];
+		
+		telem_st->cur.cpu_ms[pp] = (float)ran / (float)PROCESS_TICK_INSTRS;
+	}
+	
+	telem_st->ring[telem_st->head] = telem_st->cur;
+	telem_st->head = (telem_st->head + 1) % TELEM_HISTORY;
+	if(telem_st->count < TELEM_HISTORY)
+		telem_st->count++;
+	
+	telem_begin(now);
+}
+
+int telem_history(telem_frame_t *out, int max)
+{
+	int nout = (max < telem_st->count) ? max : telem_st->count;
+	int first = (telem_st->head + TELEM_HISTORY - nout) % TELEM_HISTORY;
+	for(int ff = 0; ff < nout; ff++)
+	{
+		out[ff] = telem_st->ring[(first + ff) % TELEM_HISTORY];
+	}
+	return nout;
+}
+
+void telem_summarize(telem_summary_t *out)
+{
+	memset(out, 0, sizeof(*out));
+	
+	uint64_t host_us = 0;
+	uint64_t emul_us = 0;
+	float latency_total = 0.0f;
+	float input_total = 0.0f;
+	int ninputs = 0;
+	int nsummed = (telem_st->count < 60) ? telem_st->count : 60;
+	for(int ff = 0; ff < nsummed; ff++)
+	{
+		const telem_frame_t *fptr = &(telem_st->ring[(telem_st->head + TELEM_HISTORY - 1 - ff) % TELEM_HISTORY]);
+		host_us += fptr->host_us;
+		emul_us += fptr->emul_us;
+		if(fptr->missed)
+			out->missed++;
+		
+		if(fptr->fresh)
+		{
+			out->fps++;
+			latency_total += fptr->latency_ms;
+			if(fptr->frame_ms > out->frame_ms_max)
+				out->frame_ms_max = fptr->frame_ms;
+		}
+		
+		if(fptr->input)
+		{
+			ninputs++;
+			input_total += fptr->input_ms;
+			if(fptr->input_ms > out->input_ms_max)
+				out->input_ms_max = fptr->input_ms;
+		}
+	}
+	
+	out->speed_pct = host_us ? (int)((emul_us * 100) / host_us) : 0;
+	out->latency_ms_avg = out->fps ? (latency_total / out->fps) : 0.0f;
+	out->input_ms_avg = ninputs ? (input_total / ninputs) : 0.0f;
+}
+
+void telem_statusline(char *buf, int len)
+{
+	//One character per displayed frame, a step up the ramp for each half-vsync it took.
+	//Plain ASCII, as wxWidgets may be built without Unicode.
+	static const char bars[] = "_.:-=+*#";
+	
+	int used = 0;
+	int nbars = 0;
+	for(int ff = (telem_st->count < 60) ? telem_st->count : 60; ff > 0 && used + 1 < len; ff--)
+	{
+		const telem_frame_t *fptr = &(telem_st->ring[(telem_st->head + TELEM_HISTORY - ff) % TELEM_HISTORY]);
+		if(!fptr->fresh)
+			continue;
+		
+		int level = (int)(fptr->frame_ms * 120.0f / 1000.0f);
+		if(level > 7)
+			level = 7;
+		
+		buf[used++] = bars[level];
+		buf[used] = '\0';
+		nbars++;
+	}
+	
+	telem_summary_t summary;
+	telem_summarize(&summary);
+	if(used < len)
+		snprintf(buf + used, len - used, "%s%d%% %dfps %dmiss", nbars ? " " : "", summary.speed_pct, summary.fps, summary.missed);
+}
+
+bool telem_savecsv(const char *path)
+{
+	FILE *fp = fopen(path, "w");
+	if(fp == NULL)
+	{
+		TERROR("Failed to open %s for telemetry: %s\n", path, strerror(errno));
+		return false;
+	}
+	
+	fprintf(fp, "vsync,host_us,emul_us,fresh,missed,frame_ms,latency_ms,input,input_ms");
+	for(int pp = 0; pp < PROCESS_MAX; pp++)
+	{
+		fprintf(fp, ",pid%d,cpu_ms%d", pp, pp);
+	}
+	fprintf(fp, "\n");
+	
+	for(int ff = telem_st->count; ff > 0; ff--)
+	{
+		const telem_frame_t *fptr = &(telem_st->ring[(telem_st->head + TELEM_HISTORY - ff) % TELEM_HISTORY]);
+		fprintf(fp, "%u,%u,%u,%d,%d,%.3f,%.3f,%d,%.3f", fptr->vsync, fptr->host_us, fptr->emul_us,
+			fptr->fresh ? 1 : 0, fptr->missed ? 1 : 0, fptr->frame_ms, fptr->latency_ms, fptr->input ? 1 : 0, fptr->input_ms);
+		
+		for(int pp = 0; pp < PROCESS_MAX; pp++)
+		{
+			fprintf(fp, ",%d,%.3f", fptr->pid[pp], fptr->cpu_ms[pp]);
+		}
+		fprintf(fp, "\n");
+	}
+	
+	bool ok = !ferror(fp);
+	if(fclose(fp) != 0)
+		ok = false;
+	
+	if(!ok)
+		TERROR("Failed to write telemetry to %s\n", path);
+	
+	return ok;
+}
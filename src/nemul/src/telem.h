@@ -0,0 +1,86 @@
+//telem.h
+//Frame timing telemetry for Neki32 simulator
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#ifndef _TELEM_H
+#define _TELEM_H
+
+#include <stdint.h>
+#include "process.h"
+
+//What happened between one emulated vsync and the next
+typedef struct telem_frame_s
+{
+	uint32_t vsync; //Vsync that started the interval
+	uint32_t host_us; //Host time the interval took to emulate
+	uint32_t emul_us; //Emulated time in the interval
+	bool fresh; //Whether a newly flipped frame was displayed
+	bool missed; //Whether a frame was on screen but nothing new replaced it
+	float frame_ms; //For a fresh frame, emulated time since the process flipped its previous one
+	float latency_ms; //For a fresh frame, emulated time from its flip until display
+	bool input; //Whether a frame flipped in the interval came after reading input
+	float input_ms; //For such a frame, emulated time from the oldest input read until the flip
+	int pid[PROCESS_MAX]; //Process in each table entry
+	float cpu_ms[PROCESS_MAX]; //Emulated CPU time used by each process
+} telem_frame_t;
+
+//Number of intervals kept
+#define TELEM_HISTORY 3600
+
+//Summary of the last second or so
+typedef struct telem_summary_s
+{
+	int speed_pct; //Emulation speed, as a percentage of real time
+	int fps; //Fresh frames displayed
+	int missed; //Vsyncs that repeated a frame
+	float frame_ms_max; //Worst frame time
+	float latency_ms_avg; //Average flip-to-display latency
+	float input_ms_avg; //Average input-to-flip latency
+	float input_ms_max; //Worst input-to-flip latency
+} telem_summary_t;
+
+//History of one emulated console
+typedef struct telem_ctx_s telem_ctx_t;
+
+//Makes or frees the telemetry for a console
+telem_ctx_t *telem_ctx_new(void);
+void telem_ctx_delete(telem_ctx_t *st);
+
+//Selects the telemetry used by later calls on this thread, or NULL for the one used when there's no console
+void telem_select(telem_ctx_t *st);
+
+//Forgets all history, for a new run of the simulation
+void telem_reset(void);
+
+//Notes that a process enqueued a frame for display
+void telem_flip(int pid);
+
+//Notes that a process read an input event that happened at the given emulated time, in nanoseconds.
+//Its next flip is timed from the oldest input read since its last one.
+void telem_input(int pid, uint64_t ns);
+
+//Notes that the display picked up the latest enqueued frame, in the given graphics mode
+void telem_present(int mode);
+
+//Finishes the current interval, at an emulated vsync
+void telem_vsync(void);
+
+//Copies out the most recent intervals, oldest first. Returns the number copied.
+int telem_history(telem_frame_t *out, int max);
+
+//Summarizes the last second of intervals
+void telem_summarize(telem_summary_t *out);
+
+//Describes recent frame times as a little bar graph in ASCII text, for the status bar
+void telem_statusline(char *buf, int len);
+
+//Writes the history to a CSV file. Returns false on failure.
+bool telem_savecsv(const char *path);
+
+#endif //_TELEM_H
@@ -0,0 +1,102 @@
+//test_sysc.cpp
+//Checks of system call behavior in the Neki32 simulator, run without a window
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#if TEST_SYSC
+//Makes system calls from a process set up by hand, and checks what the console would show.
+//Prints each check and exits nonzero if any failed.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "emul.h"
+#include "process.h"
+#include "sysc.h"
+#include "textscr.h"
+
+//Checks failed so far
+static int test_failures;
+
+//Notes the result of one check
+static void test_check(bool ok, const char *what)
+{
+	printf("%s: %s\n", ok ? "PASS" : "FAIL", what);
+	if(!ok)
+		test_failures++;
+}
+
+//Makes a system call from the given process, as if it ran SVC with these registers, and returns r0
+static int test_call(process_t *pptr, uint32_t nr, uint32_t a1, uint32_t a2)
+{
+	pptr->regs[0] = nr;
+	pptr->regs[1] = a1;
+	pptr->regs[2] = a2;
+	sysc(pptr);
+	return (int)(pptr->regs[0]);
+}
+
+//Flipping to text mode after a framebuffer shows the text screen again
+static void test_gfx_text(process_t *pptr)
+{
+	const uint32_t fbaddr = 0x10000;
+	
+	uint16_t *shown = NULL;
+	int mode = 0;
+	test_check(test_call(pptr, 0x30, 1, fbaddr) >= 0, "flip to a VGA framebuffer");
+	sysc_popfbptr(&shown, &mode);
+	test_check(mode == 1 && shown == (uint16_t*)(pptr->mem + (fbaddr / 4)), "framebuffer shown");
+	
+	test_check(test_call(pptr, 0x30, 0, 0) >= 0, "flip to text mode with no buffer");
+	sysc_popfbptr(&shown, &mode);
+	test_check(mode == 1 && shown == textscr_render(), "text screen shown after framebuffer");
+	
+	test_check(test_call(pptr, 0x30, 0, fbaddr) == -PVMK_EINVAL, "text mode rejects a buffer");
+	test_check(test_call(pptr, 0x30, 1, 0) == -PVMK_EINVAL, "VGA mode needs a buffer");
+	test_check(test_call(pptr, 0x30, 1, pptr->size - 4096) == -PVMK_EFAULT, "VGA buffer must fit");
+}
+
+int main(int argc, const char **argv)
+{
+	(void)argc;
+	(void)argv;
+	
+	emul_t *eptr = emul_new();
+	if(eptr == NULL)
+	{
+		fprintf(stderr, "%s", "Failed to allocate emulated console\n");
+		return -1;
+	}
+	emul_select(eptr);
+	emul_reset(-1);
+	
+	//A process of our own, beside init, with room for a framebuffer
+	process_t *pptr = &(process_table[2]);
+	pptr->state = PROCESS_STATE_ALIVE;
+	pptr->pid = 2;
+	pptr->ppid = 1;
+	pptr->size = 1024 * 1024;
+	pptr->mem = (uint32_t*)calloc(1, pptr->size);
+	if(pptr->mem == NULL)
+	{
+		fprintf(stderr, "%s", "Failed to allocate process memory\n");
+		return -1;
+	}
+	
+	test_gfx_text(pptr);
+	
+	emul_select(NULL);
+	emul_delete(eptr);
+	
+	printf("%d checks failed\n", test_failures);
+	return (test_failures > 0) ? 1 : 0;
+}
+
+#endif //TEST_SYSC
@@ -0,0 +1,139 @@
+//textscr.cpp
+//Text-mode screen of the Neki32 simulator, showing what processes print
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#include "textscr.h"
+
+#include <string.h>
+#include <new>
+
+//8x16 glyphs of the first 128 characters, side by side in rows of 1024 pixels. Clear bits are lit.
+#include "font.xbm"
+
+//Colors of lit and unlit pixels, in RGB565
+#define TEXTSCR_FG 0xAD55
+#define TEXTSCR_BG 0x0000
+
+//Text screen of one emulated console
+struct textscr_ctx_s
+{
+	//Characters on screen, with NUL for blank
+	char cells[TEXTSCR_ROWS][TEXTSCR_COLS];
+	
+	//Where the next character goes
+	int row;
+	int col;
+	
+	//Framebuffer drawn from the characters, and whether it's out of date
+	uint16_t fb[TEXTSCR_ROWS * 16][TEXTSCR_COLS * 8];
+	bool dirty = true;
+};
+
+//State used when no console is selected, and the one selected on this thread
+static textscr_ctx_t textscr_default;
+static thread_local textscr_ctx_t *textscr_st = &textscr_default;
+
+textscr_ctx_t *textscr_ctx_new(void)
+{
+	return new(std::nothrow) textscr_ctx_t();
+}
+
+void textscr_ctx_delete(textscr_ctx_t *st)
+{
+	delete st;
+}
+
+void textscr_select(textscr_ctx_t *st)
+{
+	textscr_st = (st != NULL) ? st : &textscr_default;
+}
+
+void textscr_reset(void)
+{
+	memset(textscr_st->cells, 0, sizeof(textscr_st->cells));
+	textscr_st->row = 0;
+	textscr_st->col = 0;
+	textscr_st->dirty = true;
+}
+
+//Moves the cursor to the start of the next line, scrolling if it was on the last
+static void textscr_newline(void)
+{
+	textscr_st->col = 0;
+	textscr_st->row++;
+	if(textscr_st->row >= TEXTSCR_ROWS)
+	{
+		memmove(textscr_st->cells[0], textscr_st->cells[1], sizeof(textscr_st->cells[0]) * (TEXTSCR_ROWS - 1));
+		memset(textscr_st->cells[TEXTSCR_ROWS - 1], 0, sizeof(textscr_st->cells[0]));
+		textscr_st->row = TEXTSCR_ROWS - 1;
+	}
+}
+
+void textscr_write(const char *buf, int len)
+{
+	for(int bb = 0; bb < len; bb++)
+	{
+		unsigned char ch = buf[bb];
+		switch(ch)
+		{
+			case '\n':
+				textscr_newline();
+				break;
+			case '\r':
+				textscr_st->col = 0;
+				break;
+			case '\b':
+				if(textscr_st->col > 0)
+					textscr_st->col--;
+				break;
+			case '\t':
+				do { textscr_write(" ", 1); } while(textscr_st->col % 8 != 0);
+				break;
+			default:
+				if(ch < ' ')
+					break; //Other control characters do nothing
+				
+				if(textscr_st->col >= TEXTSCR_COLS)
+					textscr_newline();
+				
+				textscr_st->cells[textscr_st->row][textscr_st->col] = (ch < 128) ? ch : '?';
+				textscr_st->col++;
+				break;
+		}
+	}
+	
+	if(len > 0)
+		textscr_st->dirty = true;
+}
+
+const uint16_t *textscr_render(void)
+{
+	if(!textscr_st->dirty)
+		return &(textscr_st->fb[0][0]);
+	
+	for(int rr = 0; rr < TEXTSCR_ROWS; rr++)
+	{
+		for(int cc = 0; cc < TEXTSCR_COLS; cc++)
+		{
+			char ch = textscr_st->cells[rr][cc];
+			for(int yy = 0; yy < 16; yy++)
+			{
+				uint8_t bits = (ch != '\0') ? font_bits[ch + (yy * 128)] : 0xFF;
+				uint16_t *pxptr = &(textscr_st->fb[(rr * 16) + yy][cc * 8]);
+				for(int xx = 0; xx < 8; xx++)
+				{
+					pxptr[xx] = (bits & (1u << xx)) ? TEXTSCR_BG : TEXTSCR_FG;
+				}
+			}
+		}
+	}
+	
+	textscr_st->dirty = false;
+	return &(textscr_st->fb[0][0]);
+}
@@ -0,0 +1,39 @@
+//textscr.h
+//Text-mode screen of the Neki32 simulator, showing what processes print
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#ifndef _TEXTSCR_H
+#define _TEXTSCR_H
+
+#include <stdint.h>
+
+//Size of the screen in characters, which are 8x16 pixels on a 640x480 display
+#define TEXTSCR_COLS 80
+#define TEXTSCR_ROWS 30
+
+//Text screen of one emulated console
+typedef struct textscr_ctx_s textscr_ctx_t;
+
+//Makes or frees the screen for a console
+textscr_ctx_t *textscr_ctx_new(void);
+void textscr_ctx_delete(textscr_ctx_t *st);
+
+//Selects the screen used by later calls on this thread, or NULL for the one used when there's no console
+void textscr_select(textscr_ctx_t *st);
+
+//Clears the screen, for a new run of the simulation
+void textscr_reset(void);
+
+//Prints characters at the cursor, scrolling as needed. Handles newline, carriage return, backspace and tab.
+void textscr_write(const char *buf, int len);
+
+//Returns the screen drawn as a 640x480 RGB565 framebuffer, redrawn only if something was printed since last time
+const uint16_t *textscr_render(void);
+
+#endif //_TEXTSCR_H
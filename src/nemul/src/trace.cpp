@@ -11,15 +11,38 @@
 #include "trace.h"
 #include <stdarg.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 //Currently configured verbosity
 trace_sev_e trace_sev_limit[TRACE_CAT_MAX];
 
-//Buffer for trace data
+//Buffer for trace data, one for each emulated console
 #define TRACE_BUF_LEN (4*1024*1024)
-static char trace_buf[TRACE_BUF_LEN];
-static int trace_pos;
+struct trace_ctx_s
+{
+	char buf[TRACE_BUF_LEN];
+	int pos;
+};
+
+//Buffer used when no console is selected, and the one selected on this thread
+static trace_ctx_t trace_default;
+static thread_local trace_ctx_t *trace_st = &trace_default;
+
+trace_ctx_t *trace_ctx_new(void)
+{
+	return (trace_ctx_t*)calloc(1, sizeof(trace_ctx_t));
+}
+
+void trace_ctx_delete(trace_ctx_t *st)
+{
+	free(st);
+}
+
+void trace_select(trace_ctx_t *st)
+{
+	trace_st = (st != NULL) ? st : &trace_default;
+}
 
 //Each entry in the trace buffer has the following format:
 //1 byte - category
@@ -30,33 +53,33 @@ static int trace_pos;
 void trace_write(trace_cat_e cat, trace_sev_e sev, const char *fmt, ...)
 {
 	//If we're obviously off the end of the buffer, blank it and go back
-	if(trace_pos + 5 >= TRACE_BUF_LEN)
+	if(trace_st->pos + 5 >= TRACE_BUF_LEN)
 	{
-		memset(trace_buf + trace_pos, 0, TRACE_BUF_LEN - trace_pos);
-		trace_pos = 0;
+		memset(trace_st->buf + trace_st->pos, 0, TRACE_BUF_LEN - trace_st->pos);
+		trace_st->pos = 0;
 	}
 	
 	//Try to append the new message to see if it fits, including the terminating NUL
 	va_list ap;
 	va_start(ap, fmt);
-	int msglen = vsnprintf(trace_buf + trace_pos + 6, TRACE_BUF_LEN - (trace_pos + 6), fmt, ap);
+	int msglen = vsnprintf(trace_st->buf + trace_st->pos + 6, TRACE_BUF_LEN - (trace_st->pos + 6), fmt, ap);
 	va_end(ap);
 	
 	if(msglen + 7 >= TRACE_BUF_LEN)
 	{
 		//Ran off the end of the buffer
-		memset(trace_buf + trace_pos, 0, TRACE_BUF_LEN - trace_pos);
-		trace_pos = 0;
+		memset(trace_st->buf + trace_st->pos, 0, TRACE_BUF_LEN - trace_st->pos);
+		trace_st->pos = 0;
 		
 		//Try again
 		va_start(ap, fmt);
-		msglen = vsnprintf(trace_buf + trace_pos + 6, TRACE_BUF_LEN - (trace_pos + 6), fmt, ap);
+		msglen = vsnprintf(trace_st->buf + trace_st->pos + 6, TRACE_BUF_LEN - (trace_st->pos + 6), fmt, ap);
 		va_end(ap);
 	}
 	
 	//Write the "header" information before the message
-	trace_buf[trace_pos + 0] = cat;
-	trace_buf[trace_pos + 1] = sev;
+	trace_st->buf[trace_st->pos + 0] = cat;
+	trace_st->buf[trace_st->pos + 1] = sev;
 	
 	uint32_t enabled_bits = 0;
 	for(int cc = 0; cc < TRACE_CAT_MAX; cc++)
@@ -64,31 +87,31 @@ void trace_write(trace_cat_e cat, trace_sev_e sev, const char *fmt, ...)
 		enabled_bits <<= 3;
 		enabled_bits |= trace_sev_limit[cc] & 0x7;
 	}
-	memcpy(trace_buf + trace_pos + 2, &enabled_bits, 4);
+	memcpy(trace_st->buf + trace_st->pos + 2, &enabled_bits, 4);
 	
 	//Move past the header, message string, terminating NUL
-	trace_pos += 6 + msglen + 1;
+	trace_st->pos += 6 + msglen + 1;
 }
 
 bool trace_recall(int back, trace_cat_e *cat_out, trace_sev_e *sev_out, char **msg_out)
 {
-	int starting_pos = trace_pos;
+	int starting_pos = trace_st->pos;
 	for(int bb = 0; bb <= back; bb++)
 	{
-		while(trace_buf[starting_pos] == '\0')
+		while(trace_st->buf[starting_pos] == '\0')
 		{
 			starting_pos--;
 			if(starting_pos < 0)
 				starting_pos = TRACE_BUF_LEN-1;
-			if(starting_pos == trace_pos)
+			if(starting_pos == trace_st->pos)
 				return false;
 		}
-		while(trace_buf[starting_pos] != '\0')
+		while(trace_st->buf[starting_pos] != '\0')
 		{
 			starting_pos--;
 			if(starting_pos < 0)
 				starting_pos = TRACE_BUF_LEN-1;
-			if(starting_pos == trace_pos)
+			if(starting_pos == trace_st->pos)
 				return false;
 		}
 	}
@@ -97,8 +120,8 @@ bool trace_recall(int back, trace_cat_e *cat_out, trace_sev_e *sev_out, char **m
 	if(starting_pos >= TRACE_BUF_LEN)
 		starting_pos = 0;
 	
-	*cat_out = (trace_cat_e)trace_buf[starting_pos + 0];
-	*sev_out = (trace_sev_e)trace_buf[starting_pos + 1];
-	*msg_out = trace_buf + starting_pos + 6;
+	*cat_out = (trace_cat_e)trace_st->buf[starting_pos + 0];
+	*sev_out = (trace_sev_e)trace_st->buf[starting_pos + 1];
+	*msg_out = trace_st->buf + starting_pos + 6;
 	return true;
 }
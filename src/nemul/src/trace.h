@@ -22,6 +22,10 @@ enum trace_cat_e
 	TRACE_CAT_PROCESS,
 	TRACE_CAT_RSP,
 	TRACE_CAT_SYSC,
+	TRACE_CAT_SND,
+	TRACE_CAT_NVM,
+	TRACE_CAT_TELEM,
+	TRACE_CAT_JOY,
 	TRACE_CAT_MAX
 };
 
@@ -59,6 +63,16 @@ extern trace_sev_e trace_sev_limit[TRACE_CAT_MAX];
 #define TINFO(x, ...)    TRACE(FILE_TRACE_CAT, TRACE_SEV_INFO,    x, __VA_ARGS__)
 #define TDEBUG(x, ...)   TRACE(FILE_TRACE_CAT, TRACE_SEV_DEBUG,   x, __VA_ARGS__)
 
+//Trace buffer of one emulated console
+typedef struct trace_ctx_s trace_ctx_t;
+
+//Makes or frees the trace buffer for a console
+trace_ctx_t *trace_ctx_new(void);
+void trace_ctx_delete(trace_ctx_t *st);
+
+//Selects the buffer that later traces on this thread go to, or NULL for the one used when there's no console
+void trace_select(trace_ctx_t *st);
+
 //Function that logs to the internal tracing buffer
 void trace_write(trace_cat_e cat, trace_sev_e sev, const char *fmt, ...);
 
@@ -0,0 +1,329 @@
+//undo.cpp
+//Undo log for reverse execution in Neki32 simulator
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#define FILE_TRACE_CAT TRACE_CAT_PROCESS
+#include "trace.h"
+
+#include "undo.h"
+#include "interp.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+
+//Kinds of entry in the log.
+//Each instruction makes a STEP entry, followed by whatever it changed.
+//Going backwards, we restore those changes and then the STEP entry's PC and flags.
+typedef enum undo_kind_e
+{
+	UNDO_KIND_STEP = 1, //a = PC, b = CPSR before the instruction
+	UNDO_KIND_REG, //a = old register value
+	UNDO_KIND_MEM, //a = word address, b = old word
+} undo_kind_t;
+
+//Registers past r14 that we track changes in, for system calls
+#define UNDO_REG_FLAGS   16 //Paused and unpaused flags
+#define UNDO_REG_SIGMASK 17 //Signal mask
+
+//Entry in the log - small and fixed-size, so recording is cheap.
+//The tag holds the kind in bits 0-7, the process table index in bits 8-15, and the register number in bits 16-23.
+typedef struct undo_entry_s
+{
+	uint32_t tag;
+	uint32_t a;
+	uint32_t b;
+} undo_entry_t;
+
+#define UNDO_TAG(kind, idx, reg) ((uint32_t)(kind) | ((uint32_t)(idx) << 8) | ((uint32_t)(reg) << 16))
+
+//Default amount of host memory for the log
+#define UNDO_BUDGET_DEFAULT (64 * 1024 * 1024)
+
+//Recording of one emulated console
+struct undo_ctx_s
+{
+	//Log of entries, kept as a ring. When full, the oldest instructions are dropped.
+	undo_entry_t *log;
+	size_t cap;
+	size_t head; //Where the next entry goes
+	size_t len; //Number of entries kept
+	uint64_t steps; //Number of instructions kept
+	
+	//Host memory allowed for the log
+	size_t budget = UNDO_BUDGET_DEFAULT;
+	
+	//Instruction being recorded, and the process state from before it
+	bool open;
+	size_t open_len; //Entries logged for it so far
+	int open_idx;
+	uint32_t open_regs[15];
+	uint32_t open_flags;
+	uint32_t open_sigmask;
+};
+
+//State used when no console is selected, and the one selected on this thread
+static undo_ctx_t undo_default;
+static thread_local undo_ctx_t *undo_st = &undo_default;
+
+undo_ctx_t *undo_ctx_new(void)
+{
+	return new(std::nothrow) undo_ctx_t();
+}
+
+void undo_ctx_delete(undo_ctx_t *st)
+{
+	if(st == NULL)
+		return;
+	
+	free(st->log);
+	delete st;
+}
+
+void undo_select(undo_ctx_t *st)
+{
+	undo_st = (st != NULL) ? st : &undo_default;
+}
+
+//Packs flags that system calls change
+static uint32_t undo_flags(const process_t *pptr)
+{
+	return (pptr->paused ? 1u : 0u) | (pptr->unpaused ? 2u : 0u);
+}
+
+//Drops the oldest instruction in the log to make room
+static void undo_dropoldest(void)
+{
+	if(undo_st->open && undo_st->open_len >= undo_st->len)
+	{
+		//The instruction being recorded doesn't fit by itself - give up on having any history
+		TWARNING("%s", "Instruction changed too much memory for the undo log, history discarded\n");
+		undo_barrier();
+		return;
+	}
+	
+	size_t tail = (undo_st->head + undo_st->cap - undo_st->len) % undo_st->cap;
+	do
+	{
+		tail = (tail + 1) % undo_st->cap;
+		undo_st->len--;
+	}
+	while(undo_st->len > 0 && (undo_st->log[tail].tag & 0xFF) != UNDO_KIND_STEP);
+	
+	undo_st->steps--;
+}
+
+//Appends an entry to the log
+static void undo_push(uint32_t tag, uint32_t a, uint32_t b)
+{
+	if(undo_st->len >= undo_st->cap)
+	{
+		undo_dropoldest();
+		if(!undo_st->open)
+			return; //History was discarded along with what we were recording
+	}
+	
+	undo_st->log[undo_st->head].tag = tag;
+	undo_st->log[undo_st->head].a = a;
+	undo_st->log[undo_st->head].b = b;
+	undo_st->head = (undo_st->head + 1) % undo_st->cap;
+	undo_st->len++;
+	undo_st->open_len++;
+}
+
+//Called by the interpreter before each store, while recording
+static void undo_storehook(uint32_t addr, uint32_t oldword)
+{
+	if(undo_st->open)
+		undo_push(UNDO_TAG(UNDO_KIND_MEM, undo_st->open_idx, 0), addr, oldword);
+}
+
+void undo_setbudget(int megabytes)
+{
+	if(megabytes < 1)
+		megabytes = 1;
+	
+	size_t budget = (size_t)megabytes * 1024 * 1024;
+	if(budget == undo_st->budget)
+		return;
+	
+	//Takes effect next time recording starts
+	undo_st->budget = budget;
+	if(undo_st->log != NULL)
+	{
+		undo_enable(false);
+		undo_enable(true);
+	}
+}
+
+void undo_enable(bool enable)
+{
+	if(enable && undo_st->log == NULL)
+	{
+		undo_st->cap = undo_st->budget / sizeof(undo_entry_t);
+		undo_st->log = (undo_entry_t*)malloc(undo_st->cap * sizeof(undo_entry_t));
+		if(undo_st->log == NULL)
+		{
+			TERROR("Failed to allocate %lu bytes for undo log\n", (unsigned long)undo_st->budget);
+			return;
+		}
+		
+		undo_barrier();
+		interp_setstorehook(undo_storehook);
+		TINFO("Recording for reverse execution, %lu entries\n", (unsigned long)undo_st->cap);
+	}
+	else if(!enable && undo_st->log != NULL)
+	{
+		interp_setstorehook(NULL);
+		undo_barrier();
+		free(undo_st->log);
+		undo_st->log = NULL;
+		undo_st->cap = 0;
+	}
+}
+
+bool undo_active(void)
+{
+	return (undo_st->log != NULL);
+}
+
+void undo_barrier(void)
+{
+	undo_st->head = 0;
+	undo_st->len = 0;
+	undo_st->steps = 0;
+	undo_st->open = false;
+}
+
+void undo_begin(const process_t *pptr)
+{
+	if(undo_st->log == NULL)
+		return;
+	
+	undo_st->open = true;
+	undo_st->open_len = 0;
+	undo_st->open_idx = pptr - process_table;
+	memcpy(undo_st->open_regs, pptr->regs, sizeof(undo_st->open_regs));
+	undo_st->open_flags = undo_flags(pptr);
+	undo_st->open_sigmask = pptr->sigmask;
+	
+	undo_push(UNDO_TAG(UNDO_KIND_STEP, undo_st->open_idx, 0), pptr->regs[15], pptr->cpsr);
+}
+
+void undo_end(const process_t *pptr)
+{
+	if(!undo_st->open)
+		return;
+	
+	//Usually only one or two registers change, so compare them all rather than decoding the instruction
+	for(int rr = 0; rr < 15; rr++)
+	{
+		if(pptr->regs[rr] != undo_st->open_regs[rr])
+			undo_push(UNDO_TAG(UNDO_KIND_REG, undo_st->open_idx, rr), undo_st->open_regs[rr], 0);
+	}
+	
+	if(undo_flags(pptr) != undo_st->open_flags)
+		undo_push(UNDO_TAG(UNDO_KIND_REG, undo_st->open_idx, UNDO_REG_FLAGS), undo_st->open_flags, 0);
+	
+	if(pptr->sigmask != undo_st->open_sigmask)
+		undo_push(UNDO_TAG(UNDO_KIND_REG, undo_st->open_idx, UNDO_REG_SIGMASK), undo_st->open_sigmask, 0);
+	
+	if(undo_st->open)
+		undo_st->steps++;
+	
+	undo_st->open = false;
+}
+
+void undo_memblock(const process_t *pptr, uint32_t addr, uint32_t len)
+{
+	if(!undo_st->open || (pptr - process_table) != undo_st->open_idx)
+		return;
+	
+	uint32_t first = addr & ~3u;
+	uint32_t last = (addr + len + 3) & ~3u;
+	if(last > pptr->size || last < first)
+		last = pptr->size & ~3u;
+	
+	for(uint32_t aa = first; aa < last && undo_st->open; aa += 4)
+	{
+		undo_push(UNDO_TAG(UNDO_KIND_MEM, undo_st->open_idx, 0), aa, pptr->mem[aa/4]);
+	}
+}
+
+process_t *undo_back(undo_memcb_t memcb)
+{
+	undo_st->open = false;
+	while(undo_st->len > 0)
+	{
+		undo_st->head = (undo_st->head + undo_st->cap - 1) % undo_st->cap;
+		undo_st->len--;
+		
+		const undo_entry_t *eptr = &(undo_st->log[undo_st->head]);
+		process_t *pptr = &(process_table[(eptr->tag >> 8) & 0xFF]);
+		switch(eptr->tag & 0xFF)
+		{
+			case UNDO_KIND_STEP:
+			{
+				pptr->regs[15] = eptr->a;
+				pptr->cpsr = eptr->b;
+				undo_st->steps--;
+				return pptr;
+			}
+			case UNDO_KIND_REG:
+			{
+				int reg = (eptr->tag >> 16) & 0xFF;
+				if(reg < 15)
+				{
+					pptr->regs[reg] = eptr->a;
+				}
+				else if(reg == UNDO_REG_FLAGS)
+				{
+					pptr->paused = (eptr->a & 1) != 0;
+					pptr->unpaused = (eptr->a & 2) != 0;
+				}
+				else if(reg == UNDO_REG_SIGMASK)
+				{
+					pptr->sigmask = eptr->a;
+				}
+				break;
+			}
+			case UNDO_KIND_MEM:
+			{
+				if(pptr->mem == NULL || eptr->a + 4 > pptr->size)
+					break;
+				
+				//Tell the caller which bytes actually change
+				uint32_t diff = pptr->mem[eptr->a / 4] ^ eptr->b;
+				pptr->mem[eptr->a / 4] = eptr->b;
+				if(diff != 0 && memcb != NULL)
+				{
+					int lo = __builtin_ctz(diff) / 8;
+					int hi = (31 - __builtin_clz(diff)) / 8;
+					memcb(pptr, eptr->a + lo, hi - lo + 1);
+				}
+				break;
+			}
+			default:
+			{
+				TERROR("Bad entry %8.8X in undo log\n", eptr->tag);
+				break;
+			}
+		}
+	}
+	
+	//Ran out of history in the middle of an instruction - shouldn't happen, entries are dropped whole
+	undo_barrier();
+	return NULL;
+}
+
+uint64_t undo_depth(void)
+{
+	return undo_st->steps;
+}
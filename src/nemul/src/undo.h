@@ -0,0 +1,58 @@
+//undo.h
+//Undo log for reverse execution in Neki32 simulator
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//Nemul, the Neki32 Simulator, Copyright 2025 Nekisoft Pty Ltd, ACN 680 583 251
+//This program is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+
+#ifndef _UNDO_H
+#define _UNDO_H
+
+#include <stdint.h>
+#include "process.h"
+
+//History of one emulated console
+typedef struct undo_ctx_s undo_ctx_t;
+
+//Makes or frees the undo log for a console
+undo_ctx_t *undo_ctx_new(void);
+void undo_ctx_delete(undo_ctx_t *st);
+
+//Selects the log used by later calls on this thread, or NULL for the one used when there's no console
+void undo_select(undo_ctx_t *st);
+
+//Sets how much host memory the log can use, in megabytes. The oldest history is dropped to stay under it.
+void undo_setbudget(int megabytes);
+
+//Starts or stops recording. Stopping throws away the history.
+void undo_enable(bool enable);
+
+//Returns whether instructions are being recorded
+bool undo_active(void);
+
+//Forgets all history, when something happens that the log can't take back (fork, exit, exec...)
+void undo_barrier(void);
+
+//Records the state of a process before it runs an instruction
+void undo_begin(const process_t *pptr);
+
+//Records what the instruction changed in the process's registers, once it and any system call it made are done
+void undo_end(const process_t *pptr);
+
+//Records the old contents of process memory before a system call writes to it
+void undo_memblock(const process_t *pptr, uint32_t addr, uint32_t len);
+
+//Function told about each range of memory that changes as instructions are undone
+typedef void (*undo_memcb_t)(process_t *pptr, uint32_t addr, uint32_t len);
+
+//Takes back the last instruction recorded, restoring the registers and memory of the process that ran it.
+//Returns that process, or NULL if there's no more history.
+process_t *undo_back(undo_memcb_t memcb);
+
+//Returns the number of instructions that can be taken back
+uint64_t undo_depth(void);
+
+#endif //_UNDO_H
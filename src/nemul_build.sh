@@ -24,6 +24,10 @@ then
 fi
 
 ${MAKE}
+${MAKE} bin/bench_card.elf
 
 cp bin/nemul.* ${PLATDIR}/pvmk-nemul
 
+#Headless runner, for scripted test runs like collecting profiles
+cp bin/bench_card.elf ${PLATDIR}/pvmk-nemul-bench
+
@@ -0,0 +1,112 @@
+//gcov.c
+//Writes profiles from games built with -fprofile-generate out through the simulator
+//Bryan E. Topp <betopp@betopp.com> 2025
+
+//There's no filesystem to write .gcda files to, so the usual libgcov exit handler does nothing here.
+//Instead, pvmk.specs builds with -fprofile-info-section, which makes GCC put a pointer to each object's
+//profile in the .gcov_info section. The linker script gathers them up, and this walks them, having libgcov
+//turn each into the contents of its .gcda file and sending that to the host with _sc_dbg_fwrite.
+
+#include <sc.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pvmkgcov.h"
+
+//Profile of each object built with -fprofile-info-section, as gathered by the linker script
+struct gcov_info;
+extern const struct gcov_info *const __gcov_info_start[];
+extern const struct gcov_info *const __gcov_info_end[];
+
+//Writes out the .gcda file for one object, from libgcov.
+//Weak, so games built without profiling don't need libgcov; pvmk.specs makes sure it's linked when they do.
+extern void __gcov_info_to_gcda(const struct gcov_info *info,
+	void (*filename_fn)(const char *name, void *arg),
+	void (*dump_fn)(const void *data, unsigned len, void *arg),
+	void *(*allocate_fn)(unsigned len, void *arg),
+	void *arg) __attribute__((weak));
+
+//File being written, and data waiting to go out to it.
+//libgcov writes a word at a time, so this saves making a system call for each one.
+typedef struct _gcov_out_s
+{
+	const char *name;
+	int started;
+	int err;
+	unsigned len;
+	unsigned char buf[512];
+} _gcov_out_t;
+static _gcov_out_t _gcov_out;
+
+//Sends the data waiting to the host
+static void _gcov_flush(_gcov_out_t *out)
+{
+	if(out->started && out->len == 0)
+		return;
+	
+	int written = _sc_dbg_fwrite(out->name, out->buf, out->len, out->started ? 0 : _SC_DBG_FWRITE_TRUNC);
+	if(written < 0 && out->err == 0)
+		out->err = written;
+	
+	out->started = 1;
+	out->len = 0;
+}
+
+//Called by libgcov when it starts on the file for an object
+static void _gcov_filename(const char *name, void *arg)
+{
+	_gcov_out_t *out = (_gcov_out_t*)arg;
+	out->name = name;
+	out->started = 0;
+	out->len = 0;
+}
+
+//Called by libgcov with the contents of the file
+static void _gcov_dump(const void *data, unsigned len, void *arg)
+{
+	_gcov_out_t *out = (_gcov_out_t*)arg;
+	const unsigned char *bytes = (const unsigned char*)data;
+	while(len > 0)
+	{
+		unsigned chunk = sizeof(out->buf) - out->len;
+		if(chunk > len)
+			chunk = len;
+		
+		memcpy(out->buf + out->len, bytes, chunk);
+		out->len += chunk;
+		bytes += chunk;
+		len -= chunk;
+		
+		if(out->len == sizeof(out->buf))
+			_gcov_flush(out);
+	}
+}
+
+//Called by libgcov for space to merge value profiles in
+static void *_gcov_allocate(unsigned len, void *arg)
+{
+	(void)arg;
+	return malloc(len);
+}
+
+int _pvmk_gcov_dump(void)
+{
+	if(__gcov_info_to_gcda == NULL)
+		return 0; //Not built with -fprofile-generate
+	
+	_gcov_out_t *out = &_gcov_out;
+	out->err = 0;
+	
+	int nfiles = 0;
+	for(const struct gcov_info *const *ii = __gcov_info_start; ii < __gcov_info_end; ii++)
+	{
+		__gcov_info_to_gcda(*ii, _gcov_filename, _gcov_dump, _gcov_allocate, out);
+		_gcov_flush(out);
+		if(out->err != 0)
+			return out->err; //Probably not running in the simulator - don't bother with the rest
+		
+		nfiles++;
+	}
+	return nfiles;
+}
@@ -0,0 +1,14 @@
+//pvmkgcov.h
+//Getting profiles out of games built with -fprofile-generate, for profile-guided optimization
+//Bryan E. Topp <betopp@betopp.com> 2025
+#ifndef PVMKGCOV_H
+#define PVMKGCOV_H
+
+//Writes the profile counted so far as .gcda files, through the Nemul simulator's _sc_dbg_fwrite.
+//Games rarely exit, so call this now and then (say, at the end of each level) for a test run to get its profile.
+//Each call writes the whole profile again. It's also done on exit.
+//Does nothing unless the game was built with -fprofile-generate.
+//Returns the number of files written, or a negative error number (like -_SC_ENOSYS on real hardware).
+int _pvmk_gcov_dump(void);
+
+#endif //PVMKGCOV_H
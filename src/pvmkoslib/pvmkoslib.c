@@ -23,6 +23,7 @@
 #include <sys/times.h>
 
 #include "cdfs.h"
+#include "pvmkgcov.h"
 
 //Table of open files on the CD filesystem
 typedef struct _user_file_s
@@ -36,6 +37,14 @@ typedef struct _user_file_s
 _user_file_t _user_file_table[USER_FILE_MAX];
 uint32_t _user_cwd;
 
+//Output to stdout/stderr not yet printed - lines are printed whole, rather than a system call per byte
+#define CONSOLE_BUF_MAX 256
+static char _console_buf[CONSOLE_BUF_MAX + 1];
+static int _console_len;
+
+//Set if the system doesn't have _sc_print_len, so output has to go through _sc_print
+static int _console_noprintlen;
+
 
 //Define this to placate cxx things that expect dynamic linking
 int __dso_handle = 0;
@@ -407,6 +416,33 @@ ssize_t read(int fd, void *buf, size_t nbyte)
 	}
 }
 
+//Prints everything buffered for stdout/stderr
+static void _console_flush(void)
+{
+	if(_console_len <= 0)
+		return;
+	
+	if(!_console_noprintlen)
+	{
+		if(_sc_print_len(_console_buf, _console_len) != -_SC_ENOSYS)
+		{
+			_console_len = 0;
+			return;
+		}
+		
+		_console_noprintlen = 1;
+	}
+	
+	//Older system - print the runs between any NULs, which _sc_print would stop at
+	_console_buf[_console_len] = '\0';
+	for(int start = 0; start < _console_len; start += strlen(_console_buf + start) + 1)
+	{
+		if(_console_buf[start] != '\0')
+			_sc_print(_console_buf + start);
+	}
+	_console_len = 0;
+}
+
 ssize_t write(int fd, const void *buf, size_t nbyte)
 {
 	if(fd < USER_FILE_MIN)
@@ -419,14 +455,20 @@ ssize_t write(int fd, const void *buf, size_t nbyte)
 		}
 		if(fd == 1 || fd == 2)
 		{
-			//Print out stdout/stderr to text-mode console
+			//Print out stdout/stderr to text-mode console, a line at a time
+			const char *bytes = (const char*)buf;
 			for(size_t bb = 0; bb < nbyte; bb++)
 			{
-				char twochar[2];
-				twochar[0] = ((const char*)buf)[bb];
-				twochar[1] = '\0';
-				_sc_print(twochar);
+				_console_buf[_console_len] = bytes[bb];
+				_console_len++;
+				if(bytes[bb] == '\n' || _console_len >= CONSOLE_BUF_MAX)
+					_console_flush();
 			}
+			
+			//Don't hold on to errors, in case we crash before the line ends
+			if(fd == 2)
+				_console_flush();
+			
 			return nbyte;
 		}
 		else
@@ -503,6 +545,13 @@ void _exit(int status)
 	//Reset the process instead of exiting.
 	//_sc_exit(status, 0);
 	(void)status;
+	
+	//Print anything left of the last line
+	_console_flush();
+	
+	//Restarting loses the profile counts of a game built with -fprofile-generate, so write them out first
+	_pvmk_gcov_dump();
+	
 	while(1)
 	{
 		extern char _BSS_START[];
@@ -1104,6 +1153,7 @@ int execv(const char *path, char *const argv[])
 			break;
 	}
 	
+	_console_flush();
 	_sc_mexec_apply();
 	return 0;
 }
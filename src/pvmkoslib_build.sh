@@ -19,7 +19,7 @@ cp src/pvmkoslib/sys/*.h ${OUTDIR}/include/sys/
 
 #Compile library objects
 mkdir -p obj/pvmkoslib
-for CFILE in cdfs pvmkoslib atomics
+for CFILE in cdfs pvmkoslib atomics gcov
 do
 	echo $CFILE
 	${CC} ${CFLAGS} -c src/pvmkoslib/${CFILE}.c -o obj/pvmkoslib/${CFILE}.o